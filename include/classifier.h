@@ -0,0 +1,31 @@
+#pragma once
+
+#include <Arduino.h>
+
+/**
+ * Pad classifier model layout, shared by the firmware and tools/train_classifier.
+ *
+ * A model is a binary decision tree stored as a flat node array in flash, root first.
+ * Branch nodes send features[feature] <= threshold to the left child, everything else to the right.
+ * Leaf nodes have a feature of ClassifierLeaf and hold the class in threshold (0 - inactive, 1 - active).
+ */
+
+// Feature indices, each pad is classified from its own features first and the other pad's second
+enum ClassifierFeature
+{
+  FEATURE_DELTA,       // filtered reading above the learned baseline
+  FEATURE_RATE,        // filtered change per sensor check
+  FEATURE_OTHER_DELTA, // the other pad's delta
+  FEATURE_OTHER_RATE,  // the other pad's rate
+  ClassifierFeatureCount
+};
+
+const int8_t ClassifierLeaf = -1;
+
+struct ClassifierNode
+{
+  int8_t feature;
+  int16_t threshold;
+  uint8_t left;
+  uint8_t right;
+};
@@ -0,0 +1,14 @@
+#pragma once
+
+// Placeholder model, a single split at a delta of 1000 above the baseline.
+// Regenerate from recorded traces with tools/train_classifier.
+
+#include "classifier.h"
+
+const int ClassifierModelDepth = 1;
+
+const ClassifierNode classifierModel[] PROGMEM = {
+    {FEATURE_DELTA, 1000, 1, 2},
+    {ClassifierLeaf, 0, 0, 0},
+    {ClassifierLeaf, 1, 0, 0},
+};
@@ -0,0 +1,463 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/**
+ * Sensing decisions shared by the firmware and the host tests and tools.
+ *
+ * Everything here is integer logic on its arguments - debouncing, onset detection, alpha-beta filtering,
+ * learned baselines, proximity, grip, join prediction, chain length and confidence - with no pin access,
+ * so the same code runs on the module and in test/ and tools/. Fixed point state is int32_t, the size of
+ * long on AVR, so results match bit for bit on the host.
+ */
+
+const int maxCapThreshold = 15000;
+const int BaselineShift = 8; // fixed point fraction bits of baselines
+const int FilterShift = 4;   // fixed point fraction bits of filter state
+const int MinChainLength = 2;
+const int MaxChainLength = 5;
+const int ChainRefCount = MaxChainLength - MinChainLength + 1;
+
+enum Hand
+{
+  HAND_LEFT,
+  HAND_RIGHT
+};
+
+// Runtime parameters the decisions read, settable over serial (see parameters in main.cpp)
+struct SensingConfig
+{
+  int debounceCount;              // N - readings that must disagree with the current pad state before it flips...
+  int debounceWindow;             // M - ...out of the last M readings (max 8)
+  int onsetSlope;                 // rise between consecutive readings that reports a touch early, 0 disables
+  int onsetConfirm;               // sensor checks an onset has to reach the absolute threshold before it is dropped
+  int relativeThresholds;         // 1 - pots set an offset above each pad's learned baseline, 0 - pots set absolute thresholds
+  int baselineRate;               // baseline follows 1/2^n of the difference each sensor check, 8 is roughly 13 seconds
+  int proximityRate;              // approach follows 1/2^n of the delta each sensor check while a pad is inactive
+  int joinRate;                   // filtered rate both pads have to exceed in the same sensor check to predict a join
+  int chainRefs[ChainRefCount];   // impedence reading for each number of people in the loop, 0 - not calibrated
+  int chainHysteresis;            // how much closer another reference has to be before the estimate moves to it
+  int gripThreshold;              // raw reading above an electrode's baseline that counts it as covered
+};
+
+const SensingConfig DefaultSensingConfig = {2, 3, 0, 3, 1, 8, 2, 300, {0, 0, 0, 0}, 10, 300};
+
+struct AlphaBetaFilter
+{
+  int32_t value; // estimated reading << FilterShift
+  int32_t rate;  // estimated change per update << FilterShift
+  bool primed;
+};
+
+// Per-pad detection bookkeeping
+struct PadTracker
+{
+  uint8_t history;    // bit history of readings that disagreed with the pad state, newest in bit 0
+  uint8_t onsetTimer; // sensor checks left to confirm a pending onset, 0 when none is pending
+  int prevValue;      // previous raw reading, for the onset slope
+  int32_t baseline;   // learned untouched reading << BaselineShift, 0 until the first reading
+  int32_t approach;   // delta above the baseline integrated while inactive << BaselineShift, for proximity
+};
+
+const PadTracker NewPadTracker = {0, 0, INT16_MAX, 0, 0}; // prevValue starts high so the first reading never looks like a rise
+
+/**
+ * @brief Applies N-of-M debouncing to a single pad reading.
+ * The state only flips once debounceCount of the last debounceWindow readings disagree with it.
+ *
+ * @param active current debounced pad state
+ * @param tracker pad bookkeeping, holding the debounce history
+ * @param disagrees whether the latest reading disagrees with the current state
+ * @param config
+ * @return new debounced pad state
+ */
+inline bool debouncePad(bool active, PadTracker &tracker, bool disagrees, const SensingConfig &config)
+{
+  uint8_t windowMask = (1 << config.debounceWindow) - 1;
+  tracker.history = ((tracker.history << 1) | disagrees) & windowMask;
+
+  int disagreeCount = 0;
+  for (uint8_t bits = tracker.history; bits; bits >>= 1)
+  {
+    disagreeCount += bits & 1;
+  }
+
+  int needed = config.debounceCount < config.debounceWindow ? config.debounceCount : config.debounceWindow;
+  if (disagreeCount >= needed)
+  {
+    tracker.history = 0;
+    return !active;
+  }
+
+  return active;
+}
+
+/**
+ * @brief Updates a pad's active state from its latest reading.
+ * A sharp raw rise (more than onsetSlope since the last reading) reports the pad active immediately,
+ * and it stays active while pending until the absolute threshold confirms it within onsetConfirm checks.
+ * Otherwise the reading is compared against the enter/exit thresholds, or the classifier's verdict is
+ * used when there is one, and the result goes through debouncePad.
+ *
+ * @param active current pad state
+ * @param tracker pad bookkeeping
+ * @param raw latest raw pad reading, used for the onset slope
+ * @param value latest filtered pad reading, compared against the thresholds
+ * @param threshold enter threshold
+ * @param hysteresis distance of the exit threshold below the enter threshold
+ * @param modelClass classifier verdict for the reading (0 - inactive, 1 - active), -1 to use the thresholds
+ * @param config
+ * @param falseOnsets counts onsets that were never confirmed
+ * @return new pad state
+ */
+inline bool updatePad(bool active, PadTracker &tracker, int raw, int value, int threshold, int hysteresis, int modelClass,
+                      const SensingConfig &config, int &falseOnsets)
+{
+  int32_t slope = (int32_t)raw - tracker.prevValue;
+  tracker.prevValue = raw;
+
+  if (tracker.onsetTimer > 0)
+  {
+    if (value > threshold)
+    {
+      tracker.onsetTimer = 0;
+      return true;
+    }
+
+    tracker.onsetTimer--;
+    if (tracker.onsetTimer == 0)
+    {
+      if (falseOnsets < INT16_MAX)
+        falseOnsets++;
+      return false;
+    }
+
+    return true;
+  }
+
+  if (!active && config.onsetSlope > 0 && slope > config.onsetSlope)
+  {
+    tracker.history = 0;
+    if (value <= threshold)
+      tracker.onsetTimer = config.onsetConfirm;
+    return true;
+  }
+
+  bool disagrees;
+  if (modelClass >= 0)
+  {
+    disagrees = (modelClass == 1) != active;
+  }
+  else
+  {
+    disagrees = active ? value < threshold - hysteresis : value > threshold;
+  }
+
+  return debouncePad(active, tracker, disagrees, config);
+}
+
+/**
+ * @brief Runs one fixed point alpha-beta filter update. The filter predicts the next reading from its
+ * value and rate, then corrects both by alpha/256 and beta/256 of the prediction error.
+ * The first update after priming is cleared takes the reading as is with zero rate.
+ *
+ * @param filter
+ * @param measurement latest raw reading
+ * @param alpha value gain in 1/256ths
+ * @param beta rate gain in 1/256ths
+ * @return filtered value
+ */
+inline int updateFilter(AlphaBetaFilter &filter, int measurement, int alpha, int beta)
+{
+  int32_t scaled = (int32_t)measurement << FilterShift;
+
+  if (!filter.primed)
+  {
+    filter.value = scaled;
+    filter.rate = 0;
+    filter.primed = true;
+    return measurement;
+  }
+
+  int32_t predicted = filter.value + filter.rate;
+  int32_t residual = scaled - predicted;
+  filter.value = predicted + ((residual * alpha) >> 8);
+  filter.rate += (residual * beta) >> 8;
+
+  return filter.value >> FilterShift;
+}
+
+/**
+ * @brief
+ *
+ * @param tracker
+ * @param setting pot setting
+ * @param config
+ * @return the setting itself for absolute thresholds, otherwise the setting above the learned baseline
+ */
+inline int padThreshold(const PadTracker &tracker, int setting, const SensingConfig &config)
+{
+  if (!config.relativeThresholds)
+    return setting;
+
+  // Nothing learned yet, hold the pad inactive until its first reading seeds the baseline
+  if (tracker.baseline == 0)
+    return maxCapThreshold;
+
+  int32_t threshold = (tracker.baseline >> BaselineShift) + setting;
+  return threshold < INT16_MAX ? threshold : INT16_MAX;
+}
+
+/**
+ * @brief Slowly follows an untouched reading so relative thresholds track room drift.
+ * Active pads only let the baseline fall, so a long touch is never learned as the new baseline.
+ *
+ * @param baseline learned reading << BaselineShift, 0 until the first reading
+ * @param value latest pad or electrode reading
+ * @param active pad state after this reading
+ * @param config
+ */
+inline void updateBaseline(int32_t &baseline, int value, bool active, const SensingConfig &config)
+{
+  int32_t scaled = (int32_t)value << BaselineShift;
+
+  if (baseline == 0)
+  {
+    baseline = scaled;
+    return;
+  }
+
+  if (active && scaled > baseline)
+    return;
+
+  baseline += (scaled - baseline) >> config.baselineRate;
+}
+
+/**
+ * @brief Grades how close a hand is to a pad from the delta above its baseline, as a fraction of the way
+ * to the enter threshold. The delta is integrated over several checks first, but only while the pad is
+ * inactive, so the extra smoothing never reaches touch decisions.
+ *
+ * @param tracker
+ * @param delta latest filtered reading above the baseline
+ * @param threshold enter threshold
+ * @param active pad state after this reading
+ * @param config
+ * @return 0-8 approaching, 9 touching
+ */
+inline uint8_t updateProximity(PadTracker &tracker, int delta, int threshold, bool active, const SensingConfig &config)
+{
+  if (active)
+  {
+    tracker.approach = 0;
+    return 9;
+  }
+
+  tracker.approach += (((int32_t)delta << BaselineShift) - tracker.approach) >> config.proximityRate;
+
+  int32_t range = threshold - (tracker.baseline >> BaselineShift);
+  if (tracker.approach <= 0 || range <= 0)
+    return 0;
+
+  int32_t level = (tracker.approach >> BaselineShift) * 9 / range;
+  return level < 8 ? level : 8;
+}
+
+/**
+ * @brief Groups electrodes into hands, each hand reading as the sum of its electrodes
+ *
+ * @param values latest raw reading per electrode
+ * @param hands hand of each electrode
+ * @param count electrodes
+ * @param totals summed reading of each hand, by Hand, saturating at INT16_MAX
+ */
+inline void sumHands(const long values[], const Hand hands[], uint8_t count, int totals[2])
+{
+  int32_t sums[2] = {0, 0};
+  for (uint8_t i = 0; i < count; i++)
+  {
+    sums[hands[i]] += values[i];
+  }
+
+  for (uint8_t hand = HAND_LEFT; hand <= HAND_RIGHT; hand++)
+  {
+    totals[hand] = sums[hand] < INT16_MAX ? sums[hand] : INT16_MAX;
+  }
+}
+
+/**
+ * @brief Counts each touched hand's electrodes sitting gripThreshold above their own baselines,
+ * so a palm covering several electrodes reads higher than a fingertip on one. Also learns every
+ * electrode's baseline.
+ *
+ * @param values latest raw reading per electrode
+ * @param baselines learned untouched reading per electrode << BaselineShift
+ * @param hands hand of each electrode
+ * @param count electrodes
+ * @param active pad state of each hand, by Hand
+ * @param config
+ * @param grip percent of each touched hand's electrodes covered, 0 while untouched
+ */
+inline void updateGrip(const long values[], int32_t baselines[], const Hand hands[], uint8_t count, const bool active[2],
+                       const SensingConfig &config, uint8_t grip[2])
+{
+  uint8_t covered[2] = {0, 0};
+  uint8_t electrodes[2] = {0, 0};
+
+  for (uint8_t i = 0; i < count; i++)
+  {
+    Hand hand = hands[i];
+    int value = values[i] < 0 ? 0 : values[i] > INT16_MAX ? INT16_MAX : (int)values[i];
+
+    electrodes[hand]++;
+    if (baselines[i] != 0 && value - (baselines[i] >> BaselineShift) > config.gripThreshold)
+      covered[hand]++;
+
+    updateBaseline(baselines[i], value, active[hand], config);
+  }
+
+  for (uint8_t hand = HAND_LEFT; hand <= HAND_RIGHT; hand++)
+  {
+    // A hand without electrodes of its own never reads as gripped
+    grip[hand] = active[hand] && electrodes[hand] > 0 ? covered[hand] * 100 / electrodes[hand] : 0;
+  }
+}
+
+/**
+ * @brief Joining hands adds the other person's body capacitance to both pads at once, so both
+ * filtered rates jump together. Requires both rates above joinRate and within 2x of each other,
+ * which rules out one person simply pressing harder.
+ *
+ * @param leftRate filtered change per sensor check
+ * @param rightRate
+ * @param config
+ * @return true if the pads look joined
+ */
+inline bool predictJoin(int leftRate, int rightRate, const SensingConfig &config)
+{
+  if (leftRate <= config.joinRate || rightRate <= config.joinRate)
+    return false;
+
+  return (int32_t)leftRate <= 2 * (int32_t)rightRate && (int32_t)rightRate <= 2 * (int32_t)leftRate;
+}
+
+// What capacitiveCheck does while both pads are active
+enum JoinStep
+{
+  JOIN_HOLD,   // report BOTH and keep sensing the pads until the relay buffer interval wears off
+  JOIN_CHECK,  // report BOTH and switch the relay to check impedence
+  JOIN_PREDICT // report JOINED now and switch the relay to confirm it
+};
+
+/**
+ * @brief Decides what to do with both pads active. Neither the relay check nor a prediction happens until
+ * the buffer interval since the last return to capacitive sensing has worn off, so two separate people
+ * touching the hands do not flip the relay constantly, and a missed prediction is not repeated from the
+ * readings taken straight after the relay flips back.
+ *
+ * @param bufferExpired whether capCheckBufferInterval has passed since capacitive sensing resumed
+ * @param predicting whether relay-free join prediction is on (joinMode 1)
+ * @param leftRate filtered change per sensor check
+ * @param rightRate
+ * @param config
+ * @return next step
+ */
+inline JoinStep joinStep(bool bufferExpired, bool predicting, int leftRate, int rightRate, const SensingConfig &config)
+{
+  if (!bufferExpired)
+    return JOIN_HOLD;
+
+  if (predicting && predictJoin(leftRate, rightRate, config))
+    return JOIN_PREDICT;
+
+  return JOIN_CHECK;
+}
+
+/**
+ * @brief Estimates how many people are in the loop by picking the calibrated chain reference closest
+ * to the filtered impedence value. The estimate only moves to another length once that reference is
+ * chainHysteresis closer than the current one.
+ *
+ * @param chainLength current estimate, 0 if none
+ * @param impedence filtered impedence reading
+ * @param config
+ * @return new estimate, 0 until calibrated
+ */
+inline int updateChainLength(int chainLength, int impedence, const SensingConfig &config)
+{
+  int bestLength = 0;
+  int bestDistance = 0;
+  int currentDistance = -1;
+
+  for (int length = MinChainLength; length <= MaxChainLength; length++)
+  {
+    int ref = config.chainRefs[length - MinChainLength];
+    if (ref == 0)
+      continue;
+
+    int distance = abs(impedence - ref);
+    if (length == chainLength)
+      currentDistance = distance;
+
+    if (bestLength == 0 || distance < bestDistance)
+    {
+      bestLength = length;
+      bestDistance = distance;
+    }
+  }
+
+  if (bestLength == 0)
+    return 0;
+
+  if (currentDistance < 0 || bestDistance + config.chainHysteresis < currentDistance)
+    return bestLength;
+
+  return chainLength;
+}
+
+/**
+ * @brief
+ *
+ * @param distance how far the reading sits past the threshold, negative if it has not crossed it
+ * @param scale threshold setting, absolute or relative to the baseline
+ * @return 0-9, reaching 9 at a quarter of the scale
+ */
+inline int marginScore(int distance, int scale)
+{
+  if (distance <= 0)
+    return 0;
+
+  int32_t fullScale = scale / 4 > 1 ? scale / 4 : 1;
+  int32_t score = (int32_t)distance * 9 / fullScale;
+  return score < 9 ? score : 9;
+}
+
+/**
+ * @brief
+ *
+ * @param active pad state
+ * @param value filtered pad reading
+ * @param threshold enter threshold
+ * @param hysteresis distance of the exit threshold below the enter threshold
+ * @return how far an active pad sits above its exit threshold, or an inactive pad below its enter threshold
+ */
+inline int padMargin(bool active, int value, int threshold, int hysteresis)
+{
+  return active ? value - (threshold - hysteresis) : threshold - value;
+}
+
+/**
+ * @brief Scores an output state 0-9 from the margin of its deciding readings, weighted 2:1 against how
+ * many sensor checks the state has held. A clear reading scores 6 the moment it changes state and 9 three
+ * checks later, while a reading sitting on its threshold never scores above 3.
+ *
+ * @param margin 0-9, see marginScore
+ * @param stableChecks sensor checks since the output state last changed
+ * @return 0-9
+ */
+inline uint8_t confidenceScore(int margin, uint8_t stableChecks)
+{
+  int stability = stableChecks < 3 ? stableChecks * 3 : 9;
+  return (2 * margin + stability) / 3;
+}
@@ -0,0 +1,100 @@
+#include "CapacitiveGroup.h"
+
+// Loop iterations before a pin counts as timed out, matching CapacitiveSensor's default of 2000
+const unsigned long TimeoutLoops = (2000UL * 310UL * (F_CPU / 1000000UL)) / 16UL;
+
+CapacitiveGroup::CapacitiveGroup(uint8_t sendPin, const uint8_t receivePins[], uint8_t count)
+    : sendPin(sendPin), count(min(count, CapacitiveGroupMaxPins)), timeout(TimeoutLoops)
+{
+  pinMode(sendPin, OUTPUT);
+  digitalWrite(sendPin, LOW);
+
+  for (uint8_t i = 0; i < this->count; i++)
+  {
+    this->receivePins[i] = receivePins[i];
+    receiveRegisters[i] = portInputRegister(digitalPinToPort(receivePins[i]));
+    receiveMasks[i] = digitalPinToBitMask(receivePins[i]);
+    pinMode(receivePins[i], INPUT);
+  }
+}
+
+void CapacitiveGroup::senseRaw(uint8_t samples, long totals[])
+{
+  uint8_t allPins = (1 << count) - 1;
+  uint8_t failed = 0;
+
+  for (uint8_t i = 0; i < count; i++)
+  {
+    totals[i] = 0;
+  }
+
+  for (uint8_t sample = 0; sample < samples; sample++)
+  {
+    unsigned long loops = 0;
+
+    // Discharge every receive pin, then charge them all through the send pin
+    noInterrupts();
+    digitalWrite(sendPin, LOW);
+    for (uint8_t i = 0; i < count; i++)
+    {
+      pinMode(receivePins[i], OUTPUT);
+      digitalWrite(receivePins[i], LOW);
+    }
+    delayMicroseconds(10);
+    for (uint8_t i = 0; i < count; i++)
+    {
+      pinMode(receivePins[i], INPUT);
+    }
+    digitalWrite(sendPin, HIGH);
+    interrupts();
+
+    failed |= countWhile(allPins & ~failed, false, totals, loops);
+
+    // Top the receive pins up fully, as the charge loop exits around half supply, then discharge through the send pin
+    noInterrupts();
+    for (uint8_t i = 0; i < count; i++)
+    {
+      digitalWrite(receivePins[i], HIGH);
+      pinMode(receivePins[i], OUTPUT);
+      pinMode(receivePins[i], INPUT);
+    }
+    digitalWrite(sendPin, LOW);
+    interrupts();
+
+    loops = 0;
+    failed |= countWhile(allPins & ~failed, true, totals, loops);
+
+    if (failed == allPins)
+      break;
+  }
+
+  for (uint8_t i = 0; i < count; i++)
+  {
+    if (failed & (1 << i))
+      totals[i] = -2;
+  }
+}
+
+/**
+ * @brief Counts loop iterations until each pending pin leaves the given level, adding each pin's count to its total
+ *
+ * @return pins that were still pending at the timeout
+ */
+uint8_t CapacitiveGroup::countWhile(uint8_t pending, bool level, long totals[], unsigned long &loops)
+{
+  while (pending && loops < timeout)
+  {
+    loops++;
+    for (uint8_t i = 0; i < count; i++)
+    {
+      uint8_t bit = 1 << i;
+      if ((pending & bit) && ((*receiveRegisters[i] & receiveMasks[i]) != 0) != level)
+      {
+        totals[i] += loops;
+        pending &= ~bit;
+      }
+    }
+  }
+
+  return pending;
+}
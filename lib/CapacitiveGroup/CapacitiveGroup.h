@@ -0,0 +1,38 @@
+#pragma once
+
+#include <Arduino.h>
+
+/**
+ * Charge timing capacitive sensing for several receive pins sharing one send pin, after the
+ * CapacitiveSensor library's method, but measuring every receive pin in the same pass.
+ *
+ * Each sample drives the send pin high and counts loop iterations until each receive pin reads high,
+ * then drives it low and counts until each reads low again. Counts are summed over all samples.
+ * Iterations cost more with more pins, so readings are only comparable within the same group.
+ */
+
+const uint8_t CapacitiveGroupMaxPins = 8;
+
+class CapacitiveGroup
+{
+public:
+  CapacitiveGroup(uint8_t sendPin, const uint8_t receivePins[], uint8_t count);
+
+  /**
+   * @brief Measures every receive pin over the given number of samples
+   *
+   * @param samples
+   * @param totals one per receive pin, -2 for pins that timed out, as CapacitiveSensor does
+   */
+  void senseRaw(uint8_t samples, long totals[]);
+
+private:
+  uint8_t sendPin;
+  uint8_t count;
+  uint8_t receivePins[CapacitiveGroupMaxPins];
+  volatile uint8_t *receiveRegisters[CapacitiveGroupMaxPins];
+  uint8_t receiveMasks[CapacitiveGroupMaxPins];
+  unsigned long timeout;
+
+  uint8_t countWhile(uint8_t pending, bool level, long totals[], unsigned long &loops);
+};
@@ -1,6 +1,12 @@
 #include <Arduino.h>
+#ifdef CAP_GROUPS
+#include <CapacitiveGroup.h>
+#else
 #include <CapacitiveSensor.h>
+#endif
 #include <LiquidCrystal_I2C.h>
+#include "classifier_model.h"
+#include "sensing.h"
 
 LiquidCrystal_I2C lcd(0x27, 20, 4); // set the LCD address to 0x27 for a 16 chars and 2 line display
 
@@ -30,6 +36,7 @@ LiquidCrystal_I2C lcd(0x27, 20, 4); // set the LCD address to 0x27 for a 16 char
  * updateOutputState()    - updates output state if necessary
  * sendOutputState()      - prints output state via serial
  * updateLEDs()           - updates LEDs
+ * readCommands()         - reads runtime configuration commands from serial
  */
 
 #define CAP_SEND_PIN 7
@@ -45,21 +52,89 @@ LiquidCrystal_I2C lcd(0x27, 20, 4); // set the LCD address to 0x27 for a 16 char
 #define CAP_R_LED 3
 #define IMP_LED 2
 
+// Cap electrodes - every receive pin shares CAP_SEND_PIN.
+// Experimental - built with CAP_GROUPS defined, a hand can have several electrodes for grip sensing, all scanned in one pass.
+// Add each extra receive pin with the hand it belongs to.
+const uint8_t CapElectrodePins[] = {CAP_RECEIVE_L, CAP_RECEIVE_R};
+const Hand CapElectrodeHands[] = {HAND_LEFT, HAND_RIGHT};
+const uint8_t CapElectrodeCount = sizeof(CapElectrodePins);
+
+#ifdef CAP_GROUPS
+static_assert(CapElectrodeCount <= CapacitiveGroupMaxPins, "CapacitiveGroup scans at most CapacitiveGroupMaxPins electrodes");
+
+CapacitiveGroup CapSensors = CapacitiveGroup(CAP_SEND_PIN, CapElectrodePins, CapElectrodeCount);
+#else
+static_assert(CapElectrodeCount == 2, "several electrodes per hand need CAP_GROUPS");
+
 CapacitiveSensor CapSensorL = CapacitiveSensor(CAP_SEND_PIN, CAP_RECEIVE_L);
 CapacitiveSensor CapSensorR = CapacitiveSensor(CAP_SEND_PIN, CAP_RECEIVE_R);
+#endif
 
 // Sensor Variables
+SensingConfig sensing = DefaultSensingConfig; // runtime parameters of the sensing decisions, see sensing.h
 const int minCapThreshold = 0;
-const int maxCapThreshold = 15000;
-int curCapLeftThreshold = maxCapThreshold;
+const int maxCapOffset = 5000;                 // pot range above the learned baseline when thresholds are relative
+int curCapLeftSetting = maxCapThreshold;       // pot setting - absolute threshold, or offset above the baseline
+int curCapRightSetting = maxCapThreshold;
+int curCapLeftThreshold = maxCapThreshold;     // effective enter threshold
 int curCapRightThreshold = maxCapThreshold;
 int curImpThreshold = 0;
-int capLeftValue = 0;
-int capRightValue = 0;
-int impedenceValue = 0;
+int capLeftValue = 0;  // filtered
+int capRightValue = 0; // filtered
+int capLeftRate = 0;   // filtered change per sensor check
+int capRightRate = 0;
+int capLeftDelta = 0;  // filtered reading above the learned baseline
+int capRightDelta = 0;
+int impedenceValue = 0; // filtered
+int capSensorSamples = 100;
 bool capLeftActive = false;
 bool capRightActive = false;
 
+// Debounce Variables
+int capLeftHysteresis = 200;  // exit threshold sits this far below the left pot threshold
+int capRightHysteresis = 200; // exit threshold sits this far below the right pot threshold
+
+// Classifier Variables
+int capModelMode = 0; // 0 - pads compare against thresholds, 1 - pads are classified by classifier_model.h
+
+// Onset Variables
+int capFalseOnsets = 0; // onsets that were never confirmed, reset by setting to 0
+
+// Cap Join Prediction Variables - experimental relay-free JOINED detection
+int capJoinMode = 0;      // 0 - relay only, 1 - report JOINED from a correlated rise on both pads and confirm with the relay
+int capJoinMisses = 0;    // predictions the relay did not confirm, reset by setting to 0
+bool joinPredicted = false;
+
+// Chain Length Variables
+int chainLength = 0; // estimated people in the loop while JOINED, 0 otherwise
+
+// Grip Variables
+long capElectrodeValues[CapElectrodeCount];       // latest raw reading per electrode
+int32_t capElectrodeBaselines[CapElectrodeCount]; // learned untouched reading per electrode << BaselineShift
+uint8_t capGrip[2] = {0, 0};                      // percent of each touched hand's electrodes covered, by Hand
+
+// Proximity Variables
+uint8_t capLeftProximity = 0; // 0-8 approaching, 9 touching
+uint8_t capRightProximity = 0;
+
+// Filter Variables - alpha-beta gains in 1/256ths, 256/0 passes readings straight through
+int capFilterAlpha = 128;
+int capFilterBeta = 16;
+int impFilterAlpha = 96;
+int impFilterBeta = 8;
+AlphaBetaFilter capLeftFilter = {0, 0, false};
+AlphaBetaFilter capRightFilter = {0, 0, false};
+AlphaBetaFilter impFilter = {0, 0, false};
+
+// Per-pad detection bookkeeping
+PadTracker capLeftTracker = NewPadTracker;
+PadTracker capRightTracker = NewPadTracker;
+
+// Output Variables
+int outputFormat = 0;        // 0 - legacy [xyz] lines, 1 - [xyz] followed by extended fields, 2 - extended and telemetry fields
+uint8_t outputConfidence = 0; // 0-9 confidence in the current output state
+uint8_t stableChecks = 0;     // sensor checks since the output state last changed, saturating
+
 // Threshold Buffers
 const int ThresholdBufferSize = 20;
 int capLeftThresholdBuffer[ThresholdBufferSize];
@@ -70,8 +145,8 @@ int thresholdBufferIndex = 0;                // the index of the current reading
 // Timing Variables (in Milliseconds)
 const int SensorCheckInterval = 50;
 const int ThresholdUpdateInterval = 25;
-const int ImpCheckBufferInterval = 500;
-const int CapCheckBufferInterval = 500;
+int impCheckBufferInterval = 500; // how long the relay stays on impedence for the reading to settle
+int capCheckBufferInterval = 500; // how long both pads stay on cap sensing before the relay checks them again
 const int DisplayUpdateInterval = 500;
 unsigned long curMillis = 0;
 unsigned long prevSensorCheckMillis = 0;
@@ -82,6 +157,11 @@ unsigned long prevThresholdDisplayMillis = 0;
 unsigned long prevValueDisplayMillis = 0;
 unsigned long prevActiveDisplayMillis = 0;
 
+// Command Variables
+const int CommandBufferSize = 32;
+char commandBuffer[CommandBufferSize];
+int commandBufferIndex = 0;
+
 // Display string variables
 char labelDisplayString[20];
 char thresholdDisplayString[20];
@@ -109,6 +189,62 @@ enum SensingState
 OutputState curOutputState = OUTPUT_INIT;
 SensingState curSensingState = SENSING_INIT;
 
+// Diagnostic Variables - reported by the stats, hist and trace commands
+unsigned long sensorChecks = 0;
+unsigned long stateChanges = 0;
+unsigned long relayFlips = 0; // switches to impedence sensing
+unsigned long maxCheckMicros = 0;
+const int CheckHistogramBucketMs = 10;
+const int CheckHistogramSize = 8;            // the last bucket holds everything slower
+uint16_t checkHistogram[CheckHistogramSize]; // sensor check durations, saturating
+const int TraceSize = 16;
+unsigned long traceMillis[TraceSize]; // recent output state changes, oldest overwritten first
+OutputState traceStates[TraceSize];
+int traceIndex = 0;
+int traceCount = 0;
+const int MaxBenchScans = 100;
+
+// Runtime Parameters - readable and writable over serial with get/set commands
+struct Parameter
+{
+  const char *name;
+  int *value;
+  int minValue;
+  int maxValue;
+};
+
+Parameter parameters[] = {
+    {"capLHyst", &capLeftHysteresis, 0, maxCapThreshold},
+    {"capRHyst", &capRightHysteresis, 0, maxCapThreshold},
+    {"capN", &sensing.debounceCount, 1, 8},
+    {"capM", &sensing.debounceWindow, 1, 8},
+    {"onset", &sensing.onsetSlope, 0, maxCapThreshold},
+    {"onsetN", &sensing.onsetConfirm, 1, 20},
+    {"onsetMiss", &capFalseOnsets, 0, 0},
+    {"capSamples", &capSensorSamples, 1, 255},
+    {"capAlpha", &capFilterAlpha, 1, 256},
+    {"capBeta", &capFilterBeta, 0, 256},
+    {"impAlpha", &impFilterAlpha, 1, 256},
+    {"impBeta", &impFilterBeta, 0, 256},
+    {"joinMode", &capJoinMode, 0, 1},
+    {"joinRate", &sensing.joinRate, 0, maxCapThreshold},
+    {"joinMiss", &capJoinMisses, 0, 0},
+    {"outFmt", &outputFormat, 0, 2},
+    {"chain2", &sensing.chainRefs[0], 0, 1023},
+    {"chain3", &sensing.chainRefs[1], 0, 1023},
+    {"chain4", &sensing.chainRefs[2], 0, 1023},
+    {"chain5", &sensing.chainRefs[3], 0, 1023},
+    {"chainHyst", &sensing.chainHysteresis, 0, 1023},
+    {"capRel", &sensing.relativeThresholds, 0, 1},
+    {"baseRate", &sensing.baselineRate, 1, 15},
+    {"capModel", &capModelMode, 0, 1},
+    {"proxRate", &sensing.proximityRate, 0, 8},
+    {"gripThresh", &sensing.gripThreshold, 0, maxCapThreshold},
+    {"capBuf", &capCheckBufferInterval, 0, 10000},
+    {"impBuf", &impCheckBufferInterval, 0, 10000},
+};
+const int ParameterCount = sizeof(parameters) / sizeof(parameters[0]);
+
 // Function Declarations
 void updateThresholds();                      // - updates thresholds every 200ms
 void updateThresholdDisplay();                // - updates threshold display when changing
@@ -120,8 +256,21 @@ void updateValueDisplay();                    // - updates value display when ch
 void updateSensingState(SensingState);        // - switches sensing state, updating the relay
 void updateOutputState(OutputState);          // - updates output state if necessary
 void sendOutputState();                       // - prints output state via serial
+void updateConfidence();                      // - scores the current output state from margins and stability
 void updateLEDs();                            // - Updates indicator LEDs
 void updateActiveDisplay();                   // - updates active sensors when changing
+int classifyPad(const int[]);                 // - evaluates classifier_model.h for a pad
+void readCommands();                          // - reads runtime configuration commands from serial
+void handleCommand(char *);                   // - runs a single get/set/list command
+Parameter *findParameter(const char *);       // - looks up a runtime parameter by name
+void printParameter(const Parameter &);       // - prints a runtime parameter as #name=value
+const char *outputStateCode(OutputState);     // - returns the xyz digits for an output state
+void recordCheckTime(unsigned long);          // - adds a sensor check duration to the diagnostics
+void printStats();                            // - prints diagnostic counters
+void printHistogram();                        // - prints the sensor check duration histogram
+void printTrace();                            // - prints recent output state changes
+void runBenchmark(int);                       // - times back to back cap scans
+void senseElectrodes();                       // - reads every cap electrode into capElectrodeValues
 
 void setup()
 {
@@ -158,6 +307,8 @@ void loop()
   // Update current millis to be used across all function calls for main loop
   curMillis = millis();
 
+  readCommands();
+
   if (curMillis - prevThresholdUpdateMillis > ThresholdUpdateInterval)
   {
     prevThresholdUpdateMillis = curMillis;
@@ -167,7 +318,9 @@ void loop()
   if (curMillis - prevSensorCheckMillis > SensorCheckInterval)
   {
     prevSensorCheckMillis = curMillis;
+    unsigned long checkStartMicros = micros();
     checkSensors();
+    recordCheckTime(micros() - checkStartMicros);
   }
 }
 
@@ -177,8 +330,9 @@ void loop()
  */
 void updateThresholds()
 {
-  curCapLeftThreshold = map(bufferedThresholdRead(capLeftThresholdBuffer, CAP_L_POT), 0, 1023, minCapThreshold, maxCapThreshold);
-  curCapRightThreshold = map(bufferedThresholdRead(capRightThresholdBuffer, CAP_R_POT), 0, 1023, minCapThreshold, maxCapThreshold);
+  int maxCapSetting = sensing.relativeThresholds ? maxCapOffset : maxCapThreshold;
+  curCapLeftSetting = map(bufferedThresholdRead(capLeftThresholdBuffer, CAP_L_POT), 0, 1023, minCapThreshold, maxCapSetting);
+  curCapRightSetting = map(bufferedThresholdRead(capRightThresholdBuffer, CAP_R_POT), 0, 1023, minCapThreshold, maxCapSetting);
   curImpThreshold = bufferedThresholdRead(impThresholdBuffer, IMP_POT);
 
   // Increase buffer
@@ -244,14 +398,23 @@ void updateSensingState(SensingState newSensingState)
 
       // Update Cap buffer millis to prevent constant, quick switching
       prevCapCheckBufferMillis = curMillis;
+
+      // The pads were not read while impedence sensing, so restart their filters and onset slopes
+      // rather than treat the gap as a single step
+      capLeftFilter.primed = false;
+      capRightFilter.primed = false;
+      capLeftTracker.prevValue = NewPadTracker.prevValue;
+      capRightTracker.prevValue = NewPadTracker.prevValue;
       break;
 
     case IMPEDENCE:
       digitalWrite(RELAY_PIN_1, LOW);
       digitalWrite(RELAY_PIN_2, LOW);
+      relayFlips++;
 
       // Update Impedence buffer millis to allow time for impedence check to stabalize
       prevImpCheckBufferMillis = curMillis;
+      impFilter.primed = false; // Restart filtering from the first reading through the relay
       break;
 
     // Default to capacitive checking
@@ -269,6 +432,10 @@ void updateSensingState(SensingState newSensingState)
  */
 void checkSensors()
 {
+  if (stableChecks < UINT8_MAX)
+    stableChecks++;
+  sensorChecks++;
+
   switch (curSensingState)
   {
   case CAPACITIVE:
@@ -280,21 +447,68 @@ void checkSensors()
     break;
   }
 
+  updateConfidence();
   sendOutputState(); // Send output state after every sensor check
   updateValueDisplay();
 }
 
+/**
+ * @brief Reads every cap electrode, in one pass with CAP_GROUPS or one CapacitiveSensor per hand without
+ *
+ */
+void senseElectrodes()
+{
+#ifdef CAP_GROUPS
+  CapSensors.senseRaw(capSensorSamples, capElectrodeValues);
+#else
+  for (uint8_t i = 0; i < CapElectrodeCount; i++)
+  {
+    CapacitiveSensor &sensor = CapElectrodeHands[i] == HAND_LEFT ? CapSensorL : CapSensorR;
+    capElectrodeValues[i] = sensor.capacitiveSensorRaw(capSensorSamples);
+  }
+#endif
+}
+
 /**
  * @brief
  *
  */
-const int CapSensorSamples = 100;
 void capacitiveCheck()
 {
-  capLeftValue = CapSensorL.capacitiveSensorRaw(CapSensorSamples);
-  capRightValue = CapSensorR.capacitiveSensorRaw(CapSensorSamples);
-  capLeftActive = capLeftValue > curCapLeftThreshold;
-  capRightActive = capRightValue > curCapRightThreshold;
+  senseElectrodes();
+
+  int capRaw[2];
+  sumHands(capElectrodeValues, CapElectrodeHands, CapElectrodeCount, capRaw);
+  int capLeftRaw = capRaw[HAND_LEFT];
+  int capRightRaw = capRaw[HAND_RIGHT];
+  capLeftValue = updateFilter(capLeftFilter, capLeftRaw, capFilterAlpha, capFilterBeta);
+  capRightValue = updateFilter(capRightFilter, capRightRaw, capFilterAlpha, capFilterBeta);
+  capLeftRate = capLeftFilter.rate >> FilterShift;
+  capRightRate = capRightFilter.rate >> FilterShift;
+  capLeftDelta = capLeftValue - (capLeftTracker.baseline >> BaselineShift);
+  capRightDelta = capRightValue - (capRightTracker.baseline >> BaselineShift);
+  curCapLeftThreshold = padThreshold(capLeftTracker, curCapLeftSetting, sensing);
+  curCapRightThreshold = padThreshold(capRightTracker, curCapRightSetting, sensing);
+
+  int leftClass = -1;
+  int rightClass = -1;
+  if (capModelMode)
+  {
+    int leftFeatures[ClassifierFeatureCount] = {capLeftDelta, capLeftRate, capRightDelta, capRightRate};
+    int rightFeatures[ClassifierFeatureCount] = {capRightDelta, capRightRate, capLeftDelta, capLeftRate};
+    leftClass = classifyPad(leftFeatures);
+    rightClass = classifyPad(rightFeatures);
+  }
+
+  capLeftActive = updatePad(capLeftActive, capLeftTracker, capLeftRaw, capLeftValue, curCapLeftThreshold, capLeftHysteresis, leftClass, sensing, capFalseOnsets);
+  capRightActive = updatePad(capRightActive, capRightTracker, capRightRaw, capRightValue, curCapRightThreshold, capRightHysteresis, rightClass, sensing, capFalseOnsets);
+  capLeftProximity = updateProximity(capLeftTracker, capLeftDelta, curCapLeftThreshold, capLeftActive, sensing);
+  capRightProximity = updateProximity(capRightTracker, capRightDelta, curCapRightThreshold, capRightActive, sensing);
+  updateBaseline(capLeftTracker.baseline, capLeftValue, capLeftActive, sensing);
+  updateBaseline(capRightTracker.baseline, capRightValue, capRightActive, sensing);
+
+  bool handsActive[2] = {capLeftActive, capRightActive};
+  updateGrip(capElectrodeValues, capElectrodeBaselines, CapElectrodeHands, CapElectrodeCount, handsActive, sensing, capGrip);
 
   if (capLeftActive && !capRightActive)
   {
@@ -310,10 +524,22 @@ void capacitiveCheck()
 
   if (capLeftActive && capRightActive)
   {
+    // Only switch to Impedence sensing if buffer interval has worn off, to prevent constant switching when two separate people touch the hands
+    bool bufferExpired = curMillis - prevCapCheckBufferMillis > capCheckBufferInterval;
+    JoinStep step = joinStep(bufferExpired, capJoinMode == 1, capLeftRate, capRightRate, sensing);
+
+    // Experimental - report JOINED straight from the pads, the relay flip only confirms it
+    if (step == JOIN_PREDICT)
+    {
+      joinPredicted = true;
+      updateOutputState(JOINED);
+      updateSensingState(IMPEDENCE);
+      return;
+    }
+
     updateOutputState(BOTH);
 
-    // Only switch to Impedence sensing if buffer interval has worn off, to prevent constant switching when two separate people touch the hands
-    if (curMillis - prevCapCheckBufferMillis > CapCheckBufferInterval)
+    if (step == JOIN_CHECK)
     {
       updateSensingState(IMPEDENCE);
     }
@@ -325,28 +551,64 @@ void capacitiveCheck()
   return;
 }
 
+/**
+ * @brief Walks classifier_model.h from the root to a leaf. Each step moves one level down,
+ * so evaluation is bounded by ClassifierModelDepth comparisons.
+ *
+ * @param features see ClassifierFeature
+ * @return class of the reached leaf, 0 - inactive, 1 - active
+ */
+int classifyPad(const int features[])
+{
+  ClassifierNode node;
+  uint8_t index = 0;
+
+  for (int depth = 0; depth <= ClassifierModelDepth; depth++)
+  {
+    memcpy_P(&node, &classifierModel[index], sizeof(node));
+    if (node.feature == ClassifierLeaf)
+      return node.threshold;
+
+    index = features[node.feature] <= node.threshold ? node.left : node.right;
+  }
+
+  // Malformed model, deeper than it claims
+  return 0;
+}
+
 /**
  * @brief
  *
  */
 void impedenceCheck()
 {
-  impedenceValue = analogRead(IMP_CHECK);
+  impedenceValue = updateFilter(impFilter, analogRead(IMP_CHECK), impFilterAlpha, impFilterBeta);
 
   // Update and keep checking impedence while value is still above threshold
   if (impedenceValue < curImpThreshold)
   {
     updateOutputState(JOINED);
     prevImpCheckBufferMillis = curMillis;
+    joinPredicted = false;
+    chainLength = updateChainLength(chainLength, impedenceValue, sensing);
     return;
   }
 
   // Otherwise, continue checking impedence if we haven't triggered while buffer interval is still active, to allow for stabalizing of the signal
-  if (curOutputState != JOINED && curMillis - prevImpCheckBufferMillis < ImpCheckBufferInterval)
+  // A predicted JOINED is still unconfirmed, so it gets the same stabalizing time
+  if ((curOutputState != JOINED || joinPredicted) && curMillis - prevImpCheckBufferMillis < impCheckBufferInterval)
   {
     return;
   }
 
+  if (joinPredicted)
+  {
+    joinPredicted = false;
+    if (capJoinMisses < INT16_MAX)
+      capJoinMisses++;
+    updateOutputState(BOTH); // Both pads were active when the prediction was made
+  }
+
   // Finally, return to cap sensing if buffer has expired without triggering
   updateSensingState(CAPACITIVE);
   return;
@@ -388,6 +650,15 @@ void updateOutputState(OutputState newOutputState)
   if (curOutputState != newOutputState)
   {
     curOutputState = newOutputState;
+    stableChecks = 0;
+    stateChanges++;
+    traceMillis[traceIndex] = curMillis;
+    traceStates[traceIndex] = curOutputState;
+    traceIndex = (traceIndex + 1) % TraceSize;
+    if (traceCount < TraceSize)
+      traceCount++;
+    if (curOutputState != JOINED)
+      chainLength = 0;
     updateLEDs(); // Only update LEDs when a new state is detected
     updateActiveDisplay();
   }
@@ -399,28 +670,105 @@ void updateOutputState(OutputState newOutputState)
  */
 void sendOutputState()
 {
-  switch (curOutputState)
+  Serial.print('[');
+  Serial.print(outputStateCode(curOutputState));
+  Serial.print(']');
+
+  // Extended fields are space separated, each a letter followed by its value
+  if (outputFormat >= 1)
+  {
+    Serial.print(" c");
+    Serial.print(outputConfidence);
+    Serial.print(" n");
+    Serial.print(chainLength);
+    Serial.print(" p");
+    Serial.print(capLeftProximity);
+    Serial.print(',');
+    Serial.print(capRightProximity);
+    Serial.print(" g");
+    Serial.print(capGrip[HAND_LEFT]);
+    Serial.print(',');
+    Serial.print(capGrip[HAND_RIGHT]);
+  }
+
+  // Telemetry fields carry the readings behind the decision for recording, only the sensing path in use is current
+  if (outputFormat == 2)
+  {
+    switch (curSensingState)
+    {
+    case CAPACITIVE:
+      Serial.print(" l");
+      Serial.print(capLeftDelta);
+      Serial.print(',');
+      Serial.print(capLeftRate);
+      Serial.print(" r");
+      Serial.print(capRightDelta);
+      Serial.print(',');
+      Serial.print(capRightRate);
+      break;
+
+    case IMPEDENCE:
+      Serial.print(" i");
+      Serial.print(impedenceValue);
+      break;
+
+    default:
+      break;
+    }
+  }
+
+  Serial.println();
+}
+
+/**
+ * @brief
+ *
+ * @param state
+ * @return the xyz digits sent for the state, without brackets
+ */
+const char *outputStateCode(OutputState state)
+{
+  switch (state)
   {
   case LEFT:
-    Serial.println("[100]");
-    break;
+    return "100";
 
   case RIGHT:
-    Serial.println("[010]");
-    break;
+    return "010";
 
   case BOTH:
-    Serial.println("[110]");
-    break;
+    return "110";
 
   case JOINED:
-    Serial.println("[001]");
-    break;
+    return "001";
 
   default:
-    Serial.println("[000]");
-    break;
+    return "000";
+  }
+}
+
+/**
+ * @brief Scores the current output state 0-9 from how far the deciding readings sit past their thresholds
+ * and how long it has held (see confidenceScore)
+ *
+ */
+void updateConfidence()
+{
+  int margin;
+
+  if (curOutputState == JOINED)
+  {
+    // An unconfirmed prediction has no impedence reading behind it yet
+    margin = joinPredicted ? 3 : marginScore(curImpThreshold - impedenceValue, curImpThreshold);
   }
+  else
+  {
+    int leftMargin = padMargin(capLeftActive, capLeftValue, curCapLeftThreshold, capLeftHysteresis);
+    int rightMargin = padMargin(capRightActive, capRightValue, curCapRightThreshold, capRightHysteresis);
+    margin = min(marginScore(leftMargin, curCapLeftSetting), marginScore(rightMargin, curCapRightSetting));
+  }
+
+  outputConfidence = confidenceScore(margin, stableChecks);
 }
 
 /**
@@ -495,4 +843,271 @@ void updateActiveDisplay()
   lcd.setCursor(0, 3);
   lcd.print(activeDisplayString);
   return;
-}
\ No newline at end of file
+}
+/**
+ * @brief Reads serial input without blocking, running a command for each complete line
+ *
+ */
+void readCommands()
+{
+  while (Serial.available() > 0)
+  {
+    char c = Serial.read();
+
+    if (c == '\r' || c == '\n')
+    {
+      if (commandBufferIndex > 0)
+      {
+        commandBuffer[commandBufferIndex] = '\0';
+        handleCommand(commandBuffer);
+        commandBufferIndex = 0;
+      }
+      continue;
+    }
+
+    // Drop characters past the end of the buffer, the command will be rejected as unknown
+    if (commandBufferIndex < CommandBufferSize - 1)
+    {
+      commandBuffer[commandBufferIndex++] = c;
+    }
+  }
+}
+
+/**
+ * @brief Runs a single command. Supported commands:
+ *   get <name>          - prints #name=value
+ *   set <name> <value>  - updates the parameter, clamped to its range, then prints it; #ERR set if value is not a number
+ *   cal <name>          - sets chain2-chain5 to the current impedence value while JOINED, e.g. cal chain3
+ *   list                - prints every parameter, then #ok
+ *   stats               - prints diagnostic counters, then #ok
+ *   hist                - prints the sensor check duration histogram as #hist=<count>,<count>,...
+ *   trace               - prints recent output state changes as #trace=<millis>,<xyz>, oldest first, then #ok
+ *   bench [scans]       - runs back to back cap scans and prints #bench=<scans>,<mean micros>,<max micros>
+ * Errors are printed as #ERR <command>
+ *
+ * @param command
+ */
+void handleCommand(char *command)
+{
+  char *verb = strtok(command, " ");
+  char *name = strtok(NULL, " ");
+  char *value = strtok(NULL, " ");
+
+  if (verb == NULL)
+    return;
+
+  if (strcmp(verb, "list") == 0)
+  {
+    for (int i = 0; i < ParameterCount; i++)
+    {
+      printParameter(parameters[i]);
+    }
+    Serial.println(F("#ok"));
+    return;
+  }
+
+  if (strcmp(verb, "stats") == 0)
+  {
+    printStats();
+    return;
+  }
+
+  if (strcmp(verb, "hist") == 0)
+  {
+    printHistogram();
+    return;
+  }
+
+  if (strcmp(verb, "trace") == 0)
+  {
+    printTrace();
+    return;
+  }
+
+  if (strcmp(verb, "bench") == 0)
+  {
+    runBenchmark(name == NULL ? 10 : atoi(name));
+    return;
+  }
+
+  Parameter *parameter = name == NULL ? NULL : findParameter(name);
+  if (parameter == NULL)
+  {
+    Serial.print(F("#ERR "));
+    Serial.println(verb);
+    return;
+  }
+
+  if (strcmp(verb, "cal") == 0 && value == NULL)
+  {
+    // Only the chain references are impedence readings, and only a confirmed JOINED has a settled one to calibrate against
+    bool chainRef = parameter->value >= sensing.chainRefs && parameter->value < sensing.chainRefs + ChainRefCount;
+    if (!chainRef || curOutputState != JOINED || joinPredicted)
+    {
+      Serial.print(F("#ERR "));
+      Serial.println(verb);
+      return;
+    }
+
+    *parameter->value = constrain(impedenceValue, parameter->minValue, parameter->maxValue);
+    printParameter(*parameter);
+    return;
+  }
+
+  if (strcmp(verb, "set") == 0 && value != NULL)
+  {
+    // Clamped as a long, an int is 16 bits here and would wrap first
+    char *end;
+    long parsed = strtol(value, &end, 10);
+    if (end == value || *end != '\0')
+    {
+      Serial.print(F("#ERR "));
+      Serial.println(verb);
+      return;
+    }
+
+    *parameter->value = (int)constrain(parsed, (long)parameter->minValue, (long)parameter->maxValue);
+    printParameter(*parameter);
+    return;
+  }
+
+  if (strcmp(verb, "get") == 0)
+  {
+    printParameter(*parameter);
+    return;
+  }
+
+  Serial.print(F("#ERR "));
+  Serial.println(verb);
+}
+
+/**
+ * @brief
+ *
+ * @param name
+ * @return matching parameter, or NULL if none
+ */
+Parameter *findParameter(const char *name)
+{
+  for (int i = 0; i < ParameterCount; i++)
+  {
+    if (strcmp(parameters[i].name, name) == 0)
+      return &parameters[i];
+  }
+
+  return NULL;
+}
+
+/**
+ * @brief
+ *
+ * @param parameter
+ */
+void printParameter(const Parameter &parameter)
+{
+  Serial.print('#');
+  Serial.print(parameter.name);
+  Serial.print('=');
+  Serial.println(*parameter.value);
+}
+
+/**
+ * @brief
+ *
+ * @param checkMicros
+ */
+void recordCheckTime(unsigned long checkMicros)
+{
+  if (checkMicros > maxCheckMicros)
+    maxCheckMicros = checkMicros;
+
+  int bucket = min(checkMicros / 1000 / CheckHistogramBucketMs, (unsigned long)CheckHistogramSize - 1);
+  if (checkHistogram[bucket] < UINT16_MAX)
+    checkHistogram[bucket]++;
+}
+
+/**
+ * @brief Prints each counter as #name=value, then #ok
+ *
+ */
+void printStats()
+{
+  Serial.print(F("#uptime="));
+  Serial.println(curMillis);
+  Serial.print(F("#checks="));
+  Serial.println(sensorChecks);
+  Serial.print(F("#changes="));
+  Serial.println(stateChanges);
+  Serial.print(F("#relayFlips="));
+  Serial.println(relayFlips);
+  Serial.print(F("#onsetMiss="));
+  Serial.println(capFalseOnsets);
+  Serial.print(F("#joinMiss="));
+  Serial.println(capJoinMisses);
+  Serial.print(F("#maxCheckUs="));
+  Serial.println(maxCheckMicros);
+  Serial.println(F("#ok"));
+}
+
+/**
+ * @brief
+ *
+ */
+void printHistogram()
+{
+  Serial.print(F("#hist="));
+  for (int i = 0; i < CheckHistogramSize; i++)
+  {
+    if (i > 0)
+      Serial.print(',');
+    Serial.print(checkHistogram[i]);
+  }
+  Serial.println();
+}
+
+/**
+ * @brief
+ *
+ */
+void printTrace()
+{
+  for (int i = 0; i < traceCount; i++)
+  {
+    int index = (traceIndex - traceCount + i + TraceSize) % TraceSize;
+    Serial.print(F("#trace="));
+    Serial.print(traceMillis[index]);
+    Serial.print(',');
+    Serial.println(outputStateCode(traceStates[index]));
+  }
+  Serial.println(F("#ok"));
+}
+
+/**
+ * @brief Times back to back cap scans at the current capSamples. Sensing pauses while it runs.
+ *
+ * @param scans clamped to 1-MaxBenchScans
+ */
+void runBenchmark(int scans)
+{
+  scans = constrain(scans, 1, MaxBenchScans);
+  unsigned long totalMicros = 0;
+  unsigned long maxMicros = 0;
+
+  for (int i = 0; i < scans; i++)
+  {
+    unsigned long startMicros = micros();
+    senseElectrodes();
+    unsigned long scanMicros = micros() - startMicros;
+
+    totalMicros += scanMicros;
+    if (scanMicros > maxMicros)
+      maxMicros = scanMicros;
+  }
+
+  Serial.print(F("#bench="));
+  Serial.print(scans);
+  Serial.print(',');
+  Serial.print(totalMicros / scans);
+  Serial.print(',');
+  Serial.println(maxMicros);
+}
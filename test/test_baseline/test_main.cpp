@@ -0,0 +1,148 @@
+#include <unity.h>
+
+#include "sensing.h"
+
+// Learned pad baselines and the pot as a sensitivity above them (updateBaseline, padThreshold)
+
+const int Setting = 1000;
+const int Hysteresis = 200;
+
+SensingConfig config;
+PadTracker tracker;
+bool active;
+int falseOnsets;
+
+void setUp()
+{
+  config = DefaultSensingConfig;
+  tracker = NewPadTracker;
+  active = false;
+  falseOnsets = 0;
+}
+
+void tearDown() {}
+
+int baseline()
+{
+  return tracker.baseline >> BaselineShift;
+}
+
+// One capacitiveCheck for a pad whose raw and filtered readings are the same
+bool check(int value)
+{
+  int threshold = padThreshold(tracker, Setting, config);
+  active = updatePad(active, tracker, value, value, threshold, Hysteresis, -1, config, falseOnsets);
+  updateBaseline(tracker.baseline, value, active, config);
+  return active;
+}
+
+void test_first_reading_seeds_the_baseline()
+{
+  updateBaseline(tracker.baseline, 3000, false, config);
+  TEST_ASSERT_EQUAL(3000, baseline());
+}
+
+void test_unseeded_relative_threshold_holds_the_pad_inactive()
+{
+  TEST_ASSERT_EQUAL(maxCapThreshold, padThreshold(tracker, Setting, config));
+  TEST_ASSERT_FALSE(check(5000));
+}
+
+void test_absolute_threshold_is_the_setting()
+{
+  config.relativeThresholds = 0;
+  updateBaseline(tracker.baseline, 3000, false, config);
+  TEST_ASSERT_EQUAL(Setting, padThreshold(tracker, Setting, config));
+}
+
+void test_relative_threshold_sits_above_the_baseline()
+{
+  updateBaseline(tracker.baseline, 3000, false, config);
+  TEST_ASSERT_EQUAL(3000 + Setting, padThreshold(tracker, Setting, config));
+}
+
+void test_relative_threshold_saturates()
+{
+  updateBaseline(tracker.baseline, 32000, false, config);
+  TEST_ASSERT_EQUAL(INT16_MAX, padThreshold(tracker, Setting, config));
+}
+
+void test_baseline_follows_slow_drift()
+{
+  // The room warms up by 1500 over 20 minutes of 50ms checks
+  for (int i = 0; i < 24000; i++)
+    TEST_ASSERT_FALSE(check(3000 + (int)((long)i * 1500 / 24000)));
+
+  TEST_ASSERT_INT_WITHIN(100, 4500, baseline());
+
+  // A touch still lands above the drifted threshold
+  check(4500 + 2000);
+  TEST_ASSERT_TRUE(check(4500 + 2000));
+}
+
+void test_absolute_threshold_triggers_on_drift()
+{
+  // The same drift against a pot tuned for the cold room
+  const int tuned = 3000 + Setting;
+  int spurious = 0;
+  for (int i = 0; i < 24000; i++)
+  {
+    int value = 3000 + (int)((long)i * 1500 / 24000);
+    active = updatePad(active, tracker, value, value, tuned, Hysteresis, -1, config, falseOnsets);
+    spurious += active;
+  }
+
+  TEST_ASSERT_GREATER_THAN(0, spurious);
+}
+
+void test_long_touch_is_not_learned()
+{
+  for (int i = 0; i < 100; i++)
+    check(3000);
+
+  // A visitor holding on for five minutes
+  for (int i = 0; i < 6000; i++)
+    check(5000);
+
+  TEST_ASSERT_TRUE(active);
+  TEST_ASSERT_INT_WITHIN(10, 3000, baseline());
+
+  check(3000);
+  TEST_ASSERT_FALSE(check(3000));
+}
+
+void test_active_pad_baseline_still_falls()
+{
+  updateBaseline(tracker.baseline, 3000, false, config);
+  for (int i = 0; i < 2000; i++)
+    updateBaseline(tracker.baseline, 2500, true, config);
+
+  TEST_ASSERT_INT_WITHIN(10, 2500, baseline());
+}
+
+void test_baseline_rate_sets_the_time_constant()
+{
+  updateBaseline(tracker.baseline, 3000, false, config);
+
+  // 2^baselineRate checks cover about 63% of a step
+  for (int i = 0; i < 1 << config.baselineRate; i++)
+    updateBaseline(tracker.baseline, 4000, false, config);
+
+  TEST_ASSERT_INT_WITHIN(30, 3630, baseline());
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_first_reading_seeds_the_baseline);
+  RUN_TEST(test_unseeded_relative_threshold_holds_the_pad_inactive);
+  RUN_TEST(test_absolute_threshold_is_the_setting);
+  RUN_TEST(test_relative_threshold_sits_above_the_baseline);
+  RUN_TEST(test_relative_threshold_saturates);
+  RUN_TEST(test_baseline_follows_slow_drift);
+  RUN_TEST(test_absolute_threshold_triggers_on_drift);
+  RUN_TEST(test_long_touch_is_not_learned);
+  RUN_TEST(test_active_pad_baseline_still_falls);
+  RUN_TEST(test_baseline_rate_sets_the_time_constant);
+  return UNITY_END();
+}
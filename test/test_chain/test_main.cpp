@@ -0,0 +1,134 @@
+#include <unity.h>
+
+#include "sensing.h"
+
+// Estimating the people in the loop from calibrated impedence references (updateChainLength)
+
+SensingConfig config;
+
+void setUp()
+{
+  config = DefaultSensingConfig;
+}
+
+void tearDown() {}
+
+// Synthetic divider readings: each extra person in the loop adds body resistance
+int reading(int people)
+{
+  return 150 + 60 * people;
+}
+
+// What `cal chain<n>` stores while that many people are joined
+void calibrate(int people)
+{
+  config.chainRefs[people - MinChainLength] = reading(people);
+}
+
+// Deterministic noise, a linear congruential generator in -range..range
+int noise(uint32_t &state, int range)
+{
+  state = state * 1664525u + 1013904223u;
+  return (int)((state >> 16) % (2 * range + 1)) - range;
+}
+
+void test_uncalibrated_reports_zero()
+{
+  TEST_ASSERT_EQUAL(0, updateChainLength(0, reading(3), config));
+  TEST_ASSERT_EQUAL(0, updateChainLength(4, reading(3), config));
+}
+
+void test_single_reference_always_wins()
+{
+  calibrate(3);
+  TEST_ASSERT_EQUAL(3, updateChainLength(0, reading(2), config));
+  TEST_ASSERT_EQUAL(3, updateChainLength(0, reading(5), config));
+}
+
+void test_classifies_calibrated_levels()
+{
+  for (int people = MinChainLength; people <= MaxChainLength; people++)
+    calibrate(people);
+
+  for (int people = MinChainLength; people <= MaxChainLength; people++)
+  {
+    TEST_ASSERT_EQUAL(people, updateChainLength(0, reading(people), config));
+    TEST_ASSERT_EQUAL(people, updateChainLength(0, reading(people) + 25, config));
+    TEST_ASSERT_EQUAL(people, updateChainLength(0, reading(people) - 25, config));
+  }
+}
+
+void test_skips_uncalibrated_levels()
+{
+  calibrate(2);
+  calibrate(5);
+  TEST_ASSERT_EQUAL(2, updateChainLength(0, reading(3), config));
+  TEST_ASSERT_EQUAL(5, updateChainLength(0, reading(4), config));
+}
+
+void test_hysteresis_holds_the_current_length()
+{
+  calibrate(2);
+  calibrate(3);
+  int midpoint = (reading(2) + reading(3)) / 2;
+
+  // Just past the midpoint is not chainHyst closer to the other reference
+  TEST_ASSERT_EQUAL(2, updateChainLength(2, midpoint + 5, config));
+  TEST_ASSERT_EQUAL(3, updateChainLength(3, midpoint - 5, config));
+
+  // Well past it moves
+  TEST_ASSERT_EQUAL(3, updateChainLength(2, midpoint + 6, config));
+  TEST_ASSERT_EQUAL(2, updateChainLength(3, midpoint - 6, config));
+}
+
+void test_current_length_losing_its_reference_moves()
+{
+  calibrate(2);
+  TEST_ASSERT_EQUAL(2, updateChainLength(4, reading(4), config));
+}
+
+void test_noisy_readings_do_not_flicker()
+{
+  for (int people = MinChainLength; people <= MaxChainLength; people++)
+    calibrate(people);
+
+  uint32_t state = 3;
+  int chainLength = 0;
+  int changes = 0;
+  int previous = 0;
+
+  // A reading sitting on the boundary between three and four people, with less noise than chainHyst
+  int boundary = (reading(3) + reading(4)) / 2;
+  for (int i = 0; i < 1000; i++)
+  {
+    chainLength = updateChainLength(chainLength, boundary + noise(state, 4), config);
+    changes += chainLength != previous;
+    previous = chainLength;
+  }
+
+  TEST_ASSERT_EQUAL(1, changes);
+
+  config.chainHysteresis = 0;
+  changes = 0;
+  for (int i = 0; i < 1000; i++)
+  {
+    chainLength = updateChainLength(chainLength, boundary + noise(state, 4), config);
+    changes += chainLength != previous;
+    previous = chainLength;
+  }
+
+  TEST_ASSERT_GREATER_THAN(100, changes);
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_uncalibrated_reports_zero);
+  RUN_TEST(test_single_reference_always_wins);
+  RUN_TEST(test_classifies_calibrated_levels);
+  RUN_TEST(test_skips_uncalibrated_levels);
+  RUN_TEST(test_hysteresis_holds_the_current_length);
+  RUN_TEST(test_current_length_losing_its_reference_moves);
+  RUN_TEST(test_noisy_readings_do_not_flicker);
+  return UNITY_END();
+}
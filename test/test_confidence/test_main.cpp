@@ -0,0 +1,87 @@
+#include <unity.h>
+
+#include "sensing.h"
+
+// Confidence of each output state from threshold margins and stability (marginScore, padMargin, confidenceScore)
+
+const int Threshold = 1000;
+const int Hysteresis = 200;
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_margin_scores_zero_on_the_wrong_side()
+{
+  TEST_ASSERT_EQUAL(0, marginScore(0, 1000));
+  TEST_ASSERT_EQUAL(0, marginScore(-500, 1000));
+}
+
+void test_margin_scores_nine_at_a_quarter_of_the_scale()
+{
+  TEST_ASSERT_EQUAL(9, marginScore(250, 1000));
+  TEST_ASSERT_EQUAL(9, marginScore(5000, 1000));
+  TEST_ASSERT_EQUAL(4, marginScore(125, 1000));
+}
+
+void test_margin_handles_tiny_and_large_scales()
+{
+  TEST_ASSERT_EQUAL(9, marginScore(1, 0));
+  TEST_ASSERT_EQUAL(9, marginScore(1, 3));
+  TEST_ASSERT_EQUAL(9, marginScore(INT16_MAX, INT16_MAX));
+}
+
+void test_pad_margin_is_measured_from_the_deciding_threshold()
+{
+  // Inactive pads are judged against the enter threshold, active ones against the exit threshold
+  TEST_ASSERT_EQUAL(300, padMargin(false, 700, Threshold, Hysteresis));
+  TEST_ASSERT_EQUAL(100, padMargin(true, 900, Threshold, Hysteresis));
+  TEST_ASSERT_EQUAL(-100, padMargin(true, 700, Threshold, Hysteresis));
+}
+
+void test_clear_change_scores_six_then_nine()
+{
+  TEST_ASSERT_EQUAL(6, confidenceScore(9, 0));
+  TEST_ASSERT_EQUAL(7, confidenceScore(9, 1));
+  TEST_ASSERT_EQUAL(8, confidenceScore(9, 2));
+  TEST_ASSERT_EQUAL(9, confidenceScore(9, 3));
+  TEST_ASSERT_EQUAL(9, confidenceScore(9, 255));
+}
+
+void test_reading_on_its_threshold_stays_marginal()
+{
+  for (int checks = 0; checks < 256; checks++)
+  {
+    int margin = marginScore(padMargin(true, Threshold - Hysteresis, Threshold, Hysteresis), Threshold);
+    TEST_ASSERT_TRUE(confidenceScore(margin, checks) <= 3);
+  }
+}
+
+void test_confidence_rises_with_margin_and_stability()
+{
+  for (int margin = 0; margin <= 9; margin++)
+  {
+    for (int checks = 0; checks < 10; checks++)
+    {
+      uint8_t score = confidenceScore(margin, checks);
+      TEST_ASSERT_TRUE(score <= 9);
+      if (margin > 0)
+        TEST_ASSERT_TRUE(score >= confidenceScore(margin - 1, checks));
+      if (checks > 0)
+        TEST_ASSERT_TRUE(score >= confidenceScore(margin, checks - 1));
+    }
+  }
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_margin_scores_zero_on_the_wrong_side);
+  RUN_TEST(test_margin_scores_nine_at_a_quarter_of_the_scale);
+  RUN_TEST(test_margin_handles_tiny_and_large_scales);
+  RUN_TEST(test_pad_margin_is_measured_from_the_deciding_threshold);
+  RUN_TEST(test_clear_change_scores_six_then_nine);
+  RUN_TEST(test_reading_on_its_threshold_stays_marginal);
+  RUN_TEST(test_confidence_rises_with_margin_and_stability);
+  return UNITY_END();
+}
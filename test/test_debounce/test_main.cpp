@@ -0,0 +1,135 @@
+#include <unity.h>
+
+#include "sensing.h"
+
+// Hysteresis and N-of-M debouncing of pad decisions (debouncePad, updatePad)
+
+const int Threshold = 1000;
+const int Hysteresis = 200;
+
+SensingConfig config;
+PadTracker tracker;
+int falseOnsets;
+
+void setUp()
+{
+  config = DefaultSensingConfig;
+  tracker = NewPadTracker;
+  falseOnsets = 0;
+}
+
+void tearDown() {}
+
+bool check(bool active, int value)
+{
+  return updatePad(active, tracker, value, value, Threshold, Hysteresis, -1, config, falseOnsets);
+}
+
+void test_single_disagreement_does_not_flip()
+{
+  TEST_ASSERT_FALSE(check(false, 1500));
+  TEST_ASSERT_FALSE(check(false, 500));
+  TEST_ASSERT_FALSE(check(false, 500));
+}
+
+void test_two_of_three_disagreements_flip()
+{
+  TEST_ASSERT_FALSE(check(false, 1500));
+  TEST_ASSERT_FALSE(check(false, 500));
+  TEST_ASSERT_TRUE(check(false, 1500));
+}
+
+void test_flip_clears_history()
+{
+  check(false, 1500);
+  TEST_ASSERT_TRUE(check(false, 1500));
+
+  // The readings that turned the pad on must not count towards turning it off
+  TEST_ASSERT_TRUE(check(true, 500));
+  TEST_ASSERT_FALSE(check(true, 500));
+}
+
+void test_old_disagreements_leave_the_window()
+{
+  check(false, 1500);
+  check(false, 500);
+  check(false, 500);
+  TEST_ASSERT_FALSE(check(false, 1500));
+}
+
+void test_count_above_window_is_clamped()
+{
+  config.debounceCount = 8;
+  config.debounceWindow = 2;
+  check(false, 1500);
+  TEST_ASSERT_TRUE(check(false, 1500));
+}
+
+void test_one_of_one_follows_every_reading()
+{
+  config.debounceCount = 1;
+  config.debounceWindow = 1;
+  TEST_ASSERT_TRUE(check(false, 1500));
+  TEST_ASSERT_FALSE(check(true, 500));
+}
+
+void test_hysteresis_band_holds_either_state()
+{
+  config.debounceCount = 1;
+  config.debounceWindow = 1;
+
+  // Between the exit (800) and enter (1000) thresholds nothing changes
+  TEST_ASSERT_FALSE(check(false, 900));
+  TEST_ASSERT_TRUE(check(true, 900));
+  TEST_ASSERT_TRUE(check(true, Threshold - Hysteresis));
+  TEST_ASSERT_FALSE(check(true, Threshold - Hysteresis - 1));
+  TEST_ASSERT_FALSE(check(false, Threshold));
+  TEST_ASSERT_TRUE(check(false, Threshold + 1));
+}
+
+void test_hovering_reading_flips_less_with_debouncing()
+{
+  // A reading alternating around the enter threshold, as noise on a hovering hand does
+  const int readings[] = {1050, 950, 1020, 900, 1080, 960, 1010, 940, 1030, 970};
+  int flips[2] = {0, 0};
+
+  for (int debounced = 0; debounced < 2; debounced++)
+  {
+    setUp();
+    config.debounceCount = debounced ? 2 : 1;
+    config.debounceWindow = debounced ? 3 : 1;
+    int hysteresis = debounced ? Hysteresis : 0;
+    bool active = false;
+
+    for (int i = 0; i < 10; i++)
+    {
+      bool next = updatePad(active, tracker, readings[i], readings[i], Threshold, hysteresis, -1, config, falseOnsets);
+      flips[debounced] += next != active;
+      active = next;
+    }
+  }
+
+  TEST_ASSERT_EQUAL(10, flips[0]);
+  TEST_ASSERT_EQUAL(1, flips[1]);
+}
+
+void test_classifier_verdict_is_debounced()
+{
+  TEST_ASSERT_FALSE(updatePad(false, tracker, 0, 0, Threshold, Hysteresis, 1, config, falseOnsets));
+  TEST_ASSERT_TRUE(updatePad(false, tracker, 0, 0, Threshold, Hysteresis, 1, config, falseOnsets));
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_single_disagreement_does_not_flip);
+  RUN_TEST(test_two_of_three_disagreements_flip);
+  RUN_TEST(test_flip_clears_history);
+  RUN_TEST(test_old_disagreements_leave_the_window);
+  RUN_TEST(test_count_above_window_is_clamped);
+  RUN_TEST(test_one_of_one_follows_every_reading);
+  RUN_TEST(test_hysteresis_band_holds_either_state);
+  RUN_TEST(test_hovering_reading_flips_less_with_debouncing);
+  RUN_TEST(test_classifier_verdict_is_debounced);
+  return UNITY_END();
+}
@@ -0,0 +1,139 @@
+#include <math.h>
+#include <unity.h>
+
+#include "sensing.h"
+
+// Fixed point alpha-beta filter against a floating point reference (updateFilter)
+
+AlphaBetaFilter filter;
+
+void setUp()
+{
+  filter = {0, 0, false};
+}
+
+void tearDown() {}
+
+struct ReferenceFilter
+{
+  double value;
+  double rate;
+  bool primed;
+};
+
+double updateReference(ReferenceFilter &reference, double measurement, double alpha, double beta)
+{
+  if (!reference.primed)
+  {
+    reference = {measurement, 0, true};
+    return measurement;
+  }
+
+  double predicted = reference.value + reference.rate;
+  double residual = measurement - predicted;
+  reference.value = predicted + alpha * residual;
+  reference.rate += beta * residual;
+  return reference.value;
+}
+
+// Deterministic noise, a linear congruential generator in -range..range
+int noise(uint32_t &state, int range)
+{
+  state = state * 1664525u + 1013904223u;
+  return (int)((state >> 16) % (2 * range + 1)) - range;
+}
+
+void test_first_update_primes_with_the_reading()
+{
+  TEST_ASSERT_EQUAL(1234, updateFilter(filter, 1234, 128, 16));
+  TEST_ASSERT_TRUE(filter.primed);
+  TEST_ASSERT_EQUAL(0, filter.rate);
+}
+
+void test_full_alpha_zero_beta_passes_readings_through()
+{
+  const int readings[] = {100, 5000, 20, 32767, 0};
+  for (int reading : readings)
+    TEST_ASSERT_EQUAL(reading, updateFilter(filter, reading, 256, 0));
+}
+
+void test_rate_follows_a_ramp()
+{
+  for (int i = 0; i < 200; i++)
+    updateFilter(filter, 1000 + 25 * i, 128, 16);
+
+  TEST_ASSERT_INT_WITHIN(1, 25, filter.rate >> FilterShift);
+  TEST_ASSERT_INT_WITHIN(2, 1000 + 25 * 199, filter.value >> FilterShift);
+}
+
+void test_matches_floating_point_reference()
+{
+  const int gains[][2] = {{192, 32}, {128, 16}, {96, 8}, {64, 4}};
+
+  for (const int *gain : gains)
+  {
+    setUp();
+    ReferenceFilter reference = {0, 0, false};
+    uint32_t state = 1;
+    double maxError = 0;
+    double maxRateError = 0;
+
+    for (int i = 0; i < 2000; i++)
+    {
+      // Idle, a touch step and a slow release, with noise throughout
+      int level = i < 500 ? 3000 : i < 1200 ? 5000 : 5000 - (i - 1200) * 2;
+      int reading = level + noise(state, 250);
+
+      int value = updateFilter(filter, reading, gain[0], gain[1]);
+      double expected = updateReference(reference, reading, gain[0] / 256.0, gain[1] / 256.0);
+      maxError = fmax(maxError, fabs(value - expected));
+      maxRateError = fmax(maxRateError, fabs((double)filter.rate / (1 << FilterShift) - reference.rate));
+    }
+
+    // Truncating to 1/16ths loses a little every update, it must not accumulate
+    TEST_ASSERT_FLOAT_WITHIN(4.0, 0.0, maxError);
+    TEST_ASSERT_FLOAT_WITHIN(1.0, 0.0, maxRateError);
+  }
+}
+
+void test_smooths_noise()
+{
+  uint32_t state = 7;
+  double rawSquares = 0;
+  double filteredSquares = 0;
+
+  for (int i = 0; i < 4000; i++)
+  {
+    int offset = noise(state, 300);
+    int value = updateFilter(filter, 4000 + offset, 128, 16);
+    if (i >= 100)
+    {
+      rawSquares += (double)offset * offset;
+      filteredSquares += (double)(value - 4000) * (value - 4000);
+    }
+  }
+
+  // The default gains cut the noise variance at least in half
+  TEST_ASSERT_LESS_THAN(rawSquares / 2, filteredSquares);
+}
+
+void test_large_readings_do_not_overflow()
+{
+  updateFilter(filter, 0, 128, 16);
+  for (int i = 0; i < 50; i++)
+    updateFilter(filter, INT16_MAX, 256, 256);
+
+  TEST_ASSERT_INT_WITHIN(1, INT16_MAX, filter.value >> FilterShift);
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_first_update_primes_with_the_reading);
+  RUN_TEST(test_full_alpha_zero_beta_passes_readings_through);
+  RUN_TEST(test_rate_follows_a_ramp);
+  RUN_TEST(test_matches_floating_point_reference);
+  RUN_TEST(test_smooths_noise);
+  RUN_TEST(test_large_readings_do_not_overflow);
+  return UNITY_END();
+}
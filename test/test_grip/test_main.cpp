@@ -0,0 +1,145 @@
+#include <unity.h>
+
+#include "sensing.h"
+
+// Grouping electrodes into hands and grip coverage (sumHands, updateGrip)
+
+const uint8_t Count = 5;
+
+// Three electrodes on the left hand, two on the right
+const Hand Hands[Count] = {HAND_LEFT, HAND_LEFT, HAND_RIGHT, HAND_LEFT, HAND_RIGHT};
+
+SensingConfig config;
+long values[Count];
+int32_t baselines[Count];
+uint8_t grip[2];
+
+void setUp()
+{
+  config = DefaultSensingConfig;
+  for (uint8_t i = 0; i < Count; i++)
+  {
+    values[i] = 1000;
+    baselines[i] = 0;
+  }
+  grip[0] = grip[1] = 0;
+}
+
+void tearDown() {}
+
+void checkGrip(bool left, bool right)
+{
+  const bool active[2] = {left, right};
+  updateGrip(values, baselines, Hands, Count, active, config, grip);
+}
+
+// Learns every electrode's untouched reading of 1000
+void learn()
+{
+  for (int i = 0; i < 10; i++)
+    checkGrip(false, false);
+}
+
+void test_hands_sum_their_own_electrodes()
+{
+  const long readings[Count] = {100, 200, 400, 800, 1600};
+  int totals[2];
+  sumHands(readings, Hands, Count, totals);
+  TEST_ASSERT_EQUAL(1100, totals[HAND_LEFT]);
+  TEST_ASSERT_EQUAL(2000, totals[HAND_RIGHT]);
+}
+
+void test_hand_totals_saturate()
+{
+  const long readings[Count] = {20000, 20000, 5, 20000, 5};
+  int totals[2];
+  sumHands(readings, Hands, Count, totals);
+  TEST_ASSERT_EQUAL(INT16_MAX, totals[HAND_LEFT]);
+  TEST_ASSERT_EQUAL(10, totals[HAND_RIGHT]);
+}
+
+void test_single_electrode_hands_read_as_before()
+{
+  const long readings[2] = {1234, 4321};
+  const Hand hands[2] = {HAND_LEFT, HAND_RIGHT};
+  int totals[2];
+  sumHands(readings, hands, 2, totals);
+  TEST_ASSERT_EQUAL(1234, totals[HAND_LEFT]);
+  TEST_ASSERT_EQUAL(4321, totals[HAND_RIGHT]);
+}
+
+void test_untouched_hands_read_no_grip()
+{
+  learn();
+  values[0] = values[1] = values[3] = 5000;
+  checkGrip(false, false);
+  TEST_ASSERT_EQUAL(0, grip[HAND_LEFT]);
+  TEST_ASSERT_EQUAL(0, grip[HAND_RIGHT]);
+}
+
+void test_fingertip_and_palm_differ()
+{
+  learn();
+
+  // A fingertip on one of the left electrodes
+  values[1] = 1000 + config.gripThreshold + 1;
+  checkGrip(true, false);
+  TEST_ASSERT_EQUAL(33, grip[HAND_LEFT]);
+
+  // A palm over all of them
+  values[0] = values[3] = values[1];
+  checkGrip(true, false);
+  TEST_ASSERT_EQUAL(100, grip[HAND_LEFT]);
+  TEST_ASSERT_EQUAL(0, grip[HAND_RIGHT]);
+}
+
+void test_covered_needs_more_than_grip_threshold()
+{
+  learn();
+  values[2] = 1000 + config.gripThreshold;
+  values[4] = 1000 + config.gripThreshold + 1;
+  checkGrip(false, true);
+  TEST_ASSERT_EQUAL(50, grip[HAND_RIGHT]);
+}
+
+void test_unlearned_electrodes_are_not_covered()
+{
+  values[2] = values[4] = 5000;
+  checkGrip(false, true);
+  TEST_ASSERT_EQUAL(0, grip[HAND_RIGHT]);
+}
+
+void test_held_grip_is_not_learned()
+{
+  learn();
+  values[2] = values[4] = 2000;
+  for (int i = 0; i < 2000; i++)
+    checkGrip(false, true);
+
+  TEST_ASSERT_EQUAL(100, grip[HAND_RIGHT]);
+  TEST_ASSERT_INT_WITHIN(1, 1000, baselines[2] >> BaselineShift);
+}
+
+void test_hand_without_electrodes_reads_no_grip()
+{
+  const Hand leftOnly[2] = {HAND_LEFT, HAND_LEFT};
+  const bool active[2] = {true, true};
+  updateGrip(values, baselines, leftOnly, 2, active, config, grip);
+  updateGrip(values, baselines, leftOnly, 2, active, config, grip);
+  TEST_ASSERT_EQUAL(0, grip[HAND_RIGHT]);
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_hands_sum_their_own_electrodes);
+  RUN_TEST(test_hand_totals_saturate);
+  RUN_TEST(test_single_electrode_hands_read_as_before);
+  RUN_TEST(test_untouched_hands_read_no_grip);
+  RUN_TEST(test_fingertip_and_palm_differ);
+  RUN_TEST(test_covered_needs_more_than_grip_threshold);
+  RUN_TEST(test_unlearned_electrodes_are_not_covered);
+  RUN_TEST(test_held_grip_is_not_learned);
+  RUN_TEST(test_hand_without_electrodes_reads_no_grip);
+  return UNITY_END();
+}
@@ -0,0 +1,76 @@
+#include <unity.h>
+
+#include "sensing.h"
+
+// Predicting joined hands from the pad rates, and when the relay may check them (predictJoin, joinStep)
+
+SensingConfig config;
+
+void setUp()
+{
+  config = DefaultSensingConfig;
+  config.joinRate = 100;
+}
+
+void tearDown() {}
+
+void test_both_pads_jumping_together_predict_a_join()
+{
+  TEST_ASSERT_TRUE(predictJoin(150, 200, config));
+  TEST_ASSERT_TRUE(predictJoin(300, 150, config));
+}
+
+void test_one_slow_pad_is_not_a_join()
+{
+  TEST_ASSERT_FALSE(predictJoin(400, 100, config));
+  TEST_ASSERT_FALSE(predictJoin(100, 400, config));
+  TEST_ASSERT_FALSE(predictJoin(-300, 300, config));
+}
+
+void test_one_pad_pressed_much_harder_is_not_a_join()
+{
+  TEST_ASSERT_FALSE(predictJoin(500, 240, config));
+  TEST_ASSERT_FALSE(predictJoin(240, 500, config));
+}
+
+void test_large_rates_do_not_overflow_the_ratio()
+{
+  TEST_ASSERT_TRUE(predictJoin(INT16_MAX, 20000, config));
+}
+
+void test_relay_waits_for_the_buffer_interval()
+{
+  TEST_ASSERT_EQUAL(JOIN_HOLD, joinStep(false, false, 0, 0, config));
+  TEST_ASSERT_EQUAL(JOIN_CHECK, joinStep(true, false, 0, 0, config));
+}
+
+void test_prediction_waits_for_the_buffer_interval()
+{
+  // Straight after a missed prediction the pads still look joined, they must not be predicted again
+  TEST_ASSERT_EQUAL(JOIN_HOLD, joinStep(false, true, 300, 300, config));
+  TEST_ASSERT_EQUAL(JOIN_PREDICT, joinStep(true, true, 300, 300, config));
+}
+
+void test_prediction_off_only_checks_the_relay()
+{
+  TEST_ASSERT_EQUAL(JOIN_CHECK, joinStep(true, false, 300, 300, config));
+}
+
+void test_unpredicted_pads_still_check_the_relay()
+{
+  TEST_ASSERT_EQUAL(JOIN_CHECK, joinStep(true, true, 20, 20, config));
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_both_pads_jumping_together_predict_a_join);
+  RUN_TEST(test_one_slow_pad_is_not_a_join);
+  RUN_TEST(test_one_pad_pressed_much_harder_is_not_a_join);
+  RUN_TEST(test_large_rates_do_not_overflow_the_ratio);
+  RUN_TEST(test_relay_waits_for_the_buffer_interval);
+  RUN_TEST(test_prediction_waits_for_the_buffer_interval);
+  RUN_TEST(test_prediction_off_only_checks_the_relay);
+  RUN_TEST(test_unpredicted_pads_still_check_the_relay);
+  return UNITY_END();
+}
@@ -0,0 +1,118 @@
+#include <unity.h>
+
+#include "sensing.h"
+
+// Slope based touch onsets and their confirmation by the absolute threshold (updatePad)
+
+const int Threshold = 1000;
+const int Hysteresis = 200;
+
+SensingConfig config;
+PadTracker tracker;
+int falseOnsets;
+
+void setUp()
+{
+  config = DefaultSensingConfig;
+  config.onsetSlope = 400;
+  config.onsetConfirm = 3;
+  tracker = NewPadTracker;
+  falseOnsets = 0;
+}
+
+void tearDown() {}
+
+// Raw and filtered readings are the same here, so the slope is the rise between calls
+bool check(bool active, int value)
+{
+  return updatePad(active, tracker, value, value, Threshold, Hysteresis, -1, config, falseOnsets);
+}
+
+void test_first_reading_is_never_an_onset()
+{
+  TEST_ASSERT_FALSE(check(false, 900));
+}
+
+void test_sharp_rise_reports_touch_immediately()
+{
+  check(false, 100);
+  TEST_ASSERT_TRUE(check(false, 600));
+  TEST_ASSERT_EQUAL(3, tracker.onsetTimer);
+}
+
+void test_gradual_rise_waits_for_the_threshold()
+{
+  check(false, 100);
+  TEST_ASSERT_FALSE(check(false, 400));
+  TEST_ASSERT_FALSE(check(false, 700));
+  TEST_ASSERT_FALSE(check(false, 1000));
+  TEST_ASSERT_FALSE(check(false, 1100));
+  TEST_ASSERT_TRUE(check(false, 1200));
+}
+
+void test_onset_is_confirmed_by_the_threshold()
+{
+  check(false, 100);
+  TEST_ASSERT_TRUE(check(false, 600));
+  TEST_ASSERT_TRUE(check(true, 900));
+  TEST_ASSERT_TRUE(check(true, 1100));
+  TEST_ASSERT_EQUAL(0, tracker.onsetTimer);
+  TEST_ASSERT_EQUAL(0, falseOnsets);
+
+  // Confirmed touches release through the usual debouncing
+  TEST_ASSERT_TRUE(check(true, 500));
+  TEST_ASSERT_FALSE(check(true, 500));
+}
+
+void test_unconfirmed_onset_is_dropped_and_counted()
+{
+  check(false, 100);
+  TEST_ASSERT_TRUE(check(false, 600));
+  TEST_ASSERT_TRUE(check(true, 700));
+  TEST_ASSERT_TRUE(check(true, 700));
+  TEST_ASSERT_FALSE(check(true, 700));
+  TEST_ASSERT_EQUAL(1, falseOnsets);
+}
+
+void test_rise_above_threshold_needs_no_confirmation()
+{
+  check(false, 100);
+  TEST_ASSERT_TRUE(check(false, 1500));
+  TEST_ASSERT_EQUAL(0, tracker.onsetTimer);
+}
+
+void test_disabled_at_zero()
+{
+  config.onsetSlope = 0;
+  check(false, 100);
+  TEST_ASSERT_FALSE(check(false, 900));
+}
+
+void test_active_pad_ignores_slope()
+{
+  check(true, 1100);
+  TEST_ASSERT_TRUE(check(true, 3000));
+  TEST_ASSERT_EQUAL(0, tracker.onsetTimer);
+}
+
+void test_state_fits_in_two_bytes_beyond_the_reading()
+{
+  // history and onsetTimer are all an onset needs besides the previous reading
+  TEST_ASSERT_EQUAL(1, sizeof(tracker.history));
+  TEST_ASSERT_EQUAL(1, sizeof(tracker.onsetTimer));
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_first_reading_is_never_an_onset);
+  RUN_TEST(test_sharp_rise_reports_touch_immediately);
+  RUN_TEST(test_gradual_rise_waits_for_the_threshold);
+  RUN_TEST(test_onset_is_confirmed_by_the_threshold);
+  RUN_TEST(test_unconfirmed_onset_is_dropped_and_counted);
+  RUN_TEST(test_rise_above_threshold_needs_no_confirmation);
+  RUN_TEST(test_disabled_at_zero);
+  RUN_TEST(test_active_pad_ignores_slope);
+  RUN_TEST(test_state_fits_in_two_bytes_beyond_the_reading);
+  return UNITY_END();
+}
@@ -0,0 +1,123 @@
+#include <unity.h>
+
+#include "sensing.h"
+
+// Graded pre-touch proximity below the touch threshold (updateProximity)
+
+const int Baseline = 3000;
+const int Setting = 1000;
+const int Hysteresis = 200;
+
+SensingConfig config;
+PadTracker tracker;
+int falseOnsets;
+
+void setUp()
+{
+  config = DefaultSensingConfig;
+  tracker = NewPadTracker;
+  tracker.baseline = (int32_t)Baseline << BaselineShift;
+  falseOnsets = 0;
+}
+
+void tearDown() {}
+
+// Feeds a steady delta above the baseline until the integration settles
+uint8_t settle(int delta)
+{
+  uint8_t level = 0;
+  for (int i = 0; i < 50; i++)
+    level = updateProximity(tracker, delta, Baseline + Setting, false, config);
+
+  return level;
+}
+
+void test_untouched_pad_reads_zero()
+{
+  TEST_ASSERT_EQUAL(0, settle(0));
+  TEST_ASSERT_EQUAL(0, settle(-300));
+}
+
+void test_level_grades_the_way_to_the_threshold()
+{
+  TEST_ASSERT_EQUAL(2, settle(Setting / 4));
+  TEST_ASSERT_EQUAL(4, settle(Setting / 2));
+  TEST_ASSERT_EQUAL(6, settle(Setting * 3 / 4));
+}
+
+void test_level_stays_below_touch()
+{
+  TEST_ASSERT_EQUAL(8, settle(Setting - 1));
+  TEST_ASSERT_EQUAL(8, settle(Setting * 2));
+}
+
+void test_active_pad_reads_nine_and_restarts_the_approach()
+{
+  settle(Setting / 2);
+  TEST_ASSERT_EQUAL(9, updateProximity(tracker, Setting * 2, Baseline + Setting, true, config));
+  TEST_ASSERT_EQUAL(0, tracker.approach);
+}
+
+void test_single_noisy_check_is_smoothed()
+{
+  // One check at the threshold moves the level by a quarter with the default proximityRate
+  TEST_ASSERT_EQUAL(2, updateProximity(tracker, Setting, Baseline + Setting, false, config));
+}
+
+void test_longer_integration_is_slower()
+{
+  int checks[2] = {0, 0};
+  for (int rate = 0; rate < 2; rate++)
+  {
+    setUp();
+    config.proximityRate = rate ? 4 : 1;
+    while (updateProximity(tracker, Setting * 3 / 4, Baseline + Setting, false, config) < 6)
+      checks[rate]++;
+  }
+
+  TEST_ASSERT_LESS_THAN(checks[1], checks[0]);
+}
+
+void test_threshold_at_the_baseline_reads_zero()
+{
+  TEST_ASSERT_EQUAL(0, updateProximity(tracker, 500, Baseline, false, config));
+}
+
+void test_touch_decisions_are_unaffected()
+{
+  // A hand hovering, then touching: the pad flips on the same check with or without proximity
+  const int deltas[] = {0, 200, 400, 600, 700, 800, 1100, 1500, 1800, 1800, 1800};
+  int flips[2] = {-1, -1};
+
+  for (int withProximity = 0; withProximity < 2; withProximity++)
+  {
+    setUp();
+    bool active = false;
+    for (int i = 0; i < 11; i++)
+    {
+      int value = Baseline + deltas[i];
+      active = updatePad(active, tracker, value, value, Baseline + Setting, Hysteresis, -1, config, falseOnsets);
+      if (withProximity)
+        updateProximity(tracker, deltas[i], Baseline + Setting, active, config);
+      if (active && flips[withProximity] < 0)
+        flips[withProximity] = i;
+    }
+  }
+
+  TEST_ASSERT_TRUE(flips[0] >= 0);
+  TEST_ASSERT_EQUAL(flips[0], flips[1]);
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_untouched_pad_reads_zero);
+  RUN_TEST(test_level_grades_the_way_to_the_threshold);
+  RUN_TEST(test_level_stays_below_touch);
+  RUN_TEST(test_active_pad_reads_nine_and_restarts_the_approach);
+  RUN_TEST(test_single_noisy_check_is_smoothed);
+  RUN_TEST(test_longer_integration_is_slower);
+  RUN_TEST(test_threshold_at_the_baseline_reads_zero);
+  RUN_TEST(test_touch_decisions_are_unaffected);
+  return UNITY_END();
+}
@@ -0,0 +1,578 @@
+/**
+ * Searches pad threshold and debounce settings, then the impedence threshold and relay timing, against
+ * labelled telemetry and prints the Pareto fronts of error rate against latency.
+ *
+ * Build:
+ *   g++ -std=c++17 -O2 -pthread -o auto_tuner tools/auto_tuner.cpp
+ *
+ * Usage:
+ *   auto_tuner [--offsets MIN:MAX:STEP] [--hysteresis MIN:MAX:STEP] [--imp MIN:MAX:STEP] [--buffers MIN:MAX:STEP]
+ *              [--max-relays N] [--threads N] [--export PATH] LR[J]=FILE [LR[J]=FILE ...]
+ *
+ * Each FILE is a serial log recorded with `set outFmt 2` (capRel 1) while the true pad states were known and fixed,
+ * given as LR digits as for train_classifier, with a third digit of 1 if the two people had joined hands (111).
+ * The files are replayed back to back in the order given, so the label changes between them stand in for touches,
+ * joins and releases - e.g. 00=idle.log 10=left.log 11=both.log 111=joined.log 00=idle2.log.
+ *
+ * Pads first: each candidate setting replays every pad through the firmware's threshold and N-of-M debounce
+ * rules (debouncePad in include/sensing.h) on the recorded deltas. Error rate is the share of checks where a pad
+ * disagrees with its label, and latency is the mean number of sensor checks after a label change before the pad
+ * follows it.
+ *
+ * Then the relay: with the best pad setting, each impedence threshold (the IMP pot, read straight from its
+ * ADC) and pair of capBuf/impBuf intervals replays the whole module - both pads, the relay flips and the `i`
+ * readings - the way capacitiveCheck and impedenceCheck do. The recording only holds impedence readings from
+ * when its own relay was switched, so every replayed relay flip restarts from the next recorded stretch of
+ * readings in the same file, settling included, and holds its last reading if the replay stays switched
+ * longer. Pad deltas are held over checks the recording spent on impedence. Errors and latency compare the
+ * output state with the label, and settings flipping the relay more than --max-relays times a minute are
+ * left out.
+ *
+ * Settings that change what the firmware would have recorded cannot be replayed and are not searched: capSamples
+ * changes the raw counts and their noise, the filter gains change the recorded deltas and impedence readings.
+ *
+ * The search is split across all cores, each worker taking the next unclaimed setting. The chosen settings
+ * (lowest error, then lowest latency) can be exported as a script of set commands to send over serial. Lines
+ * starting with # are notes, such as the pot settings, which can only be set by hand.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../include/sensing.h"
+
+namespace
+{
+
+const int SensorCheckMs = 50; // SensorCheckInterval
+
+struct Range
+{
+  int min;
+  int max;
+  int step;
+};
+
+struct Options
+{
+  Range offsets = {100, 3000, 100};
+  Range hysteresis = {0, 1000, 50};
+  Range impedence = {100, 1000, 20};
+  Range buffers = {0, 2000, 100};
+  double maxRelays = 30; // relay flips per minute
+  unsigned threads = 0;  // 0 - one per core
+  std::string exportPath;
+};
+
+// One sensor check of one pad
+struct Sample
+{
+  int delta;
+  bool label;
+};
+
+struct Setting
+{
+  int offset;     // pot offset above the baseline
+  int hysteresis; // capLHyst/capRHyst
+  int count;      // capN
+  int window;     // capM
+};
+
+struct Result
+{
+  Setting setting;
+  double errorRate;
+  double latency;
+};
+
+// Output states, as the firmware's OutputState
+enum State
+{
+  IDLE,
+  LEFT,
+  RIGHT,
+  BOTH,
+  JOINED
+};
+
+// One telemetry line of a labelled log
+struct Check
+{
+  bool pads; // false while the recording was sensing impedence
+  int left;
+  int right;
+};
+
+struct Segment
+{
+  State label;
+  std::vector<Check> checks;
+  std::vector<std::vector<int>> stretches; // `i` readings from each time the recording switched the relay
+};
+
+struct Timing
+{
+  int impedence; // IMP pot reading
+  int capBuffer; // capBuf, ms
+  int impBuffer; // impBuf, ms
+};
+
+struct TimingResult
+{
+  Timing timing;
+  double errorRate;
+  double latency;
+  double relaysPerMinute;
+};
+
+bool parseRange(const char *text, Range &range)
+{
+  return sscanf(text, "%d:%d:%d", &range.min, &range.max, &range.step) == 3 && range.step > 0 && range.min <= range.max;
+}
+
+/**
+ * @brief Reads one labelled log, appending each telemetry line to the left and right pad sequences and
+ * the log itself to the segments
+ */
+bool loadLog(const std::string &path, bool leftLabel, bool rightLabel, bool joined, std::vector<Sample> &left,
+             std::vector<Sample> &right, std::vector<Segment> &segments)
+{
+  std::ifstream in(path);
+  if (!in)
+    return false;
+
+  Segment segment;
+  segment.label = joined ? JOINED : leftLabel && rightLabel ? BOTH : leftLabel ? LEFT : rightLabel ? RIGHT : IDLE;
+  bool switched = false;
+
+  std::string line;
+  while (std::getline(in, line))
+  {
+    const char *i = strstr(line.c_str(), " i");
+    int impedence;
+    if (i != nullptr && sscanf(i + 2, "%d", &impedence) == 1)
+    {
+      if (!switched)
+        segment.stretches.emplace_back();
+      segment.stretches.back().push_back(impedence);
+      segment.checks.push_back({false, 0, 0});
+      switched = true;
+      continue;
+    }
+
+    const char *l = strstr(line.c_str(), " l");
+    const char *r = strstr(line.c_str(), " r");
+    int dl, rl, dr, rr;
+    if (l == nullptr || r == nullptr || sscanf(l + 2, "%d,%d", &dl, &rl) != 2 || sscanf(r + 2, "%d,%d", &dr, &rr) != 2)
+      continue;
+
+    left.push_back({dl, leftLabel});
+    right.push_back({dr, rightLabel});
+    segment.checks.push_back({true, dl, dr});
+    switched = false;
+  }
+
+  segments.push_back(segment);
+  return true;
+}
+
+/**
+ * @brief Replays one pad through the firmware's threshold and debounce rules
+ *
+ * @param errors checks where the pad disagreed with its label
+ * @param latencyChecks summed checks from each label change until the pad followed it
+ * @param changes label changes seen
+ */
+void replay(const std::vector<Sample> &samples, const Setting &setting, uint64_t &errors, uint64_t &latencyChecks, uint64_t &changes)
+{
+  SensingConfig config = DefaultSensingConfig;
+  config.debounceCount = setting.count;
+  config.debounceWindow = setting.window;
+  PadTracker tracker = NewPadTracker;
+  bool active = false;
+  bool label = false;
+  bool following = true;
+
+  for (const Sample &sample : samples)
+  {
+    if (sample.label != label)
+    {
+      label = sample.label;
+      following = false;
+      changes++;
+    }
+
+    bool disagrees = active ? sample.delta < setting.offset - setting.hysteresis : sample.delta > setting.offset;
+    active = debouncePad(active, tracker, disagrees, config);
+
+    if (active != label)
+    {
+      errors++;
+      if (!following)
+        latencyChecks++;
+    }
+    else
+    {
+      following = true;
+    }
+  }
+}
+
+/**
+ * @brief Replays the whole module, pads and relay, the way capacitiveCheck and impedenceCheck do
+ *
+ * @param errors checks where the output state disagreed with the label
+ * @param latencyChecks summed checks from each label change until the output followed it
+ * @param changes label changes seen
+ * @param relayFlips switches to impedence sensing
+ */
+void replayModule(const std::vector<Segment> &segments, const Setting &setting, const Timing &timing, uint64_t &errors,
+                  uint64_t &latencyChecks, uint64_t &changes, uint64_t &relayFlips)
+{
+  SensingConfig config = DefaultSensingConfig;
+  config.debounceCount = setting.count;
+  config.debounceWindow = setting.window;
+  PadTracker trackers[2] = {NewPadTracker, NewPadTracker};
+  bool active[2] = {false, false};
+  int deltas[2] = {0, 0};
+
+  long capBufferChecks = timing.capBuffer / SensorCheckMs;
+  long impBufferChecks = timing.impBuffer / SensorCheckMs;
+  long now = 0;
+  long capBufferStart = 0;
+  long impBufferStart = 0;
+  bool impedenceSensing = false;
+  State output = IDLE;
+  State label = IDLE;
+  bool following = true;
+
+  for (const Segment &segment : segments)
+  {
+    size_t nextStretch = 0;
+    const std::vector<int> *stretch = nullptr;
+    size_t position = 0;
+
+    for (const Check &check : segment.checks)
+    {
+      now++;
+      if (segment.label != label)
+      {
+        label = segment.label;
+        following = false;
+        changes++;
+      }
+
+      if (check.pads)
+      {
+        deltas[0] = check.left;
+        deltas[1] = check.right;
+      }
+
+      if (impedenceSensing)
+      {
+        // Without any recorded readings the loop reads as open
+        int impedence = 1023;
+        if (stretch != nullptr && !stretch->empty())
+          impedence = (*stretch)[std::min(position++, stretch->size() - 1)];
+
+        if (impedence < timing.impedence)
+        {
+          output = JOINED;
+          impBufferStart = now;
+        }
+        else if (output == JOINED || now - impBufferStart >= impBufferChecks)
+        {
+          impedenceSensing = false;
+          capBufferStart = now;
+        }
+      }
+      else
+      {
+        for (int pad = 0; pad < 2; pad++)
+        {
+          bool disagrees = active[pad] ? deltas[pad] < setting.offset - setting.hysteresis : deltas[pad] > setting.offset;
+          active[pad] = debouncePad(active[pad], trackers[pad], disagrees, config);
+        }
+
+        output = active[0] && active[1] ? BOTH : active[0] ? LEFT : active[1] ? RIGHT : IDLE;
+        if (output == BOTH && now - capBufferStart > capBufferChecks)
+        {
+          impedenceSensing = true;
+          impBufferStart = now;
+          relayFlips++;
+          stretch = segment.stretches.empty() ? nullptr : &segment.stretches[nextStretch++ % segment.stretches.size()];
+          position = 0;
+        }
+      }
+
+      if (output != label)
+      {
+        errors++;
+        if (!following)
+          latencyChecks++;
+      }
+      else
+      {
+        following = true;
+      }
+    }
+  }
+}
+
+std::vector<Setting> buildGrid(const Options &options)
+{
+  std::vector<Setting> grid;
+  for (int offset = options.offsets.min; offset <= options.offsets.max; offset += options.offsets.step)
+    for (int hysteresis = options.hysteresis.min; hysteresis <= options.hysteresis.max; hysteresis += options.hysteresis.step)
+      for (int window = 1; window <= 8; window++)
+        for (int count = 1; count <= window; count++)
+          grid.push_back({offset, hysteresis, count, window});
+
+  return grid;
+}
+
+std::vector<Timing> buildTimingGrid(const Options &options)
+{
+  std::vector<Timing> grid;
+  for (int impedence = options.impedence.min; impedence <= options.impedence.max; impedence += options.impedence.step)
+    for (int capBuffer = options.buffers.min; capBuffer <= options.buffers.max; capBuffer += options.buffers.step)
+      for (int impBuffer = options.buffers.min; impBuffer <= options.buffers.max; impBuffer += options.buffers.step)
+        grid.push_back({impedence, capBuffer, impBuffer});
+
+  return grid;
+}
+
+/**
+ * @brief Runs work(i) for every i below count, each thread taking the next unclaimed index
+ */
+template <typename Work>
+void runParallel(size_t count, unsigned threadCount, Work work)
+{
+  std::atomic<size_t> next(0);
+  auto worker = [&]()
+  {
+    for (size_t i = next++; i < count; i = next++)
+      work(i);
+  };
+
+  std::vector<std::thread> threads;
+  for (unsigned i = 0; i < threadCount; i++)
+    threads.emplace_back(worker);
+  for (std::thread &thread : threads)
+    thread.join();
+}
+
+/**
+ * @brief Keeps the results no other result beats on both error rate and latency, sorted by error rate
+ */
+template <typename T>
+std::vector<T> paretoFront(std::vector<T> results)
+{
+  std::sort(results.begin(), results.end(), [](const T &a, const T &b)
+            { return a.errorRate != b.errorRate ? a.errorRate < b.errorRate : a.latency < b.latency; });
+
+  std::vector<T> front;
+  for (const T &result : results)
+  {
+    if (front.empty() || result.latency < front.back().latency)
+      front.push_back(result);
+  }
+
+  return front;
+}
+
+bool exportSetting(const std::string &path, const Setting &setting, const Timing *timing)
+{
+  FILE *out = fopen(path.c_str(), "w");
+  if (out == nullptr)
+    return false;
+
+  fprintf(out, "# auto_tuner - the pot offset is set by hand, turn both cap pots to %d of %d (capRel 1)\n", setting.offset, 5000);
+  if (timing != nullptr)
+    fprintf(out, "# turn the IMP pot until the display shows an impedence threshold of %d\n", timing->impedence);
+  fprintf(out, "set capRel 1\n");
+  fprintf(out, "set capLHyst %d\n", setting.hysteresis);
+  fprintf(out, "set capRHyst %d\n", setting.hysteresis);
+  fprintf(out, "set capN %d\n", setting.count);
+  fprintf(out, "set capM %d\n", setting.window);
+  if (timing != nullptr)
+  {
+    fprintf(out, "set capBuf %d\n", timing->capBuffer);
+    fprintf(out, "set impBuf %d\n", timing->impBuffer);
+  }
+
+  return fclose(out) == 0;
+}
+
+void usage()
+{
+  fprintf(stderr, "usage: auto_tuner [--offsets MIN:MAX:STEP] [--hysteresis MIN:MAX:STEP] [--imp MIN:MAX:STEP] [--buffers MIN:MAX:STEP]\n"
+                  "                  [--max-relays N] [--threads N] [--export PATH] LR[J]=FILE [LR[J]=FILE ...]\n");
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+  Options options;
+  std::vector<Sample> left, right;
+  std::vector<Segment> segments;
+
+  for (int i = 1; i < argc; i++)
+  {
+    std::string arg = argv[i];
+    if (arg == "--offsets" && i + 1 < argc)
+    {
+      if (!parseRange(argv[++i], options.offsets))
+      {
+        usage();
+        return 1;
+      }
+    }
+    else if (arg == "--hysteresis" && i + 1 < argc)
+    {
+      if (!parseRange(argv[++i], options.hysteresis))
+      {
+        usage();
+        return 1;
+      }
+    }
+    else if (arg == "--imp" && i + 1 < argc)
+    {
+      if (!parseRange(argv[++i], options.impedence))
+      {
+        usage();
+        return 1;
+      }
+    }
+    else if (arg == "--buffers" && i + 1 < argc)
+    {
+      if (!parseRange(argv[++i], options.buffers))
+      {
+        usage();
+        return 1;
+      }
+    }
+    else if (arg == "--max-relays" && i + 1 < argc)
+    {
+      options.maxRelays = atof(argv[++i]);
+    }
+    else if (arg == "--threads" && i + 1 < argc)
+    {
+      options.threads = atoi(argv[++i]);
+    }
+    else if (arg == "--export" && i + 1 < argc)
+    {
+      options.exportPath = argv[++i];
+    }
+    else if (arg.size() > 3 && (arg[0] == '0' || arg[0] == '1') && (arg[1] == '0' || arg[1] == '1') &&
+             (arg[2] == '=' || (arg.size() > 4 && arg[2] == '1' && arg[3] == '=' && arg[0] == '1' && arg[1] == '1')))
+    {
+      bool joined = arg[2] == '1';
+      std::string path = arg.substr(joined ? 4 : 3);
+      if (!loadLog(path, arg[0] == '1', arg[1] == '1', joined, left, right, segments))
+      {
+        fprintf(stderr, "cannot read %s\n", path.c_str());
+        return 1;
+      }
+    }
+    else
+    {
+      usage();
+      return 1;
+    }
+  }
+
+  if (left.empty())
+  {
+    usage();
+    fprintf(stderr, "no telemetry samples found, record logs with `set outFmt 2`\n");
+    return 1;
+  }
+
+  std::vector<Setting> grid = buildGrid(options);
+  std::vector<Result> results(grid.size());
+  unsigned threadCount = options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+
+  runParallel(grid.size(), threadCount, [&](size_t i)
+              {
+                uint64_t errors = 0, latencyChecks = 0, changes = 0;
+                replay(left, grid[i], errors, latencyChecks, changes);
+                replay(right, grid[i], errors, latencyChecks, changes);
+                results[i] = {grid[i], (double)errors / (left.size() + right.size()), changes ? (double)latencyChecks / changes : 0.0}; });
+
+  std::vector<Result> front = paretoFront(results);
+
+  printf("%zu samples per pad, %zu settings on %u threads\n\n", left.size(), grid.size(), threadCount);
+  printf("%8s %8s %6s %6s %10s %14s\n", "offset", "capHyst", "capN", "capM", "error %", "latency (ms)");
+  for (const Result &result : front)
+  {
+    printf("%8d %8d %6d %6d %10.3f %14.1f\n", result.setting.offset, result.setting.hysteresis, result.setting.count,
+           result.setting.window, result.errorRate * 100, result.latency * SensorCheckMs);
+  }
+
+  // The relay only comes into play with both pads touched
+  bool relayTraces = false;
+  for (const Segment &segment : segments)
+    relayTraces |= segment.label >= BOTH;
+
+  const Timing *chosenTiming = nullptr;
+  std::vector<TimingResult> timingFront;
+  if (relayTraces)
+  {
+    const Setting &pads = front.front().setting;
+    std::vector<Timing> timingGrid = buildTimingGrid(options);
+    std::vector<TimingResult> timingResults(timingGrid.size());
+    size_t checks = 0;
+    for (const Segment &segment : segments)
+      checks += segment.checks.size();
+    double minutes = checks * SensorCheckMs / 60000.0;
+
+    runParallel(timingGrid.size(), threadCount, [&](size_t i)
+                {
+                  uint64_t errors = 0, latencyChecks = 0, changes = 0, relayFlips = 0;
+                  replayModule(segments, pads, timingGrid[i], errors, latencyChecks, changes, relayFlips);
+                  timingResults[i] = {timingGrid[i], (double)errors / checks, changes ? (double)latencyChecks / changes : 0.0,
+                                      relayFlips / minutes}; });
+
+    timingResults.erase(std::remove_if(timingResults.begin(), timingResults.end(), [&](const TimingResult &result)
+                                       { return result.relaysPerMinute > options.maxRelays; }),
+                        timingResults.end());
+    timingFront = paretoFront(timingResults);
+
+    printf("\nrelay with the first pad setting, %zu settings, at most %.0f relay flips a minute\n\n", timingGrid.size(), options.maxRelays);
+    printf("%8s %8s %8s %10s %14s %12s\n", "impPot", "capBuf", "impBuf", "error %", "latency (ms)", "relays/min");
+    for (const TimingResult &result : timingFront)
+    {
+      printf("%8d %8d %8d %10.3f %14.1f %12.1f\n", result.timing.impedence, result.timing.capBuffer, result.timing.impBuffer,
+             result.errorRate * 100, result.latency * SensorCheckMs, result.relaysPerMinute);
+    }
+
+    if (timingFront.empty())
+      printf("(none, raise --max-relays)\n");
+    else
+      chosenTiming = &timingFront.front().timing;
+  }
+
+  if (!options.exportPath.empty())
+  {
+    if (!exportSetting(options.exportPath, front.front().setting, chosenTiming))
+    {
+      fprintf(stderr, "cannot write %s\n", options.exportPath.c_str());
+      return 1;
+    }
+
+    printf("\nwrote %s\n", options.exportPath.c_str());
+  }
+
+  return 0;
+}
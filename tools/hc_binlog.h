@@ -0,0 +1,301 @@
+#pragma once
+
+/**
+ * Compact binary log format for long recordings of the module's state lines, written by hc_logger.
+ *
+ * A file is an 8 byte header ("HCLOG" and the format version) followed by chunks, each holding the lines of
+ * one module received over a stretch of time. A chunk is a 36 byte header and a payload of columns, one per
+ * field of hc::Event plus the receive time. Each column holds the change from the previous line as a zigzag
+ * varint, with runs of no change stored as a 0 and the run length, so fields that hold still (state,
+ * confidence, grip...) cost next to nothing and the noisy telemetry fields cost a byte or two.
+ *
+ * The chunk header carries the chunk's first and last times, the states seen in it and a CRC-32 of the
+ * header and payload. Chunks are only ever appended, each with a single write, so after a crash a file is
+ * valid up to its last complete chunk and a torn tail is detected by its size or checksum. All values are
+ * little endian.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "hc_parser.h"
+
+namespace hc
+{
+namespace binlog
+{
+
+const char FileMagic[6] = {'H', 'C', 'L', 'O', 'G', 1}; // the last byte is the format version
+const size_t FileHeaderSize = 8;
+const uint32_t ChunkMagic = 0x6b434348; // "HCCk"
+const size_t ChunkHeaderSize = 36;
+const uint32_t MaxPayload = 64 << 20;   // anything larger is corruption
+const uint32_t MaxCount = 1 << 18;      // records in a chunk, likewise (3.6 hours of one module at 20Hz)
+
+struct Record
+{
+  int64_t timeMs;
+  Event event;
+};
+
+struct ChunkHeader
+{
+  uint16_t module;
+  uint8_t stateMask; // bit per hc::State seen in the chunk
+  uint32_t count;
+  uint32_t payloadSize;
+  int64_t firstMs;
+  int64_t lastMs;
+  uint32_t crc;
+};
+
+inline uint32_t crc32(const uint8_t *data, size_t size, uint32_t crc = 0)
+{
+  struct Table
+  {
+    uint32_t entries[256];
+
+    Table()
+    {
+      for (uint32_t i = 0; i < 256; i++)
+      {
+        uint32_t value = i;
+        for (int bit = 0; bit < 8; bit++)
+          value = value & 1 ? 0xEDB88320 ^ (value >> 1) : value >> 1;
+        entries[i] = value;
+      }
+    }
+  };
+  static const Table table;
+
+  crc = ~crc;
+  for (size_t i = 0; i < size; i++)
+    crc = table.entries[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+  return ~crc;
+}
+
+inline void writeFileHeader(uint8_t *out)
+{
+  memcpy(out, FileMagic, sizeof(FileMagic));
+  out[6] = out[7] = 0;
+}
+
+inline bool checkFileHeader(const uint8_t *data, size_t size)
+{
+  return size >= FileHeaderSize && memcmp(data, FileMagic, sizeof(FileMagic)) == 0;
+}
+
+/**
+ * @brief Reads a chunk header, checking its magic and size but not yet its checksum
+ */
+inline bool parseChunkHeader(const uint8_t *data, size_t size, ChunkHeader &header)
+{
+  uint32_t magic;
+  if (size < ChunkHeaderSize)
+    return false;
+
+  memcpy(&magic, data, 4);
+  memcpy(&header.module, data + 4, 2);
+  header.stateMask = data[6];
+  memcpy(&header.count, data + 8, 4);
+  memcpy(&header.payloadSize, data + 12, 4);
+  memcpy(&header.firstMs, data + 16, 8);
+  memcpy(&header.lastMs, data + 24, 8);
+  memcpy(&header.crc, data + 32, 4);
+  return magic == ChunkMagic && header.payloadSize <= MaxPayload && header.count <= MaxCount;
+}
+
+/**
+ * @brief Checks a chunk's checksum, given its header followed by its payload
+ */
+inline bool checkChunk(const uint8_t *chunk, const ChunkHeader &header)
+{
+  uint32_t crc = crc32(chunk, ChunkHeaderSize - 4);
+  return crc32(chunk + ChunkHeaderSize, header.payloadSize, crc) == header.crc;
+}
+
+namespace detail
+{
+
+inline void putVarint(std::string &out, uint64_t value)
+{
+  while (value >= 0x80)
+  {
+    out.push_back((char)(value | 0x80));
+    value >>= 7;
+  }
+  out.push_back((char)value);
+}
+
+inline bool getVarint(const uint8_t *&p, const uint8_t *end, uint64_t &value)
+{
+  value = 0;
+  for (int shift = 0; p < end && shift < 64; shift += 7)
+  {
+    uint8_t byte = *p++;
+    value |= (uint64_t)(byte & 0x7F) << shift;
+    if (!(byte & 0x80))
+      return true;
+  }
+  return false;
+}
+
+inline uint64_t zigzag(int64_t value) { return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63); }
+
+inline int64_t unzigzag(uint64_t value) { return (int64_t)(value >> 1) ^ -(int64_t)(value & 1); }
+
+const int ColumnCount = 14;
+
+inline void toColumns(const Record &record, int64_t columns[ColumnCount])
+{
+  const Event &e = record.event;
+  int64_t values[ColumnCount] = {record.timeMs, (int64_t)e.state, e.confidence, e.chainLength, e.proximity[0],
+                                 e.proximity[1], e.grip[0], e.grip[1], e.delta[0], e.rate[0], e.delta[1], e.rate[1],
+                                 e.impedance, e.hasTelemetry};
+  memcpy(columns, values, sizeof(values));
+}
+
+inline void fromColumns(const int64_t columns[ColumnCount], Record &record)
+{
+  Event &e = record.event;
+  record.timeMs = columns[0];
+  e.state = (State)columns[1];
+  e.confidence = (int8_t)columns[2];
+  e.chainLength = (int8_t)columns[3];
+  e.proximity[0] = (int8_t)columns[4];
+  e.proximity[1] = (int8_t)columns[5];
+  e.grip[0] = (int8_t)columns[6];
+  e.grip[1] = (int8_t)columns[7];
+  e.delta[0] = (int16_t)columns[8];
+  e.rate[0] = (int16_t)columns[9];
+  e.delta[1] = (int16_t)columns[10];
+  e.rate[1] = (int16_t)columns[11];
+  e.impedance = (int16_t)columns[12];
+  e.hasTelemetry = columns[13] != 0;
+}
+
+} // namespace detail
+
+/**
+ * @brief Encodes a module's records, oldest first, as one chunk ready to append; callers keep to MaxCount
+ */
+inline void encodeChunk(uint16_t module, const std::vector<Record> &records, std::string &out)
+{
+  using namespace detail;
+
+  out.assign(ChunkHeaderSize, '\0');
+  ChunkHeader header = {};
+  header.module = module;
+  header.count = records.size();
+  header.firstMs = records.empty() ? 0 : records.front().timeMs;
+  header.lastMs = records.empty() ? 0 : records.back().timeMs;
+
+  std::vector<int64_t> values(records.size() * ColumnCount);
+  for (size_t i = 0; i < records.size(); i++)
+  {
+    toColumns(records[i], &values[i * ColumnCount]);
+    header.stateMask |= 1 << (int)records[i].event.state;
+  }
+
+  for (int column = 0; column < ColumnCount; column++)
+  {
+    int64_t previous = column == 0 ? header.firstMs : 0;
+    uint64_t run = 0;
+    for (size_t i = 0; i < records.size(); i++)
+    {
+      int64_t value = values[i * ColumnCount + column];
+      int64_t change = value - previous;
+      previous = value;
+
+      if (change == 0)
+      {
+        run++;
+        continue;
+      }
+
+      if (run > 0)
+      {
+        putVarint(out, 0);
+        putVarint(out, run - 1);
+        run = 0;
+      }
+      putVarint(out, zigzag(change));
+    }
+
+    if (run > 0)
+    {
+      putVarint(out, 0);
+      putVarint(out, run - 1);
+    }
+  }
+
+  header.payloadSize = out.size() - ChunkHeaderSize;
+  uint32_t magic = ChunkMagic;
+  char *p = &out[0];
+  memcpy(p, &magic, 4);
+  memcpy(p + 4, &header.module, 2);
+  p[6] = (char)header.stateMask;
+  memcpy(p + 8, &header.count, 4);
+  memcpy(p + 12, &header.payloadSize, 4);
+  memcpy(p + 16, &header.firstMs, 8);
+  memcpy(p + 24, &header.lastMs, 8);
+
+  const uint8_t *bytes = (const uint8_t *)out.data();
+  header.crc = crc32(bytes + ChunkHeaderSize, header.payloadSize, crc32(bytes, ChunkHeaderSize - 4));
+  memcpy(p + 32, &header.crc, 4);
+}
+
+/**
+ * @brief Decodes a checked chunk's payload, appending its records
+ *
+ * @return false if the payload does not hold the header's count of records
+ */
+inline bool decodeChunk(const ChunkHeader &header, const uint8_t *payload, std::vector<Record> &records)
+{
+  using namespace detail;
+
+  // Every column takes at least a byte for any records and none without, so a count the payload cannot hold
+  // is caught before allocating for it
+  if (header.count > MaxCount || (header.count > 0 ? header.payloadSize < ColumnCount : header.payloadSize != 0))
+    return false;
+
+  size_t base = records.size();
+  records.resize(base + header.count);
+  std::vector<int64_t> values((size_t)header.count * ColumnCount);
+
+  const uint8_t *p = payload, *end = payload + header.payloadSize;
+  for (int column = 0; column < ColumnCount; column++)
+  {
+    int64_t value = column == 0 ? header.firstMs : 0;
+    for (uint32_t i = 0; i < header.count;)
+    {
+      uint64_t token;
+      if (!getVarint(p, end, token))
+        return false;
+
+      if (token != 0)
+      {
+        value += unzigzag(token);
+        values[(size_t)i++ * ColumnCount + column] = value;
+        continue;
+      }
+
+      uint64_t run;
+      if (!getVarint(p, end, run) || run >= header.count - i)
+        return false;
+      for (uint64_t j = 0; j <= run; j++)
+        values[(size_t)i++ * ColumnCount + column] = value;
+    }
+  }
+
+  for (uint32_t i = 0; i < header.count; i++)
+    fromColumns(&values[(size_t)i * ColumnCount], records[base + i]);
+
+  return p == end;
+}
+
+} // namespace binlog
+} // namespace hc
@@ -0,0 +1,330 @@
+/**
+ * Talks to a module over its serial command channel: reads and writes parameters, dumps diagnostics,
+ * runs the benchmark and watches the output state.
+ *
+ * Build:
+ *   g++ -std=c++17 -O2 -o hc_cli tools/hc_cli.cpp
+ *
+ * Usage:
+ *   hc_cli [-p PORT] [-b BAUD] [-t TIMEOUT_MS] COMMAND [ARGS...]
+ *   hc_cli [-p PORT] [-b BAUD] [-t TIMEOUT_MS] -f SCRIPT    (- reads the script from stdin)
+ *
+ * Commands are sent as they are - get, set, cal, list, stats, hist, trace, bench (see README) - and
+ * their # responses are printed without the #. `monitor [SECONDS]` prints output state lines instead,
+ * until interrupted or for the given time. Scripts hold one command per line, lines starting with #
+ * are skipped, so auto_tuner exports can be loaded directly. The exit status is 1 if any command failed
+ * or timed out.
+ *
+ * The port is opened non-blocking and every read waits in poll() with a deadline, so a silent module
+ * times out instead of hanging, and an unplugged one stops the command (monitor included) with an error. Commands are only sent once the module has printed
+ * its first state line, which covers boards that reset when the port opens.
+ */
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <poll.h>
+#include <string>
+#include <time.h>
+#include <unistd.h>
+
+#include "hc_serial.h"
+
+namespace
+{
+
+const int StartupTimeoutMs = 3000;
+
+struct Options
+{
+  const char *port = "/dev/ttyACM0";
+  int baud = 9600;
+  int timeoutMs = 1000;
+  const char *script = nullptr;
+};
+
+long long nowMs()
+{
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000LL + now.tv_nsec / 1000000;
+}
+
+/**
+ * @brief Splits the serial stream into lines without ever blocking
+ */
+class LineReader
+{
+public:
+  explicit LineReader(int fd) : fd(fd) {}
+
+  /**
+   * @brief Waits for the next complete line until the deadline
+   *
+   * @return false on timeout or a closed port, see closed()
+   */
+  bool next(std::string &line, long long deadlineMs)
+  {
+    while (true)
+    {
+      size_t end = pending.find('\n');
+      if (end != std::string::npos)
+      {
+        line.assign(pending, 0, end);
+        pending.erase(0, end + 1);
+        if (!line.empty() && line.back() == '\r')
+          line.pop_back();
+        return true;
+      }
+
+      long long remainingMs = deadlineMs - nowMs();
+      if (remainingMs <= 0)
+        return false;
+
+      pollfd watch = {fd, POLLIN, 0};
+      int ready = poll(&watch, 1, (int)remainingMs);
+      if (ready < 0 && errno == EINTR)
+        continue;
+      if (ready <= 0)
+        return false;
+
+      char buffer[256];
+      ssize_t count = read(fd, buffer, sizeof(buffer));
+      if (count < 0 && (errno == EAGAIN || errno == EINTR))
+        continue;
+      if (count <= 0)
+      {
+        // End of file or EIO, the module was unplugged or the port hung up
+        hungUp = true;
+        return false;
+      }
+
+      pending.append(buffer, count);
+    }
+  }
+
+  /**
+   * @brief Whether the port hung up, after which next() never returns another line
+   */
+  bool closed() const { return hungUp; }
+
+private:
+  int fd;
+  std::string pending;
+  bool hungUp = false;
+};
+
+bool isStateLine(const std::string &line)
+{
+  return line.size() >= 5 && line[0] == '[' && line[4] == ']';
+}
+
+bool writeAll(int fd, const std::string &text)
+{
+  size_t sent = 0;
+  while (sent < text.size())
+  {
+    ssize_t count = write(fd, text.data() + sent, text.size() - sent);
+    if (count < 0 && errno == EAGAIN)
+    {
+      pollfd watch = {fd, POLLOUT, 0};
+      poll(&watch, 1, 100);
+      continue;
+    }
+    if (count < 0 && errno == EINTR)
+      continue;
+    if (count < 0)
+      return false;
+
+    sent += count;
+  }
+
+  return true;
+}
+
+/**
+ * @brief Commands answering with several lines end with #ok, the rest answer with a single line
+ */
+bool isMultiLine(const std::string &verb)
+{
+  return verb == "list" || verb == "stats" || verb == "trace";
+}
+
+/**
+ * @brief Sends one command and prints its response
+ *
+ * @return false if the module rejected the command or did not answer in time
+ */
+bool runCommand(int fd, LineReader &reader, const std::string &command, const Options &options)
+{
+  std::string verb = command.substr(0, command.find(' '));
+
+  if (verb == "monitor")
+  {
+    int seconds = command.size() > verb.size() ? atoi(command.c_str() + verb.size()) : 0;
+    long long endMs = seconds > 0 ? nowMs() + seconds * 1000LL : -1;
+    std::string line;
+    while (endMs < 0 || nowMs() < endMs)
+    {
+      if (reader.next(line, endMs < 0 ? nowMs() + options.timeoutMs : endMs) && isStateLine(line))
+      {
+        printf("%s\n", line.c_str());
+        fflush(stdout);
+      }
+
+      if (reader.closed())
+      {
+        fprintf(stderr, "%s: port closed\n", options.port);
+        return false;
+      }
+    }
+    return true;
+  }
+
+  if (!writeAll(fd, command + "\n"))
+  {
+    perror("write");
+    return false;
+  }
+
+  // bench blocks the module while it runs, give it longer
+  long long deadlineMs = nowMs() + (verb == "bench" ? options.timeoutMs * 10 : options.timeoutMs);
+  bool multiLine = isMultiLine(verb);
+  std::string line;
+
+  while (reader.next(line, deadlineMs))
+  {
+    if (line.empty() || line[0] != '#')
+      continue;
+
+    if (line.compare(0, 4, "#ERR") == 0)
+    {
+      fprintf(stderr, "%s: rejected\n", command.c_str());
+      return false;
+    }
+
+    if (multiLine && line == "#ok")
+      return true;
+
+    printf("%s\n", line.c_str() + 1);
+    if (!multiLine)
+      return true;
+  }
+
+  fprintf(stderr, "%s: %s\n", command.c_str(), reader.closed() ? "port closed" : "no response");
+  return false;
+}
+
+/**
+ * @brief Runs every command in a script, skipping blank lines and # notes
+ */
+bool runScript(int fd, LineReader &reader, FILE *script, const Options &options)
+{
+  bool ok = true;
+  char buffer[256];
+
+  while (fgets(buffer, sizeof(buffer), script) != nullptr)
+  {
+    std::string command = buffer;
+    while (!command.empty() && (command.back() == '\n' || command.back() == '\r' || command.back() == ' '))
+      command.pop_back();
+
+    if (command.empty() || command[0] == '#')
+      continue;
+
+    ok &= runCommand(fd, reader, command, options);
+  }
+
+  return ok;
+}
+
+void usage()
+{
+  fprintf(stderr, "usage: hc_cli [-p PORT] [-b BAUD] [-t TIMEOUT_MS] COMMAND [ARGS...]\n"
+                  "       hc_cli [-p PORT] [-b BAUD] [-t TIMEOUT_MS] -f SCRIPT\n");
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+  Options options;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "+p:b:t:f:")) != -1)
+  {
+    switch (opt)
+    {
+    case 'p':
+      options.port = optarg;
+      break;
+    case 'b':
+      options.baud = atoi(optarg);
+      break;
+    case 't':
+      options.timeoutMs = atoi(optarg);
+      break;
+    case 'f':
+      options.script = optarg;
+      break;
+    default:
+      usage();
+      return 1;
+    }
+  }
+
+  if ((options.script == nullptr) == (optind == argc))
+  {
+    usage();
+    return 1;
+  }
+
+  int fd = hc::openPort(options.port, options.baud);
+  if (fd < 0)
+  {
+    fprintf(stderr, "cannot open %s: %s\n", options.port, strerror(errno));
+    return 1;
+  }
+
+  LineReader reader(fd);
+  std::string line;
+  long long startupDeadlineMs = nowMs() + StartupTimeoutMs;
+  bool ready = false;
+  while (!ready && reader.next(line, startupDeadlineMs))
+    ready = isStateLine(line);
+
+  if (!ready)
+  {
+    fprintf(stderr, "%s: no output from the module\n", options.port);
+    close(fd);
+    return 1;
+  }
+
+  bool ok;
+  if (options.script != nullptr)
+  {
+    FILE *script = strcmp(options.script, "-") == 0 ? stdin : fopen(options.script, "r");
+    if (script == nullptr)
+    {
+      fprintf(stderr, "cannot read %s\n", options.script);
+      close(fd);
+      return 1;
+    }
+
+    ok = runScript(fd, reader, script, options);
+    if (script != stdin)
+      fclose(script);
+  }
+  else
+  {
+    std::string command = argv[optind];
+    for (int i = optind + 1; i < argc; i++)
+      command += std::string(" ") + argv[i];
+
+    ok = runCommand(fd, reader, command, options);
+  }
+
+  close(fd);
+  return ok ? 0 : 1;
+}
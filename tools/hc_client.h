@@ -0,0 +1,301 @@
+#pragma once
+
+/**
+ * Client library for show software: a module's events as an awaitable stream for C++20 coroutines, instead
+ * of a reader thread and callbacks. Needs -std=c++20.
+ *
+ *   hc::Task watch(hc::Client &client)
+ *   {
+ *     while (std::optional<hc::Update> update = co_await client.nextEvent())
+ *       show(update->event.state);
+ *   }
+ *
+ *   hc::Client client;
+ *   client.open("/dev/ttyACM0", 9600);
+ *   hc::Task task = watch(client);
+ *   while (!task.done() && client.poll(100))
+ *     ; // or add client.fd() to the app's own loop and call client.pump() when it is readable
+ *
+ * Everything runs on the thread calling poll()/pump(), which resumes the waiting coroutine as events arrive.
+ * Events wait in a ring of fixed capacity allocated up front and are parsed in place (see hc_parser.h), so
+ * nothing is allocated per event. When the ring is full and overflow is Overflow::Block, the port is left
+ * unread until the coroutine catches up: the lines wait in the driver, whose buffer holds a few seconds of
+ * output. Overflow::DropOldest instead reads everything waiting before resuming the coroutine and keeps
+ * only the newest events, counting the rest, for apps that only want the latest state. nextEvent() gives
+ * an empty optional once the port has closed.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <fcntl.h>
+#include <optional>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#include "hc_parser.h"
+#include "hc_serial.h"
+
+namespace hc
+{
+
+struct Update
+{
+  Event event;
+  int64_t receivedUs; // CLOCK_MONOTONIC when the line was read
+};
+
+enum class Overflow
+{
+  Block,
+  DropOldest
+};
+
+/**
+ * @brief Return type for coroutines that consume events. It runs as soon as it is called, up to its first
+ * co_await, and owns the coroutine frame, allocated once when it starts
+ */
+class Task
+{
+public:
+  struct promise_type
+  {
+    std::exception_ptr exception;
+
+    Task get_return_object() { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_always final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { exception = std::current_exception(); }
+  };
+
+  Task(Task &&other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+  Task &operator=(Task &&other) noexcept
+  {
+    std::swap(handle, other.handle);
+    return *this;
+  }
+  Task(const Task &) = delete;
+  Task &operator=(const Task &) = delete;
+
+  ~Task()
+  {
+    if (handle)
+      handle.destroy();
+  }
+
+  /**
+   * @brief Whether the coroutine has returned. If it ended with an exception, it is rethrown here
+   */
+  bool done() const
+  {
+    if (!handle || !handle.done())
+      return false;
+    if (handle.promise().exception)
+      std::rethrow_exception(handle.promise().exception);
+    return true;
+  }
+
+private:
+  std::coroutine_handle<promise_type> handle;
+
+  explicit Task(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+};
+
+class Client
+{
+public:
+  /**
+   * @param capacity events held for the coroutine before overflow applies
+   */
+  explicit Client(size_t capacity = 64, Overflow overflow = Overflow::Block) : ring(capacity ? capacity : 1), overflow(overflow) {}
+
+  Client(const Client &) = delete;
+  Client &operator=(const Client &) = delete;
+
+  ~Client()
+  {
+    if (port >= 0 && owned)
+      close(port);
+  }
+
+  /**
+   * @brief Opens a module's port (see hc_serial.h)
+   *
+   * @return false with errno set
+   */
+  bool open(const char *path, int baud)
+  {
+    int fd = openPort(path, baud);
+    if (fd < 0)
+      return false;
+    attach(fd, true);
+    return true;
+  }
+
+  /**
+   * @brief Reads from a descriptor that is already open, e.g. a pty, switching it to non-blocking
+   */
+  void attach(int fd, bool takeOwnership = false)
+  {
+    port = fd;
+    owned = takeOwnership;
+    closed = false;
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  }
+
+  int fd() const { return port; }
+
+  class EventAwaiter
+  {
+  public:
+    explicit EventAwaiter(Client &client) : client(client) {}
+
+    bool await_ready() const noexcept { return client.count > 0 || client.closed; }
+    void await_suspend(std::coroutine_handle<> handle) noexcept { client.waiter = handle; }
+    std::optional<Update> await_resume() noexcept { return client.pop(); }
+
+  private:
+    Client &client;
+  };
+
+  /**
+   * @brief co_await it for the next event, or an empty optional once the port has closed. One coroutine
+   * at a time may wait on a client
+   */
+  EventAwaiter nextEvent() { return EventAwaiter(*this); }
+
+  /**
+   * @brief Waits up to timeoutMs for the port, then reads and hands out what arrived
+   *
+   * @return false once the port has closed
+   */
+  bool poll(int timeoutMs)
+  {
+    if (closed)
+      return false;
+
+    pollfd watch = {port, (short)(accepting() ? POLLIN : 0), 0};
+    if (watch.events == 0)
+    {
+      // Blocked on a full ring that the coroutine is not draining, so there is nothing to wait for
+      usleep(timeoutMs * 1000);
+      return true;
+    }
+
+    if (::poll(&watch, 1, timeoutMs) > 0)
+      pump();
+    return !closed;
+  }
+
+  /**
+   * @brief Reads what the port has without blocking, as far as the ring allows, and resumes the waiting
+   * coroutine with it
+   */
+  void pump()
+  {
+    char buffer[ReadSize];
+    for (int reads = 0; reads < MaxReads && !closed && accepting(); reads++)
+    {
+      ssize_t count = read(port, buffer, readable());
+      if (count < 0 && errno == EINTR)
+        continue;
+      if (count == 0 || (count < 0 && errno != EAGAIN))
+        closed = true;
+      if (count <= 0)
+        break;
+
+      int64_t now = nowUs();
+      parser.feed(buffer, count, [&](const Event &event)
+                  { push(event, now); });
+    }
+    resume();
+  }
+
+  /**
+   * @brief Events read but not yet handed to the coroutine
+   */
+  size_t pending() const { return count; }
+
+  /**
+   * @brief Events discarded with Overflow::DropOldest
+   */
+  uint64_t dropped() const { return droppedEvents; }
+
+  /**
+   * @brief Lines that were not state lines (see hc::Parser)
+   */
+  uint64_t rejected() const { return parser.rejectedLines(); }
+
+  static int64_t nowUs()
+  {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000LL + now.tv_nsec / 1000;
+  }
+
+private:
+  std::vector<Update> ring;
+  size_t head = 0, count = 0;
+  Overflow overflow;
+  Parser parser;
+  std::coroutine_handle<> waiter;
+  int port = -1;
+  bool owned = false;
+  bool closed = true;
+  uint64_t droppedEvents = 0;
+
+  static constexpr size_t ReadSize = 1024;
+  static constexpr int MaxReads = 16; // so a port that never empties cannot hold pump() forever
+
+  /**
+   * @brief Bytes that can be read without overflowing the ring. The first line break may finish a line
+   * already begun, and every further line takes at least 6 bytes ("[xyz]" and a break)
+   */
+  size_t readable() const
+  {
+    size_t space = ring.size() - count;
+    if (overflow == Overflow::DropOldest)
+      return ReadSize;
+    return space == 0 ? 0 : std::min(ReadSize, 1 + (space - 1) * 6);
+  }
+
+  bool accepting() const { return readable() > 0; }
+
+  void push(const Event &event, int64_t now)
+  {
+    if (count == ring.size())
+    {
+      // Only reachable with DropOldest
+      head = (head + 1) % ring.size();
+      count--;
+      droppedEvents++;
+    }
+    ring[(head + count) % ring.size()] = {event, now};
+    count++;
+  }
+
+  std::optional<Update> pop()
+  {
+    if (count == 0)
+      return std::nullopt;
+    Update update = ring[head];
+    head = (head + 1) % ring.size();
+    count--;
+    return update;
+  }
+
+  void resume()
+  {
+    if (waiter && (count > 0 || closed))
+      std::exchange(waiter, nullptr).resume();
+  }
+};
+
+} // namespace hc
@@ -0,0 +1,294 @@
+/**
+ * Measures the client library (see hc_client.h) against a simulated module on a pty: the time from a line
+ * being written to the coroutine resuming with it, the heap allocations made per event, and how a
+ * consumer slower than the module is held back or loses events under each overflow policy.
+ *
+ * Build:
+ *   g++ -std=c++20 -O2 -pthread -o hc_client_bench tools/hc_client_bench.cpp
+ *
+ * Usage:
+ *   hc_client_bench [-n LINES] [-r RATE] [-b BURST] [-w WORK_US] [-c CAPACITY]
+ *
+ * The latency run writes LINES simulated outFmt 2 lines (default 200, see hc_sim.h) at RATE per second
+ * (default 20, the firmware's rate). The burst runs write BURST lines (default 20000) as fast as the pty
+ * takes them to a coroutine that spends WORK_US (default 50) on each event, with a ring of CAPACITY
+ * events (default 64): with Overflow::Block the writer is held up and nothing is lost, with
+ * Overflow::DropOldest the writer runs free and the consumer skips to the newest events.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <new>
+#include <optional>
+#include <thread>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+#include "hc_client.h"
+#include "hc_sim.h"
+
+namespace
+{
+
+const int Stamps = 4096;
+
+std::atomic<uint64_t> allocations(0);
+
+struct Options
+{
+  int lines = 200;
+  int rate = 20;
+  int burst = 20000;
+  int workUs = 50;
+  size_t capacity = 64;
+};
+
+struct Pty
+{
+  int master = -1;
+  int slave = -1;
+
+  ~Pty()
+  {
+    close(slave);
+    close(master);
+  }
+
+  bool open()
+  {
+    master = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0 || ptsname(master) == nullptr)
+      return false;
+    slave = hc::openPort(ptsname(master), 115200);
+    return slave >= 0;
+  }
+};
+
+bool writeAll(int fd, const char *data, size_t size)
+{
+  while (size > 0)
+  {
+    ssize_t count = write(fd, data, size);
+    if (count < 0 && errno == EINTR)
+      continue;
+    if (count < 0)
+      return false;
+    data += count;
+    size -= count;
+  }
+  return true;
+}
+
+/**
+ * @brief Writes lines at the rate, or as fast as the pty takes them at rate 0, stamping each
+ *
+ * @return microseconds spent in write(), i.e. held back by a full pty
+ */
+int64_t writeLines(int fd, int lines, int rate, std::atomic<int64_t> *sentUs)
+{
+  hc::SimulatedModule module(1, 2);
+  char line[hc::SimulatedModule::MaxLine];
+  int64_t startUs = hc::Client::nowUs(), writingUs = 0;
+
+  for (int i = 0; i < lines; i++)
+  {
+    if (rate > 0)
+    {
+      int64_t dueUs = startUs + (int64_t)i * 1000000 / rate;
+      timespec until = {(time_t)(dueUs / 1000000), (long)(dueUs % 1000000 * 1000)};
+      clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, nullptr);
+    }
+
+    size_t size = module.check(line);
+    int64_t before = hc::Client::nowUs();
+    if (sentUs != nullptr)
+      sentUs[i % Stamps].store(before, std::memory_order_release);
+    if (!writeAll(fd, line, size))
+      break;
+    writingUs += hc::Client::nowUs() - before;
+  }
+
+  return writingUs;
+}
+
+/**
+ * @brief Stamps each event as it resumes, counting the heap allocations made from the first event on
+ */
+hc::Task collect(hc::Client &client, int lines, const std::atomic<int64_t> *sentUs, std::vector<int64_t> &latencies,
+                 uint64_t &allocated)
+{
+  uint64_t allocationsBefore = 0;
+  for (int i = 0; i < lines; i++)
+  {
+    std::optional<hc::Update> update = co_await client.nextEvent();
+    if (!update)
+      break;
+    latencies.push_back(hc::Client::nowUs() - sentUs[i % Stamps].load(std::memory_order_acquire));
+    if (i == 0)
+      allocationsBefore = allocations;
+  }
+  allocated = allocations - allocationsBefore;
+}
+
+/**
+ * @brief Takes events until every written line is accounted for, received, dropped or rejected
+ */
+hc::Task consumeSlowly(hc::Client &client, int lines, int workUs, int &received)
+{
+  while (received + client.dropped() + client.rejected() < (uint64_t)lines)
+  {
+    std::optional<hc::Update> update = co_await client.nextEvent();
+    if (!update)
+      break;
+    received++;
+
+    int64_t until = hc::Client::nowUs() + workUs;
+    while (hc::Client::nowUs() < until)
+      ;
+  }
+}
+
+bool latencyRun(const Options &options)
+{
+  Pty pty;
+  if (!pty.open())
+  {
+    perror("pty");
+    return false;
+  }
+
+  hc::Client client(options.capacity);
+  client.attach(pty.slave);
+  std::vector<std::atomic<int64_t>> sentUs(Stamps);
+  std::vector<int64_t> latencies;
+  latencies.reserve(options.lines);
+
+  uint64_t allocated = 0;
+  hc::Task task = collect(client, options.lines, sentUs.data(), latencies, allocated);
+  std::thread writer(writeLines, pty.master, options.lines, options.rate, sentUs.data());
+  while (!task.done() && client.poll(100))
+    ;
+  writer.join();
+
+  if (latencies.empty())
+  {
+    printf("no events received\n");
+    return false;
+  }
+
+  std::sort(latencies.begin(), latencies.end());
+  int64_t total = 0;
+  for (int64_t us : latencies)
+    total += us;
+  auto at = [&](double fraction)
+  { return (long long)latencies[std::min(latencies.size() - 1, (size_t)(latencies.size() * fraction))]; };
+
+  printf("latency, %zu lines at %dHz: mean %lld us, p50 %lld us, p99 %lld us, max %lld us\n", latencies.size(), options.rate,
+         (long long)(total / (int64_t)latencies.size()), at(0.5), at(0.99), (long long)latencies.back());
+  printf("heap allocations after the first event: %llu (%.3f per event)\n\n", (unsigned long long)allocated,
+         (double)allocated / latencies.size());
+  return true;
+}
+
+bool burstRun(const Options &options, hc::Overflow overflow)
+{
+  Pty pty;
+  if (!pty.open())
+  {
+    perror("pty");
+    return false;
+  }
+
+  hc::Client client(options.capacity, overflow);
+  client.attach(pty.slave);
+  int received = 0;
+  int64_t writingUs = 0, startUs = hc::Client::nowUs();
+
+  hc::Task task = consumeSlowly(client, options.burst, options.workUs, received);
+  std::thread writer([&]
+                     { writingUs = writeLines(pty.master, options.burst, 0, nullptr); });
+  while (!task.done() && client.poll(100))
+    ;
+  writer.join();
+  double seconds = (hc::Client::nowUs() - startUs) / 1e6;
+
+  printf("%-12s %10d %10d %10llu %14.0f %16.2f\n", overflow == hc::Overflow::Block ? "block" : "drop oldest", options.burst, received,
+         (unsigned long long)client.dropped(), received / seconds, writingUs / 1e6);
+  return true;
+}
+
+void usage()
+{
+  fprintf(stderr, "usage: hc_client_bench [-n LINES] [-r RATE] [-b BURST] [-w WORK_US] [-c CAPACITY]\n");
+}
+
+} // namespace
+
+// Counts every allocation; noinline keeps GCC from pairing the inlined malloc and free as mismatched
+__attribute__((noinline)) void *operator new(size_t size)
+{
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void *memory = malloc(size ? size : 1))
+    return memory;
+  throw std::bad_alloc();
+}
+
+__attribute__((noinline)) void operator delete(void *memory) noexcept
+{
+  free(memory);
+}
+
+__attribute__((noinline)) void operator delete(void *memory, size_t) noexcept
+{
+  free(memory);
+}
+
+int main(int argc, char **argv)
+{
+  Options options;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:r:b:w:c:")) != -1)
+  {
+    switch (opt)
+    {
+    case 'n':
+      options.lines = std::clamp(atoi(optarg), 1, Stamps);
+      break;
+    case 'r':
+      options.rate = std::clamp(atoi(optarg), 1, 10000);
+      break;
+    case 'b':
+      options.burst = std::max(atoi(optarg), 1);
+      break;
+    case 'w':
+      options.workUs = std::max(atoi(optarg), 0);
+      break;
+    case 'c':
+      options.capacity = std::max(atoi(optarg), 1);
+      break;
+    default:
+      usage();
+      return 1;
+    }
+  }
+
+  if (optind != argc)
+  {
+    usage();
+    return 1;
+  }
+
+  if (!latencyRun(options))
+    return 1;
+
+  printf("burst of %d lines, %d us of work per event, ring of %zu\n", options.burst, options.workUs, options.capacity);
+  printf("%-12s %10s %10s %10s %14s %16s\n", "overflow", "written", "received", "dropped", "events/s", "writer held s");
+  return burstRun(options, hc::Overflow::Block) && burstRun(options, hc::Overflow::DropOldest) ? 0 : 1;
+}
@@ -0,0 +1,97 @@
+/**
+ * Example client (see hc_client.h): prints a module's state changes and how long each touch or join
+ * lasted, written as one coroutine reading events in a plain loop.
+ *
+ * Build:
+ *   g++ -std=c++20 -O2 -o hc_client_example tools/hc_client_example.cpp
+ *
+ * Usage:
+ *   hc_client_example [-b BAUD] PORT
+ *
+ * Try it without a module on a pty from hc_replay, e.g. `hc_replay -d /tmp/hc sim &` then
+ * `hc_client_example /tmp/hc/hc0`.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <optional>
+#include <unistd.h>
+
+#include "hc_client.h"
+
+namespace
+{
+
+const char *const StateNames[] = {"idle", "left", "right", "both", "joined"};
+
+hc::Task printChanges(hc::Client &client)
+{
+  std::optional<hc::State> last;
+  int64_t sinceUs = 0;
+
+  while (std::optional<hc::Update> update = co_await client.nextEvent())
+  {
+    hc::State state = update->event.state;
+    if (last == state)
+      continue;
+
+    if (last)
+      printf("%-6s for %6.2f s -> ", StateNames[(int)*last], (update->receivedUs - sinceUs) / 1e6);
+    printf("%s", StateNames[(int)state]);
+    if (update->event.chainLength >= 0)
+      printf(" (chain of %d)", update->event.chainLength);
+    printf("\n");
+    fflush(stdout);
+
+    last = state;
+    sinceUs = update->receivedUs;
+  }
+
+  printf("port closed\n");
+}
+
+void usage()
+{
+  fprintf(stderr, "usage: hc_client_example [-b BAUD] PORT\n");
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+  int baud = 9600;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "b:")) != -1)
+  {
+    switch (opt)
+    {
+    case 'b':
+      baud = atoi(optarg);
+      break;
+    default:
+      usage();
+      return 1;
+    }
+  }
+
+  if (optind != argc - 1)
+  {
+    usage();
+    return 1;
+  }
+
+  hc::Client client;
+  if (!client.open(argv[optind], baud))
+  {
+    fprintf(stderr, "cannot open %s: %s\n", argv[optind], strerror(errno));
+    return 1;
+  }
+
+  hc::Task task = printChanges(client);
+  while (!task.done() && client.poll(1000))
+    ;
+
+  return 0;
+}
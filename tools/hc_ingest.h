@@ -0,0 +1,496 @@
+#pragma once
+
+/**
+ * Reads many ports at once on one thread, waiting with one of three backends chosen at run time:
+ *
+ *   poll   poll() on every port, then a read() per ready port - portable, the cost grows with the ports
+ *   epoll  epoll_wait() for the ready ports only, then a read() per ready port
+ *   uring  io_uring (Linux 6.7 and later): a multishot read per port fills buffers from a ring registered
+ *          with the kernel, and one io_uring_enter() both waits and collects every port's data, so no
+ *          read() is made at all. Built on the raw system calls, so liburing is not needed
+ *
+ *   hc::ingest::Reader reader;
+ *   reader.open(hc::ingest::Backend::Uring, ports);
+ *   reader.add(0, fd);
+ *   reader.wait(1000, [&](size_t port, const char *data, size_t size) { ... }); // size 0 - port closed
+ *
+ * A port that closes or fails is reported once with size 0 and must then be removed (and its descriptor
+ * closed) by the caller before it is added again. hc_ingest_bench compares the backends.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <poll.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <vector>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define HC_INGEST_URING 1
+#endif
+
+namespace hc
+{
+namespace ingest
+{
+
+enum class Backend
+{
+  Poll,
+  Epoll,
+  Uring
+};
+
+inline const char *backendName(Backend backend)
+{
+  return backend == Backend::Uring ? "uring" : backend == Backend::Epoll ? "epoll" : "poll";
+}
+
+inline bool parseBackend(const char *text, Backend &backend)
+{
+  for (Backend candidate : {Backend::Poll, Backend::Epoll, Backend::Uring})
+  {
+    if (strcmp(text, backendName(candidate)) == 0)
+    {
+      backend = candidate;
+      return true;
+    }
+  }
+  return false;
+}
+
+const size_t BufferSize = 1024;
+
+class Reader
+{
+public:
+  Reader() = default;
+  Reader(const Reader &) = delete;
+  Reader &operator=(const Reader &) = delete;
+
+  ~Reader() { close(); }
+
+  /**
+   * @brief Sets up for ports numbered 0 to ports - 1
+   *
+   * @return false with errno set, e.g. ENOSYS or EINVAL when the kernel lacks what uring needs
+   */
+  bool open(Backend backend, size_t ports)
+  {
+    close();
+    chosen = backend;
+    fds.assign(ports, -1);
+    buffer.resize(BufferSize);
+
+    if (backend == Backend::Epoll)
+    {
+      epoll = epoll_create1(EPOLL_CLOEXEC);
+      events.resize(std::min<size_t>(std::max<size_t>(ports, 1), 1024));
+      return epoll >= 0;
+    }
+    if (backend == Backend::Uring)
+    {
+#ifdef HC_INGEST_URING
+      return openUring(ports);
+#else
+      errno = ENOSYS;
+      return false;
+#endif
+    }
+    return true;
+  }
+
+  void close()
+  {
+    if (epoll >= 0)
+      ::close(epoll);
+    epoll = -1;
+#ifdef HC_INGEST_URING
+    closeUring();
+#endif
+  }
+
+  bool add(size_t port, int fd)
+  {
+    fds[port] = fd;
+    if (chosen == Backend::Epoll)
+    {
+      calls++;
+      epoll_event event = {};
+      event.events = EPOLLIN;
+      event.data.u64 = port;
+      return epoll_ctl(epoll, EPOLL_CTL_ADD, fd, &event) == 0;
+    }
+#ifdef HC_INGEST_URING
+    if (chosen == Backend::Uring)
+    {
+      generations[port]++;
+      armed[port] = true;
+      queueRead(port);
+    }
+#endif
+    return true;
+  }
+
+  /**
+   * @brief Stops watching a port, before its descriptor is closed
+   */
+  void remove(size_t port)
+  {
+    if (chosen == Backend::Epoll && fds[port] >= 0)
+    {
+      epoll_ctl(epoll, EPOLL_CTL_DEL, fds[port], nullptr);
+      calls++;
+    }
+#ifdef HC_INGEST_URING
+    if (chosen == Backend::Uring)
+    {
+      // Completions already on their way for the old port are recognised by generation and dropped
+      if (armed[port])
+        queueCancel(port);
+      armed[port] = false;
+      generations[port]++;
+      submitPending();
+    }
+#endif
+    fds[port] = -1;
+  }
+
+  /**
+   * @brief Waits up to timeoutMs for data, calling onData(port, data, size) for each read, size 0 when a
+   * port has closed
+   *
+   * @return false if waiting failed
+   */
+  template <typename Callback>
+  bool wait(int timeoutMs, Callback &&onData)
+  {
+    switch (chosen)
+    {
+    case Backend::Epoll:
+      return waitEpoll(timeoutMs, onData);
+    case Backend::Uring:
+#ifdef HC_INGEST_URING
+      return waitUring(timeoutMs, onData);
+#endif
+    default:
+      return waitPoll(timeoutMs, onData);
+    }
+  }
+
+  /**
+   * @brief System calls made waiting, reading and adding or removing ports
+   */
+  uint64_t systemCalls() const { return calls; }
+
+private:
+  Backend chosen = Backend::Poll;
+  std::vector<int> fds;
+  std::vector<char> buffer;
+  uint64_t calls = 0;
+
+  std::vector<pollfd> watches;
+  int epoll = -1;
+  std::vector<epoll_event> events;
+
+  /**
+   * @brief One read per ready port: a short read leaves it drained, and a full one is reported ready again
+   * by the next wait, so reading until EAGAIN would only add a system call
+   */
+  template <typename Callback>
+  void readReady(size_t port, Callback &onData)
+  {
+    ssize_t count = read(fds[port], buffer.data(), buffer.size());
+    calls++;
+    if (count > 0)
+      onData(port, buffer.data(), (size_t)count);
+    else if (count == 0 || (errno != EAGAIN && errno != EINTR))
+      onData(port, buffer.data(), 0);
+  }
+
+  template <typename Callback>
+  bool waitPoll(int timeoutMs, Callback &onData)
+  {
+    watches.clear();
+    for (int fd : fds)
+      watches.push_back({fd, POLLIN, 0});
+
+    calls++;
+    if (poll(watches.data(), watches.size(), timeoutMs) < 0)
+      return errno == EINTR;
+
+    for (size_t port = 0; port < watches.size(); port++)
+    {
+      if (watches[port].fd >= 0 && fds[port] == watches[port].fd && (watches[port].revents & (POLLIN | POLLHUP | POLLERR)))
+        readReady(port, onData);
+    }
+    return true;
+  }
+
+  template <typename Callback>
+  bool waitEpoll(int timeoutMs, Callback &onData)
+  {
+    calls++;
+    int ready = epoll_wait(epoll, events.data(), events.size(), timeoutMs);
+    if (ready < 0)
+      return errno == EINTR;
+
+    for (int i = 0; i < ready; i++)
+    {
+      size_t port = events[i].data.u64;
+      if (fds[port] >= 0)
+        readReady(port, onData);
+    }
+    return true;
+  }
+
+#ifdef HC_INGEST_URING
+  static const uint8_t OpReadMultishot = 49; // IORING_OP_READ_MULTISHOT, newer than some kernel headers
+  static const uint16_t BufferGroup = 0;
+
+  int ring = -1;
+  uint8_t *sqMap = nullptr, *cqMap = nullptr;
+  size_t sqMapSize = 0, cqMapSize = 0;
+  io_uring_sqe *sqes = nullptr;
+  size_t sqesSize = 0;
+  std::atomic<unsigned> *sqTail = nullptr, *cqHead = nullptr, *cqTail = nullptr;
+  unsigned *sqArray = nullptr;
+  unsigned sqMask = 0, cqMask = 0, sqEntries = 0;
+  io_uring_cqe *cqes = nullptr;
+  unsigned queued = 0;
+
+  io_uring_buf_ring *bufferRing = nullptr;
+  size_t bufferRingSize = 0;
+  std::vector<char> buffers;
+  unsigned bufferCount = 0;
+  uint16_t bufferTail = 0;
+
+  std::vector<uint32_t> generations;
+  std::vector<bool> armed;
+
+  static unsigned powerOfTwo(size_t atLeast)
+  {
+    unsigned size = 1;
+    while (size < atLeast)
+      size <<= 1;
+    return size;
+  }
+
+  bool openUring(size_t ports)
+  {
+    generations.assign(ports, 0);
+    armed.assign(ports, false);
+
+    io_uring_params params = {};
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_COOP_TASKRUN;
+    params.cq_entries = std::max(4096u, powerOfTwo(ports * 8));
+    ring = (int)syscall(__NR_io_uring_setup, std::max(64u, powerOfTwo(ports)), &params);
+    if (ring < 0 || !(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_EXT_ARG) ||
+        !supportsMultishotRead())
+    {
+      closeUring();
+      errno = ring < 0 ? errno : ENOSYS;
+      return false;
+    }
+
+    // Single mmap kernels share one mapping between the two rings
+    sqMapSize = cqMapSize = std::max(params.sq_off.array + params.sq_entries * sizeof(unsigned),
+                                     params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+    sqMap = cqMap = (uint8_t *)mmap(nullptr, sqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQ_RING);
+    sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    sqes = (io_uring_sqe *)mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQES);
+    if (sqMap == MAP_FAILED || sqes == MAP_FAILED)
+    {
+      sqMap = cqMap = nullptr;
+      sqes = nullptr;
+      closeUring();
+      return false;
+    }
+
+    sqTail = (std::atomic<unsigned> *)(sqMap + params.sq_off.tail);
+    sqMask = *(unsigned *)(sqMap + params.sq_off.ring_mask);
+    sqArray = (unsigned *)(sqMap + params.sq_off.array);
+    sqEntries = params.sq_entries;
+    cqHead = (std::atomic<unsigned> *)(cqMap + params.cq_off.head);
+    cqTail = (std::atomic<unsigned> *)(cqMap + params.cq_off.tail);
+    cqMask = *(unsigned *)(cqMap + params.cq_off.ring_mask);
+    cqes = (io_uring_cqe *)(cqMap + params.cq_off.cqes);
+
+    // Four buffers a port gives room for bursts before a port's reads stop for want of one
+    bufferCount = std::min(32768u, std::max(64u, powerOfTwo(ports * 4)));
+    bufferRingSize = bufferCount * sizeof(io_uring_buf);
+    void *memory = mmap(nullptr, bufferRingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED)
+    {
+      closeUring();
+      return false;
+    }
+    bufferRing = (io_uring_buf_ring *)memory;
+    buffers.resize((size_t)bufferCount * BufferSize);
+
+    io_uring_buf_reg registration = {};
+    registration.ring_addr = (uint64_t)(uintptr_t)bufferRing;
+    registration.ring_entries = bufferCount;
+    registration.bgid = BufferGroup;
+    if (syscall(__NR_io_uring_register, ring, IORING_REGISTER_PBUF_RING, &registration, 1) != 0)
+    {
+      closeUring();
+      return false;
+    }
+
+    for (unsigned id = 0; id < bufferCount; id++)
+      recycle(id);
+    return true;
+  }
+
+  void closeUring()
+  {
+    if (sqMap != nullptr)
+      munmap(sqMap, sqMapSize);
+    if (sqes != nullptr)
+      munmap(sqes, sqesSize);
+    if (bufferRing != nullptr)
+      munmap(bufferRing, bufferRingSize);
+    if (ring >= 0)
+      ::close(ring);
+    sqMap = cqMap = nullptr;
+    sqes = nullptr;
+    bufferRing = nullptr;
+    ring = -1;
+    bufferTail = 0;
+    queued = 0;
+  }
+
+  bool supportsMultishotRead()
+  {
+    std::vector<uint8_t> memory(sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op), 0);
+    io_uring_probe *probe = (io_uring_probe *)memory.data();
+    if (syscall(__NR_io_uring_register, ring, IORING_REGISTER_PROBE, probe, 256) != 0)
+      return false;
+    return probe->last_op >= OpReadMultishot && (probe->ops[OpReadMultishot].flags & IO_URING_OP_SUPPORTED);
+  }
+
+  /**
+   * @brief Hands a buffer back to the kernel
+   */
+  void recycle(unsigned id)
+  {
+    // Indexed by hand: as C++ the header's flexible array starts 8 bytes late, after an empty struct of size 1
+    io_uring_buf &slot = ((io_uring_buf *)bufferRing)[bufferTail & (bufferCount - 1)];
+    slot.addr = (uint64_t)(uintptr_t)(buffers.data() + (size_t)id * BufferSize);
+    slot.len = BufferSize;
+    slot.bid = (uint16_t)id;
+    bufferTail++;
+    __atomic_store_n(&bufferRing->tail, bufferTail, __ATOMIC_RELEASE);
+  }
+
+  io_uring_sqe *nextEntry()
+  {
+    if (queued == sqEntries)
+      submitPending();
+
+    unsigned tail = sqTail->load(std::memory_order_relaxed) + queued;
+    io_uring_sqe *entry = &sqes[tail & sqMask];
+    memset(entry, 0, sizeof(*entry));
+    sqArray[tail & sqMask] = tail & sqMask;
+    queued++;
+    return entry;
+  }
+
+  uint64_t tag(size_t port) const { return (uint64_t)generations[port] << 32 | port; }
+
+  void queueRead(size_t port)
+  {
+    io_uring_sqe *entry = nextEntry();
+    entry->opcode = OpReadMultishot;
+    entry->fd = fds[port];
+    entry->flags = IOSQE_BUFFER_SELECT;
+    entry->buf_group = BufferGroup;
+    entry->user_data = tag(port);
+  }
+
+  void queueCancel(size_t port)
+  {
+    io_uring_sqe *entry = nextEntry();
+    entry->opcode = IORING_OP_ASYNC_CANCEL;
+    entry->addr = tag(port);
+    entry->user_data = UINT64_MAX;
+  }
+
+  /**
+   * @brief Makes queued entries visible to the kernel and submits them, waiting for a completion if asked
+   */
+  int enter(unsigned waitFor, int timeoutMs)
+  {
+    sqTail->store(sqTail->load(std::memory_order_relaxed) + queued, std::memory_order_release);
+    unsigned submitting = queued;
+    queued = 0;
+
+    __kernel_timespec timeout = {timeoutMs / 1000, (timeoutMs % 1000) * 1000000LL};
+    io_uring_getevents_arg arg = {};
+    arg.sigmask_sz = _NSIG / 8;
+    arg.ts = (uint64_t)(uintptr_t)&timeout;
+
+    calls++;
+    return (int)syscall(__NR_io_uring_enter, ring, submitting, waitFor, waitFor ? IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG : 0,
+                        waitFor ? &arg : nullptr, waitFor ? sizeof(arg) : 0);
+  }
+
+  void submitPending()
+  {
+    if (queued > 0)
+      enter(0, 0);
+  }
+
+  template <typename Callback>
+  bool waitUring(int timeoutMs, Callback &onData)
+  {
+    // Submitting and waiting share one system call, skipped when completions are already waiting
+    unsigned head = cqHead->load(std::memory_order_relaxed);
+    if (head == cqTail->load(std::memory_order_acquire) &&
+        enter(1, timeoutMs) < 0 && errno != ETIME && errno != EINTR && errno != EBUSY)
+      return false;
+
+    unsigned tail = cqTail->load(std::memory_order_acquire);
+    for (; head != tail; head++)
+    {
+      io_uring_cqe cqe = cqes[head & cqMask];
+      size_t port = (size_t)(uint32_t)cqe.user_data;
+      bool current = cqe.user_data != UINT64_MAX && port < fds.size() && (uint32_t)(cqe.user_data >> 32) == generations[port];
+
+      if (cqe.flags & IORING_CQE_F_BUFFER)
+      {
+        unsigned id = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+        if (current && cqe.res > 0)
+          onData(port, buffers.data() + (size_t)id * BufferSize, (size_t)cqe.res);
+        recycle(id);
+      }
+
+      if (!current || (cqe.flags & IORING_CQE_F_MORE))
+        continue;
+
+      // The multishot read has ended: rearm it if it only ran out of buffers, otherwise the port is done
+      current = generations[port] == (uint32_t)(cqe.user_data >> 32); // onData may have removed the port
+      if (current && (cqe.res > 0 || cqe.res == -ENOBUFS))
+        queueRead(port);
+      else if (current)
+      {
+        armed[port] = false;
+        onData(port, buffers.data(), 0);
+      }
+    }
+    cqHead->store(head, std::memory_order_release);
+    return true;
+  }
+#endif
+};
+
+} // namespace ingest
+} // namespace hc
@@ -0,0 +1,251 @@
+/**
+ * Compares the ingestion backends (see hc_ingest.h) reading hundreds of simulated modules over ptys: the
+ * system calls and CPU time the reading thread spends per line, and how long lines take to reach it.
+ *
+ * Build:
+ *   g++ -std=c++17 -O2 -pthread -o hc_ingest_bench tools/hc_ingest_bench.cpp
+ *
+ * Usage:
+ *   hc_ingest_bench [-n MODULES] [-r RATE] [-f FORMAT] [-t SECONDS]
+ *
+ * MODULES simulated modules (default 300, see hc_sim.h) print outFmt FORMAT lines (default 2) RATE times a
+ * second (default 20) each onto their own pty, spread evenly over the interval, from one writer thread.
+ * Each backend reads them for SECONDS (default 5) on the main thread, the way hc_logger record does. Lines
+ * are stamped as they are written and again when their line break is read. Backends the kernel cannot
+ * run (uring needs Linux 6.7) are skipped with the reason.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <string>
+#include <thread>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+#include "hc_ingest.h"
+#include "hc_serial.h"
+#include "hc_sim.h"
+
+namespace
+{
+
+const int Stamps = 64; // lines a module can have in flight
+
+struct Options
+{
+  int modules = 300;
+  int rate = 20;
+  int format = 2;
+  int seconds = 5;
+};
+
+struct Module
+{
+  std::unique_ptr<hc::SimulatedModule> simulation;
+  int master = -1;
+  int slave = -1;
+  std::atomic<int64_t> sentUs[Stamps];
+  uint64_t written = 0;
+  uint64_t read = 0;
+  bool midLine = false;
+};
+
+int64_t nowUs()
+{
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000LL + now.tv_nsec / 1000;
+}
+
+int64_t threadCpuUs()
+{
+  timespec now;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+  return now.tv_sec * 1000000LL + now.tv_nsec / 1000;
+}
+
+bool openPty(Module &module)
+{
+  module.master = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+  if (module.master < 0 || grantpt(module.master) != 0 || unlockpt(module.master) != 0 || ptsname(module.master) == nullptr)
+    return false;
+  module.slave = hc::openPort(ptsname(module.master), 115200);
+  return module.slave >= 0;
+}
+
+/**
+ * @brief Prints every module's lines at the rate, each at its own phase of the interval, until stopped
+ *
+ * @return lines dropped because a pty was full
+ */
+uint64_t writeLines(std::vector<Module> &modules, const Options &options, const std::atomic<bool> &stop)
+{
+  int64_t intervalUs = 1000000 / options.rate;
+  int64_t startUs = nowUs();
+  char line[hc::SimulatedModule::MaxLine];
+  uint64_t dropped = 0;
+
+  for (int64_t tick = 0; !stop; tick++)
+  {
+    for (size_t i = 0; i < modules.size() && !stop; i++)
+    {
+      int64_t dueUs = startUs + tick * intervalUs + intervalUs * (int64_t)i / (int64_t)modules.size();
+      timespec until = {(time_t)(dueUs / 1000000), (long)(dueUs % 1000000 * 1000)};
+      while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, nullptr) == EINTR)
+        ;
+
+      Module &module = modules[i];
+      size_t size = module.simulation->check(line);
+      module.sentUs[module.written % Stamps].store(nowUs(), std::memory_order_release);
+      if (write(module.master, line, size) == (ssize_t)size)
+        module.written++;
+      else
+        dropped++;
+    }
+  }
+
+  return dropped;
+}
+
+void run(hc::ingest::Backend backend, const Options &options)
+{
+  std::vector<Module> modules(options.modules);
+  for (size_t i = 0; i < modules.size(); i++)
+  {
+    modules[i].simulation.reset(new hc::SimulatedModule(i, options.format));
+    if (!openPty(modules[i]))
+    {
+      fprintf(stderr, "cannot open pty %zu: %s\n", i, strerror(errno));
+      exit(1);
+    }
+  }
+
+  hc::ingest::Reader reader;
+  if (!reader.open(backend, modules.size()))
+  {
+    printf("%-6s unavailable: %s\n", hc::ingest::backendName(backend), strerror(errno));
+  }
+  else
+  {
+    for (size_t i = 0; i < modules.size(); i++)
+      reader.add(i, modules[i].slave);
+
+    std::atomic<bool> stop(false);
+    uint64_t dropped = 0;
+    std::thread writer([&]
+                       { dropped = writeLines(modules, options, stop); });
+
+    std::vector<int64_t> latencies;
+    latencies.reserve((size_t)options.modules * options.rate * options.seconds + 1024);
+    uint64_t callsBefore = reader.systemCalls(), closed = 0;
+    int64_t cpuBefore = threadCpuUs(), startUs = nowUs(), endUs = startUs + options.seconds * 1000000LL;
+
+    while (nowUs() < endUs)
+    {
+      reader.wait(100, [&](size_t port, const char *data, size_t size)
+                  {
+                    Module &module = modules[port];
+                    if (size == 0)
+                    {
+                      reader.remove(port);
+                      closed++;
+                      return;
+                    }
+
+                    int64_t readUs = nowUs();
+                    for (size_t i = 0; i < size; i++)
+                    {
+                      bool lineBreak = data[i] == '\n' || data[i] == '\r';
+                      if (lineBreak && module.midLine)
+                        latencies.push_back(readUs - module.sentUs[module.read++ % Stamps].load(std::memory_order_acquire));
+                      module.midLine = !lineBreak;
+                    } });
+    }
+
+    int64_t cpuUs = threadCpuUs() - cpuBefore, wallUs = nowUs() - startUs;
+    uint64_t calls = reader.systemCalls() - callsBefore;
+    stop = true;
+    writer.join();
+
+    std::sort(latencies.begin(), latencies.end());
+    size_t lines = latencies.size();
+    auto at = [&](double fraction)
+    { return lines ? (long long)latencies[std::min(lines - 1, (size_t)(lines * fraction))] : 0LL; };
+    long long mean = 0;
+    for (int64_t us : latencies)
+      mean += us;
+    mean = lines ? mean / (long long)lines : 0;
+
+    printf("%-6s %10zu %10.0f %10.2f %8.1f%% %10.2f %8lld %8lld %8lld %8lld", hc::ingest::backendName(backend), lines,
+           calls * 1e6 / wallUs, lines ? (double)calls / lines : 0.0, 100.0 * cpuUs / wallUs, lines ? (double)cpuUs / lines : 0.0,
+           mean, at(0.5), at(0.99), lines ? (long long)latencies.back() : 0LL);
+    if (dropped || closed)
+      printf("  %llu dropped, %llu closed", (unsigned long long)dropped, (unsigned long long)closed);
+    printf("\n");
+  }
+
+  reader.close();
+  for (Module &module : modules)
+  {
+    close(module.slave);
+    close(module.master);
+  }
+}
+
+void usage()
+{
+  fprintf(stderr, "usage: hc_ingest_bench [-n MODULES] [-r RATE] [-f FORMAT] [-t SECONDS]\n");
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+  Options options;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:r:f:t:")) != -1)
+  {
+    switch (opt)
+    {
+    case 'n':
+      options.modules = std::clamp(atoi(optarg), 1, 4096);
+      break;
+    case 'r':
+      options.rate = std::clamp(atoi(optarg), 1, 1000);
+      break;
+    case 'f':
+      options.format = std::clamp(atoi(optarg), 0, 2);
+      break;
+    case 't':
+      options.seconds = std::max(atoi(optarg), 1);
+      break;
+    default:
+      usage();
+      return 1;
+    }
+  }
+
+  if (optind != argc)
+  {
+    usage();
+    return 1;
+  }
+
+  printf("%d modules at %dHz in outFmt %d, %d s per backend\n\n", options.modules, options.rate, options.format, options.seconds);
+  printf("%-6s %10s %10s %10s %9s %10s %8s %8s %8s %8s\n", "", "lines", "calls/s", "calls/line", "cpu", "cpu us/line",
+         "mean us", "p50 us", "p99 us", "max us");
+
+  for (hc::ingest::Backend backend : {hc::ingest::Backend::Poll, hc::ingest::Backend::Epoll, hc::ingest::Backend::Uring})
+    run(backend, options);
+
+  return 0;
+}
@@ -0,0 +1,254 @@
+/**
+ * Compares how late a poll() loop like hc_logger's wakes up while other threads load every CPU, with the
+ * loop running normally, pinned to a CPU, at SCHED_FIFO priority, and all of those with memory locked
+ * (see hc_rt.h), to show what the logger's -R/-a/-l options buy on a busy show PC.
+ *
+ * Build:
+ *   g++ -std=c++17 -O2 -pthread -o hc_jitter tools/hc_jitter.cpp
+ *
+ * Usage:
+ *   hc_jitter [-t SECONDS] [-r RATE] [-j THREADS] [-a CPU] [-R PRIORITY]
+ *
+ * Each mode runs for SECONDS (default 5) on a fresh thread waiting in poll() on a timerfd that fires RATE
+ * times a second (default 1000); its lateness is the time from the timer's expiry to the thread running,
+ * the delay a line arriving at that moment would see on top of the port's own (see hc_latency). The load is
+ * THREADS threads (default one per CPU plus one) at normal priority, doing arithmetic and sweeping a buffer
+ * bigger than most caches. The loop is pinned to CPU (default the last) at PRIORITY (default 80). Modes
+ * that fall back for want of privileges are marked, and show what the logger would get without them.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <poll.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/timerfd.h>
+#include <thread>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+#include "hc_rt.h"
+
+namespace
+{
+
+const size_t LoadBufferSize = 32 * 1024 * 1024;
+
+struct Options
+{
+  int seconds = 5;
+  int rate = 1000;
+  unsigned threads = 0; // 0 - one per CPU plus one
+  int cpu = -1;         // -1 - the last
+  int priority = 80;
+};
+
+struct Mode
+{
+  const char *name;
+  bool pin;
+  bool fifo;
+  bool lock;
+};
+
+struct Result
+{
+  std::vector<int64_t> latenessUs;
+  bool applied = true;
+};
+
+int64_t toUs(const timespec &time)
+{
+  return time.tv_sec * 1000000LL + time.tv_nsec / 1000;
+}
+
+int64_t nowUs()
+{
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return toUs(now);
+}
+
+/**
+ * @brief Keeps a CPU busy the way a renderer would, with arithmetic and memory traffic
+ */
+void load(const std::atomic<bool> &stop, unsigned seed)
+{
+  std::vector<uint8_t> buffer(LoadBufferSize / 4, (uint8_t)seed);
+  uint64_t state = seed * 0x9e3779b97f4a7c15ULL + 1;
+  while (!stop.load(std::memory_order_relaxed))
+  {
+    for (size_t i = 0; i < buffer.size(); i += 64)
+    {
+      state ^= state << 13;
+      state ^= state >> 7;
+      state ^= state << 17;
+      buffer[i] += (uint8_t)state;
+    }
+  }
+}
+
+/**
+ * @brief The measured loop: waits in poll() like hc_logger and notes how late each timer expiry is seen
+ */
+Result measure(const Options &options, const Mode &mode, int cpu)
+{
+  Result result;
+  hc::Realtime realtime;
+  realtime.cpu = mode.pin ? cpu : -1;
+  realtime.priority = mode.fifo ? options.priority : 0;
+  realtime.lockMemory = mode.lock;
+  result.applied = hc::applyRealtime(realtime);
+
+  int timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (timer < 0)
+  {
+    perror("timerfd");
+    return result;
+  }
+
+  int64_t periodUs = 1000000 / options.rate;
+  timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  int64_t firstUs = toUs(start) + periodUs;
+  itimerspec schedule = {};
+  schedule.it_value.tv_sec = firstUs / 1000000;
+  schedule.it_value.tv_nsec = firstUs % 1000000 * 1000;
+  schedule.it_interval.tv_nsec = periodUs * 1000;
+  timerfd_settime(timer, TFD_TIMER_ABSTIME, &schedule, nullptr);
+
+  size_t wakeups = (size_t)options.seconds * options.rate;
+  result.latenessUs.reserve(wakeups);
+  uint64_t expiries = 0;
+  pollfd watch = {timer, POLLIN, 0};
+
+  while (result.latenessUs.size() < wakeups)
+  {
+    if (poll(&watch, 1, 1000) <= 0)
+      continue;
+
+    uint64_t count;
+    if (read(timer, &count, sizeof(count)) != (ssize_t)sizeof(count))
+      continue;
+
+    // Expiries missed while the thread was kept off the CPU count from the earliest
+    int64_t woken = nowUs();
+    int64_t expiredUs = firstUs + (int64_t)expiries * periodUs;
+    result.latenessUs.push_back(woken - expiredUs);
+    expiries += count;
+  }
+
+  close(timer);
+  if (mode.lock)
+    munlockall();
+  return result;
+}
+
+void report(const Mode &mode, std::vector<int64_t> lateness, bool applied, int64_t periodUs)
+{
+  std::sort(lateness.begin(), lateness.end());
+  int64_t total = 0;
+  size_t late = 0;
+  for (int64_t us : lateness)
+  {
+    total += us;
+    late += us > periodUs;
+  }
+
+  auto at = [&](double fraction)
+  { return (long long)lateness[std::min(lateness.size() - 1, (size_t)(lateness.size() * fraction))]; };
+  std::string name = std::string(mode.name) + (applied ? "" : " (fallback)");
+  printf("%-30s %9lld %9lld %9lld %9lld %9lld %9zu\n", name.c_str(), (long long)(total / (int64_t)lateness.size()), at(0.5),
+         at(0.99), at(0.999), (long long)lateness.back(), late);
+}
+
+void usage()
+{
+  fprintf(stderr, "usage: hc_jitter [-t SECONDS] [-r RATE] [-j THREADS] [-a CPU] [-R PRIORITY]\n");
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+  Options options;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "t:r:j:a:R:")) != -1)
+  {
+    switch (opt)
+    {
+    case 't':
+      options.seconds = std::max(atoi(optarg), 1);
+      break;
+    case 'r':
+      options.rate = std::clamp(atoi(optarg), 1, 100000);
+      break;
+    case 'j':
+      options.threads = std::max(atoi(optarg), 0);
+      break;
+    case 'a':
+      options.cpu = std::max(atoi(optarg), 0);
+      break;
+    case 'R':
+      options.priority = std::clamp(atoi(optarg), 1, 99);
+      break;
+    default:
+      usage();
+      return 1;
+    }
+  }
+
+  if (optind != argc)
+  {
+    usage();
+    return 1;
+  }
+
+  unsigned cpus = std::max(1u, std::thread::hardware_concurrency());
+  unsigned threads = options.threads ? options.threads : cpus + 1;
+  int cpu = options.cpu >= 0 ? options.cpu : (int)cpus - 1;
+  int64_t periodUs = 1000000 / options.rate;
+
+  const Mode modes[] = {
+      {"normal", false, false, false},
+      {"pinned", true, false, false},
+      {"fifo", false, true, false},
+      {"fifo, pinned, locked", true, true, true},
+  };
+
+  printf("%d s per mode at %dHz, %u load threads on %u CPUs, pinned to CPU %d, SCHED_FIFO %d\n\n", options.seconds,
+         options.rate, threads, cpus, cpu, options.priority);
+  printf("%-30s %9s %9s %9s %9s %9s %9s\n", "mode", "mean us", "p50 us", "p99 us", "p99.9 us", "max us", "> period");
+
+  for (const Mode &mode : modes)
+  {
+    std::atomic<bool> stop(false);
+    std::vector<std::thread> loaders;
+    for (unsigned i = 0; i < threads; i++)
+      loaders.emplace_back(load, std::cref(stop), i + 1);
+
+    // Let the load settle in before measuring
+    usleep(200000);
+
+    Result result;
+    std::thread measuring([&]
+                          { result = measure(options, mode, cpu); });
+    measuring.join();
+
+    stop = true;
+    for (std::thread &loader : loaders)
+      loader.join();
+
+    if (!result.latenessUs.empty())
+      report(mode, result.latenessUs, result.applied, periodUs);
+  }
+
+  return 0;
+}
@@ -0,0 +1,461 @@
+#pragma once
+
+/**
+ * Analysis kernels over columns of 16 bit telemetry samples (e.g. pad deltas from a binary log), for
+ * offline analysis of months of recordings.
+ *
+ * Every kernel has a portable scalar version and, on x86, SSE2 and AVX2 versions that give identical
+ * results. The best the CPU supports is picked at run time, so one build runs everywhere; pass an Isa
+ * to force one, as hc_kernels_bench does to compare them. histogram is the exception and runs scalar
+ * unless told otherwise, as its vector versions do not beat it (see histogram below).
+ *
+ *   hc::kernels::Summary summary = hc::kernels::summarize(samples, count);
+ */
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HC_KERNELS_X86 1
+#endif
+
+namespace hc
+{
+namespace kernels
+{
+
+enum class Isa
+{
+  Scalar,
+  Sse2,
+  Avx2
+};
+
+struct Summary
+{
+  size_t count = 0;
+  int16_t min = INT16_MAX;
+  int16_t max = INT16_MIN;
+  int64_t sum = 0;
+  uint64_t sumSquares = 0;
+
+  double mean() const { return count ? (double)sum / count : 0; }
+
+  double variance() const { return count ? (double)sumSquares / count - mean() * mean() : 0; }
+};
+
+const int MaxWindow = 256; // keeps moving averages exact in single precision
+
+inline Isa bestIsa()
+{
+#ifdef HC_KERNELS_X86
+  static const Isa best = __builtin_cpu_supports("avx2") ? Isa::Avx2 : Isa::Sse2;
+  return best;
+#else
+  return Isa::Scalar;
+#endif
+}
+
+inline const char *isaName(Isa isa)
+{
+  return isa == Isa::Avx2 ? "avx2" : isa == Isa::Sse2 ? "sse2" : "scalar";
+}
+
+namespace detail
+{
+
+inline void summarizeScalar(const int16_t *x, size_t n, Summary &s)
+{
+  for (size_t i = 0; i < n; i++)
+  {
+    s.min = std::min(s.min, x[i]);
+    s.max = std::max(s.max, x[i]);
+    s.sum += x[i];
+    s.sumSquares += (uint64_t)((int32_t)x[i] * x[i]);
+  }
+  s.count += n;
+}
+
+inline size_t crossingsScalar(const int16_t *x, size_t n, int16_t threshold)
+{
+  size_t count = 0;
+  for (size_t i = 1; i < n; i++)
+    count += x[i - 1] <= threshold && x[i] > threshold;
+  return count;
+}
+
+inline void histogramScalar(const int16_t *x, size_t n, int min, int shift, uint32_t *counts, int buckets)
+{
+  for (size_t i = 0; i < n; i++)
+  {
+    int bucket = std::clamp((x[i] - min) >> shift, 0, buckets - 1);
+    counts[bucket]++;
+  }
+}
+
+// out[i] = trunc((x[i] + ... + x[i + window - 1]) / window)
+inline void movingAverageScalar(const int16_t *x, size_t n, int window, int16_t *out)
+{
+  int32_t sum = 0;
+  for (int i = 0; i < window - 1; i++)
+    sum += x[i];
+  for (size_t i = 0; i + window <= n; i++)
+  {
+    sum += x[i + window - 1];
+    out[i] = (int16_t)(sum / window);
+    sum -= x[i];
+  }
+}
+
+#ifdef HC_KERNELS_X86
+
+inline void summarizeSse2(const int16_t *x, size_t n, Summary &s)
+{
+  __m128i vmin = _mm_set1_epi16(INT16_MAX), vmax = _mm_set1_epi16(INT16_MIN);
+  __m128i ones = _mm_set1_epi16(1), zero = _mm_setzero_si128();
+  __m128i sum64 = zero, squares64 = zero;
+  size_t i = 0;
+
+  while (i + 8 <= n)
+  {
+    // Pair sums fit 32 bit lanes for 16384 rounds, then widen
+    __m128i sum32 = zero;
+    size_t blockEnd = std::min(n & ~(size_t)7, i + 8 * 16384);
+    for (; i < blockEnd; i += 8)
+    {
+      __m128i v = _mm_loadu_si128((const __m128i *)(x + i));
+      vmin = _mm_min_epi16(vmin, v);
+      vmax = _mm_max_epi16(vmax, v);
+      sum32 = _mm_add_epi32(sum32, _mm_madd_epi16(v, ones));
+
+      // A pair of squares can reach 2^31, so they are widened unsigned every round
+      __m128i squares = _mm_madd_epi16(v, v);
+      squares64 = _mm_add_epi64(squares64, _mm_unpacklo_epi32(squares, zero));
+      squares64 = _mm_add_epi64(squares64, _mm_unpackhi_epi32(squares, zero));
+    }
+
+    __m128i sign = _mm_cmpgt_epi32(zero, sum32);
+    sum64 = _mm_add_epi64(sum64, _mm_unpacklo_epi32(sum32, sign));
+    sum64 = _mm_add_epi64(sum64, _mm_unpackhi_epi32(sum32, sign));
+  }
+
+  int16_t mins[8], maxs[8];
+  int64_t sums[2];
+  uint64_t squares[2];
+  _mm_storeu_si128((__m128i *)mins, vmin);
+  _mm_storeu_si128((__m128i *)maxs, vmax);
+  _mm_storeu_si128((__m128i *)sums, sum64);
+  _mm_storeu_si128((__m128i *)squares, squares64);
+
+  for (int lane = 0; lane < 8; lane++)
+  {
+    s.min = std::min(s.min, mins[lane]);
+    s.max = std::max(s.max, maxs[lane]);
+  }
+  s.sum += sums[0] + sums[1];
+  s.sumSquares += squares[0] + squares[1];
+  s.count += i;
+
+  summarizeScalar(x + i, n - i, s);
+}
+
+__attribute__((target("avx2"))) inline void summarizeAvx2(const int16_t *x, size_t n, Summary &s)
+{
+  __m256i vmin = _mm256_set1_epi16(INT16_MAX), vmax = _mm256_set1_epi16(INT16_MIN);
+  __m256i ones = _mm256_set1_epi16(1), zero = _mm256_setzero_si256();
+  __m256i sum64 = zero, squares64 = zero;
+  size_t i = 0;
+
+  while (i + 16 <= n)
+  {
+    __m256i sum32 = zero;
+    size_t blockEnd = std::min(n & ~(size_t)15, i + 16 * 16384);
+    for (; i < blockEnd; i += 16)
+    {
+      __m256i v = _mm256_loadu_si256((const __m256i *)(x + i));
+      vmin = _mm256_min_epi16(vmin, v);
+      vmax = _mm256_max_epi16(vmax, v);
+      sum32 = _mm256_add_epi32(sum32, _mm256_madd_epi16(v, ones));
+
+      __m256i squares = _mm256_madd_epi16(v, v);
+      squares64 = _mm256_add_epi64(squares64, _mm256_unpacklo_epi32(squares, zero));
+      squares64 = _mm256_add_epi64(squares64, _mm256_unpackhi_epi32(squares, zero));
+    }
+
+    __m256i sign = _mm256_cmpgt_epi32(zero, sum32);
+    sum64 = _mm256_add_epi64(sum64, _mm256_unpacklo_epi32(sum32, sign));
+    sum64 = _mm256_add_epi64(sum64, _mm256_unpackhi_epi32(sum32, sign));
+  }
+
+  int16_t mins[16], maxs[16];
+  int64_t sums[4];
+  uint64_t squares[4];
+  _mm256_storeu_si256((__m256i *)mins, vmin);
+  _mm256_storeu_si256((__m256i *)maxs, vmax);
+  _mm256_storeu_si256((__m256i *)sums, sum64);
+  _mm256_storeu_si256((__m256i *)squares, squares64);
+
+  for (int lane = 0; lane < 16; lane++)
+  {
+    s.min = std::min(s.min, mins[lane]);
+    s.max = std::max(s.max, maxs[lane]);
+  }
+  s.sum += sums[0] + sums[1] + sums[2] + sums[3];
+  s.sumSquares += squares[0] + squares[1] + squares[2] + squares[3];
+  s.count += i;
+
+  summarizeScalar(x + i, n - i, s);
+}
+
+inline size_t crossingsSse2(const int16_t *x, size_t n, int16_t threshold)
+{
+  __m128i t = _mm_set1_epi16(threshold);
+  size_t count = 0, i = 1;
+  for (; i + 8 <= n; i += 8)
+  {
+    __m128i above = _mm_cmpgt_epi16(_mm_loadu_si128((const __m128i *)(x + i)), t);
+    __m128i wasAbove = _mm_cmpgt_epi16(_mm_loadu_si128((const __m128i *)(x + i - 1)), t);
+    count += __builtin_popcount(_mm_movemask_epi8(_mm_andnot_si128(wasAbove, above)));
+  }
+  count /= 2; // movemask gives two bits per 16 bit lane
+
+  return count + (i < n ? crossingsScalar(x + i - 1, n - i + 1, threshold) : 0);
+}
+
+__attribute__((target("avx2"))) inline size_t crossingsAvx2(const int16_t *x, size_t n, int16_t threshold)
+{
+  __m256i t = _mm256_set1_epi16(threshold);
+  size_t count = 0, i = 1;
+  for (; i + 16 <= n; i += 16)
+  {
+    __m256i above = _mm256_cmpgt_epi16(_mm256_loadu_si256((const __m256i *)(x + i)), t);
+    __m256i wasAbove = _mm256_cmpgt_epi16(_mm256_loadu_si256((const __m256i *)(x + i - 1)), t);
+    count += __builtin_popcount(_mm256_movemask_epi8(_mm256_andnot_si256(wasAbove, above)));
+  }
+  count /= 2;
+
+  return count + (i < n ? crossingsScalar(x + i - 1, n - i + 1, threshold) : 0);
+}
+
+/**
+ * @brief Adds bucket indices to four interleaved tables, so neighbouring samples in the same bucket do not
+ * wait on each other's increments
+ */
+inline void countBuckets(const int32_t *indices, int size, uint32_t *tables, int buckets)
+{
+  for (int i = 0; i < size; i++)
+    tables[(i & 3) * buckets + indices[i]]++;
+}
+
+inline void mergeTables(const std::vector<uint32_t> &tables, uint32_t *counts, int buckets)
+{
+  for (int b = 0; b < buckets; b++)
+    counts[b] += tables[b] + tables[buckets + b] + tables[2 * buckets + b] + tables[3 * buckets + b];
+}
+
+inline void histogramSse2(const int16_t *x, size_t n, int min, int shift, uint32_t *counts, int buckets)
+{
+  std::vector<uint32_t> tables(4 * buckets, 0);
+  __m128i offset = _mm_set1_epi32(min), top = _mm_set1_epi32(buckets - 1), zero = _mm_setzero_si128();
+  __m128i shiftCount = _mm_cvtsi32_si128(shift);
+  alignas(16) int32_t indices[8];
+  size_t i = 0;
+
+  for (; i + 8 <= n; i += 8)
+  {
+    __m128i v = _mm_loadu_si128((const __m128i *)(x + i));
+    __m128i halves[2] = {_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16), _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16)};
+    for (int h = 0; h < 2; h++)
+    {
+      __m128i bucket = _mm_sra_epi32(_mm_sub_epi32(halves[h], offset), shiftCount);
+      bucket = _mm_and_si128(bucket, _mm_cmpgt_epi32(bucket, zero)); // max(bucket, 0)
+      __m128i over = _mm_cmpgt_epi32(bucket, top);
+      bucket = _mm_or_si128(_mm_andnot_si128(over, bucket), _mm_and_si128(over, top));
+      _mm_store_si128((__m128i *)(indices + 4 * h), bucket);
+    }
+    countBuckets(indices, 8, tables.data(), buckets);
+  }
+
+  mergeTables(tables, counts, buckets);
+  histogramScalar(x + i, n - i, min, shift, counts, buckets);
+}
+
+__attribute__((target("avx2"))) inline void histogramAvx2(const int16_t *x, size_t n, int min, int shift, uint32_t *counts, int buckets)
+{
+  std::vector<uint32_t> tables(4 * buckets, 0);
+  __m256i offset = _mm256_set1_epi32(min), top = _mm256_set1_epi32(buckets - 1), zero = _mm256_setzero_si256();
+  __m128i shiftCount = _mm_cvtsi32_si128(shift);
+  alignas(32) int32_t indices[16];
+  size_t i = 0;
+
+  for (; i + 16 <= n; i += 16)
+  {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(x + i));
+    __m256i halves[2] = {_mm256_cvtepi16_epi32(_mm256_castsi256_si128(v)), _mm256_cvtepi16_epi32(_mm256_extracti128_si256(v, 1))};
+    for (int h = 0; h < 2; h++)
+    {
+      __m256i bucket = _mm256_sra_epi32(_mm256_sub_epi32(halves[h], offset), shiftCount);
+      bucket = _mm256_min_epi32(_mm256_max_epi32(bucket, zero), top);
+      _mm256_store_si256((__m256i *)(indices + 8 * h), bucket);
+    }
+    countBuckets(indices, 16, tables.data(), buckets);
+  }
+
+  mergeTables(tables, counts, buckets);
+  histogramScalar(x + i, n - i, min, shift, counts, buckets);
+}
+
+/**
+ * @brief Each window's sum is the previous one plus the sample entering minus the one leaving, so the
+ * changes are taken a vector at a time and summed in register, then divided in single precision
+ */
+inline void movingAverageSse2(const int16_t *x, size_t n, int window, int16_t *out)
+{
+  int32_t first = 0;
+  for (int i = 0; i < window; i++)
+    first += x[i];
+  out[0] = (int16_t)(first / window);
+
+  size_t outputs = n - window + 1, i = 1;
+  __m128 divisor = _mm_set1_ps((float)window);
+  __m128i carry = _mm_set1_epi32(first);
+  for (; i + 4 <= outputs; i += 4)
+  {
+    __m128i entering = _mm_loadl_epi64((const __m128i *)(x + i + window - 1));
+    __m128i leaving = _mm_loadl_epi64((const __m128i *)(x + i - 1));
+    __m128i change = _mm_sub_epi32(_mm_srai_epi32(_mm_unpacklo_epi16(entering, entering), 16),
+                                   _mm_srai_epi32(_mm_unpacklo_epi16(leaving, leaving), 16));
+    change = _mm_add_epi32(change, _mm_slli_si128(change, 4));
+    change = _mm_add_epi32(change, _mm_slli_si128(change, 8));
+    __m128i sums = _mm_add_epi32(change, carry);
+    carry = _mm_shuffle_epi32(sums, 0xFF);
+
+    __m128i means = _mm_cvttps_epi32(_mm_div_ps(_mm_cvtepi32_ps(sums), divisor));
+    _mm_storel_epi64((__m128i *)(out + i), _mm_packs_epi32(means, means));
+  }
+
+  int32_t sum = _mm_cvtsi128_si32(carry);
+  for (; i < outputs; i++)
+  {
+    sum += x[i + window - 1] - x[i - 1];
+    out[i] = (int16_t)(sum / window);
+  }
+}
+
+__attribute__((target("avx2"))) inline void movingAverageAvx2(const int16_t *x, size_t n, int window, int16_t *out)
+{
+  int32_t first = 0;
+  for (int i = 0; i < window; i++)
+    first += x[i];
+  out[0] = (int16_t)(first / window);
+
+  size_t outputs = n - window + 1, i = 1;
+  __m256 divisor = _mm256_set1_ps((float)window);
+  __m256i carry = _mm256_set1_epi32(first), last = _mm256_set1_epi32(7);
+  for (; i + 8 <= outputs; i += 8)
+  {
+    __m256i change = _mm256_sub_epi32(_mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(x + i + window - 1))),
+                                      _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(x + i - 1))));
+
+    // Running total within each 128 bit half, then the low half's total carried into the high half
+    change = _mm256_add_epi32(change, _mm256_slli_si256(change, 4));
+    change = _mm256_add_epi32(change, _mm256_slli_si256(change, 8));
+    __m256i lowTotal = _mm256_permute2x128_si256(change, change, 0x08);
+    change = _mm256_add_epi32(change, _mm256_shuffle_epi32(lowTotal, 0xFF));
+    __m256i sums = _mm256_add_epi32(change, carry);
+    carry = _mm256_permutevar8x32_epi32(sums, last);
+
+    __m256i means = _mm256_cvttps_epi32(_mm256_div_ps(_mm256_cvtepi32_ps(sums), divisor));
+    __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(means, means), 0x08);
+    _mm_storeu_si128((__m128i *)(out + i), _mm256_castsi256_si128(packed));
+  }
+
+  int32_t sum = _mm256_cvtsi256_si32(carry);
+  for (; i < outputs; i++)
+  {
+    sum += x[i + window - 1] - x[i - 1];
+    out[i] = (int16_t)(sum / window);
+  }
+}
+
+#endif
+
+} // namespace detail
+
+/**
+ * @brief Count, min, max, sum and sum of squares of the samples, for mean and variance
+ */
+inline Summary summarize(const int16_t *x, size_t n, Isa isa = bestIsa())
+{
+  Summary summary;
+#ifdef HC_KERNELS_X86
+  if (isa == Isa::Avx2)
+    detail::summarizeAvx2(x, n, summary);
+  else if (isa == Isa::Sse2)
+    detail::summarizeSse2(x, n, summary);
+  else
+#endif
+    detail::summarizeScalar(x, n, summary);
+
+  (void)isa;
+  return summary;
+}
+
+/**
+ * @brief Counts the samples that rise above the threshold from at or below it, e.g. touches
+ */
+inline size_t countCrossings(const int16_t *x, size_t n, int16_t threshold, Isa isa = bestIsa())
+{
+  (void)isa;
+#ifdef HC_KERNELS_X86
+  if (isa == Isa::Avx2)
+    return detail::crossingsAvx2(x, n, threshold);
+  if (isa == Isa::Sse2)
+    return detail::crossingsSse2(x, n, threshold);
+#endif
+  return detail::crossingsScalar(x, n, threshold);
+}
+
+/**
+ * @brief Adds the samples to counts[buckets], bucket (x - min) >> shift, clamped to the first and last
+ *
+ * Scalar by default: the increments are scattered stores whichever way the buckets are worked out, and the
+ * vector versions measured 0.88-1.19x (SSE2) and 0.98-1.11x (AVX2) of it in hc_kernels_bench, within run
+ * to run noise. They stay for comparison.
+ */
+inline void histogram(const int16_t *x, size_t n, int min, int shift, uint32_t *counts, int buckets, Isa isa = Isa::Scalar)
+{
+  (void)isa;
+#ifdef HC_KERNELS_X86
+  if (isa == Isa::Avx2)
+    return detail::histogramAvx2(x, n, min, shift, counts, buckets);
+  if (isa == Isa::Sse2)
+    return detail::histogramSse2(x, n, min, shift, counts, buckets);
+#endif
+  detail::histogramScalar(x, n, min, shift, counts, buckets);
+}
+
+/**
+ * @brief Writes the n - window + 1 trailing window means, truncated toward zero. window is 1 to MaxWindow
+ */
+inline void movingAverage(const int16_t *x, size_t n, int window, int16_t *out, Isa isa = bestIsa())
+{
+  (void)isa;
+  window = std::clamp(window, 1, MaxWindow);
+  if ((size_t)window > n)
+    return;
+
+#ifdef HC_KERNELS_X86
+  if (isa == Isa::Avx2)
+    return detail::movingAverageAvx2(x, n, window, out);
+  if (isa == Isa::Sse2)
+    return detail::movingAverageSse2(x, n, window, out);
+#endif
+  detail::movingAverageScalar(x, n, window, out);
+}
+
+} // namespace kernels
+} // namespace hc
@@ -0,0 +1,247 @@
+/**
+ * Times the analysis kernels (see hc_kernels.h) in each instruction set the CPU supports against the
+ * scalar versions, checking that they all agree.
+ *
+ * Build:
+ *   g++ -std=c++17 -O2 -o hc_kernels_bench tools/hc_kernels_bench.cpp
+ *
+ * Usage:
+ *   hc_kernels_bench [-n MILLIONS] [-w WINDOW]
+ *
+ * The samples are a synthetic pad delta trace of MILLIONS million samples (default 64, about an hour of
+ * 20Hz telemetry from 900 modules, up to 256): noise around the baseline with touches rising past the
+ * threshold. Each kernel runs five times per instruction set and the fastest run is reported. Every
+ * length up to 300 from a few unaligned starts is then checked against scalar too, as the timed lengths
+ * are whole millions and never leave the vector loops a tail. The exit status is 1 on any mismatch.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <random>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "hc_kernels.h"
+
+namespace
+{
+
+using hc::kernels::Isa;
+
+const int Runs = 5;
+const int16_t Threshold = 1000;
+const int HistogramMin = -2048;
+const int HistogramShift = 6;
+const int HistogramBuckets = 128;
+const int MaxMillions = 256; // the trace and the moving averages take 4 bytes a sample
+const size_t TailLengths = 300;
+const size_t TailStarts[] = {1, 3, 1001, 20007, 123457};
+
+std::vector<int16_t> makeTrace(size_t count)
+{
+  std::vector<int16_t> samples(count);
+  std::mt19937 random(1);
+  std::normal_distribution<float> noise(0, 40);
+  int level = 0, target = 0;
+
+  for (size_t i = 0; i < count; i++)
+  {
+    if (random() % 200 == 0)
+      target = target ? 0 : 1500 + (int)(random() % 500);
+    level += (target - level) / 3;
+    samples[i] = (int16_t)std::clamp(level + (int)noise(random), -32768, 32767);
+  }
+
+  return samples;
+}
+
+double bestSeconds(const std::function<void()> &kernel)
+{
+  double best = 1e9;
+  for (int run = 0; run < Runs; run++)
+  {
+    auto start = std::chrono::steady_clock::now();
+    kernel();
+    best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+  }
+  return best;
+}
+
+void report(const char *kernel, Isa isa, double seconds, double scalarSeconds, size_t count, bool agrees)
+{
+  printf("%-16s %-7s %9.2f ms %9.2f Gsample/s %8.2fx%s\n", kernel, hc::kernels::isaName(isa), seconds * 1000,
+         count / seconds / 1e9, scalarSeconds / seconds, agrees ? "" : "  MISMATCH");
+}
+
+bool sameSummary(const hc::kernels::Summary &a, const hc::kernels::Summary &b)
+{
+  return a.min == b.min && a.max == b.max && a.sum == b.sum && a.sumSquares == b.sumSquares && a.count == b.count;
+}
+
+/**
+ * @brief Runs every kernel over short stretches of every length, so the tail after the last full vector
+ * is covered in each instruction set
+ *
+ * @return the first mismatch with scalar, empty if there is none
+ */
+std::string checkTails(const std::vector<int16_t> &samples, const std::vector<Isa> &isas, int window)
+{
+  std::vector<uint32_t> expectedCounts(HistogramBuckets), counts(HistogramBuckets);
+  std::vector<int16_t> expectedAverages(TailLengths), averages(TailLengths);
+
+  for (size_t start : TailStarts)
+  {
+    for (size_t n = 0; n <= TailLengths && start + n <= samples.size(); n++)
+    {
+      const int16_t *x = samples.data() + start;
+      hc::kernels::Summary expectedSummary = hc::kernels::summarize(x, n, Isa::Scalar);
+      size_t expectedCrossings = hc::kernels::countCrossings(x, n, Threshold, Isa::Scalar);
+      std::fill(expectedCounts.begin(), expectedCounts.end(), 0);
+      hc::kernels::histogram(x, n, HistogramMin, HistogramShift, expectedCounts.data(), HistogramBuckets, Isa::Scalar);
+      hc::kernels::movingAverage(x, n, window, expectedAverages.data(), Isa::Scalar);
+      size_t outputs = n >= (size_t)window ? n - window + 1 : 0;
+
+      for (Isa isa : isas)
+      {
+        std::string where = std::string(" ") + hc::kernels::isaName(isa) + " at " + std::to_string(start) + ", length " + std::to_string(n);
+        if (!sameSummary(hc::kernels::summarize(x, n, isa), expectedSummary))
+          return "min/max/variance" + where;
+        if (hc::kernels::countCrossings(x, n, Threshold, isa) != expectedCrossings)
+          return "crossings" + where;
+
+        std::fill(counts.begin(), counts.end(), 0);
+        hc::kernels::histogram(x, n, HistogramMin, HistogramShift, counts.data(), HistogramBuckets, isa);
+        if (counts != expectedCounts)
+          return "histogram" + where;
+
+        hc::kernels::movingAverage(x, n, window, averages.data(), isa);
+        if (!std::equal(averages.begin(), averages.begin() + outputs, expectedAverages.begin()))
+          return "moving average" + where;
+      }
+    }
+  }
+
+  return "";
+}
+
+void usage()
+{
+  fprintf(stderr, "usage: hc_kernels_bench [-n MILLIONS] [-w WINDOW]\n");
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+  size_t count = 64;
+  int window = 8;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:w:")) != -1)
+  {
+    switch (opt)
+    {
+    case 'n':
+      count = std::clamp(atoi(optarg), 1, MaxMillions);
+      break;
+    case 'w':
+      window = std::clamp(atoi(optarg), 1, hc::kernels::MaxWindow);
+      break;
+    default:
+      usage();
+      return 1;
+    }
+  }
+  count *= 1000000;
+
+  std::vector<int16_t> samples = makeTrace(count);
+  std::vector<Isa> isas = {Isa::Scalar};
+  if (hc::kernels::bestIsa() != Isa::Scalar)
+    isas.push_back(Isa::Sse2);
+  if (hc::kernels::bestIsa() == Isa::Avx2)
+    isas.push_back(Isa::Avx2);
+
+  printf("%zu samples, moving average window %d, best of %d runs\n\n", count, window, Runs);
+  bool allAgree = true;
+
+  hc::kernels::Summary expectedSummary;
+  double scalarSeconds = 0;
+  for (Isa isa : isas)
+  {
+    hc::kernels::Summary summary;
+    double seconds = bestSeconds([&]
+                                 { summary = hc::kernels::summarize(samples.data(), count, isa); });
+    if (isa == Isa::Scalar)
+    {
+      expectedSummary = summary;
+      scalarSeconds = seconds;
+    }
+    bool agrees = sameSummary(summary, expectedSummary);
+    allAgree &= agrees;
+    report("min/max/variance", isa, seconds, scalarSeconds, count, agrees);
+  }
+
+  size_t expectedCrossings = 0;
+  for (Isa isa : isas)
+  {
+    size_t crossings = 0;
+    double seconds = bestSeconds([&]
+                                 { crossings = hc::kernels::countCrossings(samples.data(), count, Threshold, isa); });
+    if (isa == Isa::Scalar)
+    {
+      expectedCrossings = crossings;
+      scalarSeconds = seconds;
+    }
+    allAgree &= crossings == expectedCrossings;
+    report("crossings", isa, seconds, scalarSeconds, count, crossings == expectedCrossings);
+  }
+
+  std::vector<uint32_t> expectedCounts;
+  for (Isa isa : isas)
+  {
+    std::vector<uint32_t> counts;
+    double seconds = bestSeconds([&]
+                                 {
+                                   counts.assign(HistogramBuckets, 0);
+                                   hc::kernels::histogram(samples.data(), count, HistogramMin, HistogramShift, counts.data(), HistogramBuckets, isa);
+                                 });
+    if (isa == Isa::Scalar)
+    {
+      expectedCounts = counts;
+      scalarSeconds = seconds;
+    }
+    allAgree &= counts == expectedCounts;
+    report("histogram", isa, seconds, scalarSeconds, count, counts == expectedCounts);
+  }
+
+  std::vector<int16_t> expectedAverages;
+  for (Isa isa : isas)
+  {
+    std::vector<int16_t> averages(count - window + 1);
+    double seconds = bestSeconds([&]
+                                 { hc::kernels::movingAverage(samples.data(), count, window, averages.data(), isa); });
+    if (isa == Isa::Scalar)
+    {
+      expectedAverages = averages;
+      scalarSeconds = seconds;
+    }
+    allAgree &= averages == expectedAverages;
+    report("moving average", isa, seconds, scalarSeconds, count, averages == expectedAverages);
+  }
+
+  std::string mismatch = checkTails(samples, isas, window);
+  printf("\nlengths 0-%zu from %zu starts: %s\n", TailLengths, sizeof(TailStarts) / sizeof(TailStarts[0]),
+         mismatch.empty() ? "all agree" : ("MISMATCH in " + mismatch).c_str());
+  allAgree &= mismatch.empty();
+
+  printf("mean %.1f, stddev %.1f, min %d, max %d, %zu crossings of %d\n", expectedSummary.mean(),
+         std::sqrt(expectedSummary.variance()), expectedSummary.min, expectedSummary.max, expectedCrossings, Threshold);
+
+  return allAgree ? 0 : 1;
+}
@@ -0,0 +1,366 @@
+/**
+ * Measures how long lines take from being written to a port to being read by the host, for each way the
+ * host tools can read (see hc_serial.h), so the cost of each port setting shows up in numbers.
+ *
+ * Build:
+ *   g++ -std=c++17 -O2 -pthread -o hc_latency tools/hc_latency.cpp
+ *
+ * Usage:
+ *   hc_latency [-n LINES] [-r RATE] [-f FORMAT] [-p PORT] [-b BAUD]
+ *
+ * LINES simulated state lines (see hc_sim.h, default 100 in outFmt FORMAT, default 2) are written at RATE
+ * per second (default 20, the firmware's rate), each stamped as it is written and again when the reader
+ * has its line break, and the read modes are compared by mean, median, p99 and max of the difference:
+ *
+ *   poll       non-blocking reads woken by poll(), what hc_logger and hc_cli use
+ *   blocking   blocking reads returning at the first byte (VMIN 1, VTIME 0)
+ *   batched    blocking reads waiting for 64 bytes or a 100ms gap (VMIN 64, VTIME 1)
+ *   canonical  blocking line reads split by the kernel's line discipline
+ *
+ * Without PORT the lines go through a pty, which measures the host side alone. With PORT, a serial
+ * adapter with TX wired to RX at BAUD (default 9600), each mode also runs with the driver's low latency
+ * flag off and on, and for FTDI adapters with the latency timer at 16ms and 1ms, where they can be set.
+ * Loopback times include the lines' time on the wire (about 1ms per 10 bytes at 9600 baud).
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <string>
+#include <thread>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+#include "hc_serial.h"
+#include "hc_sim.h"
+
+namespace
+{
+
+const int Ring = 4096; // send stamps kept for lines not yet read
+const int PaddingLines = 64;
+
+struct Options
+{
+  int lines = 100;
+  int rate = 20;
+  int format = 2;
+  const char *port = nullptr;
+  int baud = 9600;
+};
+
+struct Setting
+{
+  hc::ReadMode mode;
+  int lowLatency; // -1 leave as openPort sets it, 0 off, 1 on
+  int timerMs;    // -1 leave alone
+};
+
+int64_t nowUs()
+{
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000LL + now.tv_nsec / 1000;
+}
+
+bool writeAll(int fd, const char *data, size_t size)
+{
+  while (size > 0)
+  {
+    ssize_t count = write(fd, data, size);
+    if (count < 0 && (errno == EINTR || errno == EAGAIN))
+    {
+      usleep(100);
+      continue;
+    }
+    if (count < 0)
+      return false;
+    data += count;
+    size -= count;
+  }
+  return true;
+}
+
+/**
+ * @brief A pty with its reading side opened like a port
+ */
+struct Pty
+{
+  int master = -1;
+  std::string path;
+
+  ~Pty()
+  {
+    if (master >= 0)
+      close(master);
+  }
+
+  bool open()
+  {
+    master = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0 || ptsname(master) == nullptr)
+      return false;
+    path = ptsname(master);
+    return true;
+  }
+};
+
+/**
+ * @brief Writes the lines at the rate, stamping each, then pads the stream until the reader is done so a
+ * blocked read always returns
+ */
+void writeLines(int fd, const Options &options, std::atomic<int64_t> *sentUs, const std::atomic<bool> &done)
+{
+  hc::SimulatedModule module(1, options.format);
+  char line[hc::SimulatedModule::MaxLine];
+  int64_t periodUs = 1000000 / options.rate;
+  timespec next;
+  clock_gettime(CLOCK_MONOTONIC, &next);
+
+  for (int i = 0; i < options.lines && !done; i++)
+  {
+    size_t size = module.check(line);
+    sentUs[i % Ring].store(nowUs(), std::memory_order_release);
+    if (!writeAll(fd, line, size))
+    {
+      perror("write");
+      return;
+    }
+
+    next.tv_nsec += periodUs * 1000;
+    while (next.tv_nsec >= 1000000000)
+    {
+      next.tv_nsec -= 1000000000;
+      next.tv_sec++;
+    }
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, nullptr);
+  }
+
+  // Empty lines, enough to fill a batched read, are skipped by the reader once it has every line
+  char padding[PaddingLines];
+  memset(padding, '\n', sizeof(padding));
+  for (int wait = 0; !done && wait < 100; wait++)
+  {
+    usleep(100000);
+    if (!done)
+      writeAll(fd, padding, sizeof(padding));
+  }
+}
+
+/**
+ * @return latency of each line in us, in order, with fewer than asked for if the reader gave up
+ */
+std::vector<int64_t> readLines(int fd, hc::ReadMode mode, const Options &options, std::atomic<int64_t> *sentUs, std::atomic<bool> &done)
+{
+  std::vector<int64_t> latencies;
+  char buffer[1024];
+  bool lineHasText = false;
+  int64_t deadlineUs = nowUs() + (int64_t)options.lines * 1000000 / options.rate + 5000000;
+
+  while ((int)latencies.size() < options.lines && nowUs() < deadlineUs)
+  {
+    if (mode == hc::ReadMode::Poll)
+    {
+      pollfd watch = {fd, POLLIN, 0};
+      if (poll(&watch, 1, 100) <= 0)
+        continue;
+    }
+
+    ssize_t count = read(fd, buffer, sizeof(buffer));
+    int64_t readUs = nowUs();
+    if (count < 0 && (errno == EAGAIN || errno == EINTR))
+      continue;
+    if (count <= 0)
+      break;
+
+    // Lines end \r\n, or just \n in canonical mode; a line break after text completes the next line
+    for (ssize_t i = 0; i < count && (int)latencies.size() < options.lines; i++)
+    {
+      if (buffer[i] == '\n' || buffer[i] == '\r')
+      {
+        if (lineHasText)
+          latencies.push_back(readUs - sentUs[latencies.size() % Ring].load(std::memory_order_acquire));
+        lineHasText = false;
+      }
+      else
+        lineHasText = true;
+    }
+  }
+
+  done = true;
+  return latencies;
+}
+
+void report(const char *label, std::vector<int64_t> latencies, int expected)
+{
+  if (latencies.empty())
+  {
+    printf("%-34s no lines read\n", label);
+    return;
+  }
+
+  std::sort(latencies.begin(), latencies.end());
+  int64_t total = 0;
+  for (int64_t us : latencies)
+    total += us;
+
+  auto at = [&](double fraction)
+  { return (long long)latencies[std::min(latencies.size() - 1, (size_t)(latencies.size() * fraction))]; };
+  printf("%-34s %9lld %9lld %9lld %9lld", label, (long long)(total / (int64_t)latencies.size()), at(0.5), at(0.99),
+         (long long)latencies.back());
+  if ((int)latencies.size() < expected)
+    printf("   %d lines lost", expected - (int)latencies.size());
+  printf("\n");
+}
+
+bool measure(const Options &options, const Setting &setting)
+{
+  Pty pty;
+  const char *path = options.port;
+  if (path == nullptr)
+  {
+    if (!pty.open())
+    {
+      perror("pty");
+      return false;
+    }
+    path = pty.path.c_str();
+  }
+
+  int fd = hc::openPort(path, options.baud, setting.mode, setting.lowLatency != 0);
+  if (fd < 0)
+  {
+    fprintf(stderr, "cannot open %s: %s\n", path, strerror(errno));
+    return false;
+  }
+  if (setting.lowLatency == 0)
+    hc::setLowLatency(fd, false);
+  if (setting.timerMs > 0)
+    hc::setUsbLatencyTimer(path, setting.timerMs);
+  tcflush(fd, TCIOFLUSH);
+
+  std::vector<std::atomic<int64_t>> sentUs(Ring);
+  std::atomic<bool> done(false);
+  int writer = options.port == nullptr ? pty.master : fd;
+  std::thread writing(writeLines, writer, std::cref(options), sentUs.data(), std::cref(done));
+  std::vector<int64_t> latencies = readLines(fd, setting.mode, options, sentUs.data(), done);
+  writing.join();
+  close(fd);
+
+  std::string label = hc::readModeName(setting.mode);
+  if (setting.lowLatency >= 0)
+    label += setting.lowLatency ? ", low latency" : ", normal";
+  if (setting.timerMs > 0)
+    label += ", timer " + std::to_string(setting.timerMs) + "ms";
+  report(label.c_str(), latencies, options.lines);
+  return true;
+}
+
+void usage()
+{
+  fprintf(stderr, "usage: hc_latency [-n LINES] [-r RATE] [-f FORMAT] [-p PORT] [-b BAUD]\n");
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+  Options options;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:r:f:p:b:")) != -1)
+  {
+    switch (opt)
+    {
+    case 'n':
+      options.lines = std::max(atoi(optarg), 1);
+      break;
+    case 'r':
+      options.rate = std::clamp(atoi(optarg), 1, 10000);
+      break;
+    case 'f':
+      options.format = std::clamp(atoi(optarg), 0, 2);
+      break;
+    case 'p':
+      options.port = optarg;
+      break;
+    case 'b':
+      options.baud = atoi(optarg);
+      if (hc::baudConstant(options.baud) == B0)
+      {
+        fprintf(stderr, "unsupported baud rate %s\n", optarg);
+        return 1;
+      }
+      break;
+    default:
+      usage();
+      return 1;
+    }
+  }
+
+  if (optind != argc)
+  {
+    usage();
+    return 1;
+  }
+
+  const hc::ReadMode modes[] = {hc::ReadMode::Poll, hc::ReadMode::Blocking, hc::ReadMode::Batched, hc::ReadMode::Canonical};
+  std::vector<Setting> settings;
+  int originalTimerMs = -1;
+
+  if (options.port == nullptr)
+  {
+    printf("pty, %d lines at %dHz per mode\n", options.lines, options.rate);
+    for (hc::ReadMode mode : modes)
+      settings.push_back({mode, -1, -1});
+  }
+  else
+  {
+    int fd = hc::openPort(options.port, options.baud, hc::ReadMode::Poll, false);
+    if (fd < 0)
+    {
+      fprintf(stderr, "cannot open %s: %s\n", options.port, strerror(errno));
+      return 1;
+    }
+    bool lowLatency = hc::setLowLatency(fd, false);
+    if (!lowLatency)
+      printf("%s: no low latency flag (%s)\n", options.port, strerror(errno));
+    close(fd);
+
+    originalTimerMs = hc::usbLatencyTimer(options.port);
+    bool timer = originalTimerMs >= 0 && hc::setUsbLatencyTimer(options.port, originalTimerMs);
+    if (originalTimerMs < 0)
+      printf("%s: not an FTDI adapter, no latency timer\n", options.port);
+    else if (!timer)
+      printf("%s: latency timer is %dms and cannot be written (%s), run as root to compare\n", options.port, originalTimerMs,
+             strerror(errno));
+
+    printf("%s looped back at %d baud, %d lines at %dHz per setting\n", options.port, options.baud, options.lines, options.rate);
+    for (hc::ReadMode mode : modes)
+    {
+      for (int timerMs : timer ? std::vector<int>{16, 1} : std::vector<int>{-1})
+      {
+        settings.push_back({mode, lowLatency ? 0 : -1, timerMs});
+        if (lowLatency)
+          settings.push_back({mode, 1, timerMs});
+      }
+    }
+  }
+
+  printf("\n%-34s %9s %9s %9s %9s\n", "mode", "mean us", "p50 us", "p99 us", "max us");
+  bool ok = true;
+  for (const Setting &setting : settings)
+    ok &= measure(options, setting);
+
+  if (originalTimerMs >= 0)
+    hc::setUsbLatencyTimer(options.port, originalTimerMs);
+
+  return ok ? 0 : 1;
+}
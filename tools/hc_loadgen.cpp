@@ -0,0 +1,470 @@
+/**
+ * Simulates a fleet of modules at full telemetry rate to check whether a show PC can keep up with them,
+ * reporting throughput, latency and dropped lines.
+ *
+ * Build:
+ *   g++ -std=c++17 -O2 -pthread -o hc_loadgen tools/hc_loadgen.cpp
+ *
+ * Usage:
+ *   hc_loadgen [-n MODULES] [-r HZ] [-f FORMAT] [-t SECONDS] [-j THREADS] [-c READERS] [-p | -x]
+ *
+ * Each module is a simulated module (see hc_sim.h) printing in outFmt FORMAT (default 2, full telemetry)
+ * HZ times a second (default 20, the firmware's rate), with modules spread evenly over the interval rather
+ * than all printing at once. Modules are split across a pool of THREADS generator threads (default one per
+ * core), each sleeping until its next module is due.
+ *
+ * By default modules write to in-process pipes and a pool of READERS consumer threads (default 1, like a
+ * typical show app) ingests them with epoll and hc_parser.h. With -p they write to ptys instead, which also
+ * covers the tty layer, and with -x the ptys are printed as `<name> <path>` for an external consumer - such
+ * as the show software itself - and nothing is read in process.
+ *
+ * Every line ends with an extra ` t<micros>` field holding when it was sent, which hc_parser.h and the show
+ * software skip like any field they do not know, so the built-in consumer can measure latency from the
+ * module's write to the line being parsed. A module whose consumer falls behind loses lines rather than
+ * waiting, as a real module's USB buffer would; those are counted as dropped. Generator lateness, how long
+ * after their due time lines were written, shows whether the generator itself kept up.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <string>
+#include <sys/epoll.h>
+#include <termios.h>
+#include <thread>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+#include "hc_parser.h"
+#include "hc_sim.h"
+
+namespace
+{
+
+const int HistogramBucketUs = 10;
+const int HistogramBuckets = 10000; // up to 100ms, longer waits land in the last bucket
+const size_t MaxLine = 128;         // a simulated line plus the t field
+
+struct Options
+{
+  int modules = 100;
+  int rate = 20;
+  int format = 2;
+  int seconds = 10;
+  unsigned threads = 0; // 0 - one per core
+  unsigned readers = 1;
+  bool pty = false;
+  bool external = false;
+};
+
+struct Histogram
+{
+  uint64_t count = 0;
+  int64_t totalUs = 0;
+  int64_t maxUs = 0;
+  std::vector<uint64_t> buckets = std::vector<uint64_t>(HistogramBuckets, 0);
+
+  void record(int64_t us)
+  {
+    us = std::max<int64_t>(us, 0);
+    count++;
+    totalUs += us;
+    maxUs = std::max(maxUs, us);
+    buckets[std::min<int64_t>(us / HistogramBucketUs, HistogramBuckets - 1)]++;
+  }
+
+  void merge(const Histogram &other)
+  {
+    count += other.count;
+    totalUs += other.totalUs;
+    maxUs = std::max(maxUs, other.maxUs);
+    for (int i = 0; i < HistogramBuckets; i++)
+      buckets[i] += other.buckets[i];
+  }
+
+  int64_t percentileUs(double fraction) const
+  {
+    uint64_t target = (uint64_t)(count * fraction), seen = 0;
+    for (int i = 0; i < HistogramBuckets; i++)
+    {
+      seen += buckets[i];
+      if (seen > target)
+        return (int64_t)(i + 1) * HistogramBucketUs;
+    }
+    return (int64_t)HistogramBuckets * HistogramBucketUs;
+  }
+
+  void print(const char *name) const
+  {
+    printf("%-18s mean %6lldus  p50 %6lldus  p99 %6lldus  max %6lldus\n", name,
+           count ? (long long)(totalUs / (int64_t)count) : 0LL, (long long)percentileUs(0.5),
+           (long long)percentileUs(0.99), (long long)maxUs);
+  }
+};
+
+struct Module
+{
+  std::unique_ptr<hc::SimulatedModule> simulation;
+  int64_t phaseUs;  // offset within the print interval
+  int writer = -1;  // pipe write end or pty master
+  int reader = -1;  // pipe read end or pty slave
+  std::string path; // pty slave
+  char pending[MaxLine];
+  size_t pendingSize = 0; // unsent part of the last line, while the consumer is behind
+};
+
+// Per thread counters, merged once the run is over so the hot paths never share a cache line
+struct alignas(64) GeneratorStats
+{
+  uint64_t lines = 0;
+  uint64_t dropped = 0;
+  Histogram lateness;
+};
+
+struct alignas(64) ConsumerStats
+{
+  uint64_t lines = 0;
+  uint64_t bytes = 0;
+  uint64_t rejected = 0;
+  Histogram latency;
+};
+
+int64_t nowUs()
+{
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000LL + now.tv_nsec / 1000;
+}
+
+void sleepUntilUs(int64_t us)
+{
+  timespec until = {(time_t)(us / 1000000), (long)(us % 1000000) * 1000};
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, nullptr) == EINTR)
+  {
+  }
+}
+
+bool openChannel(Module &module, bool pty)
+{
+  if (!pty)
+  {
+    int ends[2];
+    if (pipe2(ends, O_NONBLOCK | O_CLOEXEC) != 0)
+      return false;
+
+    module.reader = ends[0];
+    module.writer = ends[1];
+    return true;
+  }
+
+  module.writer = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+  if (module.writer < 0 || grantpt(module.writer) != 0 || unlockpt(module.writer) != 0 || ptsname(module.writer) == nullptr)
+    return false;
+
+  module.path = ptsname(module.writer);
+  module.reader = open(module.path.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+  if (module.reader < 0)
+    return false;
+
+  termios tty;
+  if (tcgetattr(module.reader, &tty) == 0)
+  {
+    cfmakeraw(&tty);
+    tcsetattr(module.reader, TCSANOW, &tty);
+  }
+
+  return true;
+}
+
+/**
+ * @brief Writes what the consumer has room for
+ *
+ * @return false if part of the line is still pending
+ */
+bool flush(Module &module)
+{
+  while (module.pendingSize > 0)
+  {
+    ssize_t count = write(module.writer, module.pending, module.pendingSize);
+    if (count < 0 && errno == EINTR)
+      continue;
+    if (count <= 0)
+      return false;
+
+    memmove(module.pending, module.pending + count, module.pendingSize - count);
+    module.pendingSize -= count;
+  }
+
+  return true;
+}
+
+/**
+ * @brief Prints every line of a shard of modules, sorted by phase, until the end of the run
+ */
+void generate(std::vector<Module *> shard, int64_t startUs, int64_t endUs, int64_t intervalUs, GeneratorStats &stats)
+{
+  std::sort(shard.begin(), shard.end(), [](const Module *a, const Module *b)
+            { return a->phaseUs < b->phaseUs; });
+
+  for (int64_t tickUs = startUs; tickUs < endUs; tickUs += intervalUs)
+  {
+    for (Module *module : shard)
+    {
+      int64_t dueUs = tickUs + module->phaseUs;
+      if (dueUs >= endUs)
+        return;
+
+      sleepUntilUs(dueUs);
+
+      char line[MaxLine];
+      size_t size = module->simulation->check(line) - 2; // without \r\n
+      int64_t sentUs = nowUs();
+      size += snprintf(line + size, MaxLine - size, " t%lld\r\n", (long long)sentUs);
+
+      stats.lines++;
+      stats.lateness.record(sentUs - dueUs);
+
+      if (!flush(*module))
+      {
+        stats.dropped++;
+        continue;
+      }
+
+      memcpy(module->pending, line, size);
+      module->pendingSize = size;
+      flush(*module);
+    }
+  }
+}
+
+/**
+ * @brief Splits a consumer's reads into lines, taking the send time off the end of each before parsing it
+ */
+class LineSplitter
+{
+public:
+  void feed(const char *data, size_t size, int64_t receivedUs, ConsumerStats &stats)
+  {
+    stats.bytes += size;
+    for (size_t i = 0; i < size; i++)
+    {
+      char c = data[i];
+      if (c != '\n' && c != '\r')
+      {
+        if (length < MaxLine)
+          line[length++] = c;
+        continue;
+      }
+
+      if (length > 0)
+        finish(receivedUs, stats);
+      length = 0;
+    }
+  }
+
+private:
+  char line[MaxLine];
+  size_t length = 0;
+
+  void finish(int64_t receivedUs, ConsumerStats &stats)
+  {
+    size_t stamp = length;
+    while (stamp > 0 && line[stamp - 1] != ' ')
+      stamp--;
+
+    hc::Event event;
+    if (length == MaxLine || stamp == 0 || line[stamp] != 't' || !hc::Parser::parseLine(line, stamp - 1, event))
+    {
+      stats.rejected++;
+      return;
+    }
+
+    stats.lines++;
+    stats.latency.record(receivedUs - strtoll(line + stamp + 1, nullptr, 10));
+  }
+};
+
+/**
+ * @brief Ingests a shard of modules with epoll until told to stop and nothing is left to read
+ */
+void consume(const std::vector<Module *> &shard, const std::atomic<bool> &stop, ConsumerStats &stats)
+{
+  int epoll = epoll_create1(EPOLL_CLOEXEC);
+  std::vector<LineSplitter> splitters(shard.size());
+
+  for (size_t i = 0; i < shard.size(); i++)
+  {
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.u64 = i;
+    epoll_ctl(epoll, EPOLL_CTL_ADD, shard[i]->reader, &event);
+  }
+
+  epoll_event events[64];
+  char buffer[4096];
+  while (true)
+  {
+    bool stopping = stop.load(std::memory_order_relaxed);
+    int ready = epoll_wait(epoll, events, 64, stopping ? 0 : 100);
+    if (ready <= 0 && stopping)
+      break;
+
+    for (int i = 0; i < ready; i++)
+    {
+      size_t index = events[i].data.u64;
+      ssize_t count;
+      while ((count = read(shard[index]->reader, buffer, sizeof(buffer))) > 0)
+        splitters[index].feed(buffer, count, nowUs(), stats);
+    }
+  }
+
+  close(epoll);
+}
+
+void usage()
+{
+  fprintf(stderr, "usage: hc_loadgen [-n MODULES] [-r HZ] [-f FORMAT] [-t SECONDS] [-j THREADS] [-c READERS] [-p | -x]\n");
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+  Options options;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:r:f:t:j:c:px")) != -1)
+  {
+    switch (opt)
+    {
+    case 'n':
+      options.modules = std::max(atoi(optarg), 1);
+      break;
+    case 'r':
+      options.rate = std::clamp(atoi(optarg), 1, 10000);
+      break;
+    case 'f':
+      options.format = std::clamp(atoi(optarg), 0, 2);
+      break;
+    case 't':
+      options.seconds = std::max(atoi(optarg), 1);
+      break;
+    case 'j':
+      options.threads = atoi(optarg);
+      break;
+    case 'c':
+      options.readers = std::max(atoi(optarg), 1);
+      break;
+    case 'p':
+      options.pty = true;
+      break;
+    case 'x':
+      options.pty = true;
+      options.external = true;
+      break;
+    default:
+      usage();
+      return 1;
+    }
+  }
+
+  int64_t intervalUs = 1000000 / options.rate;
+  std::vector<Module> modules(options.modules);
+  for (int i = 0; i < options.modules; i++)
+  {
+    modules[i].simulation.reset(new hc::SimulatedModule(i, options.format));
+    modules[i].phaseUs = intervalUs * i / options.modules;
+    if (!openChannel(modules[i], options.pty))
+    {
+      fprintf(stderr, "cannot open a channel for module %d: %s\n", i, strerror(errno));
+      return 1;
+    }
+
+    if (options.external)
+      printf("hc%d %s\n", i, modules[i].path.c_str());
+  }
+  fflush(stdout);
+
+  unsigned threadCount = options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+  threadCount = std::min<unsigned>(threadCount, options.modules);
+  unsigned readerCount = options.external ? 0 : std::min<unsigned>(options.readers, options.modules);
+
+  std::vector<std::vector<Module *>> generatorShards(threadCount), consumerShards(readerCount);
+  for (int i = 0; i < options.modules; i++)
+  {
+    generatorShards[i % threadCount].push_back(&modules[i]);
+    if (readerCount > 0)
+      consumerShards[i % readerCount].push_back(&modules[i]);
+  }
+
+  std::vector<GeneratorStats> generatorStats(threadCount);
+  std::vector<ConsumerStats> consumerStats(readerCount);
+  std::atomic<bool> stop(false);
+
+  std::vector<std::thread> consumers;
+  for (unsigned i = 0; i < readerCount; i++)
+    consumers.emplace_back(consume, std::cref(consumerShards[i]), std::cref(stop), std::ref(consumerStats[i]));
+
+  int64_t startUs = nowUs() + 10000;
+  int64_t endUs = startUs + options.seconds * 1000000LL;
+  std::vector<std::thread> generators;
+  for (unsigned i = 0; i < threadCount; i++)
+    generators.emplace_back(generate, generatorShards[i], startUs, endUs, intervalUs, std::ref(generatorStats[i]));
+
+  for (std::thread &thread : generators)
+    thread.join();
+
+  // Give the consumers a moment to catch up with what is already written
+  sleepUntilUs(nowUs() + 200000);
+  stop = true;
+  for (std::thread &thread : consumers)
+    thread.join();
+
+  GeneratorStats generated;
+  for (const GeneratorStats &stats : generatorStats)
+  {
+    generated.lines += stats.lines;
+    generated.dropped += stats.dropped;
+    generated.lateness.merge(stats.lateness);
+  }
+
+  ConsumerStats consumed;
+  for (const ConsumerStats &stats : consumerStats)
+  {
+    consumed.lines += stats.lines;
+    consumed.bytes += stats.bytes;
+    consumed.rejected += stats.rejected;
+    consumed.latency.merge(stats.latency);
+  }
+
+  printf("%d modules at %d Hz, outFmt %d, %s, %u generator threads, %u readers, %d s\n", options.modules, options.rate,
+         options.format, options.pty ? "ptys" : "pipes", threadCount, readerCount, options.seconds);
+  printf("generated          %llu lines, %llu dropped (%.3f%%)\n", (unsigned long long)generated.lines,
+         (unsigned long long)generated.dropped, generated.lines ? 100.0 * generated.dropped / generated.lines : 0.0);
+  generated.lateness.print("generator lateness");
+  if (generated.lateness.percentileUs(0.99) > intervalUs)
+    printf("the generator fell behind, results understate the load - add threads (-j) or reduce modules\n");
+
+  if (readerCount > 0)
+  {
+    printf("consumed           %llu lines (%.0f/s, %.2f MB/s), %llu rejected\n", (unsigned long long)consumed.lines,
+           (double)consumed.lines / options.seconds, consumed.bytes / 1e6 / options.seconds,
+           (unsigned long long)consumed.rejected);
+    consumed.latency.print("consumer latency");
+  }
+
+  for (Module &module : modules)
+  {
+    close(module.reader);
+    close(module.writer);
+  }
+
+  return 0;
+}
@@ -0,0 +1,991 @@
+/**
+ * Records the state lines of one or more modules into the compact binary log format (see hc_binlog.h),
+ * converts text logs into it and binary logs back out to CSV.
+ *
+ * Build:
+ *   g++ -std=c++17 -O2 -pthread -o hc_logger tools/hc_logger.cpp
+ *
+ * Usage:
+ *   hc_logger record [-b BAUD] [-c LINES] [-i SECONDS] [-e ADDRESS] [-I BACKEND] [-R PRIORITY] [-a CPU] [-l]
+ *                   [-L] -o FILE PORT [PORT ...]
+ *   hc_logger import [-m MODULE] -o FILE LOG [LOG ...]
+ *   hc_logger csv FILE
+ *   hc_logger bench [-n MODULES] [-t SECONDS]
+ *
+ * record appends every state line from each PORT to FILE, stamped with the time it arrived, the module
+ * being the PORT's position on the command line (0 first). A chunk is written per module every LINES lines
+ * (default 1200, a minute at 20Hz) or every SECONDS seconds (default 10), whichever comes first, and flushed
+ * to disk, so a crash or power cut loses at most that much. Recording into an existing file first cuts off
+ * any torn chunk left at its end, and refuses a file damaged before its end rather than lose the chunks
+ * after the damage. The ports are opened first, so one that cannot be opened leaves the file untouched.
+ * Ports are all read on one thread, so many modules cost little CPU, waiting with the -I BACKEND given (see
+ * hc_ingest.h): poll (the default), epoll, or uring on Linux 6.7 and later, which reads every port without
+ * a read() call each. An unavailable backend falls back to poll.
+ * A port that closes (a module unplugged or reset) is reopened every second until it comes back.
+ *
+ * With -L, FTDI adapters among the PORTs have their latency timer cut from 16ms to 1ms on every open (see
+ * hc_serial.h), so a line is not held back for up to 16ms. It is a setting of the adapter in sysfs, not of
+ * the open port: it stays at 1ms after recording, for every program, until the adapter is replugged. It
+ * usually needs root or a udev rule, and without them a warning is printed once per port.
+ *
+ * With -e, record serves metrics for Prometheus at ADDRESS, a localhost port ("9464" or "127.0.0.1:9464")
+ * or a Unix socket path: per module lines, bytes, rejected lines, reconnects, whether it is connected and
+ * how long its lines wait from the reader waking with their bytes to their parsed record being queued (behind
+ * the other ports read in the same wake and the lines before them), and chunks, bytes, queued chunks and flush times for the log. They are
+ * served from a thread of their own (see hc_metrics.h), so scrapes never delay reading, e.g.
+ *   curl -s localhost:9464/metrics
+ *   curl -s --unix-socket /run/hc_logger.sock localhost/metrics
+ *
+ * On busy PCs the reading thread can be kept ahead of other work (see hc_rt.h, and hc_jitter to compare):
+ * -R runs it SCHED_FIFO at PRIORITY (1-99), -a pins it to CPU and -l locks the process in memory. Without
+ * the privileges for them, it warns and carries on with what it is allowed. The metrics thread and the
+ * thread writing and flushing chunks are left at normal priority: the reading thread only queues a chunk
+ * for writing, so a slow disk or fdatasync never holds it up, and chunks queue in memory meanwhile.
+ *
+ * import converts recorded text logs (see trace_analyzer for the timestamp formats) as module MODULE.
+ * csv prints one row per line, fields absent from a line left empty. bench compares text and binary sizes
+ * and encode/decode speed for several chunk lengths on simulated telemetry (see hc_sim.h).
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+#include "hc_binlog.h"
+#include "hc_ingest.h"
+#include "hc_metrics.h"
+#include "hc_parser.h"
+#include "hc_rt.h"
+#include "hc_serial.h"
+#include "hc_sim.h"
+
+namespace
+{
+
+using hc::binlog::Record;
+
+const int64_t SensorCheckMs = 50;
+const int64_t DayMs = 24LL * 60 * 60 * 1000;
+
+volatile sig_atomic_t stopping = 0;
+
+struct Options
+{
+  std::string out;
+  std::string metrics;
+  int baud = 9600;
+  hc::ingest::Backend backend = hc::ingest::Backend::Poll;
+  hc::Realtime realtime;
+  bool usbLatencyTimer = false;
+  size_t chunkLines = 1200;
+  int chunkSeconds = 10;
+  int module = 0;
+  int modules = 20;
+  int seconds = 600;
+};
+
+void onSignal(int)
+{
+  stopping = 1;
+}
+
+int64_t wallMs()
+{
+  timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  return now.tv_sec * 1000LL + now.tv_nsec / 1000000;
+}
+
+int64_t monotonicUs()
+{
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000LL + now.tv_nsec / 1000;
+}
+
+/**
+ * @brief Appends chunks to a log, one write and one flush to disk per chunk
+ */
+class ChunkWriter
+{
+public:
+  ~ChunkWriter()
+  {
+    if (fd >= 0)
+      close(fd);
+  }
+
+  /**
+   * @brief Opens a log for appending, creating it or cutting off a torn chunk at its end
+   *
+   * A damaged chunk with intact chunks after it is left alone and the log refused, as cutting there would
+   * lose everything after it.
+   */
+  bool open(const std::string &path)
+  {
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0)
+      return false;
+
+    off_t damagedAt = -1;
+    off_t valid = validLength(damagedAt);
+    if (valid < 0)
+    {
+      if (damagedAt >= 0)
+        fprintf(stderr, "%s: damaged chunk at byte %lld before the end, not appending to it\n", path.c_str(), (long long)damagedAt);
+      else
+        fprintf(stderr, "%s is not a binary log\n", path.c_str());
+      errno = EINVAL;
+      return false;
+    }
+
+    off_t size = lseek(fd, 0, SEEK_END);
+    if (valid < size)
+    {
+      fprintf(stderr, "%s: cutting off %lld bytes of torn chunk\n", path.c_str(), (long long)(size - valid));
+      if (ftruncate(fd, valid) != 0)
+        return false;
+    }
+
+    if (valid == 0)
+    {
+      uint8_t header[hc::binlog::FileHeaderSize];
+      hc::binlog::writeFileHeader(header);
+      if (!writeAll(header, sizeof(header)))
+        return false;
+    }
+
+    return lseek(fd, 0, SEEK_END) >= 0;
+  }
+
+  bool append(uint16_t module, const std::vector<Record> &records)
+  {
+    if (records.empty())
+      return true;
+
+    // More records than a chunk holds (a large -c) go in several
+    for (size_t i = 0; i < records.size(); i += hc::binlog::MaxCount)
+    {
+      if (records.size() <= hc::binlog::MaxCount)
+        hc::binlog::encodeChunk(module, records, chunk);
+      else
+        hc::binlog::encodeChunk(module, std::vector<Record>(records.begin() + i, records.begin() + std::min<size_t>(records.size(), i + hc::binlog::MaxCount)), chunk);
+
+      bytes += chunk.size();
+      if (!writeAll((const uint8_t *)chunk.data(), chunk.size()))
+        return false;
+    }
+    return fdatasync(fd) == 0;
+  }
+
+  uint64_t bytesWritten() const { return bytes; }
+
+private:
+  int fd = -1;
+  std::string chunk;
+  uint64_t bytes = 0;
+
+  bool writeAll(const uint8_t *data, size_t size)
+  {
+    while (size > 0)
+    {
+      ssize_t count = write(fd, data, size);
+      if (count < 0 && errno == EINTR)
+        continue;
+      if (count < 0)
+        return false;
+
+      data += count;
+      size -= count;
+    }
+    return true;
+  }
+
+  /**
+   * @brief Walks the chunks already in the file
+   *
+   * Only the last chunk can be torn by a crash: one that runs past the end of the file, fails its checksum
+   * at the end of the file, or is followed by nothing but zeroes (space the file system allocated before
+   * the write reached it). A chunk that fails its checks with more data after it is damage, not a crash.
+   *
+   * @return the length up to the end of the last intact chunk, or -1 if the file is not a binary log or is
+   * damaged before its end, with damagedAt set to the damaged chunk's offset
+   */
+  off_t validLength(off_t &damagedAt)
+  {
+    struct stat info;
+    if (fstat(fd, &info) != 0)
+      return -1;
+    if (info.st_size == 0)
+      return 0;
+
+    uint8_t header[hc::binlog::ChunkHeaderSize];
+    if (pread(fd, header, hc::binlog::FileHeaderSize, 0) != (ssize_t)hc::binlog::FileHeaderSize ||
+        !hc::binlog::checkFileHeader(header, hc::binlog::FileHeaderSize))
+      return -1;
+
+    off_t offset = hc::binlog::FileHeaderSize;
+    std::vector<uint8_t> buffer;
+    while (offset < info.st_size)
+    {
+      // Past the end of the file, the chunk is torn
+      hc::binlog::ChunkHeader chunkHeader;
+      if (pread(fd, header, sizeof(header), offset) != (ssize_t)sizeof(header))
+        break;
+      bool parsed = hc::binlog::parseChunkHeader(header, sizeof(header), chunkHeader);
+      if (parsed && offset + (off_t)(sizeof(header) + chunkHeader.payloadSize) > info.st_size)
+        break;
+
+      if (parsed)
+      {
+        buffer.resize(sizeof(header) + chunkHeader.payloadSize);
+        if (pread(fd, buffer.data(), buffer.size(), offset) != (ssize_t)buffer.size())
+          return -1;
+        if (hc::binlog::checkChunk(buffer.data(), chunkHeader))
+        {
+          offset += buffer.size();
+          continue;
+        }
+      }
+
+      // A bad chunk ending the file, or zeroes after it, is torn; anything else after it is kept
+      if ((parsed && offset + (off_t)buffer.size() == info.st_size) || zeroesFrom(offset, info.st_size))
+        break;
+      damagedAt = offset;
+      return -1;
+    }
+
+    return offset;
+  }
+
+  bool zeroesFrom(off_t offset, off_t end)
+  {
+    uint8_t buffer[4096];
+    while (offset < end)
+    {
+      ssize_t count = pread(fd, buffer, std::min<off_t>(sizeof(buffer), end - offset), offset);
+      if (count <= 0)
+        return false;
+      for (ssize_t i = 0; i < count; i++)
+      {
+        if (buffer[i] != 0)
+          return false;
+      }
+      offset += count;
+    }
+    return true;
+  }
+};
+
+/**
+ * @brief Reads a binary log a chunk at a time, stopping at the first chunk that fails its checks
+ */
+class ChunkReader
+{
+public:
+  bool open(const std::string &path)
+  {
+    in.open(path, std::ios::binary);
+    uint8_t header[hc::binlog::FileHeaderSize];
+    return in && in.read((char *)header, sizeof(header)) && hc::binlog::checkFileHeader(header, sizeof(header));
+  }
+
+  bool next(hc::binlog::ChunkHeader &header, std::vector<Record> &records)
+  {
+    records.clear();
+    buffer.resize(hc::binlog::ChunkHeaderSize);
+    if (!in.read((char *)buffer.data(), buffer.size()))
+      return false;
+
+    if (!hc::binlog::parseChunkHeader(buffer.data(), buffer.size(), header))
+      return fail();
+
+    buffer.resize(hc::binlog::ChunkHeaderSize + header.payloadSize);
+    if (!in.read((char *)buffer.data() + hc::binlog::ChunkHeaderSize, header.payloadSize) ||
+        !hc::binlog::checkChunk(buffer.data(), header) ||
+        !hc::binlog::decodeChunk(header, buffer.data() + hc::binlog::ChunkHeaderSize, records))
+      return fail();
+
+    return true;
+  }
+
+  bool damaged() const { return corrupt; }
+
+private:
+  std::ifstream in;
+  std::vector<uint8_t> buffer;
+  bool corrupt = false;
+
+  bool fail()
+  {
+    corrupt = true;
+    return false;
+  }
+};
+
+/**
+ * @brief Parses a text log into records, timing lines from their stamps or 50ms apart without them
+ */
+bool loadText(const std::string &path, std::vector<Record> &records)
+{
+  std::ifstream in(path);
+  if (!in)
+    return false;
+
+  std::string line;
+  int64_t lastMs = -1;
+  while (std::getline(in, line))
+  {
+    Record record;
+    if (!hc::Parser::parseLine(line.data(), line.size(), record.event))
+      continue;
+
+    int64_t stamp = hc::parseTimestamp(line.data(), line.data() + line.find('['));
+    if (stamp < 0)
+      stamp = (lastMs >= 0 ? lastMs : 0) + SensorCheckMs;
+
+    // Time of day stamps wrap at midnight
+    while (lastMs >= 0 && stamp < lastMs - DayMs / 2)
+      stamp += DayMs;
+
+    record.timeMs = lastMs = stamp;
+    records.push_back(record);
+  }
+
+  return true;
+}
+
+bool writeChunks(ChunkWriter &writer, uint16_t module, const std::vector<Record> &records, size_t chunkLines)
+{
+  std::vector<Record> chunk;
+  for (size_t i = 0; i < records.size(); i += chunkLines)
+  {
+    chunk.assign(records.begin() + i, records.begin() + std::min(records.size(), i + chunkLines));
+    if (!writer.append(module, chunk))
+      return false;
+  }
+  return true;
+}
+
+// Upper bounds in seconds for a line's wait from the read that woke the reader to its queued record, and chunk flushes
+const double LatencyBounds[] = {0.00001, 0.000025, 0.00005, 0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1};
+const double FlushBounds[] = {0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5};
+const int64_t ReconnectMs = 1000;
+
+/**
+ * @brief One module's counters, kept apart from its neighbours' so the metrics thread reading them does
+ * not slow the reader's writes
+ */
+struct alignas(64) ModuleMetrics
+{
+  hc::metrics::Counter lines;
+  hc::metrics::Counter bytes;
+  hc::metrics::Counter rejected;
+  hc::metrics::Counter reconnects;
+  hc::metrics::Gauge connected;
+  hc::metrics::Histogram latency{LatencyBounds, sizeof(LatencyBounds) / sizeof(LatencyBounds[0])};
+};
+
+struct LogMetrics
+{
+  hc::metrics::Counter chunks;
+  hc::metrics::Counter bytes;
+  hc::metrics::Gauge queued;
+  hc::metrics::Histogram flush{FlushBounds, sizeof(FlushBounds) / sizeof(FlushBounds[0])};
+};
+
+/**
+ * @brief Hands chunks to a thread of their own for writing and flushing to disk, so a slow disk or
+ * fdatasync never holds up the reading thread, which may be running SCHED_FIFO
+ */
+class ChunkQueue
+{
+public:
+  ChunkQueue(ChunkWriter &writer, LogMetrics &metrics) : writer(writer), metrics(metrics) {}
+
+  ~ChunkQueue() { finish(); }
+
+  /**
+   * @brief Starts the writing thread, with the scheduling of the thread calling it
+   */
+  void start()
+  {
+    thread = std::thread([this]
+                         { run(); });
+  }
+
+  /**
+   * @brief Queues a module's records as a chunk, leaving records empty
+   */
+  void push(uint16_t module, std::vector<Record> &records)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      jobs.push_back({module, std::move(records)});
+      metrics.queued.set(jobs.size());
+    }
+    records.clear();
+    ready.notify_one();
+  }
+
+  /**
+   * @brief Writes everything queued and stops the thread
+   *
+   * @return false with errno set if a write failed
+   */
+  bool finish()
+  {
+    if (thread.joinable())
+    {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        closing = true;
+      }
+      ready.notify_one();
+      thread.join();
+    }
+
+    if (failed())
+      errno = error;
+    return !failed();
+  }
+
+  /**
+   * @brief A write failed, and nothing queued after it was written
+   */
+  bool failed() const { return failure.load(std::memory_order_acquire); }
+
+  int writeError() const { return error; }
+
+private:
+  struct Job
+  {
+    uint16_t module;
+    std::vector<Record> records;
+  };
+
+  ChunkWriter &writer;
+  LogMetrics &metrics;
+  std::thread thread;
+  std::mutex mutex;
+  std::condition_variable ready;
+  std::deque<Job> jobs;
+  bool closing = false;
+  std::atomic<bool> failure{false};
+  int error = 0; // errno of the failed write, published by failure
+
+  void run()
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+      ready.wait(lock, [this]
+                 { return closing || !jobs.empty(); });
+      if (jobs.empty())
+        return;
+
+      Job job = std::move(jobs.front());
+      jobs.pop_front();
+      metrics.queued.set(jobs.size());
+      lock.unlock();
+
+      // After a failed write the rest are dropped, as appending past a gap would hide it
+      if (!failed())
+      {
+        int64_t start = monotonicUs();
+        uint64_t bytesBefore = writer.bytesWritten();
+        if (writer.append(job.module, job.records))
+        {
+          metrics.flush.record(monotonicUs() - start);
+          metrics.chunks.add();
+          metrics.bytes.add(writer.bytesWritten() - bytesBefore);
+        }
+        else
+        {
+          error = errno;
+          failure.store(true, std::memory_order_release);
+        }
+      }
+
+      lock.lock();
+    }
+  }
+};
+
+void renderMetrics(hc::metrics::Writer &out, const std::vector<std::string> &ports, const ModuleMetrics *modules, const LogMetrics &log)
+{
+  std::vector<std::string> labels;
+  for (size_t i = 0; i < ports.size(); i++)
+    labels.push_back("module=\"" + std::to_string(i) + "\",port=\"" + hc::metrics::labelValue(ports[i]) + "\"");
+
+  // Families are written whole, one module after another, as the format requires
+  for (size_t i = 0; i < ports.size(); i++)
+    out.counter("hc_module_lines_total", i ? nullptr : "State lines read", labels[i], modules[i].lines.get());
+  for (size_t i = 0; i < ports.size(); i++)
+    out.counter("hc_module_read_bytes_total", i ? nullptr : "Bytes read from the port", labels[i], modules[i].bytes.get());
+  for (size_t i = 0; i < ports.size(); i++)
+    out.counter("hc_module_rejected_lines_total", i ? nullptr : "Lines that were not state lines: command responses, noise or overlong lines",
+                labels[i], modules[i].rejected.get());
+  for (size_t i = 0; i < ports.size(); i++)
+    out.counter("hc_module_reconnects_total", i ? nullptr : "Times the port was reopened after closing", labels[i], modules[i].reconnects.get());
+  for (size_t i = 0; i < ports.size(); i++)
+    out.gauge("hc_module_connected", i ? nullptr : "1 while the port is open", labels[i], modules[i].connected.get());
+  for (size_t i = 0; i < ports.size(); i++)
+    out.histogram("hc_module_line_latency_seconds", i ? nullptr : "Time from the reader waking with a line's bytes to its parsed record being queued",
+                  labels[i], modules[i].latency);
+
+  out.counter("hc_log_chunks_total", "Chunks written to the log", "", log.chunks.get());
+  out.counter("hc_log_bytes_total", "Bytes written to the log", "", log.bytes.get());
+  out.gauge("hc_log_queued_chunks", "Chunks waiting for the writing thread", "", log.queued.get());
+  out.histogram("hc_log_flush_seconds", "Time to write and flush a chunk to disk", "", log.flush);
+}
+
+/**
+ * @brief Opens a module's port, with -L cutting its FTDI latency timer to 1ms, warning once if it cannot
+ */
+int openModule(const Options &options, const std::string &port, bool &warned)
+{
+  int fd = hc::openPort(port.c_str(), options.baud);
+  int timerMs = fd >= 0 && options.usbLatencyTimer ? hc::usbLatencyTimer(port.c_str()) : -1;
+  if (timerMs > 1 && !hc::setUsbLatencyTimer(port.c_str(), 1) && !warned)
+  {
+    fprintf(stderr, "%s: cannot cut the latency timer from %dms: %s\n", port.c_str(), timerMs, strerror(errno));
+    warned = true;
+  }
+  return fd;
+}
+
+int record(const Options &options, const std::vector<std::string> &ports)
+{
+  std::vector<int> fds(ports.size(), -1);
+  std::vector<bool> timerWarned(ports.size(), false);
+  std::vector<hc::Parser> parsers(ports.size());
+  std::vector<uint64_t> rejectedSeen(ports.size(), 0);
+  std::vector<std::vector<Record>> pending(ports.size());
+  std::vector<int64_t> chunkStartMs(ports.size(), -1), reopenMs(ports.size(), 0);
+  std::unique_ptr<ModuleMetrics[]> metrics(new ModuleMetrics[ports.size()]);
+  LogMetrics logMetrics;
+
+  hc::ingest::Reader reader;
+  if (!reader.open(options.backend, ports.size()))
+  {
+    fprintf(stderr, "cannot read with %s (%s), using poll\n", hc::ingest::backendName(options.backend), strerror(errno));
+    reader.open(hc::ingest::Backend::Poll, ports.size());
+  }
+
+  for (size_t i = 0; i < ports.size(); i++)
+  {
+    bool warned = false;
+    fds[i] = openModule(options, ports[i], warned);
+    timerWarned[i] = warned;
+    if (fds[i] < 0)
+    {
+      fprintf(stderr, "cannot open %s: %s\n", ports[i].c_str(), strerror(errno));
+      return 1;
+    }
+    reader.add(i, fds[i]);
+    metrics[i].connected.set(1);
+    fprintf(stderr, "module %zu: %s\n", i, ports[i].c_str());
+  }
+
+  // Only once every port has opened, so a mistyped port leaves the log untouched
+  ChunkWriter writer;
+  if (!writer.open(options.out))
+  {
+    fprintf(stderr, "cannot write %s: %s\n", options.out.c_str(), strerror(errno));
+    return 1;
+  }
+
+  hc::metrics::Server server;
+  if (!options.metrics.empty())
+  {
+    if (!server.listen(options.metrics))
+    {
+      fprintf(stderr, "cannot serve metrics on %s: %s\n", options.metrics.c_str(), strerror(errno));
+      return 1;
+    }
+    server.start([&](hc::metrics::Writer &out)
+                 { renderMetrics(out, ports, metrics.get(), logMetrics); });
+    fprintf(stderr, "metrics on %s\n", options.metrics.c_str());
+  }
+
+  // After the metrics and writing threads have started, so they keep normal scheduling
+  ChunkQueue queue(writer, logMetrics);
+  queue.start();
+  hc::applyRealtime(options.realtime);
+
+  struct sigaction action = {};
+  action.sa_handler = onSignal;
+  sigaction(SIGINT, &action, nullptr);
+  sigaction(SIGTERM, &action, nullptr);
+
+  uint64_t lines = 0;
+
+  auto flush = [&](size_t i)
+  {
+    lines += pending[i].size();
+    if (!pending[i].empty())
+      queue.push(i, pending[i]);
+    chunkStartMs[i] = -1;
+  };
+
+  while (!stopping)
+  {
+    if (queue.failed())
+    {
+      errno = queue.writeError();
+      perror("write");
+      return 1;
+    }
+
+    int64_t now = -1, wakeUs = -1;
+    bool waited = reader.wait(1000, [&](size_t i, const char *data, size_t size)
+                              {
+                                ModuleMetrics &module = metrics[i];
+                                if (now < 0)
+                                {
+                                  now = wallMs();
+                                  wakeUs = monotonicUs();
+                                }
+
+                                // An unplugged or reset module is reopened once its port comes back, with a fresh parser
+                                if (size == 0)
+                                {
+                                  fprintf(stderr, "module %zu: port closed, reopening\n", i);
+                                  reader.remove(i);
+                                  close(fds[i]);
+                                  fds[i] = -1;
+                                  module.connected.set(0);
+                                  reopenMs[i] = now + ReconnectMs;
+                                  return;
+                                }
+
+                                module.bytes.add(size);
+                                parsers[i].feed(data, size, [&](const hc::Event &event)
+                                                {
+                                                  pending[i].push_back({now, event});
+                                                  module.lines.add();
+                                                  module.latency.record(monotonicUs() - wakeUs); });
+                                module.rejected.add(parsers[i].rejectedLines() - rejectedSeen[i]);
+                                rejectedSeen[i] = parsers[i].rejectedLines(); });
+    if (!waited)
+      break;
+
+    if (now < 0)
+      now = wallMs();
+    for (size_t i = 0; i < ports.size(); i++)
+    {
+      ModuleMetrics &module = metrics[i];
+      if (fds[i] < 0 && now >= reopenMs[i])
+      {
+        bool warned = timerWarned[i];
+        fds[i] = openModule(options, ports[i], warned);
+        timerWarned[i] = warned;
+        reopenMs[i] = now + ReconnectMs;
+        if (fds[i] >= 0)
+        {
+          fprintf(stderr, "module %zu: reopened %s\n", i, ports[i].c_str());
+          reader.add(i, fds[i]);
+          parsers[i] = hc::Parser();
+          rejectedSeen[i] = 0;
+          module.reconnects.add();
+          module.connected.set(1);
+        }
+      }
+
+      if (!pending[i].empty() && chunkStartMs[i] < 0)
+        chunkStartMs[i] = now;
+
+      if (pending[i].size() >= options.chunkLines || (chunkStartMs[i] >= 0 && now - chunkStartMs[i] >= options.chunkSeconds * 1000LL))
+        flush(i);
+    }
+  }
+
+  server.stop();
+  for (size_t i = 0; i < ports.size(); i++)
+  {
+    flush(i);
+    if (fds[i] >= 0)
+      close(fds[i]);
+  }
+
+  if (!queue.finish())
+  {
+    perror("write");
+    return 1;
+  }
+
+  fprintf(stderr, "%llu lines, %llu bytes\n", (unsigned long long)lines, (unsigned long long)writer.bytesWritten());
+  return 0;
+}
+
+int import(const Options &options, const std::vector<std::string> &logs)
+{
+  ChunkWriter writer;
+  if (!writer.open(options.out))
+  {
+    fprintf(stderr, "cannot write %s: %s\n", options.out.c_str(), strerror(errno));
+    return 1;
+  }
+
+  for (const std::string &log : logs)
+  {
+    std::vector<Record> records;
+    if (!loadText(log, records))
+    {
+      fprintf(stderr, "cannot read %s\n", log.c_str());
+      return 1;
+    }
+
+    if (!writeChunks(writer, options.module, records, options.chunkLines))
+    {
+      perror("write");
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+void printField(int value)
+{
+  if (value >= 0)
+    printf(",%d", value);
+  else
+    printf(",");
+}
+
+int csv(const std::string &path)
+{
+  ChunkReader reader;
+  if (!reader.open(path))
+  {
+    fprintf(stderr, "cannot read %s as a binary log\n", path.c_str());
+    return 1;
+  }
+
+  static const char *const States[] = {"000", "100", "010", "110", "001"};
+  printf("module,time_ms,state,confidence,chain,prox_l,prox_r,grip_l,grip_r,delta_l,rate_l,delta_r,rate_r,impedance\n");
+
+  hc::binlog::ChunkHeader header;
+  std::vector<Record> records;
+  while (reader.next(header, records))
+  {
+    for (const Record &record : records)
+    {
+      const hc::Event &e = record.event;
+      printf("%u,%lld,%s", header.module, (long long)record.timeMs, States[(int)e.state]);
+      printField(e.confidence);
+      printField(e.chainLength);
+      printField(e.proximity[0]);
+      printField(e.proximity[1]);
+      printField(e.grip[0]);
+      printField(e.grip[1]);
+
+      // Telemetry deltas and rates can be negative, so presence comes from the flag
+      bool cap = e.hasTelemetry && e.impedance < 0;
+      for (int pad = 0; pad < 2; pad++)
+      {
+        if (cap)
+          printf(",%d,%d", e.delta[pad], e.rate[pad]);
+        else
+          printf(",,");
+      }
+      printField(e.impedance);
+      printf("\n");
+    }
+  }
+
+  if (reader.damaged())
+  {
+    fprintf(stderr, "%s: stopped at a damaged chunk\n", path.c_str());
+    return 1;
+  }
+
+  return 0;
+}
+
+int bench(const Options &options)
+{
+  // A session of simulated modules at the firmware's rate, as they would be recorded
+  std::vector<std::vector<Record>> modules(options.modules);
+  uint64_t textBytes = 0, lines = 0;
+  int checks = options.seconds * 1000 / SensorCheckMs;
+  char line[hc::SimulatedModule::MaxLine];
+
+  auto parseStart = std::chrono::steady_clock::now();
+  for (int m = 0; m < options.modules; m++)
+  {
+    hc::SimulatedModule module(m, 2);
+    int64_t timeMs = 1700000000000LL;
+    for (int i = 0; i < checks; i++)
+    {
+      size_t size = module.check(line);
+      textBytes += size + 15; // with a serial monitor style timestamp
+      Record record;
+      record.timeMs = timeMs += SensorCheckMs + (i % 7 == 0 ? 1 : 0);
+      hc::Parser::parseLine(line, size - 2, record.event);
+      modules[m].push_back(record);
+      lines++;
+    }
+  }
+  double generateSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - parseStart).count();
+
+  printf("%d modules, %d s of outFmt 2 at 20Hz: %llu lines, %.1f MB as timestamped text (%.1f s to generate and parse)\n\n",
+         options.modules, options.seconds, (unsigned long long)lines, textBytes / 1e6, generateSeconds);
+  printf("%12s %12s %10s %12s %14s %14s\n", "chunk lines", "bytes", "ratio", "bytes/line", "encode M/s", "decode M/s");
+
+  for (size_t chunkLines : {60, 300, 1200, 6000})
+  {
+    std::vector<std::string> chunks;
+    std::string chunk;
+    std::vector<Record> slice;
+    uint64_t bytes = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (const std::vector<Record> &records : modules)
+    {
+      for (size_t i = 0; i < records.size(); i += chunkLines)
+      {
+        slice.assign(records.begin() + i, records.begin() + std::min(records.size(), i + chunkLines));
+        hc::binlog::encodeChunk(0, slice, chunk);
+        bytes += chunk.size();
+        chunks.push_back(chunk);
+      }
+    }
+    double encodeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::vector<Record> decoded;
+    uint64_t decodedLines = 0;
+    start = std::chrono::steady_clock::now();
+    for (const std::string &encoded : chunks)
+    {
+      const uint8_t *data = (const uint8_t *)encoded.data();
+      hc::binlog::ChunkHeader header;
+      decoded.clear();
+      if (!hc::binlog::parseChunkHeader(data, encoded.size(), header) || !hc::binlog::checkChunk(data, header) ||
+          !hc::binlog::decodeChunk(header, data + hc::binlog::ChunkHeaderSize, decoded))
+      {
+        fprintf(stderr, "round trip failed\n");
+        return 1;
+      }
+      decodedLines += decoded.size();
+    }
+    double decodeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("%12zu %12llu %9.1fx %12.2f %14.1f %14.1f\n", chunkLines, (unsigned long long)bytes, (double)textBytes / bytes,
+           (double)bytes / lines, lines / encodeSeconds / 1e6, decodedLines / decodeSeconds / 1e6);
+  }
+
+  return 0;
+}
+
+void usage()
+{
+  fprintf(stderr, "usage: hc_logger record [-b BAUD] [-c LINES] [-i SECONDS] [-e ADDRESS] [-I BACKEND] [-R PRIORITY] [-a CPU] [-l]\n"
+                  "                        [-L] -o FILE PORT [PORT ...]\n"
+                  "       hc_logger import [-m MODULE] -o FILE LOG [LOG ...]\n"
+                  "       hc_logger csv FILE\n"
+                  "       hc_logger bench [-n MODULES] [-t SECONDS]\n");
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+  if (argc < 2)
+  {
+    usage();
+    return 1;
+  }
+
+  std::string mode = argv[1];
+  Options options;
+  int opt;
+  optind = 2;
+
+  while ((opt = getopt(argc, argv, "o:e:b:c:i:m:n:t:I:R:a:lL")) != -1)
+  {
+    switch (opt)
+    {
+    case 'o':
+      options.out = optarg;
+      break;
+    case 'e':
+      options.metrics = optarg;
+      break;
+    case 'I':
+      if (!hc::ingest::parseBackend(optarg, options.backend))
+      {
+        usage();
+        return 1;
+      }
+      break;
+    case 'R':
+      options.realtime.priority = std::clamp(atoi(optarg), 1, 99);
+      break;
+    case 'a':
+      options.realtime.cpu = std::max(atoi(optarg), 0);
+      break;
+    case 'l':
+      options.realtime.lockMemory = true;
+      break;
+    case 'L':
+      options.usbLatencyTimer = true;
+      break;
+    case 'b':
+      options.baud = atoi(optarg);
+      break;
+    case 'c':
+      options.chunkLines = std::max(atoi(optarg), 1);
+      break;
+    case 'i':
+      options.chunkSeconds = std::max(atoi(optarg), 1);
+      break;
+    case 'm':
+      options.module = std::clamp(atoi(optarg), 0, 65535);
+      break;
+    case 'n':
+      options.modules = std::max(atoi(optarg), 1);
+      break;
+    case 't':
+      options.seconds = std::max(atoi(optarg), 1);
+      break;
+    default:
+      usage();
+      return 1;
+    }
+  }
+
+  std::vector<std::string> args(argv + optind, argv + argc);
+
+  if (mode == "record" && !options.out.empty() && !args.empty())
+    return record(options, args);
+  if (mode == "import" && !options.out.empty() && !args.empty())
+    return import(options, args);
+  if (mode == "csv" && args.size() == 1)
+    return csv(args[0]);
+  if (mode == "bench" && args.empty())
+    return bench(options);
+
+  usage();
+  return 1;
+}
@@ -0,0 +1,378 @@
+#pragma once
+
+/**
+ * Counters and histograms that an I/O thread updates without locks, and a small HTTP server that serves
+ * them to Prometheus in its text format from a thread of its own, so scrapes never hold up the I/O.
+ *
+ *   hc::metrics::Server server;
+ *   server.listen("9464");                      // or "127.0.0.1:9464", or a Unix socket path
+ *   server.start([&](hc::metrics::Writer &out) { out.counter("hc_lines_total", "Lines read", "", lines); });
+ *
+ * Each counter has a single writer thread, which increments it with plain loads and stores (no locked
+ * instructions) on relaxed atomics that the server thread can read at any time.
+ */
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <functional>
+#include <netinet/in.h>
+#include <poll.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
+namespace hc
+{
+namespace metrics
+{
+
+class Counter
+{
+public:
+  void add(uint64_t amount = 1) { value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed); }
+
+  uint64_t get() const { return value.load(std::memory_order_relaxed); }
+
+private:
+  std::atomic<uint64_t> value{0};
+};
+
+class Gauge
+{
+public:
+  void set(int64_t amount) { value.store(amount, std::memory_order_relaxed); }
+
+  int64_t get() const { return value.load(std::memory_order_relaxed); }
+
+private:
+  std::atomic<int64_t> value{0};
+};
+
+/**
+ * @brief Durations counted into buckets with fixed upper bounds, summed in microseconds
+ */
+class Histogram
+{
+public:
+  static const int MaxBounds = 15;
+
+  /**
+   * @param bounds upper bounds in seconds, ascending, at most MaxBounds; the array must outlive the histogram
+   */
+  Histogram(const double *bounds, int count) : bounds(bounds), boundCount(count < MaxBounds ? count : MaxBounds) {}
+
+  void record(int64_t us)
+  {
+    double seconds = us / 1e6;
+    int bucket = 0;
+    while (bucket < boundCount && seconds > bounds[bucket])
+      bucket++;
+
+    buckets[bucket].store(buckets[bucket].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    totalUs.store(totalUs.load(std::memory_order_relaxed) + us, std::memory_order_relaxed);
+  }
+
+private:
+  friend class Writer;
+
+  const double *bounds;
+  int boundCount;
+  std::atomic<uint64_t> buckets[MaxBounds + 1] = {}; // the last counts everything over the last bound
+  std::atomic<int64_t> totalUs{0};
+};
+
+/**
+ * @brief Builds a scrape response. Call the family's first sample with its help text and later ones with
+ * nullptr, so # HELP and # TYPE are written once per family as the format requires
+ */
+class Writer
+{
+public:
+  void counter(const char *name, const char *help, const std::string &labels, uint64_t value)
+  {
+    family(name, help, "counter");
+    sample(name, "", labels, std::to_string(value));
+  }
+
+  void gauge(const char *name, const char *help, const std::string &labels, int64_t value)
+  {
+    family(name, help, "gauge");
+    sample(name, "", labels, std::to_string(value));
+  }
+
+  void histogram(const char *name, const char *help, const std::string &labels, const Histogram &histogram)
+  {
+    family(name, help, "histogram");
+
+    // Buckets are cumulative, ending with +Inf, which equals the count
+    uint64_t cumulative = 0;
+    char bound[32];
+    std::string bucketLabels = labels.empty() ? "" : labels + ",";
+    for (int i = 0; i <= histogram.boundCount; i++)
+    {
+      cumulative += histogram.buckets[i].load(std::memory_order_relaxed);
+      if (i < histogram.boundCount)
+        snprintf(bound, sizeof(bound), "%g", histogram.bounds[i]);
+      else
+        strcpy(bound, "+Inf");
+      sample(name, "_bucket", bucketLabels + "le=\"" + bound + "\"", std::to_string(cumulative));
+    }
+
+    char sum[32];
+    snprintf(sum, sizeof(sum), "%.6f", histogram.totalUs.load(std::memory_order_relaxed) / 1e6);
+    sample(name, "_sum", labels, sum);
+    sample(name, "_count", labels, std::to_string(cumulative));
+  }
+
+  const std::string &text() const { return out; }
+
+  void clear() { out.clear(); }
+
+private:
+  std::string out;
+
+  void family(const char *name, const char *help, const char *type)
+  {
+    if (help == nullptr)
+      return;
+    out += "# HELP ";
+    out += name;
+    out += ' ';
+    out += help;
+    out += "\n# TYPE ";
+    out += name;
+    out += ' ';
+    out += type;
+    out += '\n';
+  }
+
+  void sample(const char *name, const char *suffix, const std::string &labels, const std::string &value)
+  {
+    out += name;
+    out += suffix;
+    if (!labels.empty())
+      out += "{" + labels + "}";
+    out += ' ';
+    out += value;
+    out += '\n';
+  }
+};
+
+/**
+ * @brief Label value with quotes, backslashes and line breaks escaped, e.g. a port path
+ */
+inline std::string labelValue(const std::string &text)
+{
+  std::string escaped;
+  for (char c : text)
+  {
+    if (c == '\\' || c == '"')
+      escaped += '\\';
+    escaped += c == '\n' ? 'n' : c;
+  }
+  return escaped;
+}
+
+/**
+ * @brief Answers each HTTP request on a localhost port or Unix socket with the metrics, one connection at
+ * a time on its own thread
+ */
+class Server
+{
+public:
+  ~Server() { stop(); }
+
+  /**
+   * @brief Listens on "PORT" or "127.0.0.1:PORT" (localhost only), or on a Unix socket at a path with a /
+   *
+   * A socket already at the path, left by an earlier run, is replaced; anything else there fails with EEXIST.
+   *
+   * @return false with errno set
+   */
+  bool listen(const std::string &address)
+  {
+    if (address.find('/') != std::string::npos)
+    {
+      sockaddr_un local = {};
+      local.sun_family = AF_UNIX;
+      if (address.size() >= sizeof(local.sun_path))
+      {
+        errno = ENAMETOOLONG;
+        return false;
+      }
+      strcpy(local.sun_path, address.c_str());
+
+      // Only a socket left by an earlier run is replaced, never a file given by mistake
+      struct stat info;
+      if (lstat(address.c_str(), &info) == 0)
+      {
+        if (!S_ISSOCK(info.st_mode))
+        {
+          errno = EEXIST;
+          return false;
+        }
+        if (unlink(address.c_str()) != 0)
+          return false;
+      }
+      socketPath = address;
+      return bindAndListen(AF_UNIX, (const sockaddr *)&local, sizeof(local));
+    }
+
+    size_t colon = address.rfind(':');
+    std::string host = colon == std::string::npos ? "127.0.0.1" : address.substr(0, colon);
+    int port = atoi(address.c_str() + (colon == std::string::npos ? 0 : colon + 1));
+    if ((host != "127.0.0.1" && host != "localhost") || port <= 0 || port > 65535)
+    {
+      errno = EINVAL;
+      return false;
+    }
+
+    sockaddr_in local = {};
+    local.sin_family = AF_INET;
+    local.sin_port = htons(port);
+    local.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    return bindAndListen(AF_INET, (const sockaddr *)&local, sizeof(local));
+  }
+
+  /**
+   * @brief Serves scrapes until stop(), render filling in the metrics for each
+   */
+  void start(std::function<void(Writer &)> render)
+  {
+    if (pipe2(wake, O_CLOEXEC) != 0)
+      return;
+    thread = std::thread([this, render]
+                         { serve(render); });
+  }
+
+  void stop()
+  {
+    if (thread.joinable())
+    {
+      char byte = 0;
+      if (write(wake[1], &byte, 1) < 0)
+        perror("metrics");
+      thread.join();
+      close(wake[0]);
+      close(wake[1]);
+    }
+    if (listener >= 0)
+    {
+      close(listener);
+      listener = -1;
+      if (!socketPath.empty())
+        unlink(socketPath.c_str());
+    }
+  }
+
+private:
+  int listener = -1;
+  int wake[2] = {-1, -1};
+  std::string socketPath;
+  std::thread thread;
+
+  bool bindAndListen(int family, const sockaddr *address, socklen_t size)
+  {
+    listener = socket(family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listener < 0)
+      return false;
+
+    int reuse = 1;
+    if (family == AF_INET)
+      setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    if (bind(listener, address, size) != 0 || ::listen(listener, 8) != 0)
+    {
+      int error = errno;
+      close(listener);
+      listener = -1;
+      errno = error;
+      return false;
+    }
+    return true;
+  }
+
+  void serve(const std::function<void(Writer &)> &render)
+  {
+    Writer writer;
+    pollfd watches[2] = {{listener, POLLIN, 0}, {wake[0], POLLIN, 0}};
+
+    while (true)
+    {
+      if (poll(watches, 2, -1) < 0 && errno != EINTR)
+        return;
+      if (watches[1].revents)
+        return;
+      if (!(watches[0].revents & POLLIN))
+        continue;
+
+      int client = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+      if (client < 0)
+        continue;
+
+      // A stalled client gives up its turn rather than holding up the next scrape
+      timeval timeout = {1, 0};
+      setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+      setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+      if (readRequest(client))
+      {
+        writer.clear();
+        render(writer);
+        std::string response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " +
+                               std::to_string(writer.text().size()) + "\r\nConnection: close\r\n\r\n" + writer.text();
+        writeAll(client, response.data(), response.size());
+      }
+      close(client);
+    }
+  }
+
+  /**
+   * @brief Reads up to the blank line ending the request headers. Any request gets the metrics
+   */
+  static bool readRequest(int client)
+  {
+    char buffer[2048];
+    size_t size = 0;
+    while (size < sizeof(buffer) - 1)
+    {
+      ssize_t count = read(client, buffer + size, sizeof(buffer) - 1 - size);
+      if (count < 0 && errno == EINTR)
+        continue;
+      if (count <= 0)
+        return false;
+
+      size += count;
+      buffer[size] = '\0';
+      if (strstr(buffer, "\r\n\r\n") != nullptr || strstr(buffer, "\n\n") != nullptr)
+        return true;
+    }
+    return true;
+  }
+
+  static void writeAll(int fd, const char *data, size_t size)
+  {
+    while (size > 0)
+    {
+      ssize_t count = send(fd, data, size, MSG_NOSIGNAL);
+      if (count < 0 && errno == EINTR)
+        continue;
+      if (count <= 0)
+        return;
+      data += count;
+      size -= count;
+    }
+  }
+};
+
+} // namespace metrics
+} // namespace hc
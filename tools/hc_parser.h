@@ -0,0 +1,259 @@
+#pragma once
+
+/**
+ * Incremental parser for the module's serial output, for show software and host tools.
+ *
+ * Feed it byte chunks as they arrive from the port, in any split. It calls back once per complete state line
+ * with the decoded state and any extended/telemetry fields (see README), and never allocates: the only state
+ * is a fixed line buffer. Anything that is not a state line - command responses, garbage, lines cut short by
+ * a reconnect, overlong lines - is skipped up to the next line break, so the parser resynchronises on its own.
+ *
+ *   hc::Parser parser;
+ *   parser.feed(buffer, count, [](const hc::Event &event) { ... });
+ */
+
+#include <cctype>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+
+namespace hc
+{
+
+// Matches OutputState in the firmware, in the order of the [xyz] digits
+enum class State : uint8_t
+{
+  Idle,
+  Left,
+  Right,
+  Both,
+  Joined
+};
+
+// Fields not present on a line are left at -1
+struct Event
+{
+  State state;
+  int8_t confidence = -1;                       // c
+  int8_t chainLength = -1;                      // n
+  int8_t proximity[2] = {-1, -1};               // p, left then right
+  int8_t grip[2] = {-1, -1};                    // g, percent
+  int16_t delta[2] = {-1, -1};                  // l/r telemetry delta above the baseline
+  int16_t rate[2] = {-1, -1};                   // l/r telemetry rate
+  int16_t impedance = -1;                       // i
+  bool hasTelemetry = false;                    // l/r or i fields were present
+};
+
+class Parser
+{
+public:
+  static const size_t MaxLine = 96; // well over the longest line the firmware sends
+
+  /**
+   * @brief Consumes a chunk, calling onEvent(const Event &) for every complete state line in it
+   */
+  template <typename Callback>
+  void feed(const char *data, size_t size, Callback &&onEvent)
+  {
+    for (size_t i = 0; i < size; i++)
+    {
+      char c = data[i];
+      if (c == '\n' || c == '\r')
+      {
+        if (!overflow && length > 0)
+        {
+          Event event;
+          if (parseLine(line, length, event))
+            onEvent(event);
+          else
+            rejected++;
+        }
+
+        length = 0;
+        overflow = false;
+        continue;
+      }
+
+      if (length < MaxLine)
+        line[length++] = c;
+      else if (!overflow)
+      {
+        overflow = true;
+        rejected++;
+      }
+    }
+  }
+
+  /**
+   * @brief Lines that were not state lines, including command responses
+   */
+  uint64_t rejectedLines() const { return rejected; }
+
+  /**
+   * @brief Parses one line without its line break
+   *
+   * @return false if the line is not a state line
+   */
+  static bool parseLine(const char *text, size_t size, Event &event)
+  {
+    const char *end = text + size;
+
+    // A leading timestamp or stray bytes before the state are allowed
+    const char *p = text;
+    while (p < end && *p != '[')
+      p++;
+
+    if (end - p < 5 || p[4] != ']' || !parseState(p + 1, event.state))
+      return false;
+
+    p += 5;
+    while (p < end)
+    {
+      if (*p != ' ')
+        return false;
+
+      p++;
+      if (p == end)
+        return false;
+
+      char field = *p++;
+      bool ok;
+      switch (field)
+      {
+      case 'c':
+        ok = parseNumber(p, end, event.confidence);
+        break;
+      case 'n':
+        ok = parseNumber(p, end, event.chainLength);
+        break;
+      case 'p':
+        ok = parsePair(p, end, event.proximity[0], event.proximity[1]);
+        break;
+      case 'g':
+        ok = parsePair(p, end, event.grip[0], event.grip[1]);
+        break;
+      case 'l':
+        ok = parsePair(p, end, event.delta[0], event.rate[0]);
+        event.hasTelemetry = true;
+        break;
+      case 'r':
+        ok = parsePair(p, end, event.delta[1], event.rate[1]);
+        event.hasTelemetry = true;
+        break;
+      case 'i':
+        ok = parseNumber(p, end, event.impedance);
+        event.hasTelemetry = true;
+        break;
+      default:
+        // Skip fields added by newer firmware
+        ok = true;
+        while (p < end && *p != ' ')
+          p++;
+        break;
+      }
+
+      if (!ok)
+        return false;
+    }
+
+    return true;
+  }
+
+private:
+  char line[MaxLine];
+  size_t length = 0;
+  bool overflow = false;
+  uint64_t rejected = 0;
+
+  static bool parseState(const char *digits, State &state)
+  {
+    if (digits[0] == '0' && digits[1] == '0' && digits[2] == '0')
+      state = State::Idle;
+    else if (digits[0] == '1' && digits[1] == '0' && digits[2] == '0')
+      state = State::Left;
+    else if (digits[0] == '0' && digits[1] == '1' && digits[2] == '0')
+      state = State::Right;
+    else if (digits[0] == '1' && digits[1] == '1' && digits[2] == '0')
+      state = State::Both;
+    else if (digits[0] == '0' && digits[1] == '0' && digits[2] == '1')
+      state = State::Joined;
+    else
+      return false;
+
+    return true;
+  }
+
+  /**
+   * @brief Parses an optionally negative decimal that fits in T, advancing p past it
+   */
+  template <typename T>
+  static bool parseNumber(const char *&p, const char *end, T &value)
+  {
+    bool negative = p < end && *p == '-';
+    if (negative)
+      p++;
+
+    const char *start = p;
+    long result = 0;
+    while (p < end && *p >= '0' && *p <= '9' && p - start < 6)
+      result = result * 10 + (*p++ - '0');
+
+    if (p == start || (p < end && *p != ' ' && *p != ','))
+      return false;
+
+    result = negative ? -result : result;
+    if (result < INT16_MIN || result > INT16_MAX || (sizeof(T) == 1 && (result < INT8_MIN || result > INT8_MAX)))
+      return false;
+
+    value = (T)result;
+    return true;
+  }
+
+  template <typename T>
+  static bool parsePair(const char *&p, const char *end, T &first, T &second)
+  {
+    if (!parseNumber(p, end, first) || p == end || *p != ',')
+      return false;
+
+    p++;
+    return parseNumber(p, end, second);
+  }
+};
+
+/**
+ * @brief Parses the timestamp prefix of a recorded log line, in any of the formats loggers add:
+ *   12:34:56.789 -> [110]       serial monitor time of day
+ *   1697640000.125 [110]        seconds
+ *   1697640000125 [110]         milliseconds
+ *
+ * @return milliseconds, or -1 if the prefix holds no timestamp
+ */
+inline int64_t parseTimestamp(const char *text, const char *end)
+{
+  while (text < end && isspace((unsigned char)*text))
+    text++;
+
+  if (text == end || !isdigit((unsigned char)*text))
+    return -1;
+
+  char *next;
+  int64_t whole = strtoll(text, &next, 10);
+
+  // Serial monitor time of day, HH:MM:SS.mmm
+  if (*next == ':')
+  {
+    int64_t minutes = strtoll(next + 1, &next, 10);
+    if (*next != ':')
+      return -1;
+
+    double seconds = strtod(next + 1, &next);
+    return (whole * 60 + minutes) * 60000 + (int64_t)(seconds * 1000 + 0.5);
+  }
+
+  if (*next == '.')
+    return (int64_t)(strtod(text, &next) * 1000 + 0.5);
+
+  return whole;
+}
+
+} // namespace hc
@@ -0,0 +1,196 @@
+/**
+ * Times hc_parser.h on simulated module output in each outFmt and chunk size, against the string
+ * splitting show software does today, and checks that parsing allocates nothing.
+ *
+ * Build:
+ *   g++ -std=c++17 -O2 -o hc_parser_bench tools/hc_parser_bench.cpp
+ *
+ * Usage:
+ *   hc_parser_bench [-n LINES] [-c CHUNK]
+ *
+ * The input is LINES thousand lines (default 1000, up to 100000) from simulated modules (see hc_sim.h),
+ * generated once per outFmt. It is fed to the parser in CHUNK byte reads (default 1, 64 and 4096, as a
+ * byte at a time reader, a USB packet and a full read), and split into lines and fields with std::string
+ * and std::stringstream as a baseline. Each runs five times and the fastest run is reported. The exit status
+ * is 1 if the parser missed a line, rejected one, or allocated while parsing.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <new>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "hc_parser.h"
+#include "hc_sim.h"
+
+namespace
+{
+
+const int Runs = 5;
+const int MaxThousands = 100000;
+
+std::atomic<uint64_t> allocations(0);
+
+std::string makeInput(size_t lines, int format)
+{
+  std::string text;
+  char line[hc::SimulatedModule::MaxLine];
+  for (size_t module = 0; lines > 0; module++)
+  {
+    // A few sessions back to back, so every state and field width turns up
+    hc::SimulatedModule simulated(module + 1, format);
+    for (int i = 0; i < 20000 && lines > 0; i++, lines--)
+      text.append(line, simulated.check(line));
+  }
+
+  return text;
+}
+
+double bestSeconds(const std::function<void()> &run)
+{
+  double best = 1e9;
+  for (int i = 0; i < Runs; i++)
+  {
+    auto start = std::chrono::steady_clock::now();
+    run();
+    best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+  }
+  return best;
+}
+
+/**
+ * @brief Splits lines and fields the way show software does, returning the states seen
+ */
+size_t splitLines(const std::string &text, uint64_t &checksum)
+{
+  std::istringstream in(text);
+  std::string line;
+  size_t events = 0;
+
+  while (std::getline(in, line))
+  {
+    if (!line.empty() && line.back() == '\r')
+      line.pop_back();
+    if (line.size() < 5 || line[0] != '[' || line[4] != ']')
+      continue;
+
+    std::string digits = line.substr(1, 3);
+    checksum += digits == "000" ? 0 : digits == "100" ? 1 : digits == "010" ? 2 : digits == "110" ? 3 : 4;
+
+    std::istringstream fields(line.substr(5));
+    std::string field;
+    while (fields >> field)
+      checksum += atoi(field.c_str() + 1);
+
+    events++;
+  }
+
+  return events;
+}
+
+void usage()
+{
+  fprintf(stderr, "usage: hc_parser_bench [-n LINES] [-c CHUNK]\n");
+}
+
+} // namespace
+
+// Counts every allocation, so parsing can be checked to make none; noinline keeps GCC from pairing the
+// inlined malloc and free as mismatched
+__attribute__((noinline)) void *operator new(size_t size)
+{
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void *memory = malloc(size ? size : 1))
+    return memory;
+  throw std::bad_alloc();
+}
+
+__attribute__((noinline)) void operator delete(void *memory) noexcept
+{
+  free(memory);
+}
+
+__attribute__((noinline)) void operator delete(void *memory, size_t) noexcept
+{
+  free(memory);
+}
+
+int main(int argc, char **argv)
+{
+  size_t lines = 1000;
+  std::vector<size_t> chunks = {1, 64, 4096};
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:c:")) != -1)
+  {
+    switch (opt)
+    {
+    case 'n':
+      lines = std::clamp(atoi(optarg), 1, MaxThousands);
+      break;
+    case 'c':
+      chunks = {(size_t)std::max(atoi(optarg), 1)};
+      break;
+    default:
+      usage();
+      return 1;
+    }
+  }
+  lines *= 1000;
+
+  printf("%zu lines per outFmt, best of %d runs\n\n", lines, Runs);
+  printf("%-6s %-10s %8s %10s %12s %8s %12s\n", "outFmt", "reader", "MB", "MB/s", "Mline/s", "speedup", "allocations");
+  bool ok = true;
+
+  for (int format = 0; format <= 2; format++)
+  {
+    std::string input = makeInput(lines, format);
+    double megabytes = input.size() / 1e6;
+
+    uint64_t checksum = 0;
+    size_t splitEvents = 0;
+    double splitSeconds = bestSeconds([&]
+                                      { splitEvents = splitLines(input, checksum); });
+    printf("%-6d %-10s %8.1f %10.1f %12.2f %8s %12s\n", format, "split", megabytes, megabytes / splitSeconds,
+           splitEvents / splitSeconds / 1e6, "1.00x", "-");
+
+    for (size_t chunk : chunks)
+    {
+      size_t events = 0;
+      uint64_t rejected = 0;
+      uint64_t allocated = 0;
+      double seconds = bestSeconds([&]
+                                   {
+                                     hc::Parser parser;
+                                     events = 0;
+                                     uint64_t before = allocations;
+                                     for (size_t offset = 0; offset < input.size(); offset += chunk)
+                                     {
+                                       parser.feed(input.data() + offset, std::min(chunk, input.size() - offset),
+                                                   [&](const hc::Event &) { events++; });
+                                     }
+                                     allocated = allocations - before;
+                                     rejected = parser.rejectedLines();
+                                   });
+
+      char reader[16];
+      snprintf(reader, sizeof(reader), "feed %zu", chunk);
+      char speedup[16];
+      snprintf(speedup, sizeof(speedup), "%.2fx", splitSeconds / seconds);
+      printf("%-6d %-10s %8.1f %10.1f %12.2f %8s %12llu%s\n", format, reader, megabytes, megabytes / seconds,
+             events / seconds / 1e6, speedup, (unsigned long long)allocated,
+             events == lines && rejected == 0 && allocated == 0 ? "" : "  FAILED");
+      ok &= events == lines && rejected == 0 && allocated == 0;
+    }
+  }
+
+  return ok ? 0 : 1;
+}
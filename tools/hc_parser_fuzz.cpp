@@ -0,0 +1,247 @@
+/**
+ * Fuzzes hc_parser.h: corrupted module output in random chunk splits must never crash it, read out of
+ * bounds or change what it reports, and every line after the corruption must still come through.
+ *
+ * Build:
+ *   g++ -std=c++17 -O1 -g -fsanitize=address,undefined -o hc_parser_fuzz tools/hc_parser_fuzz.cpp
+ *   clang++ -std=c++17 -O1 -g -fsanitize=fuzzer,address,undefined -DHC_LIBFUZZER -o hc_parser_fuzz tools/hc_parser_fuzz.cpp
+ *
+ * Usage:
+ *   hc_parser_fuzz [-n ITERATIONS] [-s SEED]
+ *
+ * Built on its own it runs ITERATIONS rounds (default 100000) from SEED (default 1). Each round takes a
+ * stretch of simulated module output (see hc_sim.h) in a random outFmt and mangles it: flipped, inserted
+ * and deleted bytes, random byte runs, lines cut short, overlong lines and command responses. It then
+ * checks that
+ *   - feeding it in random chunks reports the same events and rejected lines as feeding it at once,
+ *   - every event holds a valid state,
+ *   - a clean line following the mangled stretch is reported exactly as parseLine reads it alone.
+ * The first failing round is printed with its seed, and the exit status is 1.
+ *
+ * Built with -DHC_LIBFUZZER the same checks run on the inputs libFuzzer generates instead, with the
+ * chunk splits taken from the input's first bytes.
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "hc_parser.h"
+#include "hc_sim.h"
+
+namespace
+{
+
+const char CleanLine[] = "[001] c7 n3 p9,9 g100,50 i512";
+
+// xorshift64*, as hc_sim.h, so a seed always replays the same rounds
+struct Random
+{
+  uint64_t state;
+
+  uint32_t next()
+  {
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return (uint32_t)((state * 2685821657736338717ULL) >> 32);
+  }
+
+  size_t below(size_t bound) { return bound ? next() % bound : 0; }
+};
+
+bool sameEvent(const hc::Event &a, const hc::Event &b)
+{
+  return a.state == b.state && a.confidence == b.confidence && a.chainLength == b.chainLength &&
+         a.proximity[0] == b.proximity[0] && a.proximity[1] == b.proximity[1] && a.grip[0] == b.grip[0] &&
+         a.grip[1] == b.grip[1] && a.delta[0] == b.delta[0] && a.delta[1] == b.delta[1] && a.rate[0] == b.rate[0] &&
+         a.rate[1] == b.rate[1] && a.impedance == b.impedance && a.hasTelemetry == b.hasTelemetry;
+}
+
+/**
+ * @brief Feeds the input split at the given offsets, collecting the events
+ */
+uint64_t parse(const std::string &input, const std::vector<size_t> &splits, std::vector<hc::Event> &events)
+{
+  hc::Parser parser;
+  size_t offset = 0;
+  for (size_t split : splits)
+  {
+    if (split <= offset || split > input.size())
+      continue;
+    parser.feed(input.data() + offset, split - offset, [&](const hc::Event &event) { events.push_back(event); });
+    offset = split;
+  }
+  parser.feed(input.data() + offset, input.size() - offset, [&](const hc::Event &event) { events.push_back(event); });
+
+  return parser.rejectedLines();
+}
+
+/**
+ * @brief Runs every check on one input
+ *
+ * @return what failed, empty if nothing did
+ */
+std::string check(const std::string &mangled, const std::vector<size_t> &splits)
+{
+  // The mangled stretch, then a clean line that has to survive whatever came before it
+  std::string input = mangled + "\n" + CleanLine + "\r\n";
+
+  std::vector<hc::Event> whole, chunked;
+  uint64_t wholeRejected = parse(input, {}, whole);
+  uint64_t chunkedRejected = parse(input, splits, chunked);
+
+  if (whole.size() != chunked.size() || wholeRejected != chunkedRejected)
+    return "chunk splits changed the result";
+
+  for (size_t i = 0; i < whole.size(); i++)
+  {
+    if (!sameEvent(whole[i], chunked[i]))
+      return "chunk splits changed event " + std::to_string(i);
+
+    if ((uint8_t)whole[i].state > (uint8_t)hc::State::Joined)
+      return "invalid state in event " + std::to_string(i);
+  }
+
+  hc::Event expected;
+  if (!hc::Parser::parseLine(CleanLine, strlen(CleanLine), expected))
+    return "the clean line does not parse";
+  if (whole.empty() || !sameEvent(whole.back(), expected))
+    return "the line after the corruption was lost";
+
+  return "";
+}
+
+/**
+ * @brief Mangles a stretch of simulated output
+ */
+std::string mangle(Random &random)
+{
+  hc::SimulatedModule module(random.next(), random.below(3));
+  char line[hc::SimulatedModule::MaxLine];
+  std::string text;
+  size_t lines = 1 + random.below(20);
+  for (size_t i = 0; i < lines; i++)
+    text.append(line, module.check(line));
+
+  size_t edits = random.below(8);
+  for (size_t i = 0; i < edits; i++)
+  {
+    size_t at = random.below(text.size() + 1);
+    switch (random.below(7))
+    {
+    case 0:
+      if (at < text.size())
+        text[at] ^= (char)(1 << random.below(8));
+      break;
+    case 1:
+      text.insert(at, 1, (char)random.next());
+      break;
+    case 2:
+      text.erase(at, random.below(8));
+      break;
+    case 3:
+      for (size_t run = random.below(40); run > 0; run--)
+        text.insert(at, 1, (char)random.next());
+      break;
+    case 4:
+      // A reconnect cutting the rest of the line off
+      text.erase(at, text.find('\n', at) == std::string::npos ? std::string::npos : text.find('\n', at) - at);
+      break;
+    case 5:
+      text.insert(at, std::string(hc::Parser::MaxLine + random.below(200), '1'));
+      break;
+    case 6:
+      text.insert(at, "#outFmt=2\r\n#ERR set\r\n");
+      break;
+    }
+  }
+
+  return text;
+}
+
+std::vector<size_t> randomSplits(Random &random, size_t size)
+{
+  std::vector<size_t> splits;
+  for (size_t offset = random.below(8); offset < size; offset += 1 + random.below(64))
+    splits.push_back(offset);
+  return splits;
+}
+
+} // namespace
+
+#ifdef HC_LIBFUZZER
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+  // The first bytes choose the chunk sizes, the rest is the input
+  size_t header = size < 8 ? size : 8;
+  std::vector<size_t> splits;
+  size_t offset = 0;
+  for (size_t i = 0; header > 0 && i < 64; i++)
+  {
+    offset += 1 + data[i % header] % 32;
+    splits.push_back(offset);
+  }
+
+  std::string failure = check(std::string((const char *)data + header, size - header), splits);
+  if (!failure.empty())
+  {
+    fprintf(stderr, "%s\n", failure.c_str());
+    abort();
+  }
+
+  return 0;
+}
+
+#else
+
+void usage()
+{
+  fprintf(stderr, "usage: hc_parser_fuzz [-n ITERATIONS] [-s SEED]\n");
+}
+
+int main(int argc, char **argv)
+{
+  long iterations = 100000;
+  uint64_t seed = 1;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:s:")) != -1)
+  {
+    switch (opt)
+    {
+    case 'n':
+      iterations = atol(optarg);
+      break;
+    case 's':
+      seed = strtoull(optarg, nullptr, 10);
+      break;
+    default:
+      usage();
+      return 1;
+    }
+  }
+
+  for (long i = 0; i < iterations; i++)
+  {
+    // Each round is seeded on its own, so a failure can be replayed with -n 1
+    Random random = {(seed + i) * 0x9E3779B97F4A7C15ULL + 1};
+    std::string input = mangle(random);
+    std::string failure = check(input, randomSplits(random, input.size() + sizeof(CleanLine) + 2));
+    if (!failure.empty())
+    {
+      fprintf(stderr, "round %ld failed: %s, replay with -n 1 -s %llu\n", i, failure.c_str(), (unsigned long long)(seed + i));
+      return 1;
+    }
+  }
+
+  printf("%ld rounds passed\n", iterations);
+  return 0;
+}
+
+#endif
@@ -0,0 +1,520 @@
+/**
+ * Runs the performance benchmarks, records their results per commit and compares any two runs, so a change
+ * that slows the tools down, grows the firmware, slows its sensing or slows the module's scans shows up
+ * before it ships.
+ *
+ * Build:
+ *   g++ -std=c++17 -O2 -o hc_perf tools/hc_perf.cpp
+ *
+ * Usage:
+ *   hc_perf run [-r RESULTS] [-l LABEL] [-d BINDIR] [-k REPEAT] [-s SIZE_LOG] [-p PORT]
+ *   hc_perf compare [-r RESULTS] [-x PERCENT] BASE NEW
+ *   hc_perf list [-r RESULTS]
+ *
+ * run executes the benchmarks of the tools built in BINDIR (default .) - hc_logger bench, hc_loadgen and
+ * hc_query bench on generated data - REPEAT times each (default 3), keeping the median of every metric.
+ * It also runs sensing_sim debounce, onset and join once with fixed seeds, recording the simulated touch,
+ * release, onset and join delays, spurious flips and false onsets per minute and false JOINED reports of
+ * the firmware's sensing decisions, so a change to include/sensing.h shows up without a module attached.
+ * With -s it also reads the flash and RAM use from the output of `pio run` saved in SIZE_LOG, and with
+ * -p the scan and sensor check timings of the module on PORT (via hc_cli bench and stats). Results are
+ * appended to RESULTS (default perf_results.tsv) under LABEL, the short commit hash by default, as
+ * tab separated `run metric value unit better` rows, one per metric.
+ *
+ * compare prints every metric of two runs side by side with the change between them, marking changes for
+ * the worse beyond PERCENT (default 5) as regressions. The exit status is 2 if there are any.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+
+struct Options
+{
+  std::string results = "perf_results.tsv";
+  std::string label;
+  std::string binDir = ".";
+  int repeat = 3;
+  std::string sizeLog;
+  std::string port;
+  double threshold = 5;
+};
+
+struct Metric
+{
+  std::string name;
+  double value;
+  std::string unit;
+  bool higherIsBetter;
+};
+
+/**
+ * @brief Runs a shell command
+ *
+ * @return its standard output, empty if it failed
+ */
+std::string capture(const std::string &command)
+{
+  std::string output;
+  FILE *pipe = popen(command.c_str(), "r");
+  if (pipe == nullptr)
+    return output;
+
+  char buffer[4096];
+  size_t count;
+  while ((count = fread(buffer, 1, sizeof(buffer), pipe)) > 0)
+    output.append(buffer, count);
+
+  return pclose(pipe) == 0 ? output : std::string();
+}
+
+std::vector<std::string> lines(const std::string &text)
+{
+  std::vector<std::string> result;
+  std::istringstream in(text);
+  std::string line;
+  while (std::getline(in, line))
+    result.push_back(line);
+  return result;
+}
+
+void loggerMetrics(const Options &options, std::vector<Metric> &metrics)
+{
+  std::string output = capture(options.binDir + "/hc_logger bench -n 20 -t 600");
+  for (const std::string &line : lines(output))
+  {
+    unsigned long chunkLines, bytes;
+    double ratio, bytesPerLine, encode, decode;
+    if (sscanf(line.c_str(), "%lu %lu %lfx %lf %lf %lf", &chunkLines, &bytes, &ratio, &bytesPerLine, &encode, &decode) == 6 &&
+        chunkLines == 1200)
+    {
+      metrics.push_back({"binlog_bytes_per_line", bytesPerLine, "B", false});
+      metrics.push_back({"binlog_encode_rate", encode, "Mline/s", true});
+      metrics.push_back({"binlog_decode_rate", decode, "Mline/s", true});
+    }
+  }
+}
+
+void loadgenMetrics(const Options &options, std::vector<Metric> &metrics)
+{
+  std::string output = capture(options.binDir + "/hc_loadgen -n 200 -t 5");
+  for (const std::string &line : lines(output))
+  {
+    unsigned long long generated, dropped;
+    double percent;
+    long long mean, p50, p99, max;
+    if (sscanf(line.c_str(), "generated %llu lines, %llu dropped (%lf%%)", &generated, &dropped, &percent) == 3)
+      metrics.push_back({"loadgen_dropped", percent, "%", false});
+    else if (sscanf(line.c_str(), "consumer latency mean %lldus p50 %lldus p99 %lldus max %lldus", &mean, &p50, &p99, &max) == 4)
+    {
+      metrics.push_back({"loadgen_latency_mean", (double)mean, "us", false});
+      metrics.push_back({"loadgen_latency_p99", (double)p99, "us", false});
+    }
+  }
+}
+
+void queryMetrics(const Options &options, std::vector<Metric> &metrics)
+{
+  std::string log = "/tmp/hc_perf_" + std::to_string(getpid()) + ".hcl";
+  std::string query = options.binDir + "/hc_query";
+  std::string output;
+  if (!capture(query + " generate -n 10 -t 4 " + log).empty() && !capture(query + " index " + log).empty())
+    output = capture(query + " bench -q 50 " + log);
+  unlink(log.c_str());
+  unlink((log + ".idx").c_str());
+
+  static const char *const Names[] = {"query_joined_5min", "query_changes_1h", "query_all_1min", "query_changes_fleet_1h"};
+  size_t shape = 0;
+  for (const std::string &line : lines(output))
+  {
+    // Rows are the query name followed by matches, chunks, mean ms and max ms
+    std::istringstream in(line);
+    std::vector<std::string> words;
+    std::string word;
+    while (in >> word)
+      words.push_back(word);
+
+    double values[4];
+    int found = 0;
+    for (; found < 4 && words.size() > 4; found++)
+    {
+      const std::string &text = words[words.size() - 4 + found];
+      char *parsed;
+      values[found] = strtod(text.c_str(), &parsed);
+      if (*parsed != '\0')
+        break;
+    }
+
+    if (found == 4 && shape < sizeof(Names) / sizeof(Names[0]))
+      metrics.push_back({Names[shape++], values[2], "ms", false});
+  }
+}
+
+void sizeMetrics(const Options &options, std::vector<Metric> &metrics)
+{
+  std::ifstream in(options.sizeLog);
+  std::string line;
+  while (std::getline(in, line))
+  {
+    // e.g. "Flash: [===       ]  31.2% (used 15324 bytes from 49152 bytes)"
+    size_t used = line.find("(used ");
+    if (used == std::string::npos)
+      continue;
+
+    double bytes = atof(line.c_str() + used + 6);
+    if (line.compare(0, 4, "RAM:") == 0)
+      metrics.push_back({"firmware_ram", bytes, "B", false});
+    else if (line.compare(0, 6, "Flash:") == 0)
+      metrics.push_back({"firmware_flash", bytes, "B", false});
+  }
+}
+
+/**
+ * @brief Records the simulated sensing latency and stability at the firmware's default settings
+ */
+void sensingMetrics(const Options &options, std::vector<Metric> &metrics)
+{
+  // Seeds and trace length fixed, so the results only move when include/sensing.h or the simulator does. The rows kept
+  // are the firmware defaults - hysteresis 200 at 2 of 3, joinRate 300 when predicting - and an onsetSlope of 800, as it is off by default
+  std::string sim = options.binDir + "/sensing_sim ";
+  std::string flags = " -s 10 -t 600";
+
+  for (const std::string &line : lines(capture(sim + "debounce" + flags)))
+  {
+    int hysteresis, count, window;
+    double flips, spurious, touch, release;
+    long missed;
+    if (sscanf(line.c_str(), "%d %d/%d %lf %lf %lf %lf %ld", &hysteresis, &count, &window, &flips, &spurious, &touch, &release,
+               &missed) == 8 &&
+        hysteresis == 200 && count == 2 && window == 3)
+    {
+      metrics.push_back({"sensing_touch_delay", touch, "ms", false});
+      metrics.push_back({"sensing_release_delay", release, "ms", false});
+      metrics.push_back({"sensing_spurious_flips", spurious, "/min", false});
+    }
+  }
+
+  for (const std::string &line : lines(capture(sim + "onset" + flags)))
+  {
+    int slope;
+    double touch, release, falseOnsets, spurious;
+    if (sscanf(line.c_str(), "%d %lf %lf %lf %lf", &slope, &touch, &release, &falseOnsets, &spurious) == 5 && slope == 800)
+    {
+      metrics.push_back({"sensing_onset_delay", touch, "ms", false});
+      metrics.push_back({"sensing_false_onsets", falseOnsets, "/min", false});
+    }
+  }
+
+  for (const std::string &line : lines(capture(sim + "join" + flags)))
+  {
+    int rate;
+    long joins, reported, p90, falseJoined;
+    double mean, flaps, relays;
+    if (sscanf(line.c_str(), "relay only %d %ld %ld %lf %ld %ld %lf %lf", &rate, &joins, &reported, &mean, &p90, &falseJoined, &flaps,
+               &relays) == 8)
+    {
+      metrics.push_back({"sensing_join_delay", mean, "ms", false});
+      metrics.push_back({"sensing_join_flaps", flaps, "/min", false});
+    }
+    else if (sscanf(line.c_str(), "predict %d %ld %ld %lf %ld %ld %lf %lf", &rate, &joins, &reported, &mean, &p90, &falseJoined,
+                    &flaps, &relays) == 8 &&
+             rate == 300)
+    {
+      metrics.push_back({"sensing_join_predict_delay", mean, "ms", false});
+      metrics.push_back({"sensing_false_joined", (double)falseJoined, "pairs", false});
+    }
+  }
+}
+
+void deviceMetrics(const Options &options, std::vector<Metric> &metrics)
+{
+  std::string cli = options.binDir + "/hc_cli -p " + options.port + " ";
+  int scans, mean, max;
+  if (sscanf(capture(cli + "bench 100").c_str(), "bench=%d,%d,%d", &scans, &mean, &max) == 3)
+  {
+    metrics.push_back({"module_scan_mean", (double)mean, "us", false});
+    metrics.push_back({"module_scan_max", (double)max, "us", false});
+  }
+
+  for (const std::string &line : lines(capture(cli + "stats")))
+  {
+    if (line.compare(0, 11, "maxCheckUs=") == 0)
+      metrics.push_back({"module_check_max", atof(line.c_str() + 11), "us", false});
+  }
+}
+
+/**
+ * @brief Keeps the median of each metric over the repeats
+ */
+std::vector<Metric> medians(const std::vector<Metric> &samples)
+{
+  std::vector<Metric> result;
+  std::map<std::string, std::vector<double>> values;
+  for (const Metric &metric : samples)
+  {
+    if (values[metric.name].empty())
+      result.push_back(metric);
+    values[metric.name].push_back(metric.value);
+  }
+
+  for (Metric &metric : result)
+  {
+    std::vector<double> &v = values[metric.name];
+    std::sort(v.begin(), v.end());
+    metric.value = v.size() % 2 ? v[v.size() / 2] : (v[v.size() / 2 - 1] + v[v.size() / 2]) / 2;
+  }
+  return result;
+}
+
+std::string defaultLabel()
+{
+  std::string hash = capture("git rev-parse --short HEAD 2>/dev/null");
+  while (!hash.empty() && (hash.back() == '\n' || hash.back() == '\r'))
+    hash.pop_back();
+  if (hash.empty())
+    return std::to_string(time(nullptr));
+
+  return capture("git status --porcelain --untracked-files=no 2>/dev/null").empty() ? hash : hash + "-dirty";
+}
+
+int run(Options options)
+{
+  if (options.label.empty())
+    options.label = defaultLabel();
+
+  std::vector<Metric> samples;
+  for (int i = 0; i < options.repeat; i++)
+  {
+    fprintf(stderr, "run %d of %d\n", i + 1, options.repeat);
+    loggerMetrics(options, samples);
+    loadgenMetrics(options, samples);
+    queryMetrics(options, samples);
+  }
+
+  // Sizes, the simulated sensing and the module's timings are measured once, they are exact, repeatable or
+  // already the worst case
+  sensingMetrics(options, samples);
+  if (!options.sizeLog.empty())
+    sizeMetrics(options, samples);
+  if (!options.port.empty())
+    deviceMetrics(options, samples);
+
+  std::vector<Metric> metrics = medians(samples);
+  if (metrics.empty())
+  {
+    fprintf(stderr, "no benchmarks ran, build the tools into %s first\n", options.binDir.c_str());
+    return 1;
+  }
+
+  bool created = access(options.results.c_str(), F_OK) != 0;
+  FILE *out = fopen(options.results.c_str(), "a");
+  if (out == nullptr)
+  {
+    fprintf(stderr, "cannot write %s\n", options.results.c_str());
+    return 1;
+  }
+
+  if (created)
+    fprintf(out, "run\tmetric\tvalue\tunit\tbetter\n");
+  for (const Metric &metric : metrics)
+  {
+    fprintf(out, "%s\t%s\t%g\t%s\t%s\n", options.label.c_str(), metric.name.c_str(), metric.value, metric.unit.c_str(),
+            metric.higherIsBetter ? "higher" : "lower");
+    printf("%-26s %12g %s\n", metric.name.c_str(), metric.value, metric.unit.c_str());
+  }
+
+  if (fclose(out) != 0)
+  {
+    fprintf(stderr, "cannot write %s\n", options.results.c_str());
+    return 1;
+  }
+
+  printf("recorded as %s in %s\n", options.label.c_str(), options.results.c_str());
+  return 0;
+}
+
+/**
+ * @brief Reads every run's metrics, a later run with the same label replacing an earlier one
+ */
+bool loadResults(const std::string &path, std::vector<std::string> &runs, std::map<std::string, std::vector<Metric>> &metrics)
+{
+  std::ifstream in(path);
+  if (!in)
+    return false;
+
+  std::string line;
+  std::getline(in, line); // header
+  std::string previousRun;
+  while (std::getline(in, line))
+  {
+    std::istringstream fields(line);
+    std::string run, name, value, unit, better;
+    if (!std::getline(fields, run, '\t') || !std::getline(fields, name, '\t') || !std::getline(fields, value, '\t') ||
+        !std::getline(fields, unit, '\t') || !std::getline(fields, better, '\t'))
+      continue;
+
+    if (run != previousRun)
+    {
+      runs.erase(std::remove(runs.begin(), runs.end(), run), runs.end());
+      runs.push_back(run);
+      metrics[run].clear();
+      previousRun = run;
+    }
+    metrics[run].push_back({name, atof(value.c_str()), unit, better == "higher"});
+  }
+
+  return true;
+}
+
+int list(const Options &options)
+{
+  std::vector<std::string> runs;
+  std::map<std::string, std::vector<Metric>> metrics;
+  if (!loadResults(options.results, runs, metrics))
+  {
+    fprintf(stderr, "cannot read %s\n", options.results.c_str());
+    return 1;
+  }
+
+  for (const std::string &run : runs)
+    printf("%s (%zu metrics)\n", run.c_str(), metrics[run].size());
+  return 0;
+}
+
+int compare(const Options &options, const std::string &base, const std::string &next)
+{
+  std::vector<std::string> runs;
+  std::map<std::string, std::vector<Metric>> metrics;
+  if (!loadResults(options.results, runs, metrics))
+  {
+    fprintf(stderr, "cannot read %s\n", options.results.c_str());
+    return 1;
+  }
+
+  for (const std::string &run : {base, next})
+  {
+    if (metrics.find(run) == metrics.end())
+    {
+      fprintf(stderr, "no run %s in %s\n", run.c_str(), options.results.c_str());
+      return 1;
+    }
+  }
+
+  bool color = isatty(STDOUT_FILENO);
+  const char *red = color ? "\033[31m" : "", *green = color ? "\033[32m" : "", *reset = color ? "\033[0m" : "";
+  int regressions = 0;
+
+  printf("%-26s %12s %12s %-8s %9s\n", "metric", base.c_str(), next.c_str(), "unit", "change");
+  for (const Metric &after : metrics[next])
+  {
+    auto before = std::find_if(metrics[base].begin(), metrics[base].end(), [&](const Metric &metric)
+                               { return metric.name == after.name; });
+    if (before == metrics[base].end())
+    {
+      printf("%-26s %12s %12g %-8s %9s\n", after.name.c_str(), "-", after.value, after.unit.c_str(), "new");
+      continue;
+    }
+
+    // Counts that were 0 before, such as false JOINED reports, change without bound when they appear
+    double change = before->value != 0 ? (after.value - before->value) / fabs(before->value) * 100
+                    : after.value != 0 ? copysign(INFINITY, after.value)
+                                       : 0;
+    double worse = after.higherIsBetter ? -change : change;
+    const char *mark = "";
+    const char *tint = "";
+    if (worse > options.threshold)
+    {
+      mark = "  REGRESSION";
+      tint = red;
+      regressions++;
+    }
+    else if (worse < -options.threshold)
+    {
+      mark = "  better";
+      tint = green;
+    }
+
+    printf("%s%-26s %12g %12g %-8s %+8.1f%%%s%s\n", tint, after.name.c_str(), before->value, after.value,
+           after.unit.c_str(), change, mark, reset);
+  }
+
+  printf("\n%d regression%s beyond %g%%\n", regressions, regressions == 1 ? "" : "s", options.threshold);
+  return regressions > 0 ? 2 : 0;
+}
+
+void usage()
+{
+  fprintf(stderr, "usage: hc_perf run [-r RESULTS] [-l LABEL] [-d BINDIR] [-k REPEAT] [-s SIZE_LOG] [-p PORT]\n"
+                  "       hc_perf compare [-r RESULTS] [-x PERCENT] BASE NEW\n"
+                  "       hc_perf list [-r RESULTS]\n");
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+  if (argc < 2)
+  {
+    usage();
+    return 1;
+  }
+
+  std::string mode = argv[1];
+  Options options;
+  int opt;
+  optind = 2;
+
+  while ((opt = getopt(argc, argv, "r:l:d:k:s:p:x:")) != -1)
+  {
+    switch (opt)
+    {
+    case 'r':
+      options.results = optarg;
+      break;
+    case 'l':
+      options.label = optarg;
+      break;
+    case 'd':
+      options.binDir = optarg;
+      break;
+    case 'k':
+      options.repeat = std::max(atoi(optarg), 1);
+      break;
+    case 's':
+      options.sizeLog = optarg;
+      break;
+    case 'p':
+      options.port = optarg;
+      break;
+    case 'x':
+      options.threshold = std::max(atof(optarg), 0.0);
+      break;
+    default:
+      usage();
+      return 1;
+    }
+  }
+
+  int extra = argc - optind;
+  if (mode == "run" && extra == 0)
+    return run(options);
+  if (mode == "list" && extra == 0)
+    return list(options);
+  if (mode == "compare" && extra == 2)
+    return compare(options, argv[optind], argv[optind + 1]);
+
+  usage();
+  return 1;
+}
@@ -0,0 +1,649 @@
+/**
+ * Answers questions like "every JOINED line from module 7 between 21:00 and 21:05" from binary logs
+ * (see hc_binlog.h) in milliseconds, however large the log.
+ *
+ * Build:
+ *   g++ -std=c++17 -O2 -o hc_query tools/hc_query.cpp
+ *
+ * Usage:
+ *   hc_query index FILE
+ *   hc_query [-m MODULE] [-s STATE] [-f FROM] [-u UNTIL] [-c] FILE
+ *   hc_query generate [-n MODULES] [-t HOURS] FILE
+ *   hc_query bench [-q QUERIES] FILE
+ *   hc_query stats [-m MODULE] [-s STATE] [-f FROM] [-u UNTIL] [-w WINDOW] [-x THRESHOLD] FILE
+ *
+ * index writes FILE.idx, one fixed size entry per chunk holding its module, time span, states seen and
+ * offset, sorted by module then time. A query maps the log and its index into memory, binary searches the
+ * index for each module's chunks overlapping FROM-UNTIL, skips chunks that never saw STATE and decodes only
+ * the rest, straight from the mapping. A module whose chunks overlap in time, as after importing a log
+ * twice, cannot be binary searched and has its entries walked in order instead. Matching lines are printed
+ * as `<module> <time ms> <state line>`, or with -c only lines where the state changed. Without an index, or
+ * with one made for a different size or modification time of the log, the chunk headers are walked
+ * instead, which reads a little of every chunk.
+ *
+ * STATE is idle, left, right, both or joined. FROM and UNTIL are milliseconds since the epoch or local
+ * times as YYYY-MM-DDTHH:MM:SS. generate writes simulated modules (see hc_sim.h) at 20Hz to a new log,
+ * and bench times random queries against a log.
+ *
+ * stats gathers each matching module's pad deltas (l/r telemetry) and prints per pad the sample count,
+ * mean, standard deviation, min and max, and how often the delta smoothed over WINDOW samples (default 1,
+ * unsmoothed) rose past THRESHOLD (default 1000), using the vectorised kernels in hc_kernels.h.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <random>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+#include "hc_binlog.h"
+#include "hc_kernels.h"
+#include "hc_parser.h"
+#include "hc_sim.h"
+
+namespace
+{
+
+using hc::binlog::ChunkHeader;
+using hc::binlog::Record;
+
+const char IndexMagic[8] = {'H', 'C', 'I', 'D', 'X', 2, 0, 0};
+const int StateCount = 5;
+const char *const StateNames[StateCount] = {"idle", "left", "right", "both", "joined"};
+const char *const StateCodes[StateCount] = {"000", "100", "010", "110", "001"};
+
+// Index layout: magic, the log size and modification time it covers, then entries sorted by module and
+// first time
+struct IndexEntry
+{
+  uint64_t offset;
+  int64_t firstMs;
+  int64_t lastMs;
+  uint16_t module;
+  uint8_t stateMask;
+  uint8_t flags;
+  uint32_t count;
+};
+
+// Set on every entry of a module whose chunks overlap in time (an import of a log already recorded, or
+// clock steps), so their last times are out of order and cannot be binary searched
+const uint8_t Overlapping = 1;
+
+static_assert(sizeof(IndexEntry) == 32, "index entries are written as is");
+
+struct Query
+{
+  int module = -1; // -1 - every module
+  int state = -1;  // -1 - every state
+  int64_t fromMs = INT64_MIN;
+  int64_t untilMs = INT64_MAX;
+  bool changes = false;
+};
+
+/**
+ * @brief A read only mapping of a whole file
+ */
+class Mapping
+{
+public:
+  ~Mapping()
+  {
+    if (data != nullptr)
+      munmap((void *)data, size);
+  }
+
+  bool open(const std::string &path)
+  {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+      return false;
+
+    struct stat info;
+    bool ok = fstat(fd, &info) == 0 && info.st_size > 0;
+    if (ok)
+    {
+      size = info.st_size;
+      modifiedNs = info.st_mtim.tv_sec * 1000000000LL + info.st_mtim.tv_nsec;
+      void *mapped = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+      ok = mapped != MAP_FAILED;
+      data = ok ? (const uint8_t *)mapped : nullptr;
+    }
+
+    close(fd);
+    return ok;
+  }
+
+  const uint8_t *data = nullptr;
+  size_t size = 0;
+  int64_t modifiedNs = 0;
+};
+
+/**
+ * @brief Walks the chunk headers of a mapped log, checking each chunk's checksum if asked
+ *
+ * @return false if the log ends in a damaged chunk, the entries before it are still returned
+ */
+bool scanChunks(const Mapping &log, bool verify, std::vector<IndexEntry> &entries)
+{
+  size_t offset = hc::binlog::FileHeaderSize;
+  while (offset < log.size)
+  {
+    ChunkHeader header;
+    if (!hc::binlog::parseChunkHeader(log.data + offset, log.size - offset, header) ||
+        header.payloadSize > log.size - offset - hc::binlog::ChunkHeaderSize ||
+        (verify && !hc::binlog::checkChunk(log.data + offset, header)))
+      return false;
+
+    entries.push_back({offset, header.firstMs, header.lastMs, header.module, header.stateMask, 0, header.count});
+    offset += hc::binlog::ChunkHeaderSize + header.payloadSize;
+  }
+
+  return true;
+}
+
+/**
+ * @brief Sorts entries by module and first time, flagging the modules whose last times come out of order
+ */
+void sortEntries(std::vector<IndexEntry> &entries)
+{
+  std::sort(entries.begin(), entries.end(), [](const IndexEntry &a, const IndexEntry &b)
+            { return a.module != b.module ? a.module < b.module : a.firstMs < b.firstMs; });
+
+  for (size_t first = 0, last; first < entries.size(); first = last)
+  {
+    bool ordered = true;
+    for (last = first + 1; last < entries.size() && entries[last].module == entries[first].module; last++)
+      ordered &= entries[last].lastMs >= entries[last - 1].lastMs;
+
+    for (size_t i = first; i < last; i++)
+      entries[i].flags = ordered ? 0 : Overlapping;
+  }
+}
+
+int buildIndex(const std::string &path)
+{
+  Mapping log;
+  if (!log.open(path) || !hc::binlog::checkFileHeader(log.data, log.size))
+  {
+    fprintf(stderr, "cannot read %s as a binary log\n", path.c_str());
+    return 1;
+  }
+
+  std::vector<IndexEntry> entries;
+  if (!scanChunks(log, true, entries))
+    fprintf(stderr, "%s: stopped at a damaged chunk, indexing what comes before it\n", path.c_str());
+  sortEntries(entries);
+
+  std::string indexPath = path + ".idx";
+  FILE *out = fopen(indexPath.c_str(), "wb");
+  uint64_t covered[2] = {log.size, (uint64_t)log.modifiedNs};
+  if (out == nullptr || fwrite(IndexMagic, sizeof(IndexMagic), 1, out) != 1 || fwrite(covered, sizeof(covered), 1, out) != 1 ||
+      fwrite(entries.data(), sizeof(IndexEntry), entries.size(), out) != entries.size() || fclose(out) != 0)
+  {
+    fprintf(stderr, "cannot write %s\n", indexPath.c_str());
+    return 1;
+  }
+
+  printf("%zu chunks indexed in %s\n", entries.size(), indexPath.c_str());
+  return 0;
+}
+
+/**
+ * @brief Finds the chunks of a log, from its index when that is current
+ *
+ * @return entries sorted by module and time, pointing into the index mapping or into owned storage
+ */
+const IndexEntry *loadIndex(const std::string &path, const Mapping &log, Mapping &index, std::vector<IndexEntry> &scanned, size_t &count)
+{
+  const size_t headerSize = sizeof(IndexMagic) + 2 * sizeof(uint64_t);
+  if (index.open(path + ".idx") && index.size >= headerSize && memcmp(index.data, IndexMagic, sizeof(IndexMagic)) == 0 &&
+      (index.size - headerSize) % sizeof(IndexEntry) == 0)
+  {
+    // A log rewritten to the same size is caught by its modification time
+    uint64_t covered[2];
+    memcpy(covered, index.data + sizeof(IndexMagic), sizeof(covered));
+    if (covered[0] == log.size && covered[1] == (uint64_t)log.modifiedNs)
+    {
+      count = (index.size - headerSize) / sizeof(IndexEntry);
+      return (const IndexEntry *)(index.data + headerSize);
+    }
+  }
+
+  fprintf(stderr, "%s: no current index, scanning chunk headers - run `hc_query index` to speed this up\n", path.c_str());
+  scanChunks(log, false, scanned);
+  sortEntries(scanned);
+  count = scanned.size();
+  return scanned.data();
+}
+
+void printRecord(uint16_t module, const Record &record)
+{
+  const hc::Event &e = record.event;
+  printf("%u %lld [%s]", module, (long long)record.timeMs, StateCodes[(int)e.state]);
+  if (e.confidence >= 0)
+    printf(" c%d n%d p%d,%d g%d,%d", e.confidence, e.chainLength, e.proximity[0], e.proximity[1], e.grip[0], e.grip[1]);
+  if (e.hasTelemetry && e.impedance >= 0)
+    printf(" i%d", e.impedance);
+  else if (e.hasTelemetry)
+    printf(" l%d,%d r%d,%d", e.delta[0], e.rate[0], e.delta[1], e.rate[1]);
+  printf("\n");
+}
+
+/**
+ * @brief Runs a query over the indexed chunks, calling onMatch(module, record) for each matching line
+ *
+ * @return chunks decoded
+ */
+template <typename Callback>
+size_t runQuery(const Mapping &log, const IndexEntry *entries, size_t count, const Query &query, Callback &&onMatch)
+{
+  size_t decoded = 0;
+  std::vector<Record> records;
+  const IndexEntry *end = entries + count;
+
+  // One module's chunks at a time, from the first that ends at or after FROM, found by binary search unless
+  // the module's chunks overlap
+  for (const IndexEntry *first = entries; first < end;)
+  {
+    uint16_t module = first->module;
+    const IndexEntry *last = std::partition_point(first, end, [&](const IndexEntry &entry)
+                                                  { return entry.module == module; });
+
+    if (query.module < 0 || query.module == module)
+    {
+      const IndexEntry *entry = first;
+      if (!(first->flags & Overlapping))
+        entry = std::partition_point(first, last, [&](const IndexEntry &e)
+                                     { return e.lastMs < query.fromMs; });
+      int previousState = -1;
+
+      for (; entry < last && entry->firstMs <= query.untilMs; entry++)
+      {
+        if (entry->lastMs < query.fromMs)
+        {
+          previousState = -1;
+          continue;
+        }
+
+        // A chunk that never saw STATE holds no match, and cannot continue a run of STATE into the next one
+        bool wanted = query.state < 0 || (entry->stateMask & (1 << query.state));
+        if (!wanted)
+        {
+          previousState = -1;
+          continue;
+        }
+
+        ChunkHeader header;
+        const uint8_t *chunk = log.data + entry->offset;
+        records.clear();
+        if (!hc::binlog::parseChunkHeader(chunk, log.size - entry->offset, header) || !hc::binlog::checkChunk(chunk, header) ||
+            !hc::binlog::decodeChunk(header, chunk + hc::binlog::ChunkHeaderSize, records))
+        {
+          fprintf(stderr, "skipping damaged chunk at %llu\n", (unsigned long long)entry->offset);
+          previousState = -1;
+          continue;
+        }
+        decoded++;
+
+        for (const Record &record : records)
+        {
+          int state = (int)record.event.state;
+          bool changed = state != previousState;
+          previousState = state;
+
+          if (record.timeMs < query.fromMs || record.timeMs > query.untilMs || (query.state >= 0 && state != query.state) ||
+              (query.changes && !changed))
+            continue;
+
+          onMatch(module, record);
+        }
+      }
+    }
+
+    first = last;
+  }
+
+  return decoded;
+}
+
+bool parseTime(const char *text, int64_t &ms)
+{
+  tm parts = {};
+  const char *rest = strptime(text, "%Y-%m-%dT%H:%M:%S", &parts);
+  if (rest != nullptr && *rest == '\0')
+  {
+    parts.tm_isdst = -1;
+    ms = mktime(&parts) * 1000LL;
+    return true;
+  }
+
+  char *end;
+  ms = strtoll(text, &end, 10);
+  return end != text && *end == '\0';
+}
+
+int parseStateName(const char *text)
+{
+  for (int i = 0; i < StateCount; i++)
+  {
+    if (strcmp(text, StateNames[i]) == 0)
+      return i;
+  }
+  return -1;
+}
+
+int query(const std::string &path, const Query &query)
+{
+  Mapping log, index;
+  if (!log.open(path) || !hc::binlog::checkFileHeader(log.data, log.size))
+  {
+    fprintf(stderr, "cannot read %s as a binary log\n", path.c_str());
+    return 1;
+  }
+
+  std::vector<IndexEntry> scanned;
+  size_t count;
+  const IndexEntry *entries = loadIndex(path, log, index, scanned, count);
+  runQuery(log, entries, count, query, printRecord);
+  return 0;
+}
+
+void printPadStats(uint16_t module, const char *pad, const std::vector<int16_t> &deltas, int window, int16_t threshold)
+{
+  if (deltas.empty())
+    return;
+
+  hc::kernels::Summary summary = hc::kernels::summarize(deltas.data(), deltas.size());
+  size_t crossings;
+  if (window > 1 && deltas.size() >= (size_t)window)
+  {
+    std::vector<int16_t> smoothed(deltas.size() - window + 1);
+    hc::kernels::movingAverage(deltas.data(), deltas.size(), window, smoothed.data());
+    crossings = hc::kernels::countCrossings(smoothed.data(), smoothed.size(), threshold);
+  }
+  else
+    crossings = hc::kernels::countCrossings(deltas.data(), deltas.size(), threshold);
+
+  printf("%6u %-5s %12zu %9.1f %9.1f %7d %7d %10zu\n", module, pad, summary.count, summary.mean(),
+         std::sqrt(std::max(summary.variance(), 0.0)), summary.min, summary.max, crossings);
+}
+
+int stats(const std::string &path, const Query &query, int window, int16_t threshold)
+{
+  Mapping log, index;
+  if (!log.open(path) || !hc::binlog::checkFileHeader(log.data, log.size))
+  {
+    fprintf(stderr, "cannot read %s as a binary log\n", path.c_str());
+    return 1;
+  }
+
+  std::vector<IndexEntry> scanned;
+  size_t count;
+  const IndexEntry *entries = loadIndex(path, log, index, scanned, count);
+
+  // Matches arrive a module at a time, so each module's columns are summarised when the next one starts
+  std::vector<int16_t> deltas[2];
+  int current = -1;
+  auto flush = [&]
+  {
+    if (current >= 0)
+    {
+      printPadStats(current, "left", deltas[0], window, threshold);
+      printPadStats(current, "right", deltas[1], window, threshold);
+    }
+    deltas[0].clear();
+    deltas[1].clear();
+  };
+
+  printf("%6s %-5s %12s %9s %9s %7s %7s %10s\n", "module", "pad", "samples", "mean", "stddev", "min", "max", "crossings");
+  runQuery(log, entries, count, query, [&](uint16_t module, const Record &record)
+           {
+             if (module != current)
+             {
+               flush();
+               current = module;
+             }
+             const hc::Event &e = record.event;
+             if (e.hasTelemetry && e.impedance < 0)
+             {
+               deltas[0].push_back(e.delta[0]);
+               deltas[1].push_back(e.delta[1]);
+             } });
+  flush();
+  return 0;
+}
+
+int generate(const std::string &path, int modules, int hours)
+{
+  FILE *out = fopen(path.c_str(), "wb");
+  if (out == nullptr)
+  {
+    fprintf(stderr, "cannot write %s\n", path.c_str());
+    return 1;
+  }
+
+  uint8_t header[hc::binlog::FileHeaderSize];
+  hc::binlog::writeFileHeader(header);
+  fwrite(header, sizeof(header), 1, out);
+
+  // Chunks are written the way hc_logger records them, a minute of each module in turn
+  const int chunkLines = 1200;
+  const int64_t startMs = 1700000000000LL;
+  int64_t totalChecks = hours * 3600LL * 1000 / hc::SimulatedModule::SensorCheckMs;
+  std::vector<hc::SimulatedModule> simulations;
+  for (int m = 0; m < modules; m++)
+    simulations.emplace_back(m, 2);
+
+  std::vector<Record> records;
+  std::string chunk;
+  char line[hc::SimulatedModule::MaxLine];
+  uint64_t bytes = sizeof(header);
+
+  for (int64_t first = 0; first < totalChecks; first += chunkLines)
+  {
+    for (int m = 0; m < modules; m++)
+    {
+      records.clear();
+      for (int64_t check = first; check < std::min<int64_t>(first + chunkLines, totalChecks); check++)
+      {
+        Record record;
+        size_t size = simulations[m].check(line);
+        record.timeMs = startMs + check * hc::SimulatedModule::SensorCheckMs + m;
+        hc::Parser::parseLine(line, size - 2, record.event);
+        records.push_back(record);
+      }
+
+      hc::binlog::encodeChunk(m, records, chunk);
+      if (fwrite(chunk.data(), chunk.size(), 1, out) != 1)
+      {
+        fprintf(stderr, "cannot write %s\n", path.c_str());
+        fclose(out);
+        return 1;
+      }
+      bytes += chunk.size();
+    }
+  }
+
+  if (fclose(out) != 0)
+  {
+    fprintf(stderr, "cannot write %s\n", path.c_str());
+    return 1;
+  }
+
+  printf("wrote %s: %d modules, %d hours, %lld lines, %.1f MB\n", path.c_str(), modules, hours,
+         (long long)(totalChecks * modules), bytes / 1e6);
+  return 0;
+}
+
+int bench(const std::string &path, int queries)
+{
+  Mapping log, index;
+  if (!log.open(path) || !hc::binlog::checkFileHeader(log.data, log.size))
+  {
+    fprintf(stderr, "cannot read %s as a binary log\n", path.c_str());
+    return 1;
+  }
+
+  std::vector<IndexEntry> scanned;
+  size_t count;
+  auto start = std::chrono::steady_clock::now();
+  const IndexEntry *entries = loadIndex(path, log, index, scanned, count);
+  double loadMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  if (count == 0)
+  {
+    fprintf(stderr, "%s holds no chunks\n", path.c_str());
+    return 1;
+  }
+
+  int64_t minMs = INT64_MAX, maxMs = INT64_MIN;
+  int modules = 0;
+  for (size_t i = 0; i < count; i++)
+  {
+    minMs = std::min(minMs, entries[i].firstMs);
+    maxMs = std::max(maxMs, entries[i].lastMs);
+    modules = std::max(modules, entries[i].module + 1);
+  }
+
+  printf("%s: %.1f MB, %zu chunks, %d modules, index loaded in %.2f ms\n\n", path.c_str(), log.size / 1e6, count, modules, loadMs);
+  printf("%-34s %10s %10s %10s %10s\n", "query", "matches", "chunks", "mean ms", "max ms");
+
+  struct Shape
+  {
+    const char *name;
+    int64_t spanMs;
+    bool anyModule;
+    int state;
+    bool changes;
+  };
+  const Shape shapes[] = {
+      {"joined on one module, 5 minutes", 5 * 60000, false, (int)hc::State::Joined, false},
+      {"joined changes, one module, 1 hour", 3600000, false, (int)hc::State::Joined, true},
+      {"everything on one module, 1 minute", 60000, false, -1, false},
+      {"joined changes, all modules, 1 hour", 3600000, true, (int)hc::State::Joined, true},
+  };
+
+  std::mt19937_64 random(1);
+  for (const Shape &shape : shapes)
+  {
+    uint64_t matches = 0, chunks = 0;
+    double totalMs = 0, maxQueryMs = 0;
+    for (int i = 0; i < queries; i++)
+    {
+      Query query;
+      query.module = shape.anyModule ? -1 : (int)(random() % modules);
+      query.state = shape.state;
+      query.changes = shape.changes;
+      query.fromMs = minMs + (int64_t)(random() % (uint64_t)std::max<int64_t>(maxMs - minMs - shape.spanMs, 1));
+      query.untilMs = query.fromMs + shape.spanMs;
+
+      start = std::chrono::steady_clock::now();
+      chunks += runQuery(log, entries, count, query, [&](uint16_t, const Record &)
+                         { matches++; });
+      double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+      totalMs += ms;
+      maxQueryMs = std::max(maxQueryMs, ms);
+    }
+
+    printf("%-34s %10.0f %10.1f %10.3f %10.3f\n", shape.name, (double)matches / queries, (double)chunks / queries,
+           totalMs / queries, maxQueryMs);
+  }
+
+  return 0;
+}
+
+void usage()
+{
+  fprintf(stderr, "usage: hc_query index FILE\n"
+                  "       hc_query [-m MODULE] [-s STATE] [-f FROM] [-u UNTIL] [-c] FILE\n"
+                  "       hc_query generate [-n MODULES] [-t HOURS] FILE\n"
+                  "       hc_query bench [-q QUERIES] FILE\n"
+                  "       hc_query stats [-m MODULE] [-s STATE] [-f FROM] [-u UNTIL] [-w WINDOW] [-x THRESHOLD] FILE\n");
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+  std::string mode = argc > 1 ? argv[1] : "";
+  bool subcommand = mode == "index" || mode == "generate" || mode == "bench" || mode == "stats";
+  Query options;
+  int modules = 20, hours = 24, queries = 100, window = 1;
+  int16_t threshold = 1000;
+  int opt;
+  optind = subcommand ? 2 : 1;
+
+  while ((opt = getopt(argc, argv, "m:s:f:u:cn:t:q:w:x:")) != -1)
+  {
+    switch (opt)
+    {
+    case 'm':
+      options.module = atoi(optarg);
+      break;
+    case 's':
+      options.state = parseStateName(optarg);
+      if (options.state < 0)
+      {
+        usage();
+        return 1;
+      }
+      break;
+    case 'f':
+    case 'u':
+      if (!parseTime(optarg, opt == 'f' ? options.fromMs : options.untilMs))
+      {
+        usage();
+        return 1;
+      }
+      break;
+    case 'c':
+      options.changes = true;
+      break;
+    case 'n':
+      modules = std::clamp(atoi(optarg), 1, 65535);
+      break;
+    case 't':
+      hours = std::max(atoi(optarg), 1);
+      break;
+    case 'q':
+      queries = std::max(atoi(optarg), 1);
+      break;
+    case 'w':
+      window = std::clamp(atoi(optarg), 1, hc::kernels::MaxWindow);
+      break;
+    case 'x':
+      threshold = (int16_t)std::clamp(atoi(optarg), -32768, 32767);
+      break;
+    default:
+      usage();
+      return 1;
+    }
+  }
+
+  if (optind != argc - 1)
+  {
+    usage();
+    return 1;
+  }
+
+  std::string path = argv[optind];
+  if (mode == "index")
+    return buildIndex(path);
+  if (mode == "generate")
+    return generate(path, modules, hours);
+  if (mode == "bench")
+    return bench(path, queries);
+  if (mode == "stats")
+    return stats(path, options, window, threshold);
+
+  return query(path, options);
+}
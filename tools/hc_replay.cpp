@@ -0,0 +1,645 @@
+/**
+ * Stands in for modules that are not there: replays recorded serial logs, or simulated module output,
+ * onto pseudo-terminals that show software and host tools open like a real /dev/ttyACM.
+ *
+ * Build:
+ *   g++ -std=c++17 -O2 -o hc_replay tools/hc_replay.cpp
+ *
+ * Usage:
+ *   hc_replay [-n COUNT] [-s SPEED] [-l] [-d DIR] [-f FORMAT] [-t SECONDS] [-m MAX_US] [SOURCE ...]
+ *
+ * Each SOURCE is a recorded log (see trace_analyzer for the timestamp formats) or `sim` for a simulated
+ * module printing in outFmt FORMAT (see hc_sim.h), and becomes COUNT devices. With no sources, one
+ * simulated module is started. Every device's pty is printed as `<name> <path> <source>` once it is ready,
+ * and with -d linked as DIR/<name> for a stable path. Simulated modules answer `get outFmt` and
+ * `set outFmt`, anything else sent to a device is discarded.
+ *
+ * Only the state lines of a log are replayed, without their timestamps, so command responses the recording
+ * session received are not sent unasked. Lines are paced by their timestamps, or 50ms apart without them,
+ * scaled by SPEED (2 replays twice as fast); gaps over 2 seconds, such as disconnects, are shortened to 2
+ * seconds. With SPEED 0 lines are sent as fast as the reader takes them. A log replays once, or until
+ * interrupted with -l. Otherwise the tool runs until every log is done, interrupted, or for -t SECONDS.
+ *
+ * All devices run on one thread, sleeping on a timerfd armed for the next line due, so hundreds of devices
+ * cost little CPU. Like a real module, a device whose reader falls behind loses lines rather than holding
+ * up the others (except at SPEED 0); those are counted as dropped. On exit the lines sent, lines dropped and
+ * how late lines were sent against their schedule are printed to stderr. With -m the exit status is 2 if
+ * the 99th percentile lateness went over MAX_US microseconds, so scripts and hc_test can catch the replay
+ * drifting from its schedule; the maximum is left out, as one preemption of the host sets it.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <memory>
+#include <queue>
+#include <string>
+#include <sys/epoll.h>
+#include <sys/prctl.h>
+#include <sys/timerfd.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+#include "hc_parser.h"
+#include "hc_sim.h"
+
+namespace
+{
+
+const int64_t SensorCheckMs = hc::SimulatedModule::SensorCheckMs;
+const int64_t MaxGapMs = 2000;
+const int64_t DayMs = 24LL * 60 * 60 * 1000;
+const int LatenessBucketUs = 10;
+const int LatenessBuckets = 10000; // up to 100ms, later lines land in the last bucket
+
+volatile sig_atomic_t stopping = 0;
+
+struct Options
+{
+  int count = 1;
+  double speed = 1;
+  bool loop = false;
+  std::string linkDir;
+  int format = 0;
+  int seconds = 0;
+  int64_t maxLatenessUs = 0; // 0 for no bound
+};
+
+// A state line and when it is due, relative to the start of the recording
+struct Line
+{
+  int64_t atMs;
+  std::string text;
+};
+
+struct Recording
+{
+  std::string path;
+  std::vector<Line> lines;
+};
+
+struct Device
+{
+  std::string name;
+  std::string source;
+  std::string path;
+  std::string link;
+  int master = -1;
+  int slave = -1; // held open so the pty outlives readers coming and going
+
+  const Recording *recording = nullptr;
+  std::unique_ptr<hc::SimulatedModule> module;
+  size_t position = 0;  // next line of the recording
+  int64_t startNs = 0;  // when the recording's first line, or pass through it, was due
+  int64_t dueNs = 0;
+
+  std::string pending;  // unsent part of the last line, while the reader is behind
+  std::string input;    // partial command from the reader
+  bool blocked = false; // watching for the reader to make room
+  bool held = false;    // at SPEED 0, not scheduled until the reader catches up
+};
+
+struct Stats
+{
+  uint64_t lines = 0;
+  uint64_t dropped = 0;
+  uint64_t timed = 0; // lines sent against a schedule
+  int64_t latenessTotalNs = 0;
+  int64_t latenessMaxNs = 0;
+  std::vector<uint64_t> lateness = std::vector<uint64_t>(LatenessBuckets, 0);
+
+  void record(int64_t latenessNs)
+  {
+    lines++;
+    timed++;
+    latenessTotalNs += latenessNs;
+    latenessMaxNs = std::max(latenessMaxNs, latenessNs);
+    lateness[std::min<int64_t>(latenessNs / 1000 / LatenessBucketUs, LatenessBuckets - 1)]++;
+  }
+
+  int64_t percentileUs(double fraction) const
+  {
+    uint64_t target = (uint64_t)(timed * fraction), seen = 0;
+    for (int i = 0; i < LatenessBuckets; i++)
+    {
+      seen += lateness[i];
+      if (seen > target)
+        return (int64_t)(i + 1) * LatenessBucketUs;
+    }
+    return (int64_t)LatenessBuckets * LatenessBucketUs;
+  }
+};
+
+int64_t nowNs()
+{
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+void onSignal(int)
+{
+  stopping = 1;
+}
+
+/**
+ * @brief Loads the state lines of a log, placing each on the replay timeline
+ */
+bool loadRecording(const std::string &path, Recording &recording)
+{
+  std::ifstream in(path);
+  if (!in)
+    return false;
+
+  recording.path = path;
+  std::string line;
+  int64_t lastStamp = -1, atMs = -SensorCheckMs;
+  hc::Event event;
+
+  while (std::getline(in, line))
+  {
+    while (!line.empty() && (line.back() == '\r' || line.back() == ' '))
+      line.pop_back();
+
+    size_t bracket = line.find('[');
+    if (bracket == std::string::npos || !hc::Parser::parseLine(line.data(), line.size(), event))
+      continue;
+
+    int64_t stamp = hc::parseTimestamp(line.data(), line.data() + bracket);
+    int64_t stepMs = SensorCheckMs;
+    if (stamp >= 0)
+    {
+      // Time of day stamps wrap at midnight
+      while (lastStamp >= 0 && stamp < lastStamp - DayMs / 2)
+        stamp += DayMs;
+
+      stepMs = lastStamp >= 0 ? stamp - lastStamp : SensorCheckMs;
+      lastStamp = stamp;
+    }
+
+    atMs += std::clamp<int64_t>(stepMs, 0, MaxGapMs);
+    recording.lines.push_back({atMs, line.substr(bracket) + "\r\n"});
+  }
+
+  return true;
+}
+
+/**
+ * @brief Opens a pty in raw mode, so lines reach the reader byte for byte and its commands are not echoed
+ */
+bool openDevice(Device &device)
+{
+  device.master = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+  if (device.master < 0 || grantpt(device.master) != 0 || unlockpt(device.master) != 0)
+    return false;
+
+  const char *path = ptsname(device.master);
+  if (path == nullptr)
+    return false;
+
+  device.path = path;
+  device.slave = open(path, O_RDWR | O_NOCTTY | O_CLOEXEC);
+  if (device.slave < 0)
+    return false;
+
+  termios tty;
+  if (tcgetattr(device.slave, &tty) == 0)
+  {
+    cfmakeraw(&tty);
+    cfsetispeed(&tty, B9600);
+    cfsetospeed(&tty, B9600);
+    tcsetattr(device.slave, TCSANOW, &tty);
+  }
+
+  return true;
+}
+
+class Replayer
+{
+public:
+  Replayer(std::vector<Device> &devices, const Options &options) : devices(devices), options(options) {}
+
+  ~Replayer()
+  {
+    if (timer >= 0)
+      close(timer);
+    if (epoll >= 0)
+      close(epoll);
+  }
+
+  bool run()
+  {
+    epoll = epoll_create1(EPOLL_CLOEXEC);
+    timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (epoll < 0 || timer < 0)
+      return false;
+
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.u64 = TimerKey;
+    epoll_ctl(epoll, EPOLL_CTL_ADD, timer, &event);
+
+    int64_t start = nowNs();
+    for (size_t i = 0; i < devices.size(); i++)
+    {
+      event.events = EPOLLIN;
+      event.data.u64 = i;
+      epoll_ctl(epoll, EPOLL_CTL_ADD, devices[i].master, &event);
+
+      devices[i].startNs = start;
+      schedule(i, start + (devices[i].recording ? scaledNs(devices[i].recording->lines.front().atMs) : 0));
+    }
+
+    int64_t endNs = options.seconds > 0 ? start + options.seconds * 1000000000LL : INT64_MAX;
+    epoll_event events[64];
+
+    while (!stopping)
+    {
+      int64_t now = nowNs();
+      if (now >= endNs)
+        break;
+
+      while (!stopping && !due.empty() && due.top().first <= now)
+      {
+        size_t index = due.top().second;
+        due.pop();
+        send(index, now);
+      }
+
+      if (due.empty() && waiting == 0)
+        break;
+
+      arm(due.empty() ? endNs : std::min(due.top().first, endNs));
+
+      int ready = epoll_wait(epoll, events, 64, -1);
+      for (int i = 0; i < ready; i++)
+      {
+        if (events[i].data.u64 == TimerKey)
+        {
+          uint64_t expirations;
+          ssize_t ignored = read(timer, &expirations, sizeof(expirations));
+          (void)ignored;
+          continue;
+        }
+
+        size_t index = events[i].data.u64;
+        if (events[i].events & EPOLLIN)
+          receive(index);
+        if (events[i].events & EPOLLOUT)
+          drain(index);
+      }
+    }
+
+    return true;
+  }
+
+  const Stats &stats() const { return totals; }
+
+private:
+  static const uint64_t TimerKey = UINT64_MAX;
+
+  std::vector<Device> &devices;
+  const Options &options;
+  int epoll = -1;
+  int timer = -1;
+  size_t waiting = 0; // devices held back until their reader catches up, at SPEED 0
+  Stats totals;
+  std::priority_queue<std::pair<int64_t, size_t>, std::vector<std::pair<int64_t, size_t>>, std::greater<>> due;
+
+  int64_t scaledNs(int64_t ms) const
+  {
+    return options.speed > 0 ? (int64_t)(ms * 1000000 / options.speed) : 0;
+  }
+
+  void schedule(size_t index, int64_t when)
+  {
+    devices[index].dueNs = when;
+    due.push({when, index});
+  }
+
+  void arm(int64_t when)
+  {
+    itimerspec spec = {};
+    if (when != INT64_MAX)
+    {
+      // A zero value would disarm the timer, so anything already due fires a nanosecond in
+      when = std::max<int64_t>(when, 1);
+      spec.it_value.tv_sec = when / 1000000000;
+      spec.it_value.tv_nsec = when % 1000000000;
+    }
+    timerfd_settime(timer, TFD_TIMER_ABSTIME, &spec, nullptr);
+  }
+
+  /**
+   * @brief Sends a device's next line and schedules the one after, dropping it if the reader is behind
+   */
+  void send(size_t index, int64_t now)
+  {
+    Device &device = devices[index];
+    char buffer[hc::SimulatedModule::MaxLine];
+    const char *text;
+    size_t size;
+
+    if (device.module)
+    {
+      size = device.module->check(buffer);
+      text = buffer;
+    }
+    else
+    {
+      const Line &line = device.recording->lines[device.position];
+      text = line.text.data();
+      size = line.text.size();
+    }
+
+    if (!device.pending.empty())
+    {
+      totals.dropped++;
+    }
+    else
+    {
+      // At SPEED 0 there is no schedule to be late against
+      if (options.speed > 0)
+        totals.record(now - device.dueNs);
+      else
+        totals.lines++;
+
+      device.pending.assign(text, size);
+      drain(index);
+    }
+
+    advance(index);
+  }
+
+  void advance(size_t index)
+  {
+    Device &device = devices[index];
+    int64_t next;
+
+    if (device.module)
+    {
+      next = device.dueNs + scaledNs(SensorCheckMs);
+    }
+    else
+    {
+      const std::vector<Line> &lines = device.recording->lines;
+      if (++device.position == lines.size())
+      {
+        if (!options.loop)
+          return;
+
+        device.startNs += scaledNs(lines.back().atMs + SensorCheckMs);
+        device.position = 0;
+      }
+
+      next = device.startNs + scaledNs(lines[device.position].atMs);
+    }
+
+    // At SPEED 0 the next line waits for the reader instead of being dropped
+    if (options.speed > 0 || device.pending.empty())
+    {
+      schedule(index, next);
+    }
+    else
+    {
+      device.held = true;
+      waiting++;
+    }
+  }
+
+  /**
+   * @brief Writes as much of a device's pending output as its reader has room for, watching for room if any is left
+   */
+  void drain(size_t index)
+  {
+    Device &device = devices[index];
+
+    while (!device.pending.empty())
+    {
+      ssize_t count = write(device.master, device.pending.data(), device.pending.size());
+      if (count < 0 && errno == EINTR)
+        continue;
+      if (count <= 0)
+        break;
+
+      device.pending.erase(0, count);
+    }
+
+    bool blocked = !device.pending.empty();
+    if (blocked != device.blocked)
+    {
+      device.blocked = blocked;
+      epoll_event event = {};
+      event.events = blocked ? EPOLLIN | EPOLLOUT : EPOLLIN;
+      event.data.u64 = index;
+      epoll_ctl(epoll, EPOLL_CTL_MOD, device.master, &event);
+    }
+
+    // At SPEED 0 a device that was held back resumes once it drains
+    if (!blocked && device.held)
+    {
+      device.held = false;
+      waiting--;
+      schedule(index, nowNs());
+    }
+  }
+
+  /**
+   * @brief Reads commands from the reader, answering them if the device is simulated
+   */
+  void receive(size_t index)
+  {
+    Device &device = devices[index];
+    char buffer[256];
+    ssize_t count;
+
+    while ((count = read(device.master, buffer, sizeof(buffer))) > 0)
+    {
+      if (!device.module)
+        continue;
+
+      device.input.append(buffer, count);
+      size_t end;
+      while ((end = device.input.find_first_of("\r\n")) != std::string::npos)
+      {
+        if (end > 0)
+        {
+          char response[hc::SimulatedModule::MaxLine];
+          size_t size = device.module->command(device.input.data(), end, response);
+          device.pending.append(response, size);
+        }
+        device.input.erase(0, end + 1);
+      }
+
+      // Keep a runaway line from growing without bound, like the firmware's command buffer
+      if (device.input.size() > 64)
+        device.input.clear();
+    }
+
+    if (!device.pending.empty())
+      drain(index);
+  }
+};
+
+void usage()
+{
+  fprintf(stderr, "usage: hc_replay [-n COUNT] [-s SPEED] [-l] [-d DIR] [-f FORMAT] [-t SECONDS] [-m MAX_US] [SOURCE ...]\n"
+                  "       SOURCE is a recorded log or `sim`\n");
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+  Options options;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:s:ld:f:t:m:")) != -1)
+  {
+    switch (opt)
+    {
+    case 'n':
+      options.count = std::max(atoi(optarg), 1);
+      break;
+    case 's':
+      options.speed = std::max(atof(optarg), 0.0);
+      break;
+    case 'l':
+      options.loop = true;
+      break;
+    case 'd':
+      options.linkDir = optarg;
+      break;
+    case 'f':
+      options.format = std::clamp(atoi(optarg), 0, 2);
+      break;
+    case 't':
+      options.seconds = atoi(optarg);
+      break;
+    case 'm':
+      options.maxLatenessUs = std::max(atoll(optarg), 0LL);
+      break;
+    default:
+      usage();
+      return 1;
+    }
+  }
+
+  std::vector<std::string> sources(argv + optind, argv + argc);
+  if (sources.empty())
+    sources.push_back("sim");
+
+  std::vector<std::unique_ptr<Recording>> recordings;
+  std::vector<Device> devices;
+
+  for (const std::string &source : sources)
+  {
+    if (source != "sim")
+    {
+      recordings.emplace_back(new Recording());
+      if (!loadRecording(source, *recordings.back()))
+      {
+        fprintf(stderr, "cannot read %s\n", source.c_str());
+        return 1;
+      }
+      if (recordings.back()->lines.empty())
+      {
+        fprintf(stderr, "%s: no state lines\n", source.c_str());
+        return 1;
+      }
+    }
+
+    for (int i = 0; i < options.count; i++)
+    {
+      Device device;
+      device.name = "hc" + std::to_string(devices.size());
+      device.source = source;
+      if (source == "sim")
+        device.module.reset(new hc::SimulatedModule(devices.size(), options.format));
+      else
+        device.recording = recordings.back().get();
+
+      devices.push_back(std::move(device));
+    }
+  }
+
+  int status = 0;
+  for (Device &device : devices)
+  {
+    if (!openDevice(device))
+    {
+      fprintf(stderr, "cannot open a pty for %s: %s\n", device.name.c_str(), strerror(errno));
+      status = 1;
+      break;
+    }
+
+    if (!options.linkDir.empty())
+    {
+      device.link = options.linkDir + "/" + device.name;
+      unlink(device.link.c_str());
+      if (symlink(device.path.c_str(), device.link.c_str()) != 0)
+      {
+        fprintf(stderr, "cannot link %s: %s\n", device.link.c_str(), strerror(errno));
+        device.link.clear();
+      }
+    }
+
+    printf("%s %s %s\n", device.name.c_str(), device.path.c_str(), device.source.c_str());
+  }
+  fflush(stdout);
+
+  if (status == 0)
+  {
+    struct sigaction action = {};
+    action.sa_handler = onSignal;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+    signal(SIGPIPE, SIG_IGN);
+
+    // The default 50us timer slack would show up as lateness
+    prctl(PR_SET_TIMERSLACK, 1000);
+
+    Replayer replayer(devices, options);
+    if (!replayer.run())
+    {
+      perror("hc_replay");
+      status = 1;
+    }
+
+    const Stats &stats = replayer.stats();
+    fprintf(stderr, "%zu devices, %llu lines sent, %llu dropped", devices.size(), (unsigned long long)stats.lines,
+            (unsigned long long)stats.dropped);
+    if (stats.timed > 0)
+    {
+      fprintf(stderr, ", lateness mean %lldus p99 %lldus max %lldus", (long long)(stats.latenessTotalNs / (int64_t)stats.timed / 1000),
+              (long long)stats.percentileUs(0.99), (long long)(stats.latenessMaxNs / 1000));
+    }
+    fprintf(stderr, "\n");
+
+    if (status == 0 && options.maxLatenessUs > 0 && stats.timed > 0 && stats.percentileUs(0.99) > options.maxLatenessUs)
+    {
+      fprintf(stderr, "lateness p99 over the %lldus bound\n", (long long)options.maxLatenessUs);
+      status = 2;
+    }
+  }
+
+  for (Device &device : devices)
+  {
+    if (!device.link.empty())
+      unlink(device.link.c_str());
+    if (device.slave >= 0)
+      close(device.slave);
+    if (device.master >= 0)
+      close(device.master);
+  }
+
+  return status;
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+/**
+ * Real-time scheduling, CPU pinning and memory locking for the thread that reads the modules, so busy
+ * show PCs (renderers, video decoders) cannot delay touch events behind their own work.
+ *
+ *   hc::Realtime realtime;
+ *   realtime.priority = 50; // SCHED_FIFO 1-99
+ *   realtime.cpu = 3;
+ *   realtime.lockMemory = true;
+ *   hc::applyRealtime(realtime);
+ *
+ * Each setting that cannot be applied, usually for want of privileges (CAP_SYS_NICE, CAP_IPC_LOCK or the
+ * matching RLIMIT_RTPRIO/RLIMIT_MEMLOCK limits), is reported on stderr and the nearest thing allowed is
+ * used instead: a lower real-time priority within RLIMIT_RTPRIO, else the highest nice level allowed,
+ * else normal scheduling. Threads started afterwards inherit the scheduling and CPU, so start helpers first.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace hc
+{
+
+struct Realtime
+{
+  int priority = 0;        // SCHED_FIFO priority, 0 for normal scheduling
+  int cpu = -1;            // CPU to pin to, -1 for any
+  bool lockMemory = false; // lock every page in memory so none has to be faulted back in
+};
+
+/**
+ * @brief Touches a stack's worth of pages so that, once locked, the thread never faults on its stack
+ */
+inline void prefaultStack()
+{
+  const size_t Size = 256 * 1024;
+  char stack[Size];
+  memset(stack, 0, Size);
+  __asm__ __volatile__("" : : "r"(stack) : "memory"); // keeps the writes from being optimised away
+}
+
+/**
+ * @brief Applies the settings to the calling thread, falling back as described above
+ *
+ * @return true if every setting asked for was applied in full
+ */
+inline bool applyRealtime(const Realtime &realtime)
+{
+  bool applied = true;
+
+  if (realtime.cpu >= 0)
+  {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(realtime.cpu, &cpus);
+    int error = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    if (error != 0)
+    {
+      fprintf(stderr, "cannot pin to CPU %d (%s), running on any\n", realtime.cpu, strerror(error));
+      applied = false;
+    }
+  }
+
+  if (realtime.priority > 0)
+  {
+    int priority = std::clamp(realtime.priority, sched_get_priority_min(SCHED_FIFO), sched_get_priority_max(SCHED_FIFO));
+    sched_param param = {};
+    param.sched_priority = priority;
+    int error = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+
+    // Unprivileged processes may still use real-time priorities up to RLIMIT_RTPRIO
+    rlimit limit;
+    if (error == EPERM && getrlimit(RLIMIT_RTPRIO, &limit) == 0 && limit.rlim_cur > 0)
+    {
+      param.sched_priority = (int)std::min<rlim_t>(limit.rlim_cur, priority);
+      error = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+      if (error == 0)
+        fprintf(stderr, "SCHED_FIFO priority %d is over the limit, using %d\n", priority, param.sched_priority);
+    }
+
+    if (error != 0)
+    {
+      // The nice level applies to this thread alone on Linux, not the whole process
+      int nice = -20;
+      pid_t thread = (pid_t)syscall(SYS_gettid);
+      while (nice < 0 && setpriority(PRIO_PROCESS, thread, nice) != 0)
+        nice++;
+      fprintf(stderr, "cannot use SCHED_FIFO (%s), running with nice %d\n", strerror(error), nice);
+      applied = false;
+    }
+    else if (param.sched_priority != priority)
+      applied = false;
+  }
+
+  if (realtime.lockMemory)
+  {
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+    {
+      fprintf(stderr, "cannot lock memory (%s), pages may be swapped out\n", strerror(errno));
+      applied = false;
+    }
+    else
+      prefaultStack();
+  }
+
+  return applied;
+}
+
+} // namespace hc
@@ -0,0 +1,220 @@
+#pragma once
+
+/**
+ * Serial port setup shared by the host tools.
+ *
+ * Ports are opened raw and tuned for latency by default: the driver's low latency flag is set where it
+ * has one (8250/16550 style UARTs and some USB adapters). FTDI adapters' latency timer, which holds back
+ * partly filled USB packets for 16ms out of the box, is left alone by openPort: it is a sysfs setting of
+ * the adapter rather than of the open port, shared with every other program and kept after exit, so only
+ * a tool asked to changes it with setUsbLatencyTimer (hc_logger record -L). Writing it usually needs root
+ * or a udev rule. The module's own USB port is CDC ACM (ttyACM), which has neither and sends every USB
+ * frame. hc_latency measures what each setting costs.
+ */
+
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/serial.h>
+#endif
+
+namespace hc
+{
+
+/**
+ * @brief How reads wait for data
+ */
+enum class ReadMode
+{
+  Poll,      // non-blocking, woken by poll() - the default
+  Blocking,  // blocking raw read that returns as soon as a byte arrives (VMIN 1, VTIME 0)
+  Batched,   // blocking raw read that waits for 64 bytes or a 100ms gap (VMIN 64, VTIME 1)
+  Canonical, // blocking read of a whole line, split by the line discipline
+};
+
+inline const char *readModeName(ReadMode mode)
+{
+  switch (mode)
+  {
+  case ReadMode::Poll:
+    return "poll";
+  case ReadMode::Blocking:
+    return "blocking";
+  case ReadMode::Batched:
+    return "batched";
+  default:
+    return "canonical";
+  }
+}
+
+inline speed_t baudConstant(int baud)
+{
+  switch (baud)
+  {
+  case 9600:
+    return B9600;
+  case 19200:
+    return B19200;
+  case 38400:
+    return B38400;
+  case 57600:
+    return B57600;
+  case 115200:
+    return B115200;
+  default:
+    return B0;
+  }
+}
+
+/**
+ * @brief Sets 8N1 at the baud rate with reads waiting as mode says
+ */
+inline bool setReadMode(int fd, int baud, ReadMode mode)
+{
+  termios tty;
+  if (tcgetattr(fd, &tty) != 0)
+    return false;
+
+  cfmakeraw(&tty);
+  tty.c_cflag |= CLOCAL | CREAD;
+  tty.c_cc[VMIN] = 1;
+  tty.c_cc[VTIME] = 0;
+  if (mode == ReadMode::Batched)
+  {
+    tty.c_cc[VMIN] = 64;
+    tty.c_cc[VTIME] = 1;
+  }
+  else if (mode == ReadMode::Canonical)
+  {
+    // Lines end \r\n, so the \r is dropped rather than read as a line of its own
+    tty.c_lflag |= ICANON;
+    tty.c_iflag |= IGNCR;
+  }
+
+  speed_t speed = baudConstant(baud);
+  cfsetispeed(&tty, speed);
+  cfsetospeed(&tty, speed);
+  if (tcsetattr(fd, TCSANOW, &tty) != 0)
+    return false;
+
+  int flags = fcntl(fd, F_GETFL);
+  flags = mode == ReadMode::Poll ? flags | O_NONBLOCK : flags & ~O_NONBLOCK;
+  return fcntl(fd, F_SETFL, flags) == 0;
+}
+
+/**
+ * @brief Turns the driver's low latency flag on or off
+ *
+ * @return false with errno set if the driver has no such flag (ENOTTY for ptys and CDC ACM)
+ */
+inline bool setLowLatency(int fd, bool enable)
+{
+#if defined(__linux__) && defined(TIOCGSERIAL)
+  serial_struct serial;
+  if (ioctl(fd, TIOCGSERIAL, &serial) != 0)
+    return false;
+
+  serial.flags = enable ? serial.flags | ASYNC_LOW_LATENCY : serial.flags & ~ASYNC_LOW_LATENCY;
+  return ioctl(fd, TIOCSSERIAL, &serial) == 0;
+#else
+  (void)fd;
+  (void)enable;
+  errno = ENOTSUP;
+  return false;
+#endif
+}
+
+/**
+ * @brief sysfs latency timer file of the FTDI adapter behind a port, following links like /dev/serial/by-id
+ *
+ * @return the path, or empty if the port is not an FTDI adapter
+ */
+inline std::string latencyTimerPath(const char *port)
+{
+  char device[PATH_MAX];
+  if (realpath(port, device) == nullptr)
+    return "";
+
+  const char *name = strrchr(device, '/');
+  std::string path = std::string("/sys/bus/usb-serial/devices/") + (name ? name + 1 : device) + "/latency_timer";
+  return access(path.c_str(), F_OK) == 0 ? path : "";
+}
+
+/**
+ * @return the FTDI latency timer in ms, or -1 if the port has none
+ */
+inline int usbLatencyTimer(const char *port)
+{
+  std::string path = latencyTimerPath(port);
+  FILE *file = path.empty() ? nullptr : fopen(path.c_str(), "r");
+  if (file == nullptr)
+    return -1;
+
+  int ms = -1;
+  if (fscanf(file, "%d", &ms) != 1)
+    ms = -1;
+  fclose(file);
+  return ms;
+}
+
+/**
+ * @return false with errno set if the port has no latency timer or it cannot be written
+ */
+inline bool setUsbLatencyTimer(const char *port, int ms)
+{
+  std::string path = latencyTimerPath(port);
+  if (path.empty())
+  {
+    errno = ENOENT;
+    return false;
+  }
+
+  FILE *file = fopen(path.c_str(), "w");
+  if (file == nullptr)
+    return false;
+
+  bool ok = fprintf(file, "%d\n", ms) > 0;
+  return fclose(file) == 0 && ok;
+}
+
+/**
+ * @brief Opens the port in raw 8N1 mode, non-blocking unless mode says otherwise, and unless told not to,
+ * with the low latency flag wherever the driver has one
+ *
+ * @return file descriptor, or -1 with errno set
+ */
+inline int openPort(const char *path, int baud, ReadMode mode = ReadMode::Poll, bool lowLatency = true)
+{
+  if (baudConstant(baud) == B0)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+
+  int fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+  if (fd < 0)
+    return -1;
+
+  setReadMode(fd, baud, mode);
+
+  // Best effort: most ports have no such flag
+  if (lowLatency)
+  {
+    int error = errno;
+    setLowLatency(fd, true);
+    errno = error;
+  }
+
+  return fd;
+}
+
+} // namespace hc
@@ -0,0 +1,212 @@
+#pragma once
+
+/**
+ * Simulated module output, for testing show software and host tools without hardware.
+ *
+ * Each call to check() advances one sensor check (50ms) and writes the line the firmware would print,
+ * in any outFmt (see README). Visitors arrive at random, touch one pad and then the other, and most pairs
+ * go on to join hands for a while after the relay buffer interval; some let go first. Readings, confidence,
+ * proximity, grip and chain length follow the state the way they do on a real module, with noise. The
+ * generator is seeded, so a given seed always replays the same session, and it never allocates.
+ *
+ *   hc::SimulatedModule module(seed, 2);
+ *   char line[hc::SimulatedModule::MaxLine];
+ *   size_t length = module.check(line);
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+namespace hc
+{
+
+class SimulatedModule
+{
+public:
+  static const size_t MaxLine = 96;     // matches Parser::MaxLine
+  static const int SensorCheckMs = 50;  // matches SensorCheckInterval
+
+  SimulatedModule(uint64_t seed, int outputFormat) : random(seed * 2654435761u + 1), outputFormat(outputFormat) {}
+
+  /**
+   * @brief Advances one sensor check and writes its line, ending in \r\n like Serial.println
+   *
+   * @return the line length
+   */
+  size_t check(char *line)
+  {
+    step();
+
+    static const char *const Codes[] = {"000", "100", "010", "110", "001"};
+    int length = snprintf(line, MaxLine, "[%s]", Codes[state]);
+
+    if (outputFormat >= 1)
+    {
+      int chain = state == Joined ? chainLength : 0;
+      length += snprintf(line + length, MaxLine - length, " c%d n%d p%d,%d g%d,%d", confidence(), chain,
+                         proximity(0), proximity(1), grip(0), grip(1));
+    }
+
+    if (outputFormat >= 2)
+    {
+      if (state == Joined)
+        length += snprintf(line + length, MaxLine - length, " i%d", impedance());
+      else
+        length += snprintf(line + length, MaxLine - length, " l%d,%d r%d,%d", delta[0], rate[0], delta[1], rate[1]);
+    }
+
+    length += snprintf(line + length, MaxLine - length, "\r\n");
+    return length;
+  }
+
+  /**
+   * @brief Answers a command the way the firmware would. Only outFmt can be read and set, the rest are rejected
+   *
+   * @return the response length, including its line break
+   */
+  size_t command(const char *text, size_t size, char *response)
+  {
+    char verb[8] = "", name[16] = "";
+    int value;
+    char buffer[64];
+    size = size < sizeof(buffer) - 1 ? size : sizeof(buffer) - 1;
+    memcpy(buffer, text, size);
+    buffer[size] = '\0';
+
+    int fields = sscanf(buffer, "%7s %15s %d", verb, name, &value);
+    if (fields >= 2 && strcmp(name, "outFmt") == 0 && (strcmp(verb, "get") == 0 || (strcmp(verb, "set") == 0 && fields == 3)))
+    {
+      if (strcmp(verb, "set") == 0)
+        outputFormat = value < 0 ? 0 : value > 2 ? 2 : value;
+
+      return snprintf(response, MaxLine, "#outFmt=%d\r\n", outputFormat);
+    }
+
+    return snprintf(response, MaxLine, "#ERR %s\r\n", verb);
+  }
+
+private:
+  enum State
+  {
+    Idle,
+    Left,
+    Right,
+    Both,
+    Joined
+  };
+
+  static const int Threshold = 1500;  // delta a touched pad settles around
+  static const int BufferChecks = 10; // matches the capBuf default
+
+  uint64_t random;
+  int outputFormat;
+  State state = Idle;
+  int held = 0;       // checks the current state has lasted
+  int dwell = 20;     // checks until the next visitor, or until a joined pair lets go
+  int chainLength = 2;
+  int delta[2] = {0, 0};
+  int rate[2] = {0, 0};
+
+  uint32_t next()
+  {
+    // xorshift64*
+    random ^= random >> 12;
+    random ^= random << 25;
+    random ^= random >> 27;
+    return (uint32_t)((random * 2685821657736338717ULL) >> 32);
+  }
+
+  int uniform(int min, int max) { return min + (int)(next() % (uint32_t)(max - min + 1)); }
+
+  bool chance(int percent) { return (int)(next() % 100) < percent; }
+
+  void enter(State entered)
+  {
+    state = entered;
+    held = 0;
+  }
+
+  void step()
+  {
+    held++;
+    switch (state)
+    {
+    case Idle:
+      if (held >= dwell)
+      {
+        enter(chance(50) ? Left : Right);
+        dwell = uniform(4, 40);
+      }
+      break;
+    case Left:
+    case Right:
+      if (held >= dwell)
+        enter(chance(80) ? Both : Idle);
+      break;
+    case Both:
+      if (held >= BufferChecks)
+      {
+        if (chance(75))
+        {
+          enter(Joined);
+          chainLength = uniform(2, 5);
+          dwell = uniform(20, 400);
+        }
+        else
+        {
+          enter(Idle);
+        }
+      }
+      break;
+    case Joined:
+      if (held >= dwell)
+        enter(Idle);
+      break;
+    }
+
+    if (state == Idle && held == 0)
+      dwell = uniform(20, 600);
+
+    for (int pad = 0; pad < 2; pad++)
+    {
+      int target = touched(pad) ? Threshold + 200 : 0;
+      int previous = delta[pad];
+      delta[pad] += (target - delta[pad]) / 3 + uniform(-40, 40);
+      rate[pad] = delta[pad] - previous;
+    }
+  }
+
+  bool touched(int pad) const
+  {
+    return state == Both || state == Joined || (pad == 0 ? state == Left : state == Right);
+  }
+
+  int confidence() const
+  {
+    int settled = held < 9 ? held : 9;
+    return state == Idle ? 9 : settled;
+  }
+
+  int proximity(int pad) const
+  {
+    if (touched(pad))
+      return 9;
+
+    int level = delta[pad] * 9 / Threshold;
+    return level < 0 ? 0 : level > 8 ? 8 : level;
+  }
+
+  int grip(int pad) const
+  {
+    return touched(pad) ? (held < 3 ? 50 : 100) : 0;
+  }
+
+  int impedance()
+  {
+    return 200 + chainLength * 150 + uniform(-10, 10);
+  }
+};
+
+} // namespace hc
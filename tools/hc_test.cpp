@@ -0,0 +1,695 @@
+/**
+ * Runs the host tools end to end against simulated modules, so a tool that hangs, spins or misreads
+ * a device fails here rather than at a show.
+ *
+ * Build:
+ *   g++ -std=c++17 -O2 -o hc_test tools/hc_test.cpp
+ *
+ * Usage:
+ *   hc_test [-d BINDIR] [-k] [TEST ...]
+ *
+ * Every test starts the tools it needs from BINDIR (default .), built as in tools/README.md, with
+ * hc_replay standing in for the modules on pseudo-terminals. With no TEST names every test runs. Each
+ * prints `ok <name>` or `FAIL <name>: <reason>`, and the exit status is 1 if any failed. Scratch files
+ * go in a fresh directory under /tmp, removed afterwards unless -k keeps it for a look.
+ *
+ * Every tool is run under `timeout`, so one that hangs fails its test instead of the run.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+
+// Under half a sensor check: lines later than that would arrive bunched against the next. A loaded single
+// core host stalls the replay for a few milliseconds now and then, which a tighter bound would fail on
+const int ReplayMaxLatenessUs = 20000;
+
+struct Options
+{
+  std::string binDir = ".";
+  bool keep = false;
+};
+
+// What every test gets
+struct Context
+{
+  std::string binDir;
+  std::string scratch; // directory for the test's files
+};
+
+long long nowMs()
+{
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000LL + now.tv_nsec / 1000000;
+}
+
+/**
+ * @brief Runs a shell command, collecting its standard output and error together
+ *
+ * @return its exit status, 124 if it ran past timeout
+ */
+int run(const std::string &command, std::string &output)
+{
+  output.clear();
+  FILE *pipe = popen((command + " 2>&1").c_str(), "r");
+  if (pipe == nullptr)
+    return -1;
+
+  char buffer[4096];
+  size_t count;
+  while ((count = fread(buffer, 1, sizeof(buffer), pipe)) > 0)
+    output.append(buffer, count);
+
+  int status = pclose(pipe);
+  return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+std::vector<std::string> lines(const std::string &text)
+{
+  std::vector<std::string> result;
+  std::istringstream in(text);
+  std::string line;
+  while (std::getline(in, line))
+    result.push_back(line);
+  return result;
+}
+
+bool contains(const std::string &text, const std::string &part)
+{
+  return text.find(part) != std::string::npos;
+}
+
+/**
+ * @brief hc_replay running in the background, for as long as the test needs its devices
+ */
+class Replay
+{
+public:
+  /**
+   * @brief Starts hc_replay with the given arguments and waits for its devices
+   */
+  Replay(const Context &context, const std::string &arguments) : errorPath(context.scratch + "/replay.err")
+  {
+    int output[2];
+    if (pipe(output) != 0)
+      return;
+
+    std::string command = "exec " + context.binDir + "/hc_replay " + arguments + " 2>" + errorPath;
+    pid = fork();
+    if (pid == 0)
+    {
+      dup2(output[1], STDOUT_FILENO);
+      close(output[0]);
+      close(output[1]);
+      execl("/bin/sh", "sh", "-c", command.c_str(), (char *)nullptr);
+      _exit(127);
+    }
+
+    close(output[1]);
+    listing = output[0];
+
+    // Every device is listed at once before the replay starts, so the listing ends when the output pauses
+    std::string text;
+    long long deadlineMs = nowMs() + 10000;
+    while (nowMs() < deadlineMs && readable(listing, text.empty() ? 1000 : 200))
+    {
+      char buffer[4096];
+      ssize_t count = read(listing, buffer, sizeof(buffer));
+      if (count <= 0)
+        break;
+      text.append(buffer, count);
+    }
+
+    char name[64], path[256];
+    for (const std::string &line : lines(text))
+    {
+      if (sscanf(line.c_str(), "%63s %255s", name, path) == 2)
+        devices.push_back(path);
+    }
+  }
+
+  ~Replay()
+  {
+    stop();
+    if (listing >= 0)
+      close(listing);
+  }
+
+  /**
+   * @brief Interrupts the replay, or waits for it to end by itself, and collects its summary
+   *
+   * @return hc_replay's exit status
+   */
+  int stop(bool interrupt = true)
+  {
+    if (pid > 0)
+    {
+      if (interrupt)
+        kill(pid, SIGTERM);
+      int status;
+      waitpid(pid, &status, 0);
+      exitStatus = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+      pid = -1;
+
+      std::ifstream in(errorPath);
+      std::stringstream text;
+      text << in.rdbuf();
+      summary = text.str();
+    }
+
+    return exitStatus;
+  }
+
+  std::vector<std::string> devices;
+  std::string summary; // hc_replay's stderr, once stopped
+
+private:
+  std::string errorPath;
+  pid_t pid = -1;
+  int listing = -1;
+  int exitStatus = -1;
+
+  static bool readable(int fd, int timeoutMs)
+  {
+    fd_set set;
+    FD_ZERO(&set);
+    FD_SET(fd, &set);
+    timeval wait = {timeoutMs / 1000, timeoutMs % 1000 * 1000};
+    return select(fd + 1, &set, nullptr, nullptr, &wait) > 0;
+  }
+};
+
+/**
+ * @brief hc_cli reads and sets parameters on a simulated module, and reports rejected commands
+ */
+std::string cliCommands(const Context &context)
+{
+  Replay replay(context, "sim");
+  if (replay.devices.size() != 1)
+    return "hc_replay started no device";
+
+  std::string cli = "timeout 10 " + context.binDir + "/hc_cli -p " + replay.devices[0] + " ";
+  std::string output;
+
+  if (run(cli + "get outFmt", output) != 0 || output != "outFmt=0\n")
+    return "get outFmt printed " + output;
+
+  if (run(cli + "set outFmt 2", output) != 0 || output != "outFmt=2\n")
+    return "set outFmt 2 printed " + output;
+
+  if (run(cli + "get outFmt", output) != 0 || output != "outFmt=2\n")
+    return "outFmt did not stay set, printed " + output;
+
+  if (run(cli + "get capN", output) != 1 || !contains(output, "rejected"))
+    return "a rejected command did not fail: " + output;
+
+  return "";
+}
+
+/**
+ * @brief hc_cli runs a script the way auto_tuner exports them, skipping notes
+ */
+std::string cliScript(const Context &context)
+{
+  Replay replay(context, "sim");
+  if (replay.devices.size() != 1)
+    return "hc_replay started no device";
+
+  std::string script = context.scratch + "/script.txt";
+  std::ofstream(script) << "# a note\n\nset outFmt 1\nget outFmt\n";
+
+  std::string output;
+  int status = run("timeout 10 " + context.binDir + "/hc_cli -p " + replay.devices[0] + " -f " + script, output);
+  if (status != 0 || output != "outFmt=1\noutFmt=1\n")
+    return "script printed " + output;
+
+  return "";
+}
+
+/**
+ * @brief hc_cli monitor prints state lines for the time given
+ */
+std::string cliMonitor(const Context &context)
+{
+  Replay replay(context, "-f 1 sim");
+  if (replay.devices.size() != 1)
+    return "hc_replay started no device";
+
+  std::string output;
+  if (run("timeout 10 " + context.binDir + "/hc_cli -p " + replay.devices[0] + " monitor 1", output) != 0)
+    return "monitor failed: " + output;
+
+  // 20 lines a second, less whatever arrived before monitor started
+  size_t stateLines = 0;
+  for (const std::string &line : lines(output))
+    stateLines += line.size() >= 5 && line[0] == '[' && line[4] == ']' && contains(line, " c");
+
+  if (stateLines < 10)
+    return "monitor printed " + std::to_string(stateLines) + " state lines in a second";
+
+  return "";
+}
+
+/**
+ * @brief hc_cli monitor stops with an error when the device goes away, rather than spinning on the dead port
+ */
+std::string cliMonitorHangup(const Context &context)
+{
+  Replay replay(context, "-t 2 sim");
+  if (replay.devices.size() != 1)
+    return "hc_replay started no device";
+
+  std::string output;
+  long long startMs = nowMs();
+  int status = run("timeout 10 " + context.binDir + "/hc_cli -p " + replay.devices[0] + " monitor", output);
+  long long tookMs = nowMs() - startMs;
+
+  if (status == 124)
+    return "monitor kept running after the device closed";
+  if (status != 1 || !contains(output, "port closed"))
+    return "monitor exited " + std::to_string(status) + " without reporting the closed port: " + output;
+  if (tookMs > 5000)
+    return "monitor took " + std::to_string(tookMs) + "ms to notice the closed port";
+
+  return "";
+}
+
+/**
+ * @brief hc_replay keeps 50 simulated modules on schedule while a reader drains them, failing through its
+ * -m bound when the 99th percentile lateness drifts past ReplayMaxLatenessUs
+ */
+std::string replayDrift(const Context &context)
+{
+  Replay replay(context, "-n 50 -t 3 -m " + std::to_string(ReplayMaxLatenessUs) + " sim");
+  if (replay.devices.size() != 50)
+    return "hc_replay started " + std::to_string(replay.devices.size()) + " devices";
+
+  std::vector<int> ports;
+  for (const std::string &device : replay.devices)
+  {
+    int fd = open(device.c_str(), O_RDONLY | O_NOCTTY | O_NONBLOCK);
+    if (fd < 0)
+      return "cannot open " + device + ": " + strerror(errno);
+    ports.push_back(fd);
+  }
+
+  // Read like show software would until the replay ends by itself
+  long long deadlineMs = nowMs() + 3500;
+  while (nowMs() < deadlineMs)
+  {
+    fd_set set;
+    FD_ZERO(&set);
+    int highest = 0;
+    for (int fd : ports)
+    {
+      FD_SET(fd, &set);
+      highest = std::max(highest, fd);
+    }
+    timeval wait = {0, 100000};
+    if (select(highest + 1, &set, nullptr, nullptr, &wait) < 0)
+      break;
+
+    char buffer[4096];
+    for (int fd : ports)
+    {
+      if (FD_ISSET(fd, &set))
+        (void)!read(fd, buffer, sizeof(buffer));
+    }
+  }
+
+  int status = replay.stop(false);
+  for (int fd : ports)
+    close(fd);
+
+  if (status == 2)
+    return "lateness went over the bound: " + replay.summary;
+  if (status != 0 || !contains(replay.summary, "lateness"))
+    return "hc_replay exited " + std::to_string(status) + ": " + replay.summary;
+
+  return "";
+}
+
+off_t fileSize(const std::string &path)
+{
+  struct stat info;
+  return stat(path.c_str(), &info) == 0 ? info.st_size : -1;
+}
+
+/**
+ * @brief hc_logger cuts a torn chunk off the end of a log and keeps appending, but refuses a log damaged
+ * before its end, and leaves the log alone when a port will not open
+ */
+std::string loggerRecovery(const Context &context)
+{
+  std::string text = context.scratch + "/session.txt";
+  {
+    std::ofstream out(text);
+    for (int i = 0; i < 100; i++)
+      out << 1700000000000LL + i * 50 << " [" << (i % 20 < 10 ? "000" : "100") << "] c" << i % 8 << "\n";
+  }
+
+  std::string logger = "timeout 10 " + context.binDir + "/hc_logger ";
+  std::string log = context.scratch + "/session.hcl";
+  std::string output;
+  if (run(logger + "import -c 10 -o " + log + " " + text, output) != 0)
+    return "import failed: " + output;
+
+  // A crash part way through writing a chunk
+  off_t intact = fileSize(log);
+  {
+    std::ofstream out(log, std::ios::binary | std::ios::app);
+    out << "HCCk torn";
+  }
+  if (run(logger + "import -c 10 -o " + log + " " + text, output) != 0 || !contains(output, "torn chunk"))
+    return "appending after a torn chunk printed " + output;
+  if (run(logger + "csv " + log + " | wc -l", output) != 0 || output != "201\n")
+    return "after cutting the torn chunk the log holds " + output + " lines, not a header and 200";
+
+  // Damage to the first chunk's payload, with every other chunk intact after it
+  {
+    std::fstream file(log, std::ios::binary | std::ios::in | std::ios::out);
+    file.seekp(8 + 36 + 2);
+    file.put('\x55');
+  }
+  off_t damaged = fileSize(log);
+  if (damaged != 2 * intact - 8)
+    return "the log is " + std::to_string(damaged) + " bytes after appending, not " + std::to_string(2 * intact - 8);
+
+  if (run(logger + "record -o " + log + " " + context.scratch + "/missing", output) != 1 || fileSize(log) != damaged)
+    return "recording from a missing port touched the log: " + output;
+  if (run(logger + "import -c 10 -o " + log + " " + text, output) != 1 || !contains(output, "damaged chunk"))
+    return "appending to a damaged log printed " + output;
+  if (fileSize(log) != damaged)
+    return "appending to a damaged log cut it to " + std::to_string(fileSize(log)) + " bytes";
+
+  return "";
+}
+
+/**
+ * @brief hc_query finds every line in range when one module's chunks overlap in time, and stops trusting an
+ * index once the log is rewritten
+ */
+std::string queryOverlap(const Context &context)
+{
+  // A long session, then two short ones inside it imported as the same module
+  const long long startMs = 1700000000000LL;
+  const int Sessions[3][2] = {{0, 200}, {40, 20}, {80, 10}}; // first line and lines, 50ms apart
+  std::string log = context.scratch + "/overlap.hcl";
+  std::string logs;
+  for (int i = 0; i < 3; i++)
+  {
+    std::string text = context.scratch + "/session" + std::to_string(i) + ".txt";
+    std::ofstream out(text);
+    for (int line = Sessions[i][0]; line < Sessions[i][0] + Sessions[i][1]; line++)
+      out << startMs + line * 50 << " [" << (i == 0 ? "000" : "100") << "] c" << line % 8 << "\n";
+    logs += " " + text;
+  }
+
+  std::string output;
+  if (run("timeout 10 " + context.binDir + "/hc_logger import -c 1000 -o " + log + logs, output) != 0)
+    return "import failed: " + output;
+
+  std::string query = "timeout 10 " + context.binDir + "/hc_query ";
+  if (run(query + "index " + log, output) != 0 || !contains(output, "3 chunks"))
+    return "index printed " + output;
+
+  // 3.5s to 9s: lines 70 to 180 of the long session and all of the last short one, which a binary search
+  // on the chunks' last times would skip the long session for
+  if (run(query + "-m 0 -f " + std::to_string(startMs + 3500) + " -u " + std::to_string(startMs + 9000) + " " + log, output) != 0)
+    return "query failed: " + output;
+  size_t idle = 0, left = 0;
+  for (const std::string &line : lines(output))
+  {
+    idle += contains(line, "[000]");
+    left += contains(line, "[100]");
+  }
+  if (idle != 111 || left != 10)
+    return "query found " + std::to_string(idle) + " lines of the long session and " + std::to_string(left) +
+           " of the short one, not 111 and 10";
+
+  // Same size, new modification time, as a log rewritten in place would have
+  if (run("touch -d @1 " + log + " && " + query + "-m 0 " + log, output) != 0 || !contains(output, "no current index"))
+    return "the query used the index after the log changed";
+  if (lines(output).size() != 231)
+    return "after the log changed the query printed " + std::to_string(lines(output).size()) + " lines, not a warning and 230";
+
+  return "";
+}
+
+/**
+ * @brief Fetches /metrics from a Unix socket
+ *
+ * @return the response, empty if nothing answered
+ */
+std::string scrape(const std::string &path)
+{
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  sockaddr_un address = {};
+  address.sun_family = AF_UNIX;
+  snprintf(address.sun_path, sizeof(address.sun_path), "%s", path.c_str());
+
+  std::string response;
+  const char request[] = "GET /metrics HTTP/1.0\r\n\r\n";
+  if (fd >= 0 && connect(fd, (const sockaddr *)&address, sizeof(address)) == 0 &&
+      write(fd, request, sizeof(request) - 1) == (ssize_t)sizeof(request) - 1)
+  {
+    char buffer[4096];
+    ssize_t count;
+    while ((count = read(fd, buffer, sizeof(buffer))) > 0)
+      response.append(buffer, count);
+  }
+
+  if (fd >= 0)
+    close(fd);
+  return response;
+}
+
+/**
+ * @brief A sample's value from a scrape, -1 if it is not there
+ *
+ * @param sample the metric name and the start of its labels, e.g. `hc_module_lines_total{module="0"`
+ */
+double sampleValue(const std::string &metrics, const std::string &sample)
+{
+  for (const std::string &line : lines(metrics))
+  {
+    if (line.compare(0, sample.size(), sample) == 0)
+      return atof(line.c_str() + line.rfind(' ') + 1);
+  }
+  return -1;
+}
+
+/**
+ * @brief hc_logger record serves metrics that follow what it reads from two simulated modules, and will not
+ * replace a file that is not a socket with its metrics socket
+ */
+std::string loggerMetrics(const Context &context)
+{
+  Replay replay(context, "-n 2 sim");
+  if (replay.devices.size() != 2)
+    return "hc_replay started " + std::to_string(replay.devices.size()) + " devices";
+
+  std::string socketPath = context.scratch + "/metrics.sock";
+  std::string log = context.scratch + "/metrics.hcl";
+  std::string record = "timeout 10 " + context.binDir + "/hc_logger record -c 20 -e " + socketPath + " -o " + log + " " +
+                       replay.devices[0] + " " + replay.devices[1];
+
+  // A file at the socket path is left alone
+  std::ofstream(socketPath) << "notes\n";
+  std::string output;
+  if (run(record, output) != 1 || !contains(output, "cannot serve metrics"))
+    return "serving metrics over a file printed " + output;
+  std::ifstream kept(socketPath);
+  std::string note;
+  if (!std::getline(kept, note) || note != "notes")
+    return "the file at the socket path was replaced";
+  unlink(socketPath.c_str());
+
+  pid_t logger = fork();
+  if (logger == 0)
+  {
+    execl("/bin/sh", "sh", "-c", ("exec " + record + " 2>" + context.scratch + "/logger.err").c_str(), (char *)nullptr);
+    _exit(127);
+  }
+
+  // Two scrapes a second apart, once there is something to see
+  std::string first, second;
+  long long deadlineMs = nowMs() + 5000;
+  while (nowMs() < deadlineMs && sampleValue(first, "hc_module_lines_total{module=\"1\"") <= 0)
+  {
+    usleep(100000);
+    first = scrape(socketPath);
+  }
+  usleep(1000000);
+  second = scrape(socketPath);
+
+  kill(logger, SIGTERM);
+  int status;
+  waitpid(logger, &status, 0);
+  replay.stop();
+
+  if (first.empty() || second.empty())
+    return "nothing answered on " + socketPath;
+  if (!contains(second, "HTTP/1.0 200") && !contains(second, "HTTP/1.1 200"))
+    return "the scrape was answered with " + second.substr(0, second.find('\n'));
+
+  double sent = 0;
+  sscanf(replay.summary.c_str(), "%*d devices, %lf lines sent", &sent);
+  double read = 0;
+  for (int module = 0; module < 2; module++)
+  {
+    std::string labels = "{module=\"" + std::to_string(module) + "\"";
+    double before = sampleValue(first, "hc_module_lines_total" + labels);
+    double after = sampleValue(second, "hc_module_lines_total" + labels);
+    // 20 lines a second, give or take the scrapes' timing
+    if (before <= 0 || after - before < 10 || after - before > 30)
+      return "module " + std::to_string(module) + " lines went from " + std::to_string(before) + " to " + std::to_string(after) + " in a second";
+    if (sampleValue(second, "hc_module_connected" + labels) != 1)
+      return "module " + std::to_string(module) + " is not reported connected";
+    if (sampleValue(second, "hc_module_read_bytes_total" + labels) < after * 7) // "[000]\r\n" the shortest
+      return "module " + std::to_string(module) + " read fewer bytes than its lines hold";
+    // Lines are counted just before their latency, and the latency is scraped after the lines
+    double latencies = sampleValue(second, "hc_module_line_latency_seconds_count" + labels);
+    if (latencies < after - 1)
+      return "module " + std::to_string(module) + " has " + std::to_string(latencies) + " line latencies for " + std::to_string(after) + " lines";
+    if (sampleValue(second, "hc_module_line_latency_seconds_sum" + labels) > latencies * 0.05)
+      return "module " + std::to_string(module) + " lines waited over 50ms on average to be queued";
+    read += after;
+  }
+
+  if (read > sent)
+    return "the scrape counted " + std::to_string(read) + " lines of the " + std::to_string(sent) + " sent";
+  if (sampleValue(second, "hc_log_chunks_total") < 1)
+    return "no chunks were counted with one due every 20 lines";
+
+  struct stat info;
+  if (stat(socketPath.c_str(), &info) == 0)
+    return "the metrics socket was left behind";
+
+  return "";
+}
+
+struct Test
+{
+  const char *name;
+  std::string (*run)(const Context &);
+};
+
+const Test Tests[] = {
+    {"cli_commands", cliCommands},
+    {"cli_script", cliScript},
+    {"cli_monitor", cliMonitor},
+    {"cli_monitor_hangup", cliMonitorHangup},
+    {"replay_drift", replayDrift},
+    {"logger_recovery", loggerRecovery},
+    {"query_overlap", queryOverlap},
+    {"logger_metrics", loggerMetrics},
+};
+
+void usage()
+{
+  fprintf(stderr, "usage: hc_test [-d BINDIR] [-k] [TEST ...]\n");
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+  Options options;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "d:k")) != -1)
+  {
+    switch (opt)
+    {
+    case 'd':
+      options.binDir = optarg;
+      break;
+    case 'k':
+      options.keep = true;
+      break;
+    default:
+      usage();
+      return 1;
+    }
+  }
+
+  std::vector<const Test *> selected;
+  for (const Test &test : Tests)
+  {
+    bool named = optind == argc;
+    for (int i = optind; i < argc; i++)
+      named |= strcmp(argv[i], test.name) == 0;
+    if (named)
+      selected.push_back(&test);
+  }
+
+  if (selected.size() < (size_t)(argc - optind) || selected.empty())
+  {
+    usage();
+    fprintf(stderr, "tests:");
+    for (const Test &test : Tests)
+      fprintf(stderr, " %s", test.name);
+    fprintf(stderr, "\n");
+    return 1;
+  }
+
+  char scratchTemplate[] = "/tmp/hc_test.XXXXXX";
+  if (mkdtemp(scratchTemplate) == nullptr)
+  {
+    perror("mkdtemp");
+    return 1;
+  }
+
+  // A device that goes away must not take the runner with it
+  signal(SIGPIPE, SIG_IGN);
+
+  int failed = 0;
+  for (const Test *test : selected)
+  {
+    Context context = {options.binDir, std::string(scratchTemplate) + "/" + test->name};
+    mkdir(context.scratch.c_str(), 0700);
+
+    std::string failure = test->run(context);
+    if (failure.empty())
+    {
+      printf("ok %s\n", test->name);
+    }
+    else
+    {
+      while (!failure.empty() && failure.back() == '\n')
+        failure.pop_back();
+      printf("FAIL %s: %s\n", test->name, failure.c_str());
+      failed++;
+    }
+    fflush(stdout);
+  }
+
+  std::string output;
+  if (options.keep)
+    printf("scratch files kept in %s\n", scratchTemplate);
+  else
+    run(std::string("rm -rf ") + scratchTemplate, output);
+
+  printf("%zu tests, %d failed\n", selected.size(), failed);
+  return failed > 0 ? 1 : 0;
+}
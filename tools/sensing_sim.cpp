@@ -0,0 +1,749 @@
+/**
+ * Runs the firmware's sensing decisions (include/sensing.h, the same code the module runs) over synthetic
+ * noisy pad traces and reports how each setting trades stability against latency.
+ *
+ * Build:
+ *   g++ -std=c++17 -O2 -o sensing_sim tools/sensing_sim.cpp
+ *
+ * Usage:
+ *   sensing_sim debounce|onset|filter|join [-s SEEDS] [-t SECONDS] [-z NOISE] [-o OFFSET] [-u TOUCH] [-v HOVER] [-j JUMP]
+ *
+ * Each trace is one pad sampled every sensor check (50ms): a baseline that drifts slowly, visitors touching
+ * for 1-5 s between 2-10 s idles, and hands hovering near the pad for 1-4 s before some touches, all with
+ * roughly normal noise of NOISE standard deviation (default 150). A touch settles TOUCH (default 2000) above
+ * the baseline within a few checks and a hover HOVER (default 900) above it, just under the pot OFFSET
+ * (default 1000, capRel 1), so noise carries hovers back and forth over the threshold. SEEDS traces (default
+ * 10) of SECONDS each (default 600) are run through the filter, baseline and pad decisions for every setting.
+ *
+ * debounce compares hysteresis and N-of-M debouncing: pad flips per minute, the spurious ones among them
+ * (any flip but the first after each touch or release), and the mean delay from a touch or release to the
+ * pad following it. The first row is the firmware before debouncing (no hysteresis, 1 of 1).
+ *
+ * onset compares onset slopes at the default debouncing: the delay to report a touch, and onsets per minute
+ * that the threshold never confirmed, such as hands swinging towards the pad and hovering.
+ *
+ * filter runs the fixed point alpha-beta filter next to the same filter in double precision for several
+ * gains, and reports how far the fixed point value and rate stray from the reference, how much of the
+ * noise each gain removes (standard deviation of the filtered value around the noise free reading while
+ * that is settled), and how many checks the value takes to cover 90% of a touch step.
+ *
+ * join runs pairs of visitors instead: each touches a pad, up to a second apart, and most pairs then join
+ * hands, which adds JUMP (default 800) to both pads at once and closes the impedence loop; some press harder
+ * on one pad instead. The two pads, the relay and its buffer intervals are stepped the way checkSensors does,
+ * around the same joinStep, predictJoin and updateFilter the module runs. It compares relay-only sensing
+ * with prediction at several joinRate settings: joins reported and how long after the hands met, JOINED
+ * reported for pairs that were not joined, JOINED/BOTH flaps and relay flips per minute. The `ungated` row
+ * replays prediction as it was before it waited for the relay buffer interval and restarted the pad
+ * filters after impedence sensing.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <vector>
+
+#include "../include/sensing.h"
+
+namespace
+{
+
+const int SensorCheckMs = 50;
+const int Baseline = 3000;
+
+struct Options
+{
+  int seeds = 10;
+  int seconds = 600;
+  int noise = 150;
+  int offset = 1000;
+  int touch = 2000;
+  int hover = 900;
+  int jump = 800;
+};
+
+/**
+ * @brief One pad's raw readings with the true touch state behind each
+ */
+class PadTrace
+{
+public:
+  PadTrace(uint64_t seed, const Options &options) : random(seed * 2654435761u + 1), options(options) {}
+
+  /**
+   * @brief Advances one sensor check
+   *
+   * @return raw reading
+   */
+  int next()
+  {
+    if (--remaining <= 0)
+      enter();
+
+    int target = phase == Touch ? options.touch : phase == Hover ? options.hover : 0;
+    level += (target - level) / 2;
+    drift += uniform(-2, 2);
+
+    // Sum of four uniforms, close enough to normal with the requested standard deviation
+    int noise = 0;
+    for (int i = 0; i < 4; i++)
+      noise += uniform(-options.noise, options.noise);
+
+    return clean() + noise * 866 / 1000;
+  }
+
+  bool touched() const { return phase == Touch; }
+
+  /**
+   * @brief The latest reading without its noise
+   */
+  int clean() const { return Baseline + drift / 4 + level; }
+
+  uint32_t uniformUint()
+  {
+    // xorshift64*
+    random ^= random >> 12;
+    random ^= random << 25;
+    random ^= random >> 27;
+    return (uint32_t)((random * 2685821657736338717ULL) >> 32);
+  }
+
+  int uniform(int min, int max) { return min + (int)(uniformUint() % (uint32_t)(max - min + 1)); }
+
+private:
+  enum Phase
+  {
+    Idle,
+    Hover,
+    Touch
+  };
+
+  uint64_t random;
+  const Options &options;
+  Phase phase = Idle;
+  int remaining = 40; // checks left in the phase
+  int level = 0;      // reading above the baseline from the hand
+  int drift = 0;
+
+  void enter()
+  {
+    switch (phase)
+    {
+    case Idle:
+      phase = uniform(0, 2) == 0 ? Hover : Touch;
+      remaining = phase == Hover ? uniform(20, 80) : uniform(20, 100);
+      break;
+    case Hover:
+      phase = uniform(0, 1) == 0 ? Touch : Idle;
+      remaining = phase == Touch ? uniform(20, 100) : uniform(40, 200);
+      break;
+    case Touch:
+      phase = Idle;
+      remaining = uniform(40, 200);
+      break;
+    }
+  }
+};
+
+/**
+ * @brief A pad as capacitiveCheck runs it, without the classifier or the other pad
+ */
+struct Pad
+{
+  AlphaBetaFilter filter = {0, 0, false};
+  PadTracker tracker = NewPadTracker;
+  bool active = false;
+  int falseOnsets = 0;
+
+  void check(int raw, int setting, int hysteresis, const SensingConfig &config)
+  {
+    int value = updateFilter(filter, raw, 128, 16);
+    int threshold = padThreshold(tracker, setting, config);
+    active = updatePad(active, tracker, raw, value, threshold, hysteresis, -1, config, falseOnsets);
+    updateBaseline(tracker.baseline, value, active, config);
+  }
+};
+
+/**
+ * @brief Pad flips against the true touch state, and how long the pad took to follow it
+ */
+struct Score
+{
+  long checks = 0;
+  long flips = 0;
+  long spurious = 0;
+  long followed[2] = {0, 0}; // touches and releases the pad followed...
+  long delay[2] = {0, 0};    // ...and the checks it took
+  long missed = 0;           // touches and releases over before the pad followed them
+  long falseOnsets = 0;
+
+  bool lastTruth = false;
+  bool pending = false; // truth changed and the pad has not followed yet
+  int since = 0;
+
+  void add(bool truth, bool before, bool after)
+  {
+    checks++;
+    if (truth != lastTruth)
+    {
+      if (pending)
+        missed++;
+      pending = truth != before;
+      lastTruth = truth;
+      since = 0;
+    }
+    since++;
+
+    if (after == before)
+      return;
+
+    flips++;
+    if (pending && after == truth)
+    {
+      pending = false;
+      followed[truth]++;
+      delay[truth] += since;
+    }
+    else
+    {
+      spurious++;
+    }
+  }
+
+  double perMinute(long count) const { return count * 60000.0 / (checks * SensorCheckMs); }
+
+  double delayMs(bool touch) const { return followed[touch] ? delay[touch] * (double)SensorCheckMs / followed[touch] : 0; }
+};
+
+Score simulate(const Options &options, const SensingConfig &config, int hysteresis)
+{
+  Score score;
+  long checks = options.seconds * 1000L / SensorCheckMs;
+
+  for (int seed = 0; seed < options.seeds; seed++)
+  {
+    PadTrace trace(seed + 1, options);
+    Pad pad;
+    score.lastTruth = false;
+    score.pending = false;
+
+    for (long i = 0; i < checks; i++)
+    {
+      int raw = trace.next();
+      bool before = pad.active;
+      pad.check(raw, options.offset, hysteresis, config);
+      score.add(trace.touched(), before, pad.active);
+    }
+    score.falseOnsets += pad.falseOnsets;
+  }
+
+  return score;
+}
+
+void printTraces(const Options &options)
+{
+  printf("%d traces of %d s, touch +%d, hover +%d, noise %d, offset %d\n\n", options.seeds, options.seconds, options.touch,
+         options.hover, options.noise, options.offset);
+}
+
+int debounce(const Options &options)
+{
+  struct Setting
+  {
+    int hysteresis;
+    int count;
+    int window;
+  };
+  const Setting settings[] = {{0, 1, 1}, {200, 1, 1}, {0, 2, 3}, {200, 2, 3}, {400, 2, 3}, {200, 3, 5}, {400, 4, 6}};
+
+  printTraces(options);
+  printf("%5s %5s %10s %13s %9s %9s %7s\n", "hyst", "N/M", "flips/min", "spurious/min", "touch ms", "release ms", "missed");
+
+  for (const Setting &setting : settings)
+  {
+    SensingConfig config = DefaultSensingConfig;
+    config.debounceCount = setting.count;
+    config.debounceWindow = setting.window;
+    Score score = simulate(options, config, setting.hysteresis);
+
+    char window[8];
+    snprintf(window, sizeof(window), "%d/%d", setting.count, setting.window);
+    printf("%5d %5s %10.1f %13.1f %9.0f %10.0f %7ld\n", setting.hysteresis, window, score.perMinute(score.flips),
+           score.perMinute(score.spurious), score.delayMs(true), score.delayMs(false), score.missed);
+  }
+
+  return 0;
+}
+
+int onset(const Options &options)
+{
+  const int slopes[] = {0, 300, 500, 800, 1200};
+
+  printTraces(options);
+  printf("%6s %9s %10s %16s %13s\n", "onset", "touch ms", "release ms", "false onsets/min", "spurious/min");
+
+  for (int slope : slopes)
+  {
+    SensingConfig config = DefaultSensingConfig;
+    config.onsetSlope = slope;
+    Score score = simulate(options, config, 200);
+
+    printf("%6d %9.0f %10.0f %16.1f %13.1f\n", slope, score.delayMs(true), score.delayMs(false), score.perMinute(score.falseOnsets),
+           score.perMinute(score.spurious));
+  }
+
+  return 0;
+}
+
+/**
+ * @brief updateFilter in double precision, the reference for the fixed point version
+ */
+struct ReferenceFilter
+{
+  double value = 0;
+  double rate = 0;
+  bool primed = false;
+
+  double update(double measurement, double alpha, double beta)
+  {
+    if (!primed)
+    {
+      value = measurement;
+      rate = 0;
+      primed = true;
+      return value;
+    }
+
+    double predicted = value + rate;
+    double residual = measurement - predicted;
+    value = predicted + alpha * residual;
+    rate += beta * residual;
+    return value;
+  }
+};
+
+/**
+ * @brief Checks for a filter to cover 90% of a clean step of the given height
+ */
+int stepChecks(int alpha, int beta, int height)
+{
+  AlphaBetaFilter filter = {0, 0, false};
+  updateFilter(filter, Baseline, alpha, beta);
+  for (int checks = 1; checks < 100; checks++)
+  {
+    if (updateFilter(filter, Baseline + height, alpha, beta) >= Baseline + height * 9 / 10)
+      return checks;
+  }
+  return 100;
+}
+
+int filter(const Options &options)
+{
+  struct Gains
+  {
+    int alpha;
+    int beta;
+  };
+  const Gains gains[] = {{256, 0}, {192, 32}, {128, 16}, {96, 8}, {64, 4}, {32, 1}};
+  long checks = options.seconds * 1000L / SensorCheckMs;
+
+  printTraces(options);
+  printf("%5s %5s %13s %13s %13s %13s %12s %11s\n", "alpha", "beta", "max value err", "mean val err", "max rate err",
+         "mean rate err", "noise sd", "step checks");
+
+  for (const Gains &gain : gains)
+  {
+    double maxValueError = 0, maxRateError = 0, valueError = 0, rateError = 0, noise = 0;
+    long samples = 0, settled = 0;
+
+    for (int seed = 0; seed < options.seeds; seed++)
+    {
+      PadTrace trace(seed + 1, options);
+      AlphaBetaFilter fixed = {0, 0, false};
+      ReferenceFilter reference;
+
+      for (long i = 0, previous = 0, still = 0; i < checks; i++)
+      {
+        int raw = trace.next();
+        still = abs(trace.clean() - previous) <= 2 ? still + 1 : 0;
+        previous = trace.clean();
+        int value = updateFilter(fixed, raw, gain.alpha, gain.beta);
+        double expected = reference.update(raw, gain.alpha / 256.0, gain.beta / 256.0);
+
+        double error = fabs(value - expected);
+        double rate = fabs((double)fixed.rate / (1 << FilterShift) - reference.rate);
+        maxValueError = std::max(maxValueError, error);
+        maxRateError = std::max(maxRateError, rate);
+        valueError += error;
+        rateError += rate;
+        samples++;
+
+        // Skip the checks right after a change, where the error is lag rather than noise
+        if (still > 20)
+        {
+          noise += (double)(value - trace.clean()) * (value - trace.clean());
+          settled++;
+        }
+      }
+    }
+
+    printf("%5d %5d %13.2f %13.2f %13.2f %13.2f %12.0f %11d\n", gain.alpha, gain.beta, maxValueError, valueError / samples,
+           maxRateError, rateError / samples, sqrt(noise / settled), stepChecks(gain.alpha, gain.beta, options.touch));
+  }
+
+  return 0;
+}
+
+/**
+ * @brief Two visitors at the pads, and whether they have joined hands
+ */
+class VisitTrace
+{
+public:
+  VisitTrace(uint64_t seed, const Options &options) : trace(seed, options), options(options) {}
+
+  /**
+   * @brief Advances one sensor check
+   */
+  void next()
+  {
+    if (--remaining <= 0)
+      enter();
+
+    for (int pad = 0; pad < 2; pad++)
+    {
+      bool touching = phase != Idle && (pad == 0 || phase != Arriving || secondLate-- <= 0);
+      int target = touching ? options.touch + spread[pad] : 0;
+      if (touching && (joined() || pressing == pad + 1))
+        target += options.jump;
+
+      level[pad] += (target - level[pad]) / 2;
+
+      int noise = 0;
+      for (int i = 0; i < 4; i++)
+        noise += trace.uniform(-options.noise, options.noise);
+      raw[pad] = Baseline + level[pad] + noise * 866 / 1000;
+    }
+
+    impedence = (joined() ? 300 : 900) + trace.uniform(-20, 20);
+  }
+
+  bool joined() const { return phase == Joined; }
+
+  int raw[2] = {Baseline, Baseline};
+  int impedence = 900;
+
+private:
+  enum Phase
+  {
+    Idle,
+    Arriving, // the second visitor reaches their pad up to a second after the first
+    Holding,  // both touching, not joined
+    Joined
+  };
+
+  PadTrace trace; // for its random numbers
+  const Options &options;
+  Phase phase = Idle;
+  int remaining = 40;
+  int secondLate = 0;
+  int spread[2] = {0, 0}; // how much harder each visitor touches than TOUCH
+  int pressing = 0;       // pad pressed harder while holding, 1 left, 2 right
+  int level[2] = {0, 0};
+
+  void enter()
+  {
+    switch (phase)
+    {
+    case Idle:
+      phase = Arriving;
+      secondLate = trace.uniform(0, 20);
+      spread[0] = trace.uniform(-300, 300);
+      spread[1] = trace.uniform(-300, 300);
+      remaining = trace.uniform(20, 60);
+      break;
+    case Arriving:
+      if (trace.uniform(0, 4) < 3)
+      {
+        phase = Joined;
+        remaining = trace.uniform(60, 160);
+      }
+      else
+      {
+        phase = Holding;
+        pressing = trace.uniform(0, 2);
+        remaining = trace.uniform(40, 100);
+      }
+      break;
+    case Holding:
+    case Joined:
+      phase = Idle;
+      pressing = 0;
+      remaining = trace.uniform(40, 120);
+      break;
+    }
+  }
+};
+
+/**
+ * @brief The sensing loop of checkSensors, capacitiveCheck and impedenceCheck for two pads, with the
+ * impedence threshold pot at 500
+ */
+struct JoinModule
+{
+  enum Output
+  {
+    Idle,
+    Left,
+    Right,
+    Both,
+    Joined
+  };
+
+  const Options &options;
+  const SensingConfig &config;
+  bool predicting;
+  bool gated; // false - predict as soon as both pads are active, without restarting the pad filters
+
+  Pad pads[2];
+  AlphaBetaFilter impedenceFilter = {0, 0, false};
+  bool impedenceSensing = false;
+  bool joinPredicted = false;
+  long capBufferStart = 0;
+  long impBufferStart = 0;
+  Output output = Idle;
+  long relayFlips = 0;
+  long misses = 0;
+
+  JoinModule(const Options &options, const SensingConfig &config, bool predicting, bool gated)
+      : options(options), config(config), predicting(predicting), gated(gated) {}
+
+  static const long BufferChecks = 10; // the capBuf and impBuf defaults
+
+  void check(long now, const VisitTrace &visit)
+  {
+    if (impedenceSensing)
+    {
+      int value = updateFilter(impedenceFilter, visit.impedence, 96, 8);
+      if (value < 500)
+      {
+        output = Joined;
+        impBufferStart = now;
+        joinPredicted = false;
+        return;
+      }
+
+      if ((output != Joined || joinPredicted) && now - impBufferStart < BufferChecks)
+        return;
+
+      if (joinPredicted)
+      {
+        joinPredicted = false;
+        misses++;
+        output = Both;
+      }
+
+      impedenceSensing = false;
+      capBufferStart = now;
+      if (gated)
+      {
+        for (Pad &pad : pads)
+        {
+          pad.filter.primed = false;
+          pad.tracker.prevValue = NewPadTracker.prevValue;
+        }
+      }
+      return;
+    }
+
+    for (int i = 0; i < 2; i++)
+      pads[i].check(visit.raw[i], options.offset, 200, config);
+
+    if (pads[0].active && pads[1].active)
+    {
+      int leftRate = pads[0].filter.rate >> FilterShift;
+      int rightRate = pads[1].filter.rate >> FilterShift;
+      bool bufferExpired = now - capBufferStart > BufferChecks;
+      JoinStep step = joinStep(bufferExpired, predicting, leftRate, rightRate, config);
+      if (!gated && predicting && predictJoin(leftRate, rightRate, config))
+        step = JOIN_PREDICT;
+
+      if (step == JOIN_PREDICT)
+      {
+        joinPredicted = true;
+        output = Joined;
+      }
+      else
+      {
+        output = Both;
+      }
+
+      if (step != JOIN_HOLD)
+      {
+        impedenceSensing = true;
+        impBufferStart = now;
+        impedenceFilter.primed = false;
+        relayFlips++;
+      }
+      return;
+    }
+
+    output = pads[0].active ? Left : pads[1].active ? Right : Idle;
+  }
+};
+
+int join(const Options &options)
+{
+  struct Setting
+  {
+    const char *name;
+    int joinRate;
+    bool predicting;
+    bool gated;
+  };
+  const Setting settings[] = {{"relay only", 0, false, true}, {"predict", 50, true, true},  {"predict", 100, true, true},
+                              {"predict", 200, true, true},   {"predict", 300, true, true}, {"ungated", 100, true, false}};
+  long checks = options.seconds * 1000L / SensorCheckMs;
+
+  printTraces(options);
+  printf("%-10s %5s %7s %8s %9s %9s %12s %10s %11s\n", "mode", "rate", "joins", "reported", "mean ms", "p90 ms", "false JOINED",
+         "flaps/min", "relays/min");
+
+  for (const Setting &setting : settings)
+  {
+    SensingConfig config = DefaultSensingConfig;
+    config.joinRate = setting.joinRate;
+    long joins = 0, reported = 0, falseJoined = 0, flaps = 0, relayFlips = 0;
+    std::vector<long> delays;
+
+    for (int seed = 0; seed < options.seeds; seed++)
+    {
+      VisitTrace visit(seed + 1, options);
+      JoinModule module(options, config, setting.predicting, setting.gated);
+      bool wasJoined = false, seen = false;
+      long joinedAt = 0;
+      JoinModule::Output previous = JoinModule::Idle;
+
+      for (long now = 1; now <= checks; now++)
+      {
+        visit.next();
+        module.check(now, visit);
+
+        if (visit.joined() && !wasJoined)
+        {
+          joins++;
+          joinedAt = now;
+          seen = false;
+        }
+        wasJoined = visit.joined();
+
+        if (module.output == JoinModule::Joined && previous != JoinModule::Joined)
+        {
+          if (!visit.joined())
+          {
+            falseJoined++;
+          }
+          else if (!seen)
+          {
+            seen = true;
+            reported++;
+            delays.push_back((now - joinedAt) * SensorCheckMs);
+          }
+        }
+
+        if ((module.output == JoinModule::Joined && previous == JoinModule::Both) ||
+            (module.output == JoinModule::Both && previous == JoinModule::Joined))
+          flaps++;
+        previous = module.output;
+      }
+
+      relayFlips += module.relayFlips;
+    }
+
+    std::sort(delays.begin(), delays.end());
+    double mean = 0;
+    for (long delay : delays)
+      mean += delay;
+    mean = delays.empty() ? 0 : mean / delays.size();
+    long p90 = delays.empty() ? 0 : delays[std::min(delays.size() - 1, delays.size() * 9 / 10)];
+    double minutes = options.seeds * (double)options.seconds / 60;
+
+    printf("%-10s %5d %7ld %8ld %9.0f %9ld %12ld %10.1f %11.1f\n", setting.name, setting.predicting ? setting.joinRate : 0, joins,
+           reported, mean, p90, falseJoined, flaps / minutes, relayFlips / minutes);
+  }
+
+  return 0;
+}
+
+void usage()
+{
+  fprintf(stderr, "usage: sensing_sim debounce|onset|filter|join [-s SEEDS] [-t SECONDS] [-z NOISE] [-o OFFSET] [-u TOUCH] [-v HOVER] [-j JUMP]\n");
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+  if (argc < 2)
+  {
+    usage();
+    return 1;
+  }
+
+  const char *mode = argv[1];
+  Options options;
+  int opt;
+  optind = 2;
+
+  while ((opt = getopt(argc, argv, "s:t:z:o:u:v:j:")) != -1)
+  {
+    switch (opt)
+    {
+    case 's':
+      options.seeds = atoi(optarg) > 1 ? atoi(optarg) : 1;
+      break;
+    case 't':
+      options.seconds = atoi(optarg) > 1 ? atoi(optarg) : 1;
+      break;
+    case 'z':
+      options.noise = atoi(optarg) > 0 ? atoi(optarg) : 0;
+      break;
+    case 'o':
+      options.offset = atoi(optarg);
+      break;
+    case 'u':
+      options.touch = atoi(optarg);
+      break;
+    case 'v':
+      options.hover = atoi(optarg);
+      break;
+    case 'j':
+      options.jump = atoi(optarg);
+      break;
+    default:
+      usage();
+      return 1;
+    }
+  }
+
+  if (optind != argc)
+  {
+    usage();
+    return 1;
+  }
+
+  if (strcmp(mode, "debounce") == 0)
+    return debounce(options);
+  if (strcmp(mode, "onset") == 0)
+    return onset(options);
+  if (strcmp(mode, "filter") == 0)
+    return filter(options);
+  if (strcmp(mode, "join") == 0)
+    return join(options);
+
+  usage();
+  return 1;
+}
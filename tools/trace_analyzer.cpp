@@ -0,0 +1,445 @@
+/**
+ * Summarises recorded serial logs from one module as JSON: per state dwell times, flapping,
+ * time to JOINED, relay cycles and suspected false triggers.
+ *
+ * Build:
+ *   g++ -std=c++17 -O2 -o trace_analyzer tools/trace_analyzer.cpp
+ *
+ * Usage:
+ *   trace_analyzer [--flap-ms N] [--min-touch-ms N] [--gap-ms N] [FILE ...]
+ *
+ * Reads stdin when no files are given. Input is streamed line by line, so memory use does not grow
+ * with the log. Each line holds a state ([000], [100], [010], [110] or [001]), optionally followed by
+ * the extended/telemetry fields (see README), and optionally preceded by a timestamp:
+ *   12:34:56.789 -> [110]       serial monitor time of day
+ *   1697640000.125 [110]        seconds
+ *   1697640000125 [110]         milliseconds
+ * Without timestamps, lines are taken to be one sensor check (50ms) apart. Other lines, such as command
+ * responses, are ignored. Files are analysed as separate sessions but summarised together.
+ *
+ * Relay cycles are counted from the telemetry fields when present (cap fields switching to the
+ * impedance field), otherwise estimated as one per JOINED episode plus one for every two relay buffer
+ * intervals spent in BOTH without joining.
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "hc_parser.h"
+
+namespace
+{
+
+const int64_t SensorCheckMs = 50;        // matches SensorCheckInterval
+const int64_t CapCheckBufferMs = 500;    // matches the capBuf default
+const int64_t DayMs = 24LL * 60 * 60 * 1000;
+const int JoinHistogramBucketMs = 10;
+const int JoinHistogramBuckets = 1000; // up to 10 seconds, longer waits land in the last bucket
+
+enum State
+{
+  IDLE,
+  LEFT,
+  RIGHT,
+  BOTH,
+  JOINED,
+  StateCount
+};
+
+const char *StateNames[StateCount] = {"idle", "left", "right", "both", "joined"};
+
+enum Sensing
+{
+  SENSING_UNKNOWN,
+  SENSING_CAPACITIVE,
+  SENSING_IMPEDENCE
+};
+
+struct Options
+{
+  int64_t flapMs = 250;     // an episode this short that returns to the previous state is a flap
+  int64_t minTouchMs = 150; // a touch this short between two idle episodes is a suspected false trigger
+  int64_t gapMs = 2000;     // a timestamp jump this long ends the session, e.g. a disconnect
+};
+
+struct DwellStats
+{
+  uint64_t episodes = 0;
+  int64_t totalMs = 0;
+  int64_t maxMs = 0;
+};
+
+/**
+ * @brief Parses a state from "[xyz]"
+ *
+ * @return the state, or -1 if text is not a known state
+ */
+int parseState(const char *text)
+{
+  if (text[0] != '[' || text[4] != ']')
+    return -1;
+
+  if (strncmp(text + 1, "000", 3) == 0)
+    return IDLE;
+  if (strncmp(text + 1, "100", 3) == 0)
+    return LEFT;
+  if (strncmp(text + 1, "010", 3) == 0)
+    return RIGHT;
+  if (strncmp(text + 1, "110", 3) == 0)
+    return BOTH;
+  if (strncmp(text + 1, "001", 3) == 0)
+    return JOINED;
+
+  return -1;
+}
+
+class Analyzer
+{
+public:
+  explicit Analyzer(const Options &options) : options(options) {}
+
+  /**
+   * @brief Starts a new session, e.g. a new file, forgetting the previous session's episodes and clock
+   */
+  void startSession()
+  {
+    hasEpisode = false;
+    prevState = -1;
+    bothStartMs = -1;
+    lastSensing = SENSING_UNKNOWN;
+    timeOfDay = false;
+    lastMs = -1;
+    sessions++;
+  }
+
+  void addLine(const char *line)
+  {
+    const char *bracket = strchr(line, '[');
+    int state = bracket == nullptr ? -1 : parseState(bracket);
+    if (state < 0)
+    {
+      if (bracket != nullptr)
+        malformedLines++;
+      return;
+    }
+
+    int64_t now = lineTime(line, bracket);
+    if (now < 0)
+      return;
+
+    stateLines++;
+    Sensing sensing = parseSensing(bracket + 5);
+
+    if (lastMs >= 0 && now - lastMs > options.gapMs)
+    {
+      // Never count the gap itself as dwell time
+      closeEpisode(lastMs + SensorCheckMs);
+      hasEpisode = false;
+      prevState = -1;
+      bothStartMs = -1;
+      gaps++;
+    }
+
+    if (sensing != SENSING_UNKNOWN)
+    {
+      telemetryLines++;
+      if (lastSensing == SENSING_CAPACITIVE && sensing == SENSING_IMPEDENCE)
+        measuredRelayCycles++;
+      lastSensing = sensing;
+    }
+
+    if (!hasEpisode)
+    {
+      openEpisode(state, now);
+    }
+    else if (state != episodeState)
+    {
+      closeEpisode(now);
+      openEpisode(state, now);
+    }
+
+    lastMs = now;
+  }
+
+  void finish()
+  {
+    closeEpisode(lastMs + SensorCheckMs);
+    hasEpisode = false;
+  }
+
+  void print() const
+  {
+    int64_t observedMs = 0;
+    for (const DwellStats &stats : dwell)
+      observedMs += stats.totalMs;
+    double hours = observedMs / 3600000.0;
+
+    printf("{\n");
+    printf("  \"sessions\": %llu,\n", (unsigned long long)sessions);
+    printf("  \"state_lines\": %llu,\n", (unsigned long long)stateLines);
+    printf("  \"malformed_lines\": %llu,\n", (unsigned long long)malformedLines);
+    printf("  \"gaps\": %llu,\n", (unsigned long long)gaps);
+    printf("  \"observed_ms\": %lld,\n", (long long)observedMs);
+
+    printf("  \"dwell\": {\n");
+    for (int state = 0; state < StateCount; state++)
+    {
+      const DwellStats &stats = dwell[state];
+      printf("    \"%s\": {\"episodes\": %llu, \"total_ms\": %lld, \"mean_ms\": %.1f, \"max_ms\": %lld, \"share\": %.4f}%s\n",
+             StateNames[state], (unsigned long long)stats.episodes, (long long)stats.totalMs,
+             stats.episodes ? (double)stats.totalMs / stats.episodes : 0.0, (long long)stats.maxMs,
+             observedMs ? (double)stats.totalMs / observedMs : 0.0, state + 1 < StateCount ? "," : "");
+    }
+    printf("  },\n");
+
+    printf("  \"transitions\": %llu,\n", (unsigned long long)transitions);
+    printf("  \"flaps\": %llu,\n", (unsigned long long)flaps);
+    printf("  \"flaps_per_hour\": %.2f,\n", hours > 0 ? flaps / hours : 0.0);
+
+    printf("  \"time_to_joined_ms\": {\"count\": %llu, \"abandoned\": %llu, \"mean\": %.1f, \"p50\": %lld, \"p95\": %lld, \"max\": %lld},\n",
+           (unsigned long long)joins, (unsigned long long)abandonedBoths, joins ? (double)joinTotalMs / joins : 0.0,
+           (long long)joinPercentile(0.50), (long long)joinPercentile(0.95), (long long)joinMaxMs);
+
+    bool measured = telemetryLines > 0;
+    uint64_t relayCycles = measured ? measuredRelayCycles : estimatedRelayCycles;
+    printf("  \"relay_cycles\": {\"count\": %llu, \"per_hour\": %.2f, \"source\": \"%s\"},\n", (unsigned long long)relayCycles,
+           hours > 0 ? relayCycles / hours : 0.0, measured ? "telemetry" : "estimated");
+
+    printf("  \"suspected_false_triggers\": {\"count\": %llu, \"per_hour\": %.2f}\n", (unsigned long long)falseTriggers,
+           hours > 0 ? falseTriggers / hours : 0.0);
+    printf("}\n");
+  }
+
+private:
+  const Options &options;
+
+  // Session state
+  bool hasEpisode = false;
+  int episodeState = IDLE;
+  int64_t episodeStartMs = 0;
+  int prevState = -1;       // state of the episode before the current one, -1 at session start
+  int64_t bothStartMs = -1; // when the current run of BOTH started, -1 outside one
+  Sensing lastSensing = SENSING_UNKNOWN;
+  bool timeOfDay = false;
+  int64_t lastMs = -1;
+
+  // Totals
+  uint64_t sessions = 0;
+  uint64_t stateLines = 0;
+  uint64_t malformedLines = 0;
+  uint64_t telemetryLines = 0;
+  uint64_t gaps = 0;
+  uint64_t transitions = 0;
+  uint64_t flaps = 0;
+  uint64_t falseTriggers = 0;
+  uint64_t measuredRelayCycles = 0;
+  uint64_t estimatedRelayCycles = 0;
+  uint64_t joins = 0;
+  uint64_t abandonedBoths = 0;
+  int64_t joinTotalMs = 0;
+  int64_t joinMaxMs = 0;
+  uint64_t joinHistogram[JoinHistogramBuckets] = {};
+  DwellStats dwell[StateCount];
+
+  /**
+   * @brief Works out a line's time from its timestamp, or from the sensor check interval without one
+   *
+   * @return milliseconds, or -1 to skip a line that runs backwards
+   */
+  int64_t lineTime(const char *line, const char *bracket)
+  {
+    int64_t stamp = hc::parseTimestamp(line, bracket);
+    if (stamp < 0)
+      return (lastMs >= 0 ? lastMs : 0) + SensorCheckMs;
+
+    // Time of day stamps wrap at midnight
+    if (strchr(line, ':') != nullptr && strchr(line, ':') < bracket)
+      timeOfDay = true;
+    if (timeOfDay && lastMs >= 0)
+    {
+      while (stamp < lastMs - DayMs / 2)
+        stamp += DayMs;
+    }
+
+    if (lastMs >= 0 && stamp < lastMs)
+    {
+      malformedLines++;
+      return -1;
+    }
+
+    return stamp;
+  }
+
+  /**
+   * @brief Works out which sensing path was in use from the telemetry fields after the state
+   */
+  static Sensing parseSensing(const char *fields)
+  {
+    for (const char *field = strchr(fields, ' '); field != nullptr; field = strchr(field + 1, ' '))
+    {
+      if (field[1] == 'l' || field[1] == 'r')
+        return SENSING_CAPACITIVE;
+      if (field[1] == 'i')
+        return SENSING_IMPEDENCE;
+    }
+
+    return SENSING_UNKNOWN;
+  }
+
+  void openEpisode(int state, int64_t now)
+  {
+    if (hasEpisode)
+      transitions++;
+
+    if (state == BOTH && bothStartMs < 0)
+      bothStartMs = now;
+
+    if (state == JOINED && bothStartMs >= 0)
+    {
+      int64_t waitMs = now - bothStartMs;
+      joins++;
+      joinTotalMs += waitMs;
+      if (waitMs > joinMaxMs)
+        joinMaxMs = waitMs;
+      joinHistogram[waitMs / JoinHistogramBucketMs < JoinHistogramBuckets ? waitMs / JoinHistogramBucketMs : JoinHistogramBuckets - 1]++;
+    }
+
+    if (state != BOTH && state != JOINED && bothStartMs >= 0)
+      abandonedBoths++;
+
+    if (state != BOTH)
+      bothStartMs = -1;
+
+    // A short episode between two of the same state
+    if (hasEpisode && state == prevState && now - episodeStartMs < options.flapMs)
+      flaps++;
+
+    // A short touch between two idles
+    if (hasEpisode && state == IDLE && prevState == IDLE && episodeState != IDLE && now - episodeStartMs < options.minTouchMs)
+      falseTriggers++;
+
+    if (hasEpisode)
+      prevState = episodeState;
+
+    hasEpisode = true;
+    episodeState = state;
+    episodeStartMs = now;
+  }
+
+  void closeEpisode(int64_t now)
+  {
+    if (!hasEpisode || now < episodeStartMs)
+      return;
+
+    int64_t dwellMs = now - episodeStartMs;
+    DwellStats &stats = dwell[episodeState];
+    stats.episodes++;
+    stats.totalMs += dwellMs;
+    if (dwellMs > stats.maxMs)
+      stats.maxMs = dwellMs;
+
+    // Without telemetry, assume each JOINED took one flip, and a BOTH that never joined flipped,
+    // checked impedence for a buffer interval and flipped back every two buffer intervals
+    if (episodeState == JOINED)
+      estimatedRelayCycles++;
+    if (episodeState == BOTH)
+      estimatedRelayCycles += dwellMs / (CapCheckBufferMs * 2);
+  }
+
+  int64_t joinPercentile(double fraction) const
+  {
+    if (joins == 0)
+      return 0;
+
+    uint64_t target = (uint64_t)(fraction * (joins - 1)) + 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < JoinHistogramBuckets; i++)
+    {
+      seen += joinHistogram[i];
+      if (seen >= target)
+        return (int64_t)i * JoinHistogramBucketMs;
+    }
+
+    return joinMaxMs;
+  }
+};
+
+bool analyzeFile(FILE *in, Analyzer &analyzer)
+{
+  static char buffer[1 << 16];
+  setvbuf(in, nullptr, _IOFBF, 1 << 20);
+
+  analyzer.startSession();
+  while (fgets(buffer, sizeof(buffer), in) != nullptr)
+  {
+    analyzer.addLine(buffer);
+  }
+  analyzer.finish();
+
+  return !ferror(in);
+}
+
+void usage()
+{
+  fprintf(stderr, "usage: trace_analyzer [--flap-ms N] [--min-touch-ms N] [--gap-ms N] [FILE ...]\n");
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+  Options options;
+  int firstFile = argc;
+
+  for (int i = 1; i < argc; i++)
+  {
+    if (strcmp(argv[i], "--flap-ms") == 0 && i + 1 < argc)
+      options.flapMs = atoll(argv[++i]);
+    else if (strcmp(argv[i], "--min-touch-ms") == 0 && i + 1 < argc)
+      options.minTouchMs = atoll(argv[++i]);
+    else if (strcmp(argv[i], "--gap-ms") == 0 && i + 1 < argc)
+      options.gapMs = atoll(argv[++i]);
+    else if (argv[i][0] == '-' && argv[i][1] != '\0')
+    {
+      usage();
+      return 1;
+    }
+    else
+    {
+      firstFile = i;
+      break;
+    }
+  }
+
+  Analyzer analyzer(options);
+
+  if (firstFile == argc)
+  {
+    if (!analyzeFile(stdin, analyzer))
+      return 1;
+  }
+
+  for (int i = firstFile; i < argc; i++)
+  {
+    FILE *in = strcmp(argv[i], "-") == 0 ? stdin : fopen(argv[i], "r");
+    if (in == nullptr)
+    {
+      fprintf(stderr, "cannot read %s\n", argv[i]);
+      return 1;
+    }
+
+    bool ok = analyzeFile(in, analyzer);
+    if (in != stdin)
+      fclose(in);
+    if (!ok)
+    {
+      fprintf(stderr, "error reading %s\n", argv[i]);
+      return 1;
+    }
+  }
+
+  analyzer.print();
+  return 0;
+}
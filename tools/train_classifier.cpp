@@ -0,0 +1,432 @@
+/**
+ * Trains the pad classifier from recorded telemetry and writes include/classifier_model.h
+ *
+ * Build:
+ *   g++ -std=c++17 -O2 -o train_classifier tools/train_classifier.cpp
+ *
+ * Usage:
+ *   train_classifier [--depth N] [--min-leaf N] [--out PATH] LR=FILE [LR=FILE ...]
+ *
+ * Each FILE is a serial log recorded with `set outFmt 2` while the true pad states were known and fixed,
+ * given as LR digits (e.g. 00 for nobody touching, 10 for left only, 11 for both). Lines without
+ * capacitive telemetry fields are skipped. Every line yields one sample per pad, using the same
+ * features the firmware computes (see include/classifier.h).
+ *
+ * The last fifth of every log is held out to report test accuracy. Neighbouring lines share their filter
+ * state, so holding out a contiguous block rather than scattered lines keeps the test samples from being
+ * near copies of training samples. The model itself is a depth limited decision tree split on Gini impurity,
+ * so firmware evaluation takes at most depth comparisons.
+ *
+ * Once written, the model is read back from the generated header and evaluated the way the firmware's
+ * classifyPad does, with its field widths and depth bound. Any sample it classifies differently from the
+ * trainer fails the run.
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+const int FeatureCount = 4; // matches ClassifierFeatureCount
+const char *FeatureNames[FeatureCount] = {"FEATURE_DELTA", "FEATURE_RATE", "FEATURE_OTHER_DELTA", "FEATURE_OTHER_RATE"};
+const int MaxDepth = 7; // keeps node indices within the firmware's uint8_t
+
+struct Sample
+{
+  int f[FeatureCount];
+  int label;
+};
+
+struct Node
+{
+  int feature; // -1 for leaves
+  int threshold;
+  int left;
+  int right;
+};
+
+struct Options
+{
+  int depth = 4;
+  int minLeaf = 8;
+  std::string out = "include/classifier_model.h";
+};
+
+/**
+ * @brief Parses "<delta>,<rate>" following a telemetry field letter
+ */
+bool parsePair(const char *text, int &delta, int &rate)
+{
+  char *end;
+  delta = strtol(text, &end, 10);
+  if (end == text || *end != ',')
+    return false;
+
+  const char *rateText = end + 1;
+  rate = strtol(rateText, &end, 10);
+  return end != rateText;
+}
+
+/**
+ * @brief Reads one labelled log, appending a left and a right sample for every telemetry line,
+ * the last fifth of the log to test and the rest to train
+ */
+bool loadLog(const std::string &path, int leftLabel, int rightLabel, std::vector<Sample> &train, std::vector<Sample> &test)
+{
+  std::ifstream in(path);
+  if (!in)
+    return false;
+
+  std::vector<Sample> samples;
+  std::string line;
+  while (std::getline(in, line))
+  {
+    const char *l = strstr(line.c_str(), " l");
+    const char *r = strstr(line.c_str(), " r");
+    int dl, rl, dr, rr;
+    if (l == nullptr || r == nullptr || !parsePair(l + 2, dl, rl) || !parsePair(r + 2, dr, rr))
+      continue;
+
+    samples.push_back({{dl, rl, dr, rr}, leftLabel});
+    samples.push_back({{dr, rr, dl, rl}, rightLabel});
+  }
+
+  // Whole lines only, so both pads of a line land on the same side
+  size_t split = samples.size() / 2 * 4 / 5 * 2;
+  train.insert(train.end(), samples.begin(), samples.begin() + split);
+  test.insert(test.end(), samples.begin() + split, samples.end());
+  return true;
+}
+
+double gini(int positive, int total)
+{
+  if (total == 0)
+    return 0;
+
+  double p = double(positive) / total;
+  return 2 * p * (1 - p);
+}
+
+class TreeBuilder
+{
+public:
+  TreeBuilder(const std::vector<Sample> &samples, const Options &options) : samples(samples), options(options) {}
+
+  std::vector<Node> build()
+  {
+    std::vector<int> indices(samples.size());
+    for (size_t i = 0; i < indices.size(); i++)
+      indices[i] = i;
+
+    grow(indices, 0);
+    return nodes;
+  }
+
+private:
+  const std::vector<Sample> &samples;
+  const Options &options;
+  std::vector<Node> nodes;
+
+  int leaf(int label)
+  {
+    nodes.push_back({-1, label, 0, 0});
+    return nodes.size() - 1;
+  }
+
+  /**
+   * @brief Adds a subtree for the given samples in preorder, returning its root index
+   */
+  int grow(std::vector<int> &indices, int depth)
+  {
+    int positive = 0;
+    for (int i : indices)
+      positive += samples[i].label;
+
+    int total = indices.size();
+    int majority = positive * 2 >= total ? 1 : 0;
+    if (depth >= options.depth || positive == 0 || positive == total || total < 2 * options.minLeaf)
+      return leaf(majority);
+
+    double bestScore = gini(positive, total);
+    int bestFeature = -1;
+    int bestThreshold = 0;
+
+    for (int feature = 0; feature < FeatureCount; feature++)
+    {
+      std::sort(indices.begin(), indices.end(), [&](int a, int b)
+                { return samples[a].f[feature] < samples[b].f[feature]; });
+
+      int leftPositive = 0;
+      for (int split = 1; split < total; split++)
+      {
+        leftPositive += samples[indices[split - 1]].label;
+        int value = samples[indices[split - 1]].f[feature];
+        if (value == samples[indices[split]].f[feature] || split < options.minLeaf || total - split < options.minLeaf)
+          continue;
+
+        double score = (split * gini(leftPositive, split) + (total - split) * gini(positive - leftPositive, total - split)) / total;
+        if (score < bestScore)
+        {
+          bestScore = score;
+          bestFeature = feature;
+          bestThreshold = value;
+        }
+      }
+    }
+
+    if (bestFeature < 0)
+      return leaf(majority);
+
+    std::vector<int> lower, upper;
+    for (int i : indices)
+      (samples[i].f[bestFeature] <= bestThreshold ? lower : upper).push_back(i);
+
+    int index = nodes.size();
+    nodes.push_back({bestFeature, bestThreshold, 0, 0});
+    int left = grow(lower, depth + 1);
+    int right = grow(upper, depth + 1);
+
+    // Collapse splits that decide the same either way, the children are the last two nodes added
+    if (nodes[left].feature < 0 && nodes[right].feature < 0 && nodes[left].threshold == nodes[right].threshold)
+    {
+      int label = nodes[left].threshold;
+      nodes.resize(index);
+      return leaf(label);
+    }
+
+    nodes[index].left = left;
+    nodes[index].right = right;
+    return index;
+  }
+};
+
+int classify(const std::vector<Node> &nodes, const Sample &sample)
+{
+  int index = 0;
+  while (nodes[index].feature >= 0)
+    index = sample.f[nodes[index].feature] <= nodes[index].threshold ? nodes[index].left : nodes[index].right;
+
+  return nodes[index].threshold;
+}
+
+int treeDepth(const std::vector<Node> &nodes, int index)
+{
+  if (nodes[index].feature < 0)
+    return 0;
+
+  return 1 + std::max(treeDepth(nodes, nodes[index].left), treeDepth(nodes, nodes[index].right));
+}
+
+void report(const char *name, const std::vector<Node> &nodes, const std::vector<Sample> &samples)
+{
+  int confusion[2][2] = {{0, 0}, {0, 0}};
+  for (const Sample &sample : samples)
+    confusion[sample.label][classify(nodes, sample)]++;
+
+  int correct = confusion[0][0] + confusion[1][1];
+  printf("%s: %zu samples, accuracy %.2f%%, false active %d, missed active %d\n", name, samples.size(),
+         samples.empty() ? 0.0 : 100.0 * correct / samples.size(), confusion[0][1], confusion[1][0]);
+}
+
+bool writeModel(const std::string &path, const std::vector<Node> &nodes, int depth)
+{
+  FILE *out = fopen(path.c_str(), "w");
+  if (out == nullptr)
+    return false;
+
+  fprintf(out, "#pragma once\n\n");
+  fprintf(out, "// Generated by tools/train_classifier, %zu nodes.\n\n", nodes.size());
+  fprintf(out, "#include \"classifier.h\"\n\n");
+  fprintf(out, "const int ClassifierModelDepth = %d;\n\n", depth);
+  fprintf(out, "const ClassifierNode classifierModel[] PROGMEM = {\n");
+  for (const Node &node : nodes)
+  {
+    if (node.feature < 0)
+      fprintf(out, "    {ClassifierLeaf, %d, 0, 0},\n", node.threshold);
+    else
+      fprintf(out, "    {%s, %d, %d, %d},\n", FeatureNames[node.feature], node.threshold, node.left, node.right);
+  }
+  fprintf(out, "};\n");
+
+  return fclose(out) == 0;
+}
+
+// ClassifierNode as the firmware stores it
+struct ExportedNode
+{
+  int8_t feature;
+  int16_t threshold;
+  uint8_t left;
+  uint8_t right;
+};
+
+/**
+ * @brief Reads back a model written by writeModel
+ */
+bool readModel(const std::string &path, std::vector<ExportedNode> &nodes, int &depth)
+{
+  std::ifstream in(path);
+  if (!in)
+    return false;
+
+  depth = -1;
+  std::string line;
+  while (std::getline(in, line))
+  {
+    if (sscanf(line.c_str(), "const int ClassifierModelDepth = %d;", &depth) == 1)
+      continue;
+
+    char name[32];
+    long threshold, left, right;
+    if (sscanf(line.c_str(), " {%31[A-Za-z_], %ld, %ld, %ld},", name, &threshold, &left, &right) != 4)
+      continue;
+
+    int feature = -2;
+    if (strcmp(name, "ClassifierLeaf") == 0)
+      feature = -1;
+    for (int f = 0; f < FeatureCount; f++)
+    {
+      if (strcmp(name, FeatureNames[f]) == 0)
+        feature = f;
+    }
+
+    if (feature == -2)
+      return false;
+
+    // Narrowed like the brace initialiser on the target
+    nodes.push_back({(int8_t)feature, (int16_t)threshold, (uint8_t)left, (uint8_t)right});
+  }
+
+  return depth >= 0 && !nodes.empty();
+}
+
+/**
+ * @brief Mirrors classifyPad in src/main.cpp
+ */
+int classifyExported(const std::vector<ExportedNode> &nodes, int depthBound, const Sample &sample)
+{
+  uint8_t index = 0;
+
+  for (int depth = 0; depth <= depthBound; depth++)
+  {
+    if (index >= nodes.size())
+      return -1;
+
+    const ExportedNode &node = nodes[index];
+    if (node.feature == -1)
+      return node.threshold;
+
+    // Features are ints on the target too
+    index = (int16_t)sample.f[node.feature] <= node.threshold ? node.left : node.right;
+  }
+
+  return 0;
+}
+
+/**
+ * @brief Checks that the written model classifies every sample the way the trainer does
+ * @return mismatches, -1 if the model cannot be read back
+ */
+long validateModel(const std::string &path, const std::vector<Node> &nodes, const std::vector<Sample> &samples)
+{
+  std::vector<ExportedNode> exported;
+  int depth;
+  if (!readModel(path, exported, depth))
+    return -1;
+
+  long mismatches = 0;
+  for (const Sample &sample : samples)
+    mismatches += classifyExported(exported, depth, sample) != classify(nodes, sample);
+
+  return mismatches;
+}
+
+void usage()
+{
+  fprintf(stderr, "usage: train_classifier [--depth N] [--min-leaf N] [--out PATH] LR=FILE [LR=FILE ...]\n");
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+  Options options;
+  std::vector<Sample> train, test;
+
+  for (int i = 1; i < argc; i++)
+  {
+    std::string arg = argv[i];
+    if (arg == "--depth" && i + 1 < argc)
+    {
+      options.depth = std::clamp(atoi(argv[++i]), 1, MaxDepth);
+    }
+    else if (arg == "--min-leaf" && i + 1 < argc)
+    {
+      options.minLeaf = std::max(atoi(argv[++i]), 1);
+    }
+    else if (arg == "--out" && i + 1 < argc)
+    {
+      options.out = argv[++i];
+    }
+    else if (arg.size() > 3 && arg[2] == '=' && (arg[0] == '0' || arg[0] == '1') && (arg[1] == '0' || arg[1] == '1'))
+    {
+      if (!loadLog(arg.substr(3), arg[0] - '0', arg[1] - '0', train, test))
+      {
+        fprintf(stderr, "cannot read %s\n", arg.c_str() + 3);
+        return 1;
+      }
+    }
+    else
+    {
+      usage();
+      return 1;
+    }
+  }
+
+  if (train.empty())
+  {
+    usage();
+    fprintf(stderr, "no telemetry samples found, record logs with `set outFmt 2`\n");
+    return 1;
+  }
+
+  std::vector<Node> nodes = TreeBuilder(train, options).build();
+  int depth = treeDepth(nodes, 0);
+
+  report("train", nodes, train);
+  report("test", nodes, test);
+  printf("model: %zu nodes, %zu bytes of flash, at most %d comparisons per pad\n", nodes.size(), nodes.size() * 5, depth);
+
+  if (!writeModel(options.out, nodes, depth))
+  {
+    fprintf(stderr, "cannot write %s\n", options.out.c_str());
+    return 1;
+  }
+
+  printf("wrote %s\n", options.out.c_str());
+
+  std::vector<Sample> samples = train;
+  samples.insert(samples.end(), test.begin(), test.end());
+  long mismatches = validateModel(options.out, nodes, samples);
+  if (mismatches < 0)
+  {
+    fprintf(stderr, "cannot read back %s\n", options.out.c_str());
+    return 1;
+  }
+
+  if (mismatches > 0)
+  {
+    fprintf(stderr, "%s classifies %ld of %zu samples differently from the trainer\n", options.out.c_str(), mismatches, samples.size());
+    return 1;
+  }
+
+  printf("%s matches the trainer on all %zu samples\n", options.out.c_str(), samples.size());
+  return 0;
+}